@@ -770,6 +770,31 @@ char *report(void *cPrivate, ushort_t slot)
     return report;
 }
 
+/*******************************************************************************
+
+Routine:
+    irqPending
+
+Purpose:
+    Returns the interrupt requests of all slots
+
+Description:
+    The interrupt status register has an active-low bit for each slot
+    interrupt, in the same order as drvIpac's IPAC_IRQ_BIT() macro.
+
+Returns:
+    0 = OK
+
+*/
+
+LOCAL int irqPending(void *cPrivate, epicsUInt32 *pending)
+{
+    atc40Config_t *pConfig = (atc40Config_t *) cPrivate;
+
+    *pending = ~pConfig->pDev->intStatus & 0xff;
+    return OK;
+}
+
 /******************************************************************************/
 
 
@@ -783,7 +808,10 @@ static ipac_carrier_t atc40 = {
     baseAddr,
     irqCmd,
     intVecConnect,
-    NULL
+    NULL,
+    NULL,
+    NULL,
+    irqPending
 };
 
 int ipacAddATC40(const char *cardParams) {
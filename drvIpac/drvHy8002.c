@@ -772,6 +772,44 @@ static int irqCmd (
 }
 
 
+/*******************************************************************************
+
+Routine:
+    irqPending
+
+Purpose:
+    Returns the interrupt requests of all slots
+
+Description:
+    The ipstat register shows the IRQ0 signals of all four slots in its low
+    nibble and the IRQ1 signals in the next, so one read gives the state of
+    every slot.  The bits are rearranged into drvIpac's IPAC_IRQ_BIT() order.
+
+Returns:
+    0 = OK
+
+*/
+
+static int irqPending (
+    void *p,
+    epicsUInt32 *pending
+) {
+    private_t* private = (private_t *) p;
+    int ipstat = private->regs->ipstat;
+    epicsUInt32 mask = 0;
+    int slot;
+
+    for (slot = 0; slot < SLOTS; slot++) {
+        if (ipstat & (0x01 << slot))
+            mask |= IPAC_IRQ_BIT(slot, 0);
+        if (ipstat & (0x10 << slot))
+            mask |= IPAC_IRQ_BIT(slot, 1);
+    }
+    *pending = mask;
+    return OK;
+}
+
+
 
 /*******************************************************************************
 
@@ -841,7 +879,10 @@ static ipac_carrier_t Hy8002 = {
     baseAddr,
     irqCmd,
     NULL,
-    NULL
+    NULL,
+    NULL,
+    NULL,
+    irqPending
 };
 
 
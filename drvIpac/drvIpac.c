@@ -57,6 +57,7 @@ Copyright (c) 1995-2007 Andrew Johnson
 struct carrierInfo {
     ipac_carrier_t *driver;
     void *cPrivate;
+    ipac_counter_t *counters;	/* [numberSlots][IPAC_ADDR_SPACES] */
 };
 
 LOCAL struct {
@@ -68,6 +69,11 @@ LOCAL struct {
 };
 
 
+/* Bus access counter for bad addresses, never reported */
+
+LOCAL ipac_counter_t dummyCounter;
+
+
 /* Null carrier table */
 
 LOCAL ipac_carrier_t nullCarrier = {
@@ -103,9 +109,25 @@ static void ipacAddNullCallFunc(const iocshArgBuf *args) {
     ipacAddNullCarrier();
 }
 
+static const iocshArg ipacAccessArg0 = { "carrier", iocshArgInt};
+static const iocshArg * const ipacAccessArgs[1] = {&ipacAccessArg0};
+static const iocshFuncDef ipacAccessReportFuncDef =
+    {"ipacAccessReport",1,ipacAccessArgs};
+static void ipacAccessReportCallFunc(const iocshArgBuf *args) {
+    ipacAccessReport(args[0].ival);
+}
+
+static const iocshFuncDef ipacAccessResetFuncDef =
+    {"ipacAccessReset",1,ipacAccessArgs};
+static void ipacAccessResetCallFunc(const iocshArgBuf *args) {
+    ipacAccessReset(args[0].ival);
+}
+
 void ipacRegistrar(void) {
     iocshRegister(&ipacReportFuncDef, ipacReportCallFunc);
     iocshRegister(&ipacAddNullFuncDef, ipacAddNullCallFunc);
+    iocshRegister(&ipacAccessReportFuncDef, ipacAccessReportCallFunc);
+    iocshRegister(&ipacAccessResetFuncDef, ipacAccessResetCallFunc);
 }
 epicsExportRegistrar(ipacRegistrar);
 
@@ -129,7 +151,9 @@ Description:
     Checks that the carrier descriptor table looks sensible, then calls the
     initialise routine with the given card parameters, and saves the carrier 
     private pointer and carrier table address.  The card number allows the 
-    same descriptor to be used for all carriers of the same type.
+    same descriptor to be used for all carriers of the same type.  The bus
+    access counters for the carrier's slots are allocated here, so they
+    never have to be allocated by ipmAccessCounter() in an ISR.
 
     It may be necessary to remove a carrier temporarily from a system in 
     some circumstances without wanting to have to change the carrier number 
@@ -190,6 +214,8 @@ int ipacAddCarrier (
     }
 
     carriers.info[carriers.latest].driver = pcarrierTable;
+    carriers.info[carriers.latest].counters = (ipac_counter_t *) calloc(
+	pcarrierTable->numberSlots * IPAC_ADDR_SPACES, sizeof(ipac_counter_t));
 
     return OK;
 }
@@ -630,7 +656,9 @@ void *ipmBaseAddr (
     if (carrier < 0 ||
 	carrier >= carriers.number ||
 	slot < 0 ||
-	slot >= carriers.info[carrier].driver->numberSlots) {
+	slot >= carriers.info[carrier].driver->numberSlots ||
+	space < ipac_addrID ||
+	space > ipac_addrMem) {
 	return NULL;
     }
     return carriers.info[carrier].driver->baseAddr(
@@ -680,6 +708,75 @@ int ipmIrqCmd (
 }
 
 
+/*******************************************************************************
+
+Routine:
+    ipmIrqPending
+
+Function:
+    Get the interrupt request state of every slot on a carrier.
+
+Description:
+    Sets *pending to a bit-mask of the interrupt requests active on all slots
+    of the carrier, with the bit for each slot interrupt given by the macro
+    IPAC_IRQ_BIT(slot, irqNumber).  Carrier drivers that can read the state
+    of all slots from one status register provide an irqPending routine to do
+    that in a single access; for other carriers each slot interrupt is polled
+    through the carrier's irqCmd routine.  Only the first 16 slots of a
+    carrier can be reported.  An interrupt routine shared by several slots can
+    use this to service only those slots that are asking for it, e.g.
+	while (pending) {
+	    int bit = ffs(pending) - 1;
+	    pending &= pending - 1;
+	    service(bit / 2, bit % 2);
+	}
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = illegal carrier number,
+    S_IPAC_notImplemented = carrier can't report interrupt state,
+    other, from the carrier driver.
+
+*/
+
+int ipmIrqPending (
+    int carrier,
+    epicsUInt32 *pending
+) {
+    ipac_carrier_t *driver;
+    void *cPrivate;
+    epicsUInt32 mask = 0;
+    int slot, irqNumber;
+
+    if (carrier < 0 ||
+	carrier >= carriers.number ||
+	pending == NULL) {
+	return S_IPAC_badAddress;
+    }
+
+    driver = carriers.info[carrier].driver;
+    cPrivate = carriers.info[carrier].cPrivate;
+    if (driver->irqPending != NULL) {
+	return driver->irqPending(cPrivate, pending);
+    }
+
+    for (slot = 0; slot < driver->numberSlots && slot < 16; slot++) {
+	for (irqNumber = 0; irqNumber < 2; irqNumber++) {
+	    int status = driver->irqCmd(cPrivate, slot, irqNumber,
+					ipac_irqPoll);
+	    if (status == S_IPAC_notImplemented) {
+		return status;
+	    }
+	    if (status) {
+		mask |= IPAC_IRQ_BIT(slot, irqNumber);
+	    }
+	}
+    }
+    *pending = mask;
+    return OK;
+}
+
+
 /*******************************************************************************
 
 Routine:
@@ -759,6 +856,396 @@ int ipmIntConnect (
 }
 
 
+/*******************************************************************************
+
+Routine:
+    blockCopy
+
+Function:
+    Copy a block of data to or from an IP module address space
+
+Description:
+    Copies count bytes using the widest accesses that the alignment of both
+    addresses allows, starting and finishing with byte accesses where needed.
+    The IP bus is 16 bits wide so most transfers use word cycles; 32-bit
+    accesses are only used when the caller says the space supports them.
+    Where the two addresses can never be brought into word alignment with
+    each other the whole block has to be copied a byte at a time.
+
+Returns:
+    The number of bus cycles used.
+
+*/
+
+LOCAL unsigned long blockCopy (
+    volatile void *to,
+    const volatile void *from,
+    size_t count,
+    int useLongs
+) {
+    volatile epicsUInt8 *dst = (volatile epicsUInt8 *) to;
+    const volatile epicsUInt8 *src = (const volatile epicsUInt8 *) from;
+    unsigned long cycles = 0;
+
+    if (((size_t) dst ^ (size_t) src) & 1) {
+	cycles = count;
+	while (count--)
+	    *dst++ = *src++;
+	return cycles;
+    }
+
+    if (((size_t) src & 1) && count) {
+	*dst++ = *src++;
+	count--;
+	cycles++;
+    }
+
+    if (useLongs && !(((size_t) dst ^ (size_t) src) & 3)) {
+	volatile epicsUInt32 *dst32;
+	const volatile epicsUInt32 *src32;
+
+	if (((size_t) src & 2) && count >= 2) {
+	    *(volatile epicsUInt16 *) dst = *(const volatile epicsUInt16 *) src;
+	    dst += 2;
+	    src += 2;
+	    count -= 2;
+	    cycles++;
+	}
+	dst32 = (volatile epicsUInt32 *) dst;
+	src32 = (const volatile epicsUInt32 *) src;
+	while (count >= 16) {
+	    dst32[0] = src32[0];
+	    dst32[1] = src32[1];
+	    dst32[2] = src32[2];
+	    dst32[3] = src32[3];
+	    dst32 += 4;
+	    src32 += 4;
+	    count -= 16;
+	    cycles += 4;
+	}
+	while (count >= 4) {
+	    *dst32++ = *src32++;
+	    count -= 4;
+	    cycles++;
+	}
+	dst = (volatile epicsUInt8 *) dst32;
+	src = (const volatile epicsUInt8 *) src32;
+    }
+    else {
+	volatile epicsUInt16 *dst16 = (volatile epicsUInt16 *) dst;
+	const volatile epicsUInt16 *src16 = (const volatile epicsUInt16 *) src;
+
+	while (count >= 8) {
+	    dst16[0] = src16[0];
+	    dst16[1] = src16[1];
+	    dst16[2] = src16[2];
+	    dst16[3] = src16[3];
+	    dst16 += 4;
+	    src16 += 4;
+	    count -= 8;
+	    cycles += 4;
+	}
+	dst = (volatile epicsUInt8 *) dst16;
+	src = (const volatile epicsUInt8 *) src16;
+    }
+
+    while (count >= 2) {
+	*(volatile epicsUInt16 *) dst = *(const volatile epicsUInt16 *) src;
+	dst += 2;
+	src += 2;
+	count -= 2;
+	cycles++;
+    }
+    if (count) {
+	*dst = *src;
+	cycles++;
+    }
+    return cycles;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipmMemRead
+
+Function:
+    Block transfer from an IP module address space
+
+Description:
+    Checks input parameters, then copies count bytes starting at offset bytes
+    into the given address space of the module into the buffer.  A carrier
+    driver can provide its own memRead routine to perform the transfer using
+    VMEbus block transfers or DMA; if it doesn't, or if that routine returns
+    S_IPAC_notImplemented for this particular request, the data is copied by
+    the CPU using word cycles, or long-word cycles for the I/O32 space.  If
+    drvIpac was built with IPAC_COUNT_ACCESSES defined the cycles are added
+    to the slot's bus access counters.  The caller is responsible for keeping
+    the transfer inside the address space.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = illegal carrier, slot or space, or no such space,
+    other, from the carrier driver.
+
+*/
+
+int ipmMemRead (
+    int carrier,
+    int slot,
+    ipac_addr_t space,
+    size_t offset,
+    void *buffer,
+    size_t count
+) {
+    ipac_carrier_t *driver;
+    char *base;
+
+    if (carrier < 0 ||
+	carrier >= carriers.number ||
+	slot < 0 ||
+	slot >= carriers.info[carrier].driver->numberSlots ||
+	space < ipac_addrID ||
+	space > ipac_addrMem ||
+	buffer == NULL) {
+	return S_IPAC_badAddress;
+    }
+
+    driver = carriers.info[carrier].driver;
+    if (driver->memRead != NULL) {
+	int status = driver->memRead(carriers.info[carrier].cPrivate,
+		slot, space, offset, buffer, count);
+	if (status != S_IPAC_notImplemented) {
+	    return status;
+	}
+    }
+
+    base = (char *) ipmBaseAddr(carrier, slot, space);
+    if (base == NULL) {
+	return S_IPAC_badAddress;
+    }
+
+#ifdef IPAC_COUNT_ACCESSES
+    ipmAccessCounter(carrier, slot, space)->reads +=
+	blockCopy(buffer, base + offset, count, space == ipac_addrIO32);
+#else
+    blockCopy(buffer, base + offset, count, space == ipac_addrIO32);
+#endif
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipmMemWrite
+
+Function:
+    Block transfer to an IP module address space
+
+Description:
+    The reverse of ipmMemRead(), this copies count bytes from the buffer into
+    the given address space of the module starting at offset bytes.  Carrier
+    drivers may provide a memWrite routine which is tried first.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = illegal carrier, slot or space, or no such space,
+    other, from the carrier driver.
+
+*/
+
+int ipmMemWrite (
+    int carrier,
+    int slot,
+    ipac_addr_t space,
+    size_t offset,
+    const void *buffer,
+    size_t count
+) {
+    ipac_carrier_t *driver;
+    char *base;
+
+    if (carrier < 0 ||
+	carrier >= carriers.number ||
+	slot < 0 ||
+	slot >= carriers.info[carrier].driver->numberSlots ||
+	space < ipac_addrID ||
+	space > ipac_addrMem ||
+	buffer == NULL) {
+	return S_IPAC_badAddress;
+    }
+
+    driver = carriers.info[carrier].driver;
+    if (driver->memWrite != NULL) {
+	int status = driver->memWrite(carriers.info[carrier].cPrivate,
+		slot, space, offset, buffer, count);
+	if (status != S_IPAC_notImplemented) {
+	    return status;
+	}
+    }
+
+    base = (char *) ipmBaseAddr(carrier, slot, space);
+    if (base == NULL) {
+	return S_IPAC_badAddress;
+    }
+
+#ifdef IPAC_COUNT_ACCESSES
+    ipmAccessCounter(carrier, slot, space)->writes +=
+	blockCopy(base + offset, buffer, count, space == ipac_addrIO32);
+#else
+    blockCopy(base + offset, buffer, count, space == ipac_addrIO32);
+#endif
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipmAccessCounter
+
+Function:
+    Get the bus access counter for a slot and address space.
+
+Description:
+    Returns a pointer to the counter that the IPAC_READ() and IPAC_WRITE()
+    macros increment for accesses to the given address space of the slot.
+    The counters were allocated by ipacAddCarrier(), so this only looks them
+    up and is safe to call from an ISR.  A pointer to a dummy counter is
+    returned for bad arguments or if there was no memory for the counters,
+    so the result can always be used without checking it.  The
+    counters are not protected against simultaneous updates from different
+    tasks, which may occasionally lose a count on a multi-processor system.
+
+Returns:
+    Pointer to the counter.
+
+*/
+
+ipac_counter_t *ipmAccessCounter (
+    int carrier,
+    int slot,
+    ipac_addr_t space
+) {
+    struct carrierInfo *pinfo;
+
+    if (carrier < 0 ||
+	carrier >= carriers.number ||
+	slot < 0 ||
+	slot >= carriers.info[carrier].driver->numberSlots ||
+	space < ipac_addrID ||
+	space > ipac_addrMem) {
+	return &dummyCounter;
+    }
+
+    pinfo = &carriers.info[carrier];
+    if (pinfo->counters == NULL) {
+	return &dummyCounter;
+    }
+    return &pinfo->counters[slot * IPAC_ADDR_SPACES + space];
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacAccessReport
+
+Function:
+    Report bus access counts.
+
+Description:
+    Prints the number of read and write cycles counted for each slot and
+    address space of the given carrier, or of all carriers if the carrier
+    number is negative.  Slots with no accesses counted are not shown.
+
+Returns:
+    OK.
+
+*/
+
+int ipacAccessReport (
+    int carrier
+) {
+    static const char * const spaceName[IPAC_ADDR_SPACES] = {
+	"ID", "I/O", "I/O32", "Mem"
+    };
+    int first = 0, last = carriers.number - 1;
+    int slot, space;
+
+    if (carrier >= 0) {
+	first = last = carrier;
+    }
+
+    for (carrier = first; carrier <= last && carrier < carriers.number;
+	 carrier++) {
+	ipac_counter_t *pcount = carriers.info[carrier].counters;
+
+	if (pcount == NULL) {
+	    continue;
+	}
+	for (slot = 0; slot < carriers.info[carrier].driver->numberSlots;
+	     slot++, pcount += IPAC_ADDR_SPACES) {
+	    int shown = 0;
+
+	    for (space = ipac_addrID; space <= ipac_addrMem; space++) {
+		if (pcount[space].reads == 0 && pcount[space].writes == 0) {
+		    continue;
+		}
+		if (!shown++) {
+		    printf("  Carrier %d slot %d:", carrier, slot);
+		}
+		printf("  %s %lu reads, %lu writes;", spaceName[space],
+			pcount[space].reads, pcount[space].writes);
+	    }
+	    if (shown) {
+		printf("\n");
+	    }
+	}
+    }
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacAccessReset
+
+Function:
+    Reset bus access counts.
+
+Description:
+    Zeros the bus access counters for the given carrier, or for all carriers
+    if the carrier number is negative.
+
+Returns:
+    OK.
+
+*/
+
+int ipacAccessReset (
+    int carrier
+) {
+    int first = 0, last = carriers.number - 1;
+
+    if (carrier >= 0) {
+	first = last = carrier;
+    }
+
+    for (carrier = first; carrier <= last && carrier < carriers.number;
+	 carrier++) {
+	if (carriers.info[carrier].counters != NULL) {
+	    memset(carriers.info[carrier].counters, 0,
+		   carriers.info[carrier].driver->numberSlots *
+		   IPAC_ADDR_SPACES * sizeof(ipac_counter_t));
+	}
+    }
+    return OK;
+}
+
+
 /*******************************************************************************
 
 Routine:
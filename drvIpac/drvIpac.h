@@ -40,6 +40,8 @@ Copyright (c) 1995-2007 Andrew Johnson
 #ifndef INCdrvIpacH
 #define INCdrvIpacH
 
+#include <stddef.h>
+
 #include "epicsTypes.h"
 #include "errMdef.h"
 #include "shareLib.h"
@@ -171,6 +173,41 @@ typedef enum {
 } ipac_irqCmd_t;
 
 
+/* Bus access accounting.  Module drivers that make their register accesses
+   through these macros can have the number of read and write cycles to each
+   slot and address space counted, by building them with IPAC_COUNT_ACCESSES
+   defined.  Otherwise the macros just perform the access.  The counter to
+   use comes from ipmAccessCounter(); reg is any volatile lvalue, e.g.
+       status = IPAC_READ(pcount, regs->status);
+       IPAC_WRITE(pcount, regs->control, value);
+
+   Building with IPAC_ACCESS_HOOKS defined instead passes every access to
+   ipacHookRead() and ipacHookWrite(), which the program must provide.  The
+   host tests use this to run module drivers against register emulators.
+ */
+
+typedef struct {
+    unsigned long reads;
+    unsigned long writes;
+} ipac_counter_t;
+
+#if defined(IPAC_ACCESS_HOOKS)
+unsigned long ipacHookRead(ipac_counter_t *pcount, volatile void *addr,
+		int size);
+void ipacHookWrite(ipac_counter_t *pcount, volatile void *addr, int size,
+		unsigned long value);
+#define IPAC_READ(pcount, reg) ipacHookRead((pcount), &(reg), sizeof(reg))
+#define IPAC_WRITE(pcount, reg, value) \
+	ipacHookWrite((pcount), &(reg), sizeof(reg), (value))
+#elif defined(IPAC_COUNT_ACCESSES)
+#define IPAC_READ(pcount, reg) ((pcount)->reads++, (reg))
+#define IPAC_WRITE(pcount, reg, value) ((pcount)->writes++, (reg) = (value))
+#else
+#define IPAC_READ(pcount, reg) (reg)
+#define IPAC_WRITE(pcount, reg, value) ((reg) = (value))
+#endif
+
+
 /* This is a table which each IPAC carrier driver provides to allow
    it to be queried by the IPAC driver.  One table is required for
    each type of carrier.  The cPrivate pointer is returned by the
@@ -198,15 +235,33 @@ typedef struct {
 			/* Connect routine to interrupt vector */
     int (*moduleProbe)(void *cPrivate, epicsUInt16 slot);
 			/* Return 0 if reading ID Prom would Bus Error */
+    int (*memRead)(void *cPrivate, epicsUInt16 slot, ipac_addr_t space,
+		size_t offset, void *buffer, size_t count);
+			/* Block transfer from module to buffer */
+    int (*memWrite)(void *cPrivate, epicsUInt16 slot, ipac_addr_t space,
+		size_t offset, const void *buffer, size_t count);
+			/* Block transfer from buffer to module */
+    int (*irqPending)(void *cPrivate, epicsUInt32 *pending);
+			/* Return pending interrupts of all slots */
 } ipac_carrier_t;
 
 
+/* Bit in the mask returned by ipmIrqPending() for a slot interrupt */
+
+#define IPAC_IRQ_BIT(slot, irqNumber) (1u << (2 * (slot) + (irqNumber)))
+
+
 /* Functions for startup and interactive use */
 
 epicsShareFunc int ipacAddCarrier(ipac_carrier_t *pcarrier, const char *cardParams);
 epicsShareFunc int ipacReport(int interest);
 epicsShareFunc int ipacAddNullCarrier (void);
 epicsShareFunc int ipacLatestCarrier(void);
+epicsShareFunc int ipacAccessReport(int carrier);
+epicsShareFunc int ipacAccessReset(int carrier);
+epicsShareFunc int ipacHybridConfig(int carrier, int slot, int irqNumber,
+		double highRate, double lowRate, double period);
+epicsShareFunc int ipacHybridReport(int interest);
 
 
 /* Functions for use in IPAC carrier drivers */
@@ -225,6 +280,15 @@ epicsShareFunc int ipmIrqCmd(int carrier, int slot,
 		int irqNumber, ipac_irqCmd_t cmd);
 epicsShareFunc int ipmIntConnect(int carrier, int slot, int vector, 
 		void (*routine)(int parameter), int parameter);
+epicsShareFunc int ipmHybridConnect(int carrier, int slot, int irqNumber,
+		int vecNum, void (*routine)(int parameter), int parameter);
+epicsShareFunc ipac_counter_t *ipmAccessCounter(int carrier, int slot,
+		ipac_addr_t space);
+epicsShareFunc int ipmIrqPending(int carrier, epicsUInt32 *pending);
+epicsShareFunc int ipmMemRead(int carrier, int slot, ipac_addr_t space,
+		size_t offset, void *buffer, size_t count);
+epicsShareFunc int ipmMemWrite(int carrier, int slot, ipac_addr_t space,
+		size_t offset, const void *buffer, size_t count);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,832 @@
+/*******************************************************************************
+
+Project:
+    Linux UIO and Memory-Mapped File Carrier Driver for EPICS
+
+File:
+    drvUio.c
+
+Description:
+    IPAC Carrier Driver for IP carriers that are reached on Linux through a
+    memory-mappable device node or file, such as a Userspace I/O (UIO) device
+    (/dev/uioN) exported by a kernel driver for a PCI, PCIe or SoC carrier.
+    The carrier's register window is mapped into the IOC's address space and
+    the location of each slot's ID, I/O, I/O32 and Memory spaces within that
+    window is given in the card parameter string, so one driver can serve any
+    carrier whose layout is known.
+
+    Interrupts are delivered through the UIO read() interface: a dedicated
+    thread blocks reading the device file descriptor and calls the interrupt
+    routines that module drivers have connected to the slots whenever the
+    kernel reports an interrupt, then re-arms the interrupt by writing to the
+    file descriptor.  If the parameter string names an ordinary file the
+    driver works without interrupts, which allows module drivers to be run
+    against a simulated slot; the ipacUioInterrupt command can then be used
+    to call a carrier's interrupt routines by hand.
+
+Version:
+    $Id$
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+/* ANSI headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* POSIX headers */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* EPICS headers */
+#include <dbDefs.h>
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsExit.h>
+#include <epicsInterrupt.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+/* Module headers */
+#include "drvIpac.h"
+
+
+/* Characteristics of the carrier */
+
+#define SLOTS 8             /* Maximum number of IP slots */
+#define DEFAULT_SLOTS 4     /* Number of slots if not given */
+#define PATH_LEN 128        /* Longest device path accepted */
+
+
+
+/* Interrupt routine list, one per connected vector */
+
+typedef struct isr_t {
+    struct isr_t * next;
+    int vector;
+    void (*routine)(int parameter);
+    int parameter;
+} isr_t;
+
+
+/* Carrier Private structure, one instance per carrier */
+
+typedef struct private_t {
+    struct private_t * next;
+    int carrier;
+    int fd;
+    int isDevice;
+    int canRearm;
+    char path[PATH_LEN];
+    size_t size;
+    volatile epicsUInt8 * base;
+    epicsUInt16 numSlots;
+    epicsThreadId intThread;
+    volatile epicsUInt32 irqEnabled;
+    volatile epicsUInt32 irqSeen;
+    volatile unsigned long intCount;
+    isr_t * isr[SLOTS];
+    void * addr[IPAC_ADDR_SPACES][SLOTS];
+} private_t;
+
+
+/* Module Variables */
+
+static private_t *list_head = NULL;
+static const char * const drvname = "drvUio";
+static const char * const spaceName[IPAC_ADDR_SPACES] = {
+    "ID=", "IO=", "IO32=", "MEM="
+};
+
+
+/*******************************************************************************
+
+Routine: internal function
+    scanOffsets
+
+Purpose:
+    Parses the list of slot offsets for one address space
+
+Description:
+    Reads either a comma-separated list of offsets, one for each slot starting
+    from slot 0, or a single offset followed by a plus sign and a stride which
+    is added for each successive slot.  Slots that are not given an offset by
+    a list do not get that address space.
+
+Returns:
+    0 = OK
+    S_IPAC_badAddress = Error in string or offset outside the mapped area
+
+*/
+
+static int scanOffsets (
+    const char *str,
+    private_t *private,
+    ipac_addr_t space
+) {
+    unsigned long offset, stride;
+    char *end;
+    int slot;
+
+    offset = strtoul(str, &end, 0);
+    if (end == str)
+        return S_IPAC_badAddress;
+
+    if (*end == '+') {
+        str = end + 1;
+        stride = strtoul(str, &end, 0);
+        if (end == str)
+            return S_IPAC_badAddress;
+        for (slot = 0; slot < private->numSlots; slot++) {
+            if (offset >= private->size)
+                return S_IPAC_badAddress;
+            private->addr[space][slot] = (void *) (private->base + offset);
+            offset += stride;
+        }
+        return OK;
+    }
+
+    for (slot = 0; slot < private->numSlots; slot++) {
+        if (offset >= private->size)
+            return S_IPAC_badAddress;
+        private->addr[space][slot] = (void *) (private->base + offset);
+
+        if (*end != ',')
+            break;
+        str = end + 1;
+        offset = strtoul(str, &end, 0);
+        if (end == str)
+            return OK;
+    }
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine: internal function
+    mapSize
+
+Purpose:
+    Works out how much of the file or device to map
+
+Description:
+    Ordinary files are mapped in their entirety, and are extended if the SIZE
+    parameter asks for more than the file currently holds.  For a UIO device
+    the kernel publishes the size of each of its memory maps in sysfs, so we
+    look it up there when no size was given.
+
+Returns:
+    The size in bytes, or 0 if it couldn't be determined.
+
+*/
+
+static size_t mapSize (
+    private_t *private,
+    int map,
+    size_t size
+) {
+    struct stat info;
+    const char *name;
+    char sysfs[PATH_LEN + 64];
+    unsigned long mapsize;
+    FILE *fp;
+
+    if (fstat(private->fd, &info) < 0)
+        return 0;
+
+    if (S_ISREG(info.st_mode)) {
+        if (size == 0)
+            return info.st_size;
+        if (info.st_size < (off_t) size &&
+            ftruncate(private->fd, size) < 0)
+            return 0;
+        return size;
+    }
+
+    private->isDevice = S_ISCHR(info.st_mode);
+    if (size)
+        return size;
+
+    name = strrchr(private->path, '/');
+    name = name ? name + 1 : private->path;
+    sprintf(sysfs, "/sys/class/uio/%s/maps/map%d/size", name, map);
+    fp = fopen(sysfs, "r");
+    if (fp == NULL)
+        return 0;
+    if (fscanf(fp, "%lx", &mapsize) != 1)
+        mapsize = 0;
+    fclose(fp);
+    return mapsize;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    shutdown
+
+Purpose:
+    Disable interrupts on IOC exit
+
+Description:
+    This function is registered as an epicsAtExit routine which masks the
+    carrier interrupt at the UIO driver when the IOC is shutting down.
+
+Returns:
+    N/A
+
+*/
+
+static void shutdown (
+    void *p
+) {
+    private_t *private = (private_t *) p;
+    epicsUInt32 mask = 0;
+
+    private->irqEnabled = 0;
+    if (private->isDevice && private->canRearm)
+        (void) write(private->fd, &mask, sizeof(mask));
+}
+
+
+/*******************************************************************************
+
+Routine:
+    initialise
+
+Purpose:
+    Registers a new carrier reached through a UIO device or mapped file
+
+Description:
+    Opens and maps the named file, then parses the rest of the parameter
+    string for the number of slots and the offsets of each slot's address
+    spaces within the mapped area.
+
+Parameters:
+
+    The parameter string starts with the path to the device node or file to
+    be mapped, which may not contain spaces.  Any of the following optional
+    parameters may then appear in any order.  Space characters cannot be used
+    within a parameter:
+
+    SLOTS=<n>
+        The number of IP slots on the carrier, 1 through 8.  Defaults to 4.
+
+    MAP=<n>
+        Selects which of a UIO device's memory maps to use.  Defaults to 0.
+
+    SIZE=<bytes>
+        The number of bytes to map.  For a UIO device this defaults to the map
+        size given in sysfs, for an ordinary file it defaults to the file size;
+        a file that is shorter than this will be extended.
+
+    ID=<offsets>
+    IO=<offsets>
+    IO32=<offsets>
+    MEM=<offsets>
+        Give the byte offsets within the mapped area of each slot's ID, I/O,
+        I/O32 and Memory spaces.  The offsets may be a comma-separated list
+        with one entry for each slot starting from slot 0, or an offset for
+        slot 0 followed by a plus sign and the stride between slots.  Slots
+        with no offset given do not have that address space.  The ID and IO
+        spaces default to the layout of a 4-slot VME carrier's A16 window,
+        with IO at 0x0+0x100 and ID at 0x80+0x100.
+
+Examples:
+    ipacAddUio("/dev/uio0 SLOTS=4 IO=0+0x100 ID=0x80+0x100 MEM=0x400000+0x400000")
+        Maps the carrier exported through /dev/uio0, using the map size
+        published by the kernel.  Slot memory spaces are 4MB each.
+
+    ipacAddUio("/tmp/ipsim SIZE=0x10000 SLOTS=2 IO=0x1000,0x2000 ID=0x1080,0x2080")
+        Creates or maps a 64KB file to simulate a carrier with two slots.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = Parameter string error, or the file couldn't be mapped
+    S_IPAC_noMemory = malloc() failed
+
+*/
+
+static int initialise (
+    const char *params,
+    void **pprivate,
+    epicsUInt16 carrier
+) {
+    private_t *private;
+    const char *pstart;
+    unsigned long size = 0;
+    int map = 0;
+    int slots = DEFAULT_SLOTS;
+    int skip = 0;
+    int space;
+    void *base;
+
+    if (params == NULL || *params == 0)
+        return S_IPAC_badAddress;
+
+    private = (private_t *) calloc(1, sizeof(private_t));
+    if (private == NULL)
+        return S_IPAC_noMemory;
+
+    if (sscanf(params, "%127s %n", private->path, &skip) != 1) {
+        printf("%s: Error parsing card configuration '%s'\n", drvname, params);
+        goto bad_params;
+    }
+    params += skip;
+
+    if ((pstart = strstr(params, "SLOTS=")) != NULL &&
+        (sscanf(pstart+6, "%d", &slots) != 1 ||
+         slots < 1 || slots > SLOTS)) {
+        printf("%s: Bad number of slots\n", drvname);
+        goto bad_params;
+    }
+    private->numSlots = slots;
+
+    if ((pstart = strstr(params, "MAP=")) != NULL &&
+        (sscanf(pstart+4, "%d", &map) != 1 || map < 0)) {
+        printf("%s: Bad UIO map number\n", drvname);
+        goto bad_params;
+    }
+
+    if ((pstart = strstr(params, "SIZE=")) != NULL) {
+        char *end;
+
+        size = strtoul(pstart + 5, &end, 0);
+        if (end == pstart + 5) {
+            printf("%s: Bad map size\n", drvname);
+            goto bad_params;
+        }
+    }
+
+    /* Only create a missing file if we were told how big to make it */
+    private->fd = open(private->path, size ? O_RDWR | O_CREAT : O_RDWR, 0644);
+    if (private->fd < 0) {
+        printf("%s: Can't open '%s': %s\n", drvname, private->path,
+            strerror(errno));
+        goto bad_params;
+    }
+
+    private->size = mapSize(private, map, size);
+    if (private->size == 0) {
+        printf("%s: Can't determine size to map for '%s'\n",
+            drvname, private->path);
+        goto bad_file;
+    }
+
+    base = mmap(NULL, private->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+        private->fd, (off_t) map * getpagesize());
+    if (base == MAP_FAILED) {
+        printf("%s: Can't map '%s': %s\n", drvname, private->path,
+            strerror(errno));
+        goto bad_file;
+    }
+    private->base = (volatile epicsUInt8 *) base;
+
+    /* Default layout follows the common 4-slot A16 arrangement */
+    if (strstr(params, spaceName[ipac_addrIO]) == NULL &&
+        scanOffsets("0+0x100", private, ipac_addrIO))
+        goto bad_offsets;
+    if (strstr(params, spaceName[ipac_addrID]) == NULL &&
+        scanOffsets("0x80+0x100", private, ipac_addrID))
+        goto bad_offsets;
+
+    for (space = ipac_addrID; space <= ipac_addrMem; space++) {
+        if ((pstart = strstr(params, spaceName[space])) == NULL)
+            continue;
+        if (scanOffsets(pstart + strlen(spaceName[space]), private, space)) {
+            printf("%s: Bad %soffsets\n", drvname, spaceName[space]);
+            goto bad_offsets;
+        }
+    }
+
+    private->carrier = carrier;
+    private->canRearm = private->isDevice;
+    private->next = list_head;
+    list_head = private;
+    epicsAtExit(shutdown, private);
+
+    *pprivate = private;
+    return OK;
+
+bad_offsets:
+    munmap(base, private->size);
+bad_file:
+    close(private->fd);
+bad_params:
+    free(private);
+    return S_IPAC_badAddress;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    dispatch
+
+Purpose:
+    Calls the interrupt routines connected to the carrier
+
+Description:
+    The UIO interface gives us one interrupt signal for the whole carrier, so
+    every connected routine on a slot with an interrupt enabled is called in
+    turn, as would happen for a shared interrupt line.  Module interrupt
+    routines must already check their hardware to see if they were the cause
+    of the interrupt, so this is safe.  The interrupt is also recorded
+    against every slot so that ipac_irqPoll can report it to anyone polling
+    a slot with its interrupt disabled.
+
+Returns:
+    N/A
+
+*/
+
+static void dispatch (
+    private_t *private
+) {
+    int key, slot;
+
+    key = epicsInterruptLock();
+    private->irqSeen = ~0;
+    epicsInterruptUnlock(key);
+
+    private->intCount++;
+    for (slot = 0; slot < private->numSlots; slot++) {
+        isr_t *pisr;
+
+        if ((private->irqEnabled & (3 << (2 * slot))) == 0)
+            continue;
+        for (pisr = private->isr[slot]; pisr; pisr = pisr->next)
+            pisr->routine(pisr->parameter);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    intThread
+
+Purpose:
+    Waits for carrier interrupts from the UIO device
+
+Description:
+    A read() from a UIO device blocks until the next interrupt arrives and
+    returns the total interrupt count.  The kernel driver masks the interrupt
+    before waking us, so it has to be re-armed by writing a 1 once the module
+    routines have cleared their interrupt sources.  Kernel drivers that don't
+    support masking reject the write, which we only report once.
+
+Returns:
+    N/A
+
+*/
+
+static void intThread (
+    void *p
+) {
+    private_t *private = (private_t *) p;
+    epicsUInt32 count, rearm = 1;
+
+    if (write(private->fd, &rearm, sizeof(rearm)) != sizeof(rearm))
+        private->canRearm = 0;
+
+    for (;;) {
+        ssize_t len = read(private->fd, &count, sizeof(count));
+
+        if (len != sizeof(count)) {
+            if (len < 0 && errno == EINTR)
+                continue;
+            printf("%s: Interrupt read from '%s' failed, %s\n",
+                drvname, private->path, len < 0 ? strerror(errno) : "EOF");
+            break;
+        }
+
+        dispatch(private);
+
+        if (private->canRearm &&
+            write(private->fd, &rearm, sizeof(rearm)) != sizeof(rearm)) {
+            printf("%s: Can't re-enable interrupts from '%s'\n",
+                drvname, private->path);
+            private->canRearm = 0;
+        }
+    }
+    private->intThread = NULL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    report
+
+Purpose:
+    Returns a status string for the requested slot
+
+Description:
+    Shows whether each slot interrupt is enabled, and the number of carrier
+    interrupts seen so far.
+
+Returns:
+    A static string containing the slot's current status.
+
+*/
+
+static char* report (
+    void *p,
+    epicsUInt16 slot
+) {
+    private_t *private = (private_t *) p;
+    static char output[IPAC_REPORT_LEN];
+
+    sprintf(output, "Int0: %sabled    Int1: %sabled    %lu interrupts",
+        (private->irqEnabled & (1 << (2 * slot)) ? "en" : "dis"),
+        (private->irqEnabled & (2 << (2 * slot)) ? "en" : "dis"),
+        private->intCount);
+    return output;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    baseAddr
+
+Purpose:
+    Returns a pointer to the requested slot & address space
+
+Description:
+    All addresses were calculated by the initialise routine, so this is just a
+    table lookup.  Slots above the configured number of slots have no address
+    spaces, so NULL is returned for them.
+
+Returns:
+    The requested pointer, or NULL if the slot has no such space.
+
+*/
+
+static void * baseAddr (
+    void *p,
+    epicsUInt16 slot,
+    ipac_addr_t space
+) {
+    private_t *private = (private_t *) p;
+    return private->addr[space][slot];
+}
+
+
+/*******************************************************************************
+
+Routine:
+    irqCmd
+
+Purpose:
+    Handles interrupter commands and status requests
+
+Description:
+    The carrier's interrupt signal is enabled at the UIO driver, so this just
+    records which slot interrupts the module drivers want, and starts the
+    thread that waits for interrupts the first time one is enabled.
+
+    A UIO device only tells us that the carrier has interrupted, not which
+    slot asked for service, so ipac_irqPoll reports whether the carrier has
+    interrupted since that slot interrupt was last polled.  This is enough
+    for ipacHybrid to skip calling a polled module routine when there has
+    been no activity; note that the kernel still takes the carrier interrupt
+    while a slot is being polled.
+
+Returns:
+    ipac_irqGetLevel returns 0,
+    ipac_irqEnable and ipac_irqDisable return 0 = OK,
+    ipac_irqPoll returns 1 if the carrier has interrupted since the last
+    poll of this slot interrupt, else 0,
+    other calls return S_IPAC_notImplemented.
+
+*/
+
+static int irqCmd (
+    void *p,
+    epicsUInt16 slot,
+    epicsUInt16 irqNumber,
+    ipac_irqCmd_t cmd
+) {
+    private_t* private = (private_t *) p;
+    int irqBit = 1 << (2 * slot + irqNumber);
+
+    switch(cmd) {
+        case ipac_irqGetLevel:
+            return 0;
+
+        case ipac_irqEnable:
+            private->irqEnabled |= irqBit;
+            if (private->isDevice && private->intThread == NULL) {
+                char name[16];
+
+                sprintf(name, "uioInt%d", private->carrier);
+                private->intThread = epicsThreadCreate(name,
+                    epicsThreadPriorityMax,
+                    epicsThreadGetStackSize(epicsThreadStackSmall),
+                    intThread, private);
+            }
+            return OK;
+
+        case ipac_irqDisable:
+            private->irqEnabled &= ~irqBit;
+            return OK;
+
+        case ipac_irqPoll: {
+            int key = epicsInterruptLock();
+            int seen = (private->irqSeen & irqBit) != 0;
+
+            private->irqSeen &= ~irqBit;
+            epicsInterruptUnlock(key);
+            return seen;
+        }
+
+        default:
+            return S_IPAC_notImplemented;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    intConnect
+
+Purpose:
+    Connect module interrupt routine to a slot
+
+Description:
+    There is no interrupt vectoring through a UIO device, so the routine is
+    added to the list for the slot and called by dispatch() whenever the
+    carrier interrupts.  Connecting a second routine to the same vector
+    replaces the first.
+
+Returns:
+    0 = OK,
+    S_IPAC_noMemory = malloc() failed
+
+*/
+
+static int intConnect (
+    void *p,
+    epicsUInt16 slot,
+    epicsUInt16 vecNum,
+    void (*routine)(int parameter),
+    int parameter
+) {
+    private_t* private = (private_t *) p;
+    isr_t *pisr;
+
+    for (pisr = private->isr[slot]; pisr; pisr = pisr->next) {
+        if (pisr->vector == vecNum) {
+            pisr->routine = routine;
+            pisr->parameter = parameter;
+            return OK;
+        }
+    }
+
+    pisr = (isr_t *) malloc(sizeof(isr_t));
+    if (pisr == NULL)
+        return S_IPAC_noMemory;
+    pisr->vector = vecNum;
+    pisr->routine = routine;
+    pisr->parameter = parameter;
+    pisr->next = private->isr[slot];
+    private->isr[slot] = pisr;
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    moduleProbe
+
+Purpose:
+    Check whether the ID Prom space can be read
+
+Description:
+    The mapped area is ordinary memory as far as the CPU is concerned, so the
+    ID space is safe to read if the slot has one.
+
+Returns:
+    0 if the slot has no ID space, 1 otherwise.
+
+*/
+
+static int moduleProbe (
+    void *p,
+    epicsUInt16 slot
+) {
+    private_t* private = (private_t *) p;
+    return private->addr[ipac_addrID][slot] != NULL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacUioInterrupt
+
+Purpose:
+    Simulate a carrier interrupt
+
+Description:
+    Calls the interrupt routines connected to the given carrier as if the
+    carrier had interrupted.  This is mostly useful with carriers that map an
+    ordinary file, to exercise module drivers against a simulated slot.
+
+Return:
+    0 = OK
+    S_IPAC_badAddress = No such UIO carrier
+
+*/
+
+int ipacUioInterrupt (
+    int carrier
+) {
+    private_t *private;
+
+    for (private = list_head; private; private = private->next) {
+        if (private->carrier == carrier) {
+            dispatch(private);
+            return OK;
+        }
+    }
+    printf("%s: Carrier %d is not a UIO carrier\n", drvname, carrier);
+    return S_IPAC_badAddress;
+}
+
+
+/******************************************************************************/
+
+/* IPAC Carrier Table */
+
+static ipac_carrier_t uioCarrier = {
+    "Linux UIO/mmap",
+    SLOTS,
+    initialise,
+    report,
+    baseAddr,
+    irqCmd,
+    intConnect,
+    moduleProbe
+};
+
+
+int ipacAddUio(const char *cardParams) {
+    return ipacAddCarrier(&uioCarrier, cardParams);
+}
+
+
+/* iocsh Command Table and Registrar */
+
+static const iocshArg argParams =
+    {"cardParams", iocshArgString};
+static const iocshArg argCarrier =
+    {"carrier", iocshArgInt};
+
+static const iocshArg * const addArgs[] =
+    {&argParams};
+static const iocshArg * const intArgs[] =
+    {&argCarrier};
+
+static const iocshFuncDef uioFuncDef =
+    {"ipacAddUio", NELEMENTS(addArgs), addArgs};
+
+static void uioCallFunc(const iocshArgBuf *args) {
+    ipacAddUio(args[0].sval);
+}
+
+static const iocshFuncDef uioIntFuncDef =
+    {"ipacUioInterrupt", NELEMENTS(intArgs), intArgs};
+
+static void uioIntCallFunc(const iocshArgBuf *args) {
+    ipacUioInterrupt(args[0].ival);
+}
+
+static void epicsShareAPI uioRegistrar(void) {
+    iocshRegister(&uioFuncDef, uioCallFunc);
+    iocshRegister(&uioIntFuncDef, uioIntCallFunc);
+}
+
+epicsExportRegistrar(uioRegistrar);
@@ -449,6 +449,34 @@ static int irqCmd (
     }
 }
 
+/*******************************************************************************
+
+Routine:
+    irqPending
+
+Purpose:
+    Returns the interrupt requests of all slots
+
+Description:
+    The irqStatus register holds the state of both interrupt signals from all
+    four slots, in the same bit order as drvIpac's IPAC_IRQ_BIT() macro.
+
+Returns:
+    0 = OK
+
+*/
+
+static int irqPending (
+    void *p,
+    epicsUInt32 *pending
+) {
+    private_t *private = (private_t *)p;
+
+    *pending = private->regs->irqStatus & 0xff;
+    return OK;
+}
+
+
 
 /******************************************************************************/
 
@@ -462,7 +490,10 @@ static ipac_carrier_t avme96XX = {
     baseAddr,
     irqCmd,
     NULL,
-    NULL
+    NULL,
+    NULL,
+    NULL,
+    irqPending
 };
 
 
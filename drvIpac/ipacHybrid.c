@@ -0,0 +1,620 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    ipacHybrid.c
+
+Description:
+    Hybrid interrupt/polling service for IPAC module drivers.  A module
+    driver that connects its interrupt routine through ipmHybridConnect()
+    instead of ipmIntConnect() can be switched at runtime between being
+    interrupt-driven and being polled from a thread: when the interrupt rate
+    from the slot climbs above a configured threshold the slot interrupt is
+    disabled and the routine is called periodically instead, and when the
+    amount of work found by polling falls below a lower threshold the slot
+    interrupt is enabled again.  This limits the CPU time lost to interrupt
+    entry and exit when a module is very busy without adding latency when it
+    is quiet, in the same way as the NAPI scheme used by Linux network
+    drivers.
+
+Version:
+    $Id$
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdlib.h>
+
+#include <dbDefs.h>
+#include <epicsStdio.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsInterrupt.h>
+#include <epicsTime.h>
+#include <epicsExport.h>
+#include <iocsh.h>
+
+#include "drvIpac.h"
+
+
+/* Interval between interrupt rate measurements, in seconds */
+
+#define SAMPLE_TIME 0.5
+
+/* Default polling period, in seconds */
+
+#define DEFAULT_PERIOD 0.001
+
+/* Maximum number of hybrid slot interrupts */
+
+#define MAX_HYBRIDS 64
+
+
+typedef enum {
+    modeIrq = 0,
+    modePoll = 1
+} hybridMode_t;
+
+LOCAL const char * const modeName[] = { "interrupt", "polled" };
+
+
+/* Hybrid service data, one per connected slot interrupt */
+
+typedef struct hybrid_s {
+    int index;
+    int carrier;
+    int slot;
+    int irqNumber;
+    void (*routine)(int parameter);
+    int parameter;
+    double highRate;		/* Interrupts/sec that switch to polling */
+    double lowRate;		/* Busy polls/sec that switch back */
+    double period;		/* Polling period, seconds */
+    epicsThreadId thread;
+    int canPoll;		/* Carrier supports ipac_irqPoll */
+    volatile hybridMode_t mode;
+    volatile unsigned long intCount;
+    unsigned long intBase;	/* intCount at the last statistics reset */
+    unsigned long pollCount;
+    unsigned long busyCount;
+    unsigned long switches[2];	/* Number of switches into each mode */
+    double modeTime[2];		/* Seconds spent in each mode */
+    epicsTimeStamp modeStart;
+} hybrid_t;
+
+LOCAL hybrid_t *hybrids[MAX_HYBRIDS];
+LOCAL int numHybrids = 0;
+LOCAL epicsMutexId hybridLock = NULL;
+LOCAL epicsThreadOnceId hybridOnce = EPICS_THREAD_ONCE_INIT;
+
+
+LOCAL void hybridInit (
+    void *junk
+) {
+    hybridLock = epicsMutexMustCreate();
+}
+
+
+/*******************************************************************************
+
+Routine:
+    findHybrid
+
+Function:
+    Find or create the hybrid data for a slot interrupt.
+
+Description:
+    The hybrid data can be created either by the module driver connecting its
+    interrupt routine or by ipacHybridConfig() being called from the startup
+    script, whichever happens first.  The ISR shim is given the table index
+    as its parameter, since a pointer may not fit in an int.
+
+Returns:
+    Pointer to the hybrid data, or NULL if the table is full or malloc()
+    failed.
+
+*/
+
+LOCAL hybrid_t * findHybrid (
+    int carrier,
+    int slot,
+    int irqNumber
+) {
+    hybrid_t *ph = NULL;
+    int i;
+
+    epicsThreadOnce(&hybridOnce, hybridInit, NULL);
+
+    epicsMutexMustLock(hybridLock);
+    for (i = 0; i < numHybrids; i++) {
+	if (hybrids[i]->carrier == carrier &&
+	    hybrids[i]->slot == slot &&
+	    hybrids[i]->irqNumber == irqNumber) {
+	    ph = hybrids[i];
+	    break;
+	}
+    }
+
+    if (ph == NULL && numHybrids < MAX_HYBRIDS) {
+	ph = (hybrid_t *) calloc(1, sizeof(hybrid_t));
+	if (ph != NULL) {
+	    ph->index = numHybrids;
+	    ph->carrier = carrier;
+	    ph->slot = slot;
+	    ph->irqNumber = irqNumber;
+	    ph->period = DEFAULT_PERIOD;
+	    ph->mode = modeIrq;
+	    epicsTimeGetCurrent(&ph->modeStart);
+	    hybrids[numHybrids++] = ph;
+	}
+    }
+    epicsMutexUnlock(hybridLock);
+    return ph;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    hybridIsr
+
+Function:
+    Interrupt shim that counts interrupts before calling the module routine.
+
+Returns:
+    Nothing.
+
+*/
+
+LOCAL void hybridIsr (
+    int parameter
+) {
+    hybrid_t *ph = hybrids[parameter];
+
+    ph->intCount++;
+    ph->routine(ph->parameter);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    setMode
+
+Function:
+    Switch a slot interrupt between interrupt-driven and polled service.
+
+Description:
+    Changes the slot's interrupt enable at the carrier and updates the mode
+    statistics, which ipacHybridReport() may be reading or resetting.
+    Carriers are not required to implement ipac_irqDisable, so if that fails
+    the slot just stays interrupt-driven.
+
+Returns:
+    0 = OK, or the carrier's error status.
+
+*/
+
+LOCAL int setMode (
+    hybrid_t *ph,
+    hybridMode_t mode
+) {
+    epicsTimeStamp now;
+    int status;
+
+    status = ipmIrqCmd(ph->carrier, ph->slot, ph->irqNumber,
+		mode == modePoll ? ipac_irqDisable : ipac_irqEnable);
+    if (status) {
+	return status;
+    }
+
+    epicsMutexMustLock(hybridLock);
+    epicsTimeGetCurrent(&now);
+    ph->modeTime[ph->mode] += epicsTimeDiffInSeconds(&now, &ph->modeStart);
+    ph->modeStart = now;
+    ph->switches[mode]++;
+    ph->mode = mode;
+    epicsMutexUnlock(hybridLock);
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    pollOnce
+
+Function:
+    Perform one poll of the slot.
+
+Description:
+    The carrier reports the interrupt request state, so the module routine
+    is only called when the module is asking for service.
+
+    The routine was written to run as an ISR, and its module driver protects
+    the data it shares with that ISR by locking interrupts at task level.
+    That only keeps out the routine while it runs as an ISR; called from
+    this thread it must lock interrupts too, or a task in the middle of such
+    a critical section could see it run.  Disabling just the slot interrupt,
+    as is done in polled mode, can't give that exclusion, so interrupts are
+    locked for as long as the routine takes, as they are when it runs as an
+    ISR.  The routine is not called at all on polls that find no request, so
+    this happens no more often than the interrupts it replaces.
+
+Returns:
+    1 if the module needed service, else 0.
+
+*/
+
+LOCAL int pollOnce (
+    hybrid_t *ph
+) {
+    int key;
+
+    if (ipmIrqCmd(ph->carrier, ph->slot, ph->irqNumber, ipac_irqPoll) == 0) {
+	return 0;
+    }
+
+    key = epicsInterruptLock();
+    ph->routine(ph->parameter);
+    epicsInterruptUnlock(key);
+    return 1;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    hybridThread
+
+Function:
+    Monitor the interrupt rate and poll the module when it is high.
+
+Description:
+    In interrupt mode the thread wakes up every SAMPLE_TIME seconds to measure
+    the interrupt rate, switching to polled mode if it exceeds highRate.  In
+    polled mode the thread calls the module routine every period seconds, and
+    at the end of each sample interval switches back to interrupts if the
+    module needed service on fewer than lowRate polls per second.  The poll
+    counts are added to the statistics once per sample interval.  The thread
+    is only started for carriers that can report the slot's interrupt request
+    state, see startHybrid().
+
+Returns:
+    Nothing.
+
+*/
+
+LOCAL void hybridThread (
+    void *parm
+) {
+    hybrid_t *ph = (hybrid_t *) parm;
+    unsigned long lastCount = ph->intCount;
+    epicsTimeStamp start, now;
+
+    epicsTimeGetCurrent(&start);
+    while (ph->highRate > 0) {
+	double interval;
+
+	if (ph->mode == modeIrq) {
+	    epicsThreadSleep(SAMPLE_TIME);
+	    epicsTimeGetCurrent(&now);
+	    interval = epicsTimeDiffInSeconds(&now, &start);
+	    if ((ph->intCount - lastCount) > ph->highRate * interval) {
+		setMode(ph, modePoll);
+	    }
+	}
+	else {
+	    unsigned long polls = 0, busy = 0;
+
+	    do {
+		busy += pollOnce(ph);
+		polls++;
+		epicsThreadSleep(ph->period);
+		epicsTimeGetCurrent(&now);
+		interval = epicsTimeDiffInSeconds(&now, &start);
+	    } while (interval < SAMPLE_TIME);
+
+	    epicsMutexMustLock(hybridLock);
+	    ph->pollCount += polls;
+	    ph->busyCount += busy;
+	    epicsMutexUnlock(hybridLock);
+
+	    if (busy < ph->lowRate * interval) {
+		setMode(ph, modeIrq);
+	    }
+	}
+	lastCount = ph->intCount;
+	start = now;
+    }
+
+    /* Disabled by ipacHybridConfig() */
+    if (ph->mode == modePoll) {
+	setMode(ph, modeIrq);
+    }
+    ph->thread = NULL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    startHybrid
+
+Function:
+    Start the monitor thread if the slot is connected and configured.
+
+Description:
+    Polling needs the carrier to report whether the slot is requesting
+    service, through ipac_irqPoll.  Without that every poll would have to
+    call the module routine and count as busy, so the slot would never find
+    a reason to return to interrupts, and switching is refused instead; the
+    slot stays interrupt-driven.
+
+Returns:
+    0 = OK,
+    S_IPAC_notImplemented = the carrier doesn't implement ipac_irqPoll.
+
+*/
+
+LOCAL int startHybrid (
+    hybrid_t *ph
+) {
+    char name[16];
+
+    if (ph->routine == NULL || ph->highRate <= 0 || ph->thread != NULL) {
+	return OK;
+    }
+
+    ph->canPoll = ipmIrqCmd(ph->carrier, ph->slot, ph->irqNumber,
+			    ipac_irqPoll) != S_IPAC_notImplemented;
+    if (!ph->canPoll) {
+	printf("ipacHybrid: Carrier %d can't poll slot %d IRQ%d,"
+	       " staying interrupt-driven\n",
+	       ph->carrier, ph->slot, ph->irqNumber);
+	return S_IPAC_notImplemented;
+    }
+
+    epicsSnprintf(name, sizeof(name), "ipHybrid%d.%d.%d",
+		  ph->carrier, ph->slot, ph->irqNumber);
+    ph->thread = epicsThreadCreate(name, epicsThreadPriorityScanHigh + 5,
+		epicsThreadGetStackSize(epicsThreadStackSmall),
+		hybridThread, ph);
+    if (ph->thread == NULL) {
+	printf("ipacHybrid: Can't create thread %s\n", name);
+    }
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipmHybridConnect
+
+Function:
+    Connect module driver to interrupt vector with hybrid polling.
+
+Description:
+    Use this instead of ipmIntConnect() to allow the interrupt identified by
+    carrier, slot and irqNumber to be serviced by polling when the interrupt
+    rate gets high.  The routine is connected to the vector through a shim
+    that counts interrupts; until ipacHybridConfig() has given a non-zero
+    interrupt rate threshold for the slot interrupt the behaviour is the same
+    as calling ipmIntConnect().  When the slot is being polled the routine is
+    called from a thread with interrupts locked, so it must be prepared to
+    find no work to do.  A carrier that doesn't implement ipac_irqPoll can't
+    be polled, and the slot then stays interrupt-driven.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = illegal carrier, slot, irqNumber or vector,
+    S_IPAC_noMemory = hybrid table full or malloc() failed,
+    other, from ipmIntConnect().
+
+*/
+
+int ipmHybridConnect (
+    int carrier,
+    int slot,
+    int irqNumber,
+    int vecNum,
+    void (*routine)(int parameter),
+    int parameter
+) {
+    hybrid_t *ph;
+    int status;
+
+    if (irqNumber < 0 || irqNumber > 1 || routine == NULL) {
+	return S_IPAC_badAddress;
+    }
+
+    ph = findHybrid(carrier, slot, irqNumber);
+    if (ph == NULL) {
+	return S_IPAC_noMemory;
+    }
+
+    ph->routine = routine;
+    ph->parameter = parameter;
+    status = ipmIntConnect(carrier, slot, vecNum, hybridIsr, ph->index);
+    if (status) {
+	ph->routine = NULL;
+	return status;
+    }
+
+    (void) startHybrid(ph);
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacHybridConfig
+
+Function:
+    Set the switching thresholds for a slot interrupt.
+
+Description:
+    The slot interrupt is switched to polled service when it interrupts more
+    than highRate times per second, and back again when fewer than lowRate
+    polls per second find the module requesting service.  The polling period
+    is given in seconds; polling cannot happen faster than the OS clock tick
+    allows.  Setting highRate to zero disables switching for the slot and
+    returns it to interrupt service.  This may be called before or after the
+    module driver has connected its interrupt routine.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = illegal slot or irqNumber,
+    S_IPAC_noMemory = hybrid table full or malloc() failed,
+    S_IPAC_notImplemented = the carrier can't report the slot interrupt
+	state, so the slot can't be polled.
+
+*/
+
+int ipacHybridConfig (
+    int carrier,
+    int slot,
+    int irqNumber,
+    double highRate,
+    double lowRate,
+    double period
+) {
+    hybrid_t *ph;
+
+    if (irqNumber < 0 || irqNumber > 1 || slot < 0) {
+	return S_IPAC_badAddress;
+    }
+
+    ph = findHybrid(carrier, slot, irqNumber);
+    if (ph == NULL) {
+	return S_IPAC_noMemory;
+    }
+
+    ph->highRate = highRate;
+    ph->lowRate = lowRate < highRate ? lowRate : highRate;
+    if (period > 0) {
+	ph->period = period;
+    }
+
+    return startHybrid(ph);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacHybridReport
+
+Function:
+    Report the mode and statistics of all hybrid slot interrupts.
+
+Description:
+    For each slot interrupt connected through ipmHybridConnect() this shows
+    the current service mode, the number of times it has switched into each
+    mode and the time spent in each.  Interest level 1 adds the thresholds
+    and interrupt and poll counts.  Interest level 2 or more also resets the
+    statistics after printing them.  The interrupt count is reset by moving
+    its base, since the monitor thread uses the raw count to measure the
+    interrupt rate.
+
+Returns:
+    OK.
+
+*/
+
+int ipacHybridReport (
+    int interest
+) {
+    epicsTimeStamp now;
+    int i;
+
+    epicsThreadOnce(&hybridOnce, hybridInit, NULL);
+
+    epicsMutexMustLock(hybridLock);
+    epicsTimeGetCurrent(&now);
+    for (i = 0; i < numHybrids; i++) {
+	hybrid_t *ph = hybrids[i];
+	double current[2];
+
+	current[0] = ph->modeTime[0];
+	current[1] = ph->modeTime[1];
+	current[ph->mode] += epicsTimeDiffInSeconds(&now, &ph->modeStart);
+
+	printf("  Carrier %d slot %d IRQ%d: %s mode\n", ph->carrier, ph->slot,
+		ph->irqNumber, ph->routine ? modeName[ph->mode] : "unconnected");
+	printf("    to interrupts %lu times, %.3f sec;"
+		" to polled %lu times, %.3f sec\n",
+		ph->switches[modeIrq], current[modeIrq],
+		ph->switches[modePoll], current[modePoll]);
+
+	if (interest > 0) {
+	    printf("    thresholds %g/%g per sec, period %g sec%s\n",
+		    ph->highRate, ph->lowRate, ph->period,
+		    ph->canPoll ? "" : ", can't poll");
+	    printf("    %lu interrupts, %lu polls of which %lu busy\n",
+		    ph->intCount - ph->intBase, ph->pollCount, ph->busyCount);
+	}
+
+	if (interest > 1) {
+	    ph->intBase = ph->intCount;
+	    ph->pollCount = ph->busyCount = 0;
+	    ph->switches[0] = ph->switches[1] = 0;
+	    ph->modeTime[0] = ph->modeTime[1] = 0;
+	    ph->modeStart = now;
+	}
+    }
+    epicsMutexUnlock(hybridLock);
+    return OK;
+}
+
+
+/* iocsh command table and registrar */
+
+static const iocshArg hybridArg0 = { "carrier", iocshArgInt};
+static const iocshArg hybridArg1 = { "slot", iocshArgInt};
+static const iocshArg hybridArg2 = { "irqNumber", iocshArgInt};
+static const iocshArg hybridArg3 = { "highRate", iocshArgDouble};
+static const iocshArg hybridArg4 = { "lowRate", iocshArgDouble};
+static const iocshArg hybridArg5 = { "period", iocshArgDouble};
+static const iocshArg * const hybridConfigArgs[6] = {
+    &hybridArg0, &hybridArg1, &hybridArg2,
+    &hybridArg3, &hybridArg4, &hybridArg5
+};
+static const iocshFuncDef hybridConfigFuncDef =
+    {"ipacHybridConfig", 6, hybridConfigArgs};
+static void hybridConfigCallFunc(const iocshArgBuf *args) {
+    ipacHybridConfig(args[0].ival, args[1].ival, args[2].ival,
+		     args[3].dval, args[4].dval, args[5].dval);
+}
+
+static const iocshArg hybridReportArg0 = { "interest", iocshArgInt};
+static const iocshArg * const hybridReportArgs[1] = {&hybridReportArg0};
+static const iocshFuncDef hybridReportFuncDef =
+    {"ipacHybridReport", 1, hybridReportArgs};
+static void hybridReportCallFunc(const iocshArgBuf *args) {
+    ipacHybridReport(args[0].ival);
+}
+
+void ipacHybridRegistrar(void) {
+    iocshRegister(&hybridConfigFuncDef, hybridConfigCallFunc);
+    iocshRegister(&hybridReportFuncDef, hybridReportCallFunc);
+}
+epicsExportRegistrar(ipacHybridRegistrar);
@@ -0,0 +1,2941 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canBus.c
+
+Description:
+    Driver-independent parts of the CANbus interface.  Every bus is
+    registered here by its controller driver with a table of the driver's
+    routines; the canBus.h routines look after the message and signal
+    callbacks and canRead, and call through that table for transmission
+    and bus control.  A driver passes received messages and bus status
+    changes back in through canBusReceive and canBusSignal, and the end
+    of each transmission through canBusTxDone.
+
+Author:
+    Andrew Johnson <anjohnson@iee.org>
+Created:
+    20 July 1995
+Version:
+    $Id$
+
+Copyright (c) 1995-2007 Andrew Johnson
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <iocsh.h>
+#include <dbDefs.h>
+#include <epicsEvent.h>
+#include <epicsInterrupt.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <epicsTimer.h>
+#include <epicsThread.h>
+#include <epicsString.h>
+#include <epicsMessageQueue.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+
+
+/* Some local magic numbers */
+#define CAN_MAGIC_NUMBER 81100
+#define CAN_HASH_SIZE 512	/* Must be a power of 2 */
+
+#define CAN_HASH(id) (((id) ^ ((id) >> 9) ^ ((id) >> 18)) & (CAN_HASH_SIZE-1))
+
+#define CAN_LOAD_PERIOD 1.0	/* Seconds between load samples */
+#define CAN_LOAD_SAMPLES 11	/* So the window is 10 periods */
+#define CAN_TOP_MAX 64		/* Most IDs canTop will list */
+#define CAN_PRIORITIES 3	/* CAN_PRIORITY_LOW .. CAN_PRIORITY_HIGH */
+#define CAN_TX_QUEUE 64		/* canWriteAsync messages per bus */
+#define CAN_TX_TIMEOUT 1.0	/* Seconds canTxTask waits to send one */
+#define CAN_WORKERS 2		/* Tasks running deferred callbacks */
+#define CAN_WORKER_FRAMES 128	/* Frames each worker can have queued */
+
+
+typedef void callback_t(void *pprivate, long parameter);
+
+typedef struct callbackTable_s {
+    struct callbackTable_s *pnext;	/* linked list ... */
+    void *pprivate;			/* reference for callback routine */
+    callback_t *pcallback;		/* registered routine */
+    /* The rest are only used for canMessage callbacks */
+    int worker;				/* deferred worker, -1 for inline */
+    int deleted;			/* freed when pending reaches 0 */
+    epicsUInt32 pending;		/* frames on the worker queue */
+    epicsUInt32 calls;			/* times called */
+    epicsUInt32 dropped;		/* frames lost, worker queue full */
+    double totalTime;			/* seconds spent in the callback, */
+    double maxTime;			/* while timing is enabled */
+} callbackTable_t;
+
+/* A received frame waiting for a deferred callback */
+typedef struct {
+    callbackTable_t *phandler;
+    int timed;				/* canMsgTiming was on */
+    canMessage_t message;
+} deferred_t;
+
+
+/* Message callbacks are found through a hash table keyed by identifier,
+ * since extended identifiers are too many for a flat array.  Entries
+ * are never removed, so the receive path can walk a bucket without
+ * taking a lock while canMessage adds entries at its head.
+ */
+typedef struct idHandler_s {
+    struct idHandler_s *pnext;		/* next ID in this hash bucket */
+    canID_t identifier;			/* CAN message ID */
+    callbackTable_t *phandler;		/* registered callbacks */
+    epicsUInt32 count;			/* frames seen, extended IDs */
+    epicsUInt32 mark;			/* count when canTop started */
+} idHandler_t;
+
+
+/* Running totals sampled every CAN_LOAD_PERIOD for the load window */
+typedef struct {
+    epicsTimeStamp time;
+    epicsUInt32 frames;
+    epicsUInt32 bitsMin;
+    epicsUInt32 bitsMax;
+} loadSample_t;
+
+typedef struct {
+    canID_t identifier;
+    epicsUInt32 frames;
+} topEntry_t;
+
+
+/* A canRoute gateway entry, on its source bus's list */
+typedef struct route_s {
+    struct route_s *pnext;
+    canID_t first, last;		/* identifiers forwarded */
+    int offset;				/* added to the identifier */
+    int masked;				/* data bytes are ANDed with mask */
+    epicsUInt8 mask[CAN_DATA_SIZE];
+    int ndest;
+    canBusID_t *pdest;			/* destination buses */
+    epicsUInt32 forwarded;		/* frames queued to a destination */
+    epicsUInt32 dropped;		/* bad new ID or queue full */
+    epicsUInt32 failed;			/* destination driver failed */
+} route_t;
+
+/* A canWrite caller waiting for its turn at the transmitter */
+typedef struct txRequest_s {
+    struct txRequest_s *pnext;		/* pending list, most urgent first */
+    epicsUInt32 key;			/* sort key, lower is more urgent */
+    int granted;			/* transmitter handed to this caller */
+    epicsEventId wakeup;		/* signalled when granted */
+} txRequest_t;
+
+/* A canWriteAsync message waiting for canTxTask */
+typedef struct {
+    canMessage_t message;
+    int priority;
+    canWriteQueued_t *pqueued;		/* hand-over callback, or NULL */
+    void *pprivate;
+} txAsync_t;
+
+/* Transmit queueing delay statistics for one priority */
+typedef struct {
+    epicsUInt32 count;			/* frames sent */
+    epicsUInt32 queued;			/* of which had to wait */
+    double totalDelay;			/* seconds */
+    double maxDelay;
+} txBand_t;
+
+
+struct canBusID_s {
+    struct canBusID_s *pnext;	/* To next bus. Must be first member */
+    int magicNumber;		/* bus pointer confirmation */
+    char *pbusName;		/* Bus identification */
+    const canDriver_t *pdriver;	/* Controller driver routines */
+    void *pdev;			/* Controller driver's device pointer */
+    int unusedCount;		/* messages without callback */
+    canID_t unusedId;		/* last ID received without a callback */
+    epicsMutexId readSem;	/* canRead task Mutex */
+    canMessage_t *preadBuffer;	/* canRead destination buffer */
+    epicsEventId rxSem;		/* canRead message arrival signal */
+    idHandler_t *pidTable[CAN_HASH_SIZE];	/* message callbacks */
+    callbackTable_t *psigHandler;	/* error signal callbacks */
+    canTap_t *ptap;		/* sees every message, or NULL */
+    void *ptapPrivate;
+    int bitRate;		/* bits/sec, 0 if not known */
+    epicsUInt32 frames;		/* frames received and sent */
+    epicsUInt32 bitsMin;	/* bus bits they used, without stuffing */
+    epicsUInt32 bitsMax;	/* and with the most possible stuff bits */
+    epicsUInt32 extOther;	/* extended frames with no ID entry */
+    epicsUInt32 idCount[CAN_IDENTIFIERS];	/* frames per standard ID */
+    epicsTimerId loadTimer;	/* samples the totals, once started */
+    loadSample_t sample[CAN_LOAD_SAMPLES];
+    int sampleNext;		/* next sample[] to fill */
+    int samples;		/* sample[] entries filled */
+    int scheduled;		/* canWrite order by priority */
+    int timed;			/* time the message callbacks */
+    epicsMutexId txLock;	/* guards the scheduler fields below */
+    int txBusy;			/* a writer is using the driver */
+    txRequest_t *ptxPending;	/* writers waiting, most urgent first */
+    txRequest_t *ptxFree;	/* unused requests */
+    txBand_t txBand[CAN_PRIORITIES];	/* delays by priority */
+    epicsMessageQueueId txQueue;	/* canWriteAsync messages */
+    epicsEventId txDoneSem;	/* canTxTask's message completed */
+    const canMessage_t *ptxAwait;	/* message it waits for, or NULL */
+    int txAwaitDone;		/* canBusTxDone reported it */
+    int txAwaitStatus;		/* and its status */
+    epicsUInt32 asyncQueued;	/* canWriteAsync messages given to the driver */
+    epicsUInt32 asyncFailed;	/* or that the driver refused */
+    epicsUInt32 asyncFull;	/* or rejected with the queue full */
+    epicsUInt32 asyncLost;	/* given to the driver but not sent */
+    route_t *proutes;		/* canRoute entries from this bus */
+};
+
+
+static struct canBusID_s *pbusFirst = NULL;
+
+static epicsThreadOnceId workerOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMessageQueueId workerQ[CAN_WORKERS];
+static epicsMutexId workerLock;	/* guards callbackTable_t.pending */
+static int workerNext;		/* for sharing out deferred callbacks */
+
+int canSilenceErrors = FALSE;		/* for EPICS device support use */
+epicsTimerQueueId canTimerQ = NULL;	/* allocated by the driver's init */
+
+
+/*******************************************************************************
+
+Routine:
+    strdupn
+
+Purpose:
+    duplicate n characters of a string and return pointer to new substring
+
+Description:
+    Copies n characters from the input string to a newly malloc'ed memory
+    buffer, and adds a trailing '\0', then returns the new string pointer.
+
+Returns:
+    char *newString, or NULL if malloc failed.
+
+*/
+
+static char* strdupn (
+    const char *ct,
+    size_t n
+) {
+    char *duplicate;
+
+    duplicate = malloc(n+1);
+    if (duplicate == NULL) {
+	return NULL;
+    }
+
+    memcpy(duplicate, ct, n);
+    duplicate[n] = '\0';
+
+    return duplicate;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canIoParse
+
+Purpose:
+    Parse a CAN address string into a canIo_t structure
+
+Description:
+    canString which must match the format below is converted by this routine
+    into the relevent fields of the canIo_t structure pointed to by pcanIo:
+
+    	busname{/timeout}:id{+n}{.offset} parameter
+
+    where
+    	busname is alphanumeric, all other fields are hex, decimal or octal
+    	timeout is in milliseconds
+	id and any number of +n components are summed to give the CAN Id;
+	    a sum above 0x7ff is an extended (29-bit) Id, smaller extended
+	    Ids are given by adding 0x80000000 (CAN_EXTENDED)
+	offset is the byte offset into the message
+	parameter is a string or integer for use by device support
+
+Returns:
+    0, or
+    S_can_badAddress for illegal input strings,
+    ENOMEM if malloc() fails,
+    S_can_noDevice for an unregistered bus name.
+
+Example:
+    canIoParse("CAN1/20:0126+4+1.4 0xfff", &myIo);
+
+*/
+
+int canIoParse (
+    char *canString,
+    canIo_t *pcanIo
+) {
+    char separator;
+    char *name;
+
+    pcanIo->canBusID = NULL;
+
+    if (canString == NULL ||
+	pcanIo == NULL) {
+	return S_can_badAddress;
+    }
+
+    /* Get rid of leading whitespace and non-alphanumeric chars */
+    while (!isalnum(0xff & *canString)) {
+	if (*canString++ == '\0') {
+	    return S_can_badAddress;
+	}
+    }
+
+    /* First part of string is the bus name */
+    name = canString;
+
+    /* find the end of the busName */
+    canString = strpbrk(canString, "/:");
+    if (canString == NULL ||
+	*canString == '\0') {
+	return S_can_badAddress;
+    }
+
+    /* now we're at character after the end of the busName */
+    pcanIo->busName = strdupn(name, canString - name);
+    if (pcanIo->busName == NULL) {
+	return ENOMEM;
+    }
+    separator = *canString++;
+
+    /* Handle /<timeout> if present, convert from ms to seconds */
+    if (separator == '/') {
+	pcanIo->timeout = ((double)strtol(canString, &canString, 0))/1000.0;
+	separator = *canString++;
+    } else {
+	pcanIo->timeout = -1.0;
+    }
+
+    /* String must contain :<canID> */
+    if (separator != ':') {
+	return S_can_badAddress;
+    }
+    pcanIo->identifier = strtoul(canString, &canString, 0);
+    separator = *canString++;
+
+    /* Handle any number of optional +<n> additions to the ID */
+    while (separator == '+') {
+	pcanIo->identifier += strtol(canString, &canString, 0);
+	separator = *canString++;
+    }
+
+    /* Identifiers too big for 11 bits are extended */
+    if (pcanIo->identifier >= CAN_IDENTIFIERS &&
+	pcanIo->identifier < CAN_EXT_IDENTIFIERS) {
+	pcanIo->identifier |= CAN_EXTENDED;
+    }
+
+    /* Handle .<offset> if present */
+    if (separator == '.') {
+	pcanIo->offset = strtoul(canString, &canString, 0);
+	if (pcanIo->offset >= CAN_DATA_SIZE) {
+	    return S_can_badAddress;
+	}
+	separator = *canString++;
+    } else {
+	pcanIo->offset = 0;
+    }
+
+    /* Final parameter is separated by whitespace */
+    if (separator != ' ' &&
+	separator != '\t') {
+	return S_can_badAddress;
+    }
+    pcanIo->parameter = strtol(canString, &pcanIo->paramStr, 0);
+
+    /* Ok, finally look up the bus name */
+    return canOpen(pcanIo->busName, &pcanIo->canBusID);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusAdd
+
+Purpose:
+    Register a new bus for a CAN controller driver
+
+Description:
+    Checks that the bus name is unique across all drivers, then creates
+    a new bus table, initialises it and adds it to the end of the linked
+    list.  The bus name is copied, so drivers may pass a string that
+    iocsh will reuse.  The driver table and pdev pointer are used for all
+    subsequent operations on the bus.  Drivers should call this from their
+    create routine, before iocInit.
+
+Returns:
+    0,
+    S_can_duplicateBus if the name is already in use,
+    S_can_badDevice if the driver table is incomplete,
+    ENOMEM if malloc() fails.
+
+*/
+
+int canBusAdd (
+    const char *pbusName,
+    const canDriver_t *pdriver,
+    void *pdev,
+    canBusID_t *pbusID
+) {
+    struct canBusID_s *pbus, *plist = (struct canBusID_s *) &pbusFirst;
+
+    if (pdriver == NULL ||
+	pdriver->write == NULL ||
+	pdriver->reset == NULL ||
+	pdriver->stop == NULL ||
+	pdriver->restart == NULL) {
+	return S_can_badDevice;
+    }
+
+    while (plist->pnext != NULL) {
+	plist = plist->pnext;
+	if (strcmp(plist->pbusName, pbusName) == 0) {
+	    return S_can_duplicateBus;
+	}
+    }
+    /* plist now points to the last item in the list */
+
+    pbus = calloc(1, sizeof (struct canBusID_s));
+    if (pbus == NULL) {
+	return ENOMEM;
+    }
+
+    pbus->magicNumber = CAN_MAGIC_NUMBER;
+    pbus->pbusName    = epicsStrDup(pbusName);
+    pbus->pdriver     = pdriver;
+    pbus->pdev        = pdev;
+
+    pbus->rxSem   = epicsEventCreate(epicsEventEmpty);
+    pbus->readSem = epicsMutexCreate();
+    pbus->txLock  = epicsMutexCreate();
+    if (pbus->rxSem == NULL ||
+	pbus->readSem == NULL ||
+	pbus->txLock == NULL) {
+	if (pbus->rxSem) epicsEventDestroy(pbus->rxSem);
+	if (pbus->readSem) epicsMutexDestroy(pbus->readSem);
+	if (pbus->txLock) epicsMutexDestroy(pbus->txLock);
+	free(pbus->pbusName);
+	free(pbus);
+	return ENOMEM;
+    }
+
+    plist->pnext = pbus;
+    *pbusID = pbus;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusPrivate
+
+Purpose:
+    Return a driver's device pointer for a bus
+
+Description:
+    Lets driver-specific routines that are given a canBusID_t, such as
+    t810Status, check that the bus belongs to them and find their own
+    device table.
+
+Returns:
+    The pdev pointer given to canBusAdd, or NULL if the bus ID is not
+    valid or belongs to a different driver.
+
+*/
+
+void * canBusPrivate (
+    canBusID_t busID,
+    const canDriver_t *pdriver
+) {
+    if (busID == NULL ||
+	busID->magicNumber != CAN_MAGIC_NUMBER ||
+	busID->pdriver != pdriver) {
+	return NULL;
+    }
+    return busID->pdev;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    doCallbacks
+
+Purpose:
+    calls all routines in the given list
+
+Returns:
+    void
+
+*/
+
+static void doCallbacks (
+    callbackTable_t *phandler,
+    long parameter
+) {
+    while (phandler != NULL) {
+	(*phandler->pcallback)(phandler->pprivate, parameter);
+	phandler = phandler->pnext;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    timeCallback, doMsgCallbacks, canWorkerTask
+
+Purpose:
+    Run the message callbacks for a received frame
+
+Description:
+    doMsgCallbacks calls the inline callbacks in the list directly, and
+    puts a copy of the frame on the worker queue of each deferred one;
+    the queues are preallocated, and if one is full the frame is counted
+    as dropped for that callback.  Each worker task runs the callbacks
+    that were shared out to it in the order their frames arrived, so a
+    callback is never run by two tasks at once.  A deferred callback
+    counts the frames it has queued, and once canMsgDelete has marked
+    it deleted the worker that takes the last of them frees it.
+    timeCallback calls one callback, and if canMsgTiming is on for the
+    bus adds up how long it took for canMsgTimes.
+
+Returns:
+    void
+
+*/
+
+static void timeCallback (
+    callbackTable_t *phandler,
+    const canMessage_t *pmessage,
+    int timed
+) {
+    epicsTimeStamp start, end;
+    double elapsed;
+
+    if (!timed) {
+	(*phandler->pcallback)(phandler->pprivate, (long) pmessage);
+	phandler->calls++;
+	return;
+    }
+
+    epicsTimeGetCurrent(&start);
+    (*phandler->pcallback)(phandler->pprivate, (long) pmessage);
+    epicsTimeGetCurrent(&end);
+
+    elapsed = epicsTimeDiffInSeconds(&end, &start);
+    phandler->calls++;
+    phandler->totalTime += elapsed;
+    if (elapsed > phandler->maxTime) phandler->maxTime = elapsed;
+}
+
+static void doMsgCallbacks (
+    struct canBusID_s *pbus,
+    callbackTable_t *phandler,
+    const canMessage_t *pmessage
+) {
+    deferred_t deferred;
+    int timed = pbus->timed;
+
+    while (phandler != NULL) {
+	if (phandler->worker < 0) {
+	    timeCallback(phandler, pmessage, timed);
+	} else {
+	    deferred.phandler = phandler;
+	    deferred.timed    = timed;
+	    deferred.message  = *pmessage;
+	    /* Count it before the worker can take it */
+	    epicsMutexMustLock(workerLock);
+	    if (epicsMessageQueueTrySend(workerQ[phandler->worker],
+					 &deferred, sizeof (deferred_t))) {
+		phandler->dropped++;
+	    } else {
+		phandler->pending++;
+	    }
+	    epicsMutexUnlock(workerLock);
+	}
+	phandler = phandler->pnext;
+    }
+}
+
+static void canWorkerTask (
+    void *parm
+) {
+    epicsMessageQueueId queue = parm;
+    deferred_t deferred;
+    callbackTable_t *phandler;
+    int release;
+
+    while (TRUE) {
+	epicsMessageQueueReceive(queue, &deferred, sizeof (deferred_t));
+	phandler = deferred.phandler;
+	if (!phandler->deleted) {
+	    timeCallback(phandler, &deferred.message, deferred.timed);
+	}
+	epicsMutexMustLock(workerLock);
+	release = (--phandler->pending == 0 && phandler->deleted);
+	epicsMutexUnlock(workerLock);
+	if (release) {
+	    free(phandler);
+	}
+    }
+}
+
+static void workerInit (
+    void *arg
+) {
+    int i;
+
+    workerLock = epicsMutexCreate();
+    if (workerLock == NULL) {
+	return;
+    }
+    for (i = 0; i < CAN_WORKERS; i++) {
+	workerQ[i] = epicsMessageQueueCreate(CAN_WORKER_FRAMES,
+					     sizeof (deferred_t));
+	if (workerQ[i] == NULL ||
+	    epicsThreadCreate("canWorker", epicsThreadPriorityMedium,
+			      epicsThreadGetStackSize(epicsThreadStackMedium),
+			      canWorkerTask, workerQ[i]) == 0) {
+	    workerQ[i] = NULL;
+	    return;
+	}
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    lookupEntry
+
+Purpose:
+    Find the hash table entry for a message ID
+
+Returns:
+    Pointer to the entry, or NULL if the ID has never had a callback.
+
+*/
+
+static idHandler_t * lookupEntry (
+    struct canBusID_s *pbus,
+    canID_t identifier
+) {
+    idHandler_t *pentry = pbus->pidTable[CAN_HASH(identifier)];
+
+    while (pentry != NULL &&
+	   pentry->identifier != identifier) {
+	pentry = pentry->pnext;
+    }
+    return pentry;
+}
+
+static callbackTable_t * findHandlers (
+    struct canBusID_s *pbus,
+    canID_t identifier
+) {
+    idHandler_t *pentry = lookupEntry(pbus, identifier);
+
+    return pentry ? pentry->phandler : NULL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    findEntry
+
+Purpose:
+    Find or create the hash table entry for a message ID
+
+Returns:
+    Pointer to the entry, or NULL if malloc() fails.
+
+*/
+
+static idHandler_t * findEntry (
+    struct canBusID_s *pbus,
+    canID_t identifier
+) {
+    idHandler_t **pbucket = &pbus->pidTable[CAN_HASH(identifier)];
+    idHandler_t *pentry = lookupEntry(pbus, identifier);
+
+    if (pentry != NULL) {
+	return pentry;
+    }
+
+    pentry = malloc(sizeof (idHandler_t));
+    if (pentry == NULL) {
+	return NULL;
+    }
+    pentry->identifier = identifier;
+    pentry->phandler   = NULL;
+    pentry->count      = 0;
+    pentry->mark       = 0;
+    pentry->pnext      = *pbucket;
+    *pbucket = pentry;		/* Entry is complete before it's visible */
+    return pentry;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    countFrame
+
+Purpose:
+    Account for a frame received or sent
+
+Description:
+    Counts the frame against its identifier and adds the number of bits
+    it occupied on the bus to the running totals.  A frame's length is
+    fixed by its format and DLC apart from the stuff bits the controller
+    inserts after every 5 equal bits from the start of frame to the end
+    of the CRC, so a lower bound (no stuffing) and an upper bound (the
+    worst case of one stuff bit per 4 bits) are both kept; the 3 bit
+    interframe space is included.  The counters are not locked, so a
+    count could occasionally be lost when frames are sent from several
+    threads at once.
+
+Returns:
+    void
+
+*/
+
+static void countFrame (
+    struct canBusID_s *pbus,
+    const canMessage_t *pmessage,
+    idHandler_t *pentry
+) {
+    int data = (pmessage->rtr == RTR) ? 0 : 8 * pmessage->length;
+    int bits, stuffable;
+
+    if (pmessage->identifier & CAN_EXTENDED) {
+	stuffable = 54 + data;		/* SOF to end of CRC */
+	bits      = 67 + data;
+	if (pentry)
+	    pentry->count++;
+	else
+	    pbus->extOther++;
+    } else {
+	stuffable = 34 + data;
+	bits      = 47 + data;
+	pbus->idCount[pmessage->identifier]++;
+    }
+    pbus->frames++;
+    pbus->bitsMin += bits;
+    pbus->bitsMax += bits + (stuffable - 1) / 4;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    routeFrame, routeDone
+
+Purpose:
+    Forward a received message to the canRoute destinations
+
+Description:
+    Every route whose identifier range includes the message queues a
+    copy to each of its destination buses with canWriteAsync, after
+    adding the route's identifier offset and applying its data mask.
+    Copies that can't be queued, or whose new identifier would be out
+    of range or change format, are counted as dropped.  routeDone is
+    the completion routine, which counts failed transmissions.
+
+Returns:
+    void
+
+*/
+
+static void routeDone (
+    void *pprivate,
+    const canMessage_t *pmessage,
+    int status
+) {
+    route_t *proute = pprivate;
+
+    if (status) proute->failed++;
+}
+
+static void routeFrame (
+    struct canBusID_s *pbus,
+    const canMessage_t *pmessage
+) {
+    route_t *proute;
+    canMessage_t message;
+    int i;
+
+    for (proute = pbus->proutes; proute != NULL; proute = proute->pnext) {
+	if (pmessage->identifier < proute->first ||
+	    pmessage->identifier > proute->last) continue;
+
+	message = *pmessage;
+	message.identifier += proute->offset;
+	if (((message.identifier ^ pmessage->identifier) & CAN_EXTENDED) ||
+	    !CAN_ID_VALID(message.identifier)) {
+	    proute->dropped += proute->ndest;
+	    continue;
+	}
+	if (proute->masked) {
+	    for (i = 0; i < CAN_DATA_SIZE; i++)
+		message.data[i] &= proute->mask[i];
+	}
+
+	for (i = 0; i < proute->ndest; i++) {
+	    if (canWriteAsync(proute->pdest[i], &message, CAN_PRIORITY_MEDIUM,
+			      routeDone, proute)) {
+		proute->dropped++;
+	    } else {
+		proute->forwarded++;
+	    }
+	}
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusReceive
+
+Purpose:
+    Dispatch a received message
+
+Description:
+    Called by the controller driver for every message it receives, from
+    its receive task.  Forwards the message along any canRoute routes,
+    runs the callbacks registered for the message ID, and passes the
+    message to canRead if it is waiting for this ID.
+
+Returns:
+    void
+
+*/
+
+void canBusReceive (
+    canBusID_t busID,
+    const canMessage_t *pmessage
+) {
+    struct canBusID_s *pbus = busID;
+    idHandler_t *pentry;
+    callbackTable_t *phandler;
+    canTap_t *ptap = pbus->ptap;
+
+    if (ptap != NULL) {
+	ptap(pbus->ptapPrivate, pmessage, FALSE);
+    }
+
+    /* Gateway routes go first, they only have to queue the message */
+    if (pbus->proutes != NULL) {
+	routeFrame(pbus, pmessage);
+    }
+
+    /* Look up the message ID and do the message callbacks */
+    pentry = lookupEntry(pbus, pmessage->identifier);
+    countFrame(pbus, pmessage, pentry);
+    phandler = pentry ? pentry->phandler : NULL;
+    if (phandler == NULL) {
+	pbus->unusedId = pmessage->identifier;
+	pbus->unusedCount++;
+    } else {
+	doMsgCallbacks(pbus, phandler, pmessage);
+    }
+
+    /* If canRead is waiting for this ID, give it the message and kick it */
+    if (pbus->preadBuffer != NULL &&
+	pbus->preadBuffer->identifier == pmessage->identifier) {
+	memcpy(pbus->preadBuffer, pmessage, sizeof(canMessage_t));
+	pbus->preadBuffer = NULL;
+	epicsEventSignal(pbus->rxSem);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusSignal
+
+Purpose:
+    Report a change of bus status
+
+Description:
+    Called by the controller driver, possibly from interrupt context,
+    to run the canSignal callbacks with a status of CAN_BUS_OK,
+    CAN_BUS_ERROR or CAN_BUS_OFF.
+
+Returns:
+    void
+
+*/
+
+void canBusSignal (
+    canBusID_t busID,
+    int status
+) {
+    doCallbacks(busID->psigHandler, status);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    sameFrame, canBusTxDone
+
+Purpose:
+    Report the end of a transmission
+
+Description:
+    Called by the controller driver, possibly from interrupt context,
+    when a message that its write routine accepted has been sent, with a
+    status of 0, or has failed.  A NULL pmessage with a non-zero status
+    says every message the driver held has been lost, as at bus off.
+    If canTxTask is waiting for this message it is woken with the
+    status; reports for other messages are ignored.
+
+Returns:
+    void
+
+*/
+
+static int sameFrame (
+    const canMessage_t *pa,
+    const canMessage_t *pb
+) {
+    return pa->identifier == pb->identifier &&
+	   pa->rtr == pb->rtr &&
+	   pa->length == pb->length &&
+	   (pa->rtr == RTR || memcmp(pa->data, pb->data, pa->length) == 0);
+}
+
+void canBusTxDone (
+    canBusID_t busID,
+    const canMessage_t *pmessage,
+    int status
+) {
+    struct canBusID_s *pbus = busID;
+    int done = FALSE;
+    int key = epicsInterruptLock();
+
+    if (pbus->ptxAwait != NULL && !pbus->txAwaitDone &&
+	(pmessage == NULL ? status != 0 : sameFrame(pbus->ptxAwait, pmessage))) {
+	pbus->txAwaitDone   = TRUE;
+	pbus->txAwaitStatus = status;
+	done = TRUE;
+    }
+    epicsInterruptUnlock(key);
+
+    if (done) {
+	epicsEventSignal(pbus->txDoneSem);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusShow
+
+Purpose:
+    Print the driver-independent status of one bus
+
+Description:
+    Controller driver report routines call this to add the callback and
+    canRead information to their own output.  Interest level 1 prints
+    the discarded message count, level 2 the registered callbacks.
+
+Returns:
+    void
+
+*/
+
+void canBusShow (
+    canBusID_t busID,
+    int interest
+) {
+    struct canBusID_s *pbus = busID;
+    idHandler_t *pentry;
+    route_t *proute;
+    int bucket, printed;
+
+    switch (interest) {
+	case 1:
+	    printf("\tDiscarded Messages  : %5d\n", pbus->unusedCount);
+	    if (pbus->unusedCount > 0) {
+		printf("\tLast Discarded ID   : %#5x\n", pbus->unusedId);
+	    }
+	    if (pbus->loadTimer != NULL) {
+		canBusLoad_t load;
+
+		canBusLoad(pbus, &load);
+		printf("\tFrames / sec        : %5.0f\n", load.frameRate);
+		if (load.loadMax >= 0)
+		    printf("\tBus Load            : %.1f - %.1f%%\n",
+			   load.loadMin, load.loadMax);
+	    }
+	    if (pbus->scheduled) {
+		static const char * const bandName[CAN_PRIORITIES] = {
+		    "LOW", "MEDIUM", "HIGH"
+		};
+		int band;
+
+		for (band = CAN_PRIORITY_HIGH; band >= CAN_PRIORITY_LOW; band--) {
+		    txBand_t *pband = &pbus->txBand[band];
+
+		    if (pband->count == 0) continue;
+		    printf("\tTx %-6s Priority  : %5u sent, %u queued",
+			   bandName[band], pband->count, pband->queued);
+		    if (pband->queued)
+			printf(", delay mean %.2f max %.2f ms",
+			       1000 * pband->totalDelay / pband->queued,
+			       1000 * pband->maxDelay);
+		    printf("\n");
+		}
+	    }
+	    if (pbus->asyncQueued || pbus->asyncFailed || pbus->asyncFull) {
+		printf("\tAsync Tx            : %5u to controller, %u failed, %u queue full, %u lost\n",
+		       pbus->asyncQueued, pbus->asyncFailed, pbus->asyncFull,
+		       pbus->asyncLost);
+	    }
+	    for (proute = pbus->proutes; proute != NULL; proute = proute->pnext) {
+		int i;
+
+		printf("\tRoute %#x", proute->first & ~CAN_EXTENDED);
+		if (proute->last != proute->first)
+		    printf("-%#x", proute->last & ~CAN_EXTENDED);
+		if (proute->first & CAN_EXTENDED)
+		    printf(" ext");
+		if (proute->offset)
+		    printf(" %+d", proute->offset);
+		printf(" to");
+		for (i = 0; i < proute->ndest; i++)
+		    printf(" %s", proute->pdest[i]->pbusName);
+		printf(": %u forwarded, %u dropped, %u failed\n",
+		       proute->forwarded, proute->dropped, proute->failed);
+	    }
+	    break;
+
+	case 2:
+	    printed = 0;
+	    printf("\tCallbacks registered: ");
+	    for (bucket=0; bucket < CAN_HASH_SIZE; bucket++) {
+		for (pentry = pbus->pidTable[bucket]; pentry != NULL;
+		     pentry = pentry->pnext) {
+		    if (pentry->phandler == NULL) continue;
+		    if (printed % 8 == 0) {
+			printf("\n\t    ");
+		    }
+		    /* Extended IDs always show all 8 digits */
+		    if (pentry->identifier & CAN_EXTENDED) {
+			printf("0x%08x  ", pentry->identifier & ~CAN_EXTENDED);
+		    } else {
+			printf("0x%-3x       ", pentry->identifier);
+		    }
+		    printed++;
+		}
+	    }
+	    if (printed == 0) {
+		printf("None.");
+	    }
+	    printf("\n\tcanRead Status : %s\n",
+		    pbus->preadBuffer ? "Active" : "Idle");
+	    break;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canReport
+
+Purpose:
+    Report on all CAN buses
+
+Description:
+    Prints a list of all the registered buses and the driver each one
+    uses, followed for interest > 0 by the canBusShow information.
+
+Returns:
+    0, or
+    S_can_badDevice if the bus list is corrupt.
+
+Example:
+    canReport 2
+
+*/
+
+int canReport (
+    int interest
+) {
+    struct canBusID_s *pbus = pbusFirst;
+
+    while (pbus != NULL) {
+	if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	    printf("CAN bus list is corrupt\n");
+	    return S_can_badDevice;
+	}
+	printf("  '%s' : %s\n", pbus->pbusName, pbus->pdriver->driverName);
+	canBusShow(pbus, interest);
+	pbus = pbus->pnext;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusBitRate
+
+Purpose:
+    Set the bit rate of a bus
+
+Description:
+    Drivers call this with their configured bus rate so the bus load
+    can be given as a percentage; it is also an iocsh command for buses
+    whose driver can't know the rate.
+
+Returns:
+    0, or S_can_badDevice for an invalid bus ID.
+
+*/
+
+int canBusBitRate (
+    canBusID_t busID,
+    int bitRate
+) {
+    struct canBusID_s *pbus = busID;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    pbus->bitRate = bitRate > 0 ? bitRate : 0;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    loadSample
+
+Purpose:
+    Record the bus totals for the load window
+
+Description:
+    Timer routine, runs every CAN_LOAD_PERIOD seconds once canBusLoad
+    has been called for the bus.
+
+Returns:
+    void
+
+*/
+
+static void loadSample (
+    void *pprivate
+) {
+    struct canBusID_s *pbus = pprivate;
+    loadSample_t *psample = &pbus->sample[pbus->sampleNext];
+
+    epicsTimeGetCurrent(&psample->time);
+    psample->frames  = pbus->frames;
+    psample->bitsMin = pbus->bitsMin;
+    psample->bitsMax = pbus->bitsMax;
+
+    if (++pbus->sampleNext == CAN_LOAD_SAMPLES) pbus->sampleNext = 0;
+    if (pbus->samples < CAN_LOAD_SAMPLES) pbus->samples++;
+
+    epicsTimerStartDelay(pbus->loadTimer, CAN_LOAD_PERIOD);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusLoad
+
+Purpose:
+    Get the recent traffic rates on a bus
+
+Description:
+    Returns the frame rate, bit rate and load averaged over a window of
+    the last 10 seconds, which slides along once a second.  The first
+    call for a bus starts the sampling, so until the window has filled
+    the figures cover a shorter time, and they are all zero for the
+    first second.  The bit rate and load are given as a lower and an
+    upper bound because the number of stuff bits is unknown.  The loads
+    are in percent of the bus bit rate, or -1 if that is not known.
+
+Returns:
+    0,
+    S_can_badDevice for an invalid bus ID,
+    ENOMEM if the sampling timer could not be created.
+
+*/
+
+int canBusLoad (
+    canBusID_t busID,
+    canBusLoad_t *pload
+) {
+    struct canBusID_s *pbus = busID;
+    loadSample_t *pfirst, *plast;
+    double seconds;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    memset(pload, 0, sizeof (canBusLoad_t));
+    pload->loadMin = pload->loadMax = pbus->bitRate ? 0 : -1;
+
+    if (pbus->loadTimer == NULL) {
+	if (canTimerQ == NULL)
+	    canTimerQ = epicsTimerQueueAllocate(1, epicsThreadPriorityLow);
+	if (canTimerQ == NULL) return ENOMEM;
+
+	pbus->loadTimer = epicsTimerQueueCreateTimer(canTimerQ,
+						     loadSample, pbus);
+	if (pbus->loadTimer == NULL) return ENOMEM;
+	loadSample(pbus);
+	return 0;
+    }
+
+    if (pbus->samples < 2) return 0;
+
+    /* Take a consistent pair of samples; the timer may fire meanwhile */
+    plast  = &pbus->sample[(pbus->sampleNext + CAN_LOAD_SAMPLES - 1) %
+			   CAN_LOAD_SAMPLES];
+    pfirst = &pbus->sample[(pbus->sampleNext + CAN_LOAD_SAMPLES -
+			    pbus->samples) % CAN_LOAD_SAMPLES];
+    seconds = epicsTimeDiffInSeconds(&plast->time, &pfirst->time);
+    if (seconds <= 0) return 0;
+
+    pload->frameRate  = (plast->frames - pfirst->frames) / seconds;
+    pload->bitRateMin = (plast->bitsMin - pfirst->bitsMin) / seconds;
+    pload->bitRateMax = (plast->bitsMax - pfirst->bitsMax) / seconds;
+    if (pbus->bitRate) {
+	pload->loadMin = 100.0 * pload->bitRateMin / pbus->bitRate;
+	pload->loadMax = 100.0 * pload->bitRateMax / pbus->bitRate;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    topAdd
+
+Purpose:
+    Insert an identifier into the canTop table
+
+Description:
+    The table holds n entries, busiest first, and may grow to max.  An
+    identifier which is quieter than all of a full table is ignored.
+
+Returns:
+    The new number of entries.
+
+*/
+
+static int topAdd (
+    topEntry_t *ptop,
+    int n,
+    int max,
+    canID_t identifier,
+    epicsUInt32 frames
+) {
+    int i;
+
+    if (frames == 0 ||
+	(n == max && frames <= ptop[n-1].frames)) {
+	return n;
+    }
+
+    i = (n < max) ? n++ : n - 1;
+    while (i > 0 && ptop[i-1].frames < frames) {
+	ptop[i] = ptop[i-1];
+	i--;
+    }
+    ptop[i].identifier = identifier;
+    ptop[i].frames     = frames;
+    return n;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canTop
+
+Purpose:
+    Show which identifiers use the most bus time
+
+Description:
+    Notes the per-identifier counters, waits for the given number of
+    seconds and then lists the busiest identifiers on the bus over that
+    time, in both directions, with their frame rates and the bus load.
+    Extended identifiers are only counted individually if a callback
+    has ever been registered for them; the rest are shown together.
+
+Returns:
+    0,
+    S_can_noDevice if the bus does not exist,
+    ENOMEM if memory allocation fails.
+
+Example:
+    canTop "CAN1", 10, 5
+
+*/
+
+int canTop (
+    const char *pbusName,
+    int count,
+    double seconds
+) {
+    struct canBusID_s *pbus;
+    topEntry_t top[CAN_TOP_MAX];
+    epicsUInt32 *pstart, frames, bitsMin, bitsMax, extOther;
+    epicsTimeStamp t0, t1;
+    idHandler_t *pentry;
+    int i, bucket, n = 0, status;
+
+    if (pbusName == NULL) {
+	printf("Usage: canTop \"busName\", count, seconds\n");
+	return S_can_noDevice;
+    }
+    status = canOpen(pbusName, &pbus);
+    if (status) return status;
+
+    if (count <= 0) count = 10;
+    if (count > CAN_TOP_MAX) count = CAN_TOP_MAX;
+    if (seconds <= 0) seconds = 5.0;
+
+    pstart = malloc(sizeof (pbus->idCount));
+    if (pstart == NULL) return ENOMEM;
+
+    for (bucket = 0; bucket < CAN_HASH_SIZE; bucket++)
+	for (pentry = pbus->pidTable[bucket]; pentry; pentry = pentry->pnext)
+	    pentry->mark = pentry->count;
+    memcpy(pstart, pbus->idCount, sizeof (pbus->idCount));
+    frames   = pbus->frames;
+    bitsMin  = pbus->bitsMin;
+    bitsMax  = pbus->bitsMax;
+    extOther = pbus->extOther;
+    epicsTimeGetCurrent(&t0);
+
+    epicsThreadSleep(seconds);
+
+    epicsTimeGetCurrent(&t1);
+    frames   = pbus->frames - frames;
+    bitsMin  = pbus->bitsMin - bitsMin;
+    bitsMax  = pbus->bitsMax - bitsMax;
+    extOther = pbus->extOther - extOther;
+    seconds  = epicsTimeDiffInSeconds(&t1, &t0);
+
+    for (i = 0; i < CAN_IDENTIFIERS; i++) {
+	n = topAdd(top, n, count, i, pbus->idCount[i] - pstart[i]);
+    }
+    for (bucket = 0; bucket < CAN_HASH_SIZE; bucket++)
+	for (pentry = pbus->pidTable[bucket]; pentry; pentry = pentry->pnext)
+	    if (pentry->identifier & CAN_EXTENDED)
+		n = topAdd(top, n, count, pentry->identifier,
+			   pentry->count - pentry->mark);
+    free(pstart);
+
+    printf("'%s' over %.1f sec: %.0f frames/sec, %.0f - %.0f bits/sec",
+	   pbus->pbusName, seconds, frames / seconds,
+	   bitsMin / seconds, bitsMax / seconds);
+    if (pbus->bitRate) {
+	printf(", %.1f - %.1f%% of %d Kbits/sec",
+	       100.0 * bitsMin / seconds / pbus->bitRate,
+	       100.0 * bitsMax / seconds / pbus->bitRate,
+	       pbus->bitRate / 1000);
+    }
+    printf("\n\t  Identifier   Frames/sec   Share\n");
+    for (i = 0; i < n; i++) {
+	if (top[i].identifier & CAN_EXTENDED)
+	    printf("\t  0x%08x", top[i].identifier & ~CAN_EXTENDED);
+	else
+	    printf("\t  0x%-3x     ", top[i].identifier);
+	printf("  %10.1f   %4.1f%%\n", top[i].frames / seconds,
+	       100.0 * top[i].frames / frames);
+    }
+    if (extOther) {
+	printf("\t  other ext.  %10.1f   %4.1f%%\n", extOther / seconds,
+	       100.0 * extOther / frames);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canMsgTimes
+
+Purpose:
+    Show which message callbacks take the most time
+
+Description:
+    Lists the canMessage callbacks on a bus that have spent the longest
+    in total running since canMsgTiming turned timing on or the bus was
+    last reset, with their execution class, the number of calls, the
+    mean and longest time per call and the number of frames dropped
+    because a deferred callback's worker queue was full.  Calls and
+    drops are counted even when timing is off.  Callbacks are shown
+    by routine address and private pointer, which can be looked up in
+    the symbol table or the device support's report.  Inline callbacks
+    hold up every message on the bus while they run, so any with long
+    times should be made deferred or made quicker.  Without timing the
+    callbacks are listed by number of calls instead.
+
+Returns:
+    0,
+    S_can_noDevice if the bus does not exist.
+
+Example:
+    canMsgTimes "CAN1", 10
+
+*/
+
+static double msgCost (
+    struct canBusID_s *pbus,
+    callbackTable_t *phandler
+) {
+    return pbus->timed ? phandler->totalTime : (double) phandler->calls;
+}
+
+int canMsgTimes (
+    const char *pbusName,
+    int count
+) {
+    struct canBusID_s *pbus;
+    struct {
+	canID_t identifier;
+	callbackTable_t *phandler;
+    } top[CAN_TOP_MAX];
+    idHandler_t *pentry;
+    callbackTable_t *phandler;
+    int i, bucket, n = 0, status;
+
+    if (pbusName == NULL) {
+	printf("Usage: canMsgTimes \"busName\", count\n");
+	return S_can_noDevice;
+    }
+    status = canOpen(pbusName, &pbus);
+    if (status) return status;
+
+    if (count <= 0) count = 10;
+    if (count > CAN_TOP_MAX) count = CAN_TOP_MAX;
+
+    /* Insertion sort by total time, keeping the top count */
+    for (bucket = 0; bucket < CAN_HASH_SIZE; bucket++) {
+	for (pentry = pbus->pidTable[bucket]; pentry; pentry = pentry->pnext) {
+	    for (phandler = pentry->phandler; phandler;
+		 phandler = phandler->pnext) {
+		if (phandler->calls == 0 && phandler->dropped == 0) continue;
+		if (n == count &&
+		    msgCost(pbus, phandler) <= msgCost(pbus, top[n-1].phandler))
+		    continue;
+		i = (n < count) ? n++ : n - 1;
+		while (i > 0 &&
+		       msgCost(pbus, top[i-1].phandler) < msgCost(pbus, phandler)) {
+		    top[i] = top[i-1];
+		    i--;
+		}
+		top[i].identifier = pentry->identifier;
+		top[i].phandler   = phandler;
+	    }
+	}
+    }
+
+    printf("'%s' message callbacks by total %s:\n", pbus->pbusName,
+	   pbus->timed ? "time" : "calls");
+    if (!pbus->timed) {
+	printf("\tTiming is off, use canMsgTiming \"%s\", 1\n",
+	       pbus->pbusName);
+    }
+    if (n == 0) {
+	printf("\tNone called.\n");
+	return 0;
+    }
+    printf("\t  Identifier  Class       Calls   Mean us    Max us  Dropped"
+	   "  Routine / Private\n");
+    for (i = 0; i < n; i++) {
+	phandler = top[i].phandler;
+	if (top[i].identifier & CAN_EXTENDED)
+	    printf("\t  0x%08x", top[i].identifier & ~CAN_EXTENDED);
+	else
+	    printf("\t  0x%-3x     ", top[i].identifier);
+	printf("  %-8s %8u  %8.1f  %8.1f  %7u  %p / %p\n",
+	       phandler->worker < 0 ? "inline" : "deferred",
+	       phandler->calls,
+	       phandler->calls ? 1e6 * phandler->totalTime / phandler->calls : 0.0,
+	       1e6 * phandler->maxTime, phandler->dropped,
+	       (void *) phandler->pcallback, phandler->pprivate);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canMsgTiming, clearMsgTimes
+
+Purpose:
+    Turn timing of a bus's message callbacks on or off
+
+Description:
+    Reading the clock before and after each callback costs more than
+    many callbacks take, so it is only done for buses where it has
+    been asked for.  Turning timing on or off clears the figures shown
+    by canMsgTimes, as does canBusReset through clearMsgTimes.  Deferred
+    callbacks are timed if timing was on when their frame arrived.
+
+Returns:
+    0, or S_can_noDevice if the bus does not exist.
+
+Example:
+    canMsgTiming "CAN1", 1
+
+*/
+
+static void clearMsgTimes (
+    struct canBusID_s *pbus
+) {
+    idHandler_t *pentry;
+    callbackTable_t *phandler;
+    int bucket;
+
+    for (bucket = 0; bucket < CAN_HASH_SIZE; bucket++) {
+	for (pentry = pbus->pidTable[bucket]; pentry; pentry = pentry->pnext) {
+	    for (phandler = pentry->phandler; phandler;
+		 phandler = phandler->pnext) {
+		phandler->calls     = 0;
+		phandler->dropped   = 0;
+		phandler->totalTime = 0;
+		phandler->maxTime   = 0;
+	    }
+	}
+    }
+}
+
+int canMsgTiming (
+    const char *pbusName,
+    int enable
+) {
+    canBusID_t busID;
+    int status;
+
+    if (pbusName == NULL) return S_can_noDevice;
+    status = canOpen(pbusName, &busID);
+    if (status) return status;
+
+    busID->timed = enable;
+    clearMsgTimes(busID);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canOpen
+
+Purpose:
+    Return bus pointer for given CAN bus name
+
+Description:
+    Searches through the linked list of registered buses for one which
+    matches the name given, and returns the associated bus pointer.
+
+Returns:
+    0, or S_can_noDevice if no match found.
+
+Example:
+    void *can1;
+    status = canOpen("CAN1", &can1);
+
+*/
+
+int canOpen (
+    const char *pbusName,
+    canBusID_t *pbusID
+) {
+    struct canBusID_s *pbus = pbusFirst;
+
+    while (pbus != NULL) {
+	if (strcmp(pbus->pbusName, pbusName) == 0) {
+	    *pbusID = pbus;
+	    return 0;
+	}
+	pbus = pbus->pnext;
+    }
+    return S_can_noDevice;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusReset, canBusStop, canBusRestart
+
+Purpose:
+    Control I/O on named CANbus
+
+Description:
+    Passes the request to the bus's controller driver.  canBusReset
+    also clears the discarded message count.
+
+Returns:
+    0, S_can_noDevice if no match found, or the driver's status.
+
+Example:
+    status = canBusReset("CAN1");
+
+*/
+
+int canBusReset (
+    const char *pbusName
+) {
+    canBusID_t busID;
+    route_t *proute;
+    int status = canOpen(pbusName, &busID);
+
+    if (status) return status;
+
+    busID->unusedCount = 0;
+    busID->asyncQueued = 0;
+    busID->asyncFailed = 0;
+    busID->asyncFull   = 0;
+    busID->asyncLost   = 0;
+    for (proute = busID->proutes; proute != NULL; proute = proute->pnext) {
+	proute->forwarded = 0;
+	proute->dropped   = 0;
+	proute->failed    = 0;
+    }
+    clearMsgTimes(busID);
+    epicsMutexMustLock(busID->txLock);
+    memset(busID->txBand, 0, sizeof (busID->txBand));
+    epicsMutexUnlock(busID->txLock);
+    return busID->pdriver->reset(busID->pdev);
+}
+
+int canBusStop (
+    const char *pbusName
+) {
+    canBusID_t busID;
+    int status = canOpen(pbusName, &busID);
+
+    if (status) return status;
+
+    return busID->pdriver->stop(busID->pdev);
+}
+
+int canBusRestart (
+    const char *pbusName
+) {
+    canBusID_t busID;
+    int status = canOpen(pbusName, &busID);
+
+    if (status) return status;
+
+    return busID->pdriver->restart(busID->pdev);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    arbitrationKey
+
+Purpose:
+    Sort key for a message identifier
+
+Description:
+    Returns a 30-bit number which orders identifiers the way CAN bus
+    arbitration does: by the 11-bit base identifier, then a standard
+    frame before an extended frame with the same base, then by the rest
+    of the extended identifier.
+
+Returns:
+    Key, lower values are more urgent.
+
+*/
+
+static epicsUInt32 arbitrationKey (
+    canID_t identifier
+) {
+    if (identifier & CAN_EXTENDED) {
+	identifier &= ~CAN_EXTENDED;
+	return ((identifier >> 18) << 19) | (1 << 18) |
+	       (identifier & 0x3ffff);
+    }
+    return identifier << 19;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    txAcquire, txRelease
+
+Purpose:
+    Hand the transmitter to the most urgent writer
+
+Description:
+    With the scheduler enabled only one canWrite caller at a time calls
+    the driver.  txAcquire takes the transmitter at once if it is free
+    and nobody is waiting, otherwise it adds the caller to the pending
+    list in priority order and waits.  txRelease passes the transmitter
+    straight on to the first writer in the list, so the controller is
+    always given the most urgent frame that is waiting.  Writers with
+    equal keys are served in the order they arrived.  A negative timeout
+    waits for as long as it takes.
+
+Returns:
+    txAcquire returns 0 and the seconds spent waiting, S_can_timeout,
+    or ENOMEM if a list entry could not be allocated.
+
+*/
+
+static int txAcquire (
+    struct canBusID_s *pbus,
+    epicsUInt32 key,
+    double timeout,
+    double *pdelay
+) {
+    txRequest_t *preq, **pprev;
+    epicsTimeStamp start, now;
+    int granted;
+
+    *pdelay = 0;
+    epicsMutexMustLock(pbus->txLock);
+    if (!pbus->txBusy && pbus->ptxPending == NULL) {
+	pbus->txBusy = TRUE;
+	epicsMutexUnlock(pbus->txLock);
+	return 0;
+    }
+
+    preq = pbus->ptxFree;
+    if (preq != NULL) {
+	pbus->ptxFree = preq->pnext;
+    } else {
+	preq = malloc(sizeof (txRequest_t));
+	if (preq == NULL ||
+	    (preq->wakeup = epicsEventCreate(epicsEventEmpty)) == NULL) {
+	    epicsMutexUnlock(pbus->txLock);
+	    free(preq);
+	    return ENOMEM;
+	}
+    }
+    preq->key     = key;
+    preq->granted = FALSE;
+
+    pprev = &pbus->ptxPending;
+    while (*pprev != NULL && (*pprev)->key <= key) {
+	pprev = &(*pprev)->pnext;
+    }
+    preq->pnext = *pprev;
+    *pprev = preq;
+    epicsMutexUnlock(pbus->txLock);
+
+    epicsTimeGetCurrent(&start);
+    if (timeout < 0) {
+	epicsEventMustWait(preq->wakeup);
+    } else {
+	epicsEventWaitWithTimeout(preq->wakeup, timeout);
+    }
+    epicsTimeGetCurrent(&now);
+    *pdelay = epicsTimeDiffInSeconds(&now, &start);
+
+    epicsMutexMustLock(pbus->txLock);
+    granted = preq->granted;
+    if (!granted) {
+	/* Timed out, take it out of the pending list */
+	for (pprev = &pbus->ptxPending; *pprev != preq;
+	     pprev = &(*pprev)->pnext);
+	*pprev = preq->pnext;
+    } else {
+	/* Granted, maybe just after the timeout */
+	epicsEventTryWait(preq->wakeup);
+    }
+    preq->pnext   = pbus->ptxFree;
+    pbus->ptxFree = preq;
+    epicsMutexUnlock(pbus->txLock);
+
+    return granted ? 0 : S_can_timeout;
+}
+
+static void txRelease (
+    struct canBusID_s *pbus
+) {
+    txRequest_t *preq;
+
+    epicsMutexMustLock(pbus->txLock);
+    preq = pbus->ptxPending;
+    if (preq != NULL) {
+	pbus->ptxPending = preq->pnext;
+	preq->granted = TRUE;		/* txBusy stays set for it */
+	epicsEventSignal(preq->wakeup);
+    } else {
+	pbus->txBusy = FALSE;
+    }
+    epicsMutexUnlock(pbus->txLock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusScheduler
+
+Purpose:
+    Turn priority ordering of canWrite calls on or off
+
+Description:
+    Without the scheduler canWrite callers reach the controller in
+    whatever order they happen to get its transmit buffer.  With it they
+    are queued, and each time the controller can take another frame it
+    is given the most urgent one.  Frames are ordered by their priority
+    (the PRIO field of the record that sent it, or LOW for canWrite),
+    then by identifier as bus arbitration would.  The time each frame
+    spends waiting is recorded by priority and shown by canReport.
+
+Returns:
+    0, or S_can_noDevice if the bus does not exist.
+
+Example:
+    canBusScheduler "CAN1", 1
+
+*/
+
+int canBusScheduler (
+    const char *pbusName,
+    int enable
+) {
+    canBusID_t busID;
+    int status;
+
+    if (pbusName == NULL) return S_can_noDevice;
+    status = canOpen(pbusName, &busID);
+    if (status) return status;
+
+    epicsMutexMustLock(busID->txLock);
+    busID->scheduled = enable;
+    memset(busID->txBand, 0, sizeof (busID->txBand));
+    epicsMutexUnlock(busID->txLock);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canWrite
+
+Purpose:
+    writes a CAN message to the bus
+
+Description:
+    Checks the message and passes it to the bus's controller driver.
+    The timeout value allows task recovery in the event that the
+    transmitter is not available within the given number of seconds.
+    canWritePriority gives the priority used if the bus has the
+    transmit scheduler enabled; canWrite uses CAN_PRIORITY_LOW.  Time
+    spent waiting for the scheduler counts against the timeout, and the
+    driver gets what is left of it.
+
+Returns:
+    0,
+    S_can_badMessage for bad identifier, message length or rtr value,
+    S_can_badDevice for bad bus pointer,
+    S_can_timeout if the scheduler used up the timeout,
+    ENOMEM if the scheduler runs out of memory,
+    or an error from the controller driver, usually a timeout.
+
+*/
+
+int canWrite (
+    canBusID_t busID,
+    const canMessage_t *pmessage,
+    double timeout
+) {
+    return canWritePriority(busID, pmessage, CAN_PRIORITY_LOW, timeout);
+}
+
+int canWritePriority (
+    canBusID_t busID,
+    const canMessage_t *pmessage,
+    int priority,
+    double timeout
+) {
+    struct canBusID_s *pbus = busID;
+    canTap_t *ptap;
+    int status;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    if (!CAN_ID_VALID(pmessage->identifier) ||
+	pmessage->length > CAN_DATA_SIZE ||
+	(pmessage->rtr != SEND && pmessage->rtr != RTR)) {
+	return S_can_badMessage;
+    }
+
+    if (pbus->scheduled) {
+	txBand_t *pband;
+	double delay;
+
+	if (priority < CAN_PRIORITY_LOW) priority = CAN_PRIORITY_LOW;
+	if (priority > CAN_PRIORITY_HIGH) priority = CAN_PRIORITY_HIGH;
+
+	status = txAcquire(pbus,
+			   ((epicsUInt32) (CAN_PRIORITY_HIGH - priority) << 30) |
+			   arbitrationKey(pmessage->identifier),
+			   timeout, &delay);
+	if (status) return status;
+
+	/* A negative timeout waits forever, zero means don't wait */
+	if (timeout > 0 && delay > 0) {
+	    timeout -= delay;
+	    if (timeout <= 0) {
+		txRelease(pbus);
+		return S_can_timeout;
+	    }
+	}
+
+	pband = &pbus->txBand[priority];
+	pband->count++;
+	if (delay > 0) {
+	    pband->queued++;
+	    pband->totalDelay += delay;
+	    if (delay > pband->maxDelay) pband->maxDelay = delay;
+	}
+
+	status = pbus->pdriver->write(pbus->pdev, pmessage, timeout);
+	txRelease(pbus);
+    } else {
+	status = pbus->pdriver->write(pbus->pdev, pmessage, timeout);
+    }
+    if (status) return status;
+
+    countFrame(pbus, pmessage, (pmessage->identifier & CAN_EXTENDED) ?
+	       lookupEntry(pbus, pmessage->identifier) : NULL);
+
+    ptap = pbus->ptap;
+    if (ptap != NULL) {
+	ptap(pbus->ptapPrivate, pmessage, TRUE);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canWriteAsyncStart
+
+Purpose:
+    Create a bus's canWriteAsync queue and canTxTask
+
+Description:
+    Buses only get the queue and task once they need them, so this is
+    called by the first canWriteAsync on a bus and by canRoute for its
+    destination buses.  Code that will call canWriteAsync at interrupt
+    level, such as a canMessage callback on a bus whose driver calls
+    them from its ISR, must call this first from task context.  Calling
+    it again does nothing.  canTxTask picks up the queue under txLock,
+    so it can't run before the queue is published.
+
+Returns:
+    0,
+    S_can_badDevice for bad bus pointer,
+    ENOMEM if the queue or the task can't be created.
+
+*/
+
+static void canTxTask(void *parm);
+
+int canWriteAsyncStart (
+    canBusID_t busID
+) {
+    struct canBusID_s *pbus = busID;
+    epicsMessageQueueId queue;
+    int status = 0;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    epicsMutexMustLock(pbus->txLock);
+    if (pbus->txDoneSem == NULL) {
+	pbus->txDoneSem = epicsEventCreate(epicsEventEmpty);
+    }
+    if (pbus->txQueue == NULL) {
+	queue = epicsMessageQueueCreate(CAN_TX_QUEUE, sizeof (txAsync_t));
+	if (queue == NULL || pbus->txDoneSem == NULL) {
+	    status = ENOMEM;
+	} else if (epicsThreadCreate("canTxTask", epicsThreadPriorityHigh,
+			epicsThreadGetStackSize(epicsThreadStackSmall),
+			canTxTask, pbus) == 0) {
+	    status = ENOMEM;
+	} else {
+	    pbus->txQueue = queue;
+	}
+	if (status && queue != NULL) {
+	    epicsMessageQueueDestroy(queue);
+	}
+    }
+    epicsMutexUnlock(pbus->txLock);
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canWriteAsync
+
+Purpose:
+    Queue a CAN message for transmission without waiting
+
+Description:
+    Checks the message and puts a copy of it on the bus's transmit
+    queue, then returns at once.  It never blocks, so it may be called
+    from a canMessage callback or from interrupt context, for example
+    to answer a request as soon as it arrives.  The queue and the bus's
+    canTxTask are created by canWriteAsyncStart, which the first call
+    runs if need be; that fails at interrupt level.  canTxTask sends
+    queued messages in order through canWritePriority, so the priority
+    takes effect when the transmit scheduler is enabled.  If pqueued is
+    not NULL it is called from canTxTask once the message has been sent
+    on the bus, with pprivate, the message and a status of 0, or once
+    it has failed, with the canWritePriority error, S_can_txFailed if
+    the controller aborted it or went bus off, or S_can_timeout if the
+    driver didn't report it within CAN_TX_TIMEOUT.  canTxTask waits for
+    such a message to complete before it takes the next one from the
+    queue.  The routine canWriteQueuedEvent may be given as pqueued with
+    an epicsEventId as pprivate to have that event signalled.
+
+Returns:
+    0 if the message was queued,
+    S_can_queueFull if the transmit queue has no room for it,
+    S_can_noTxTask if called at interrupt level before canWriteAsyncStart,
+    ENOMEM if the queue or canTxTask can't be created,
+    S_can_badMessage for bad identifier, message length or rtr value,
+    S_can_badDevice for bad bus pointer.
+
+*/
+
+int canWriteAsync (
+    canBusID_t busID,
+    const canMessage_t *pmessage,
+    int priority,
+    canWriteQueued_t *pqueued,
+    void *pprivate
+) {
+    struct canBusID_s *pbus = busID;
+    txAsync_t async;
+    int status;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    if (!CAN_ID_VALID(pmessage->identifier) ||
+	pmessage->length > CAN_DATA_SIZE ||
+	(pmessage->rtr != SEND && pmessage->rtr != RTR)) {
+	return S_can_badMessage;
+    }
+
+    if (pbus->txQueue == NULL) {
+	if (epicsInterruptIsInterruptContext()) {
+	    return S_can_noTxTask;
+	}
+	status = canWriteAsyncStart(pbus);
+	if (status) return status;
+    }
+
+    async.message  = *pmessage;
+    async.priority = priority;
+    async.pqueued  = pqueued;
+    async.pprivate = pprivate;
+
+    if (epicsMessageQueueTrySend(pbus->txQueue, &async, sizeof (txAsync_t))) {
+	pbus->asyncFull++;
+	return S_can_queueFull;
+    }
+    return 0;
+}
+
+void canWriteQueuedEvent (
+    void *pevent,
+    const canMessage_t *pmessage,
+    int status
+) {
+    epicsEventSignal((epicsEventId) pevent);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    txAwait, txWait, canTxTask
+
+Purpose:
+    Send the messages queued by canWriteAsync
+
+Description:
+    A canTxTask runs for each bus that has used canWriteAsync.  It
+    waits for messages on the bus's transmit queue and passes them to
+    the driver with canWritePriority, and counts the result.  If the
+    message has a pqueued callback txWait waits for the driver's
+    canBusTxDone report of the message, then the callback is run.
+    txAwait makes the message the awaited one before the write, as the
+    report may come from an interrupt before the driver's write returns.
+
+Returns:
+    Never.
+
+*/
+
+static void txAwait (
+    struct canBusID_s *pbus,
+    const canMessage_t *pmessage
+) {
+    int key = epicsInterruptLock();
+
+    pbus->ptxAwait    = pmessage;
+    pbus->txAwaitDone = FALSE;
+    epicsInterruptUnlock(key);
+}
+
+static int txWait (
+    struct canBusID_s *pbus
+) {
+    int key, done, status;
+    int timedOut = FALSE;
+
+    while (TRUE) {
+	key    = epicsInterruptLock();
+	done   = pbus->txAwaitDone;
+	status = done ? pbus->txAwaitStatus : S_can_timeout;
+	if (done || timedOut) {
+	    pbus->ptxAwait = NULL;
+	}
+	epicsInterruptUnlock(key);
+	if (done || timedOut) {
+	    return status;
+	}
+	timedOut = epicsEventWaitWithTimeout(pbus->txDoneSem,
+			CAN_TX_TIMEOUT) != epicsEventWaitOK;
+    }
+}
+
+static void canTxTask (
+    void *parm
+) {
+    struct canBusID_s *pbus = parm;
+    epicsMessageQueueId queue;
+    txAsync_t async;
+    int status;
+
+    epicsMutexMustLock(pbus->txLock);	/* Wait for canWriteAsyncStart */
+    queue = pbus->txQueue;
+    epicsMutexUnlock(pbus->txLock);
+
+    while (TRUE) {
+	epicsMessageQueueReceive(queue, &async, sizeof (txAsync_t));
+
+	if (async.pqueued != NULL) {
+	    txAwait(pbus, &async.message);
+	}
+	status = canWritePriority(pbus, &async.message, async.priority,
+				  CAN_TX_TIMEOUT);
+	if (status) {
+	    pbus->asyncFailed++;
+	} else {
+	    pbus->asyncQueued++;
+	}
+
+	if (async.pqueued != NULL) {
+	    if (status) {
+		txAwait(pbus, NULL);
+	    } else if ((status = txWait(pbus)) != 0) {
+		pbus->asyncLost++;
+	    }
+	    async.pqueued(async.pprivate, &async.message, status);
+	}
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canRoute
+
+Purpose:
+    Add a gateway route from one bus to others
+
+Description:
+    Frames received on the source bus with an identifier from first to
+    last inclusive are forwarded to each of the destination buses, which
+    are named in a list separated by spaces or commas.  The offset is
+    added to the identifier of each forwarded frame.  If dataMask is
+    not NULL or empty it holds up to 16 hex digits, two for each data
+    byte starting with byte 0, that the data is ANDed with; missing
+    bytes are passed unchanged.  Extended identifiers have the
+    CAN_EXTENDED bit set, and both ends of the range must be of the
+    same format.  Frames are forwarded by canBusReceive before it runs
+    the message callbacks, using canWriteAsync with medium priority.
+    Routes can't be deleted; they should be added before iocInit.
+
+Returns:
+    0,
+    S_can_noDevice if a bus name is not registered,
+    S_can_badAddress for a bad identifier range, mask or empty list,
+    ENOMEM if malloc() fails.
+
+Example:
+    canRoute "CAN1", 0x100, 0x10f, "CAN2 CAN3", 0x200, "ffff"
+
+*/
+
+int canRoute (
+    const char *psource,
+    canID_t first,
+    canID_t last,
+    const char *pdestList,
+    int offset,
+    const char *pdataMask
+) {
+    canBusID_t source;
+    route_t *proute;
+    const char *pname;
+    char name[64];
+    int i, n, status;
+
+    if (psource == NULL || pdestList == NULL) return S_can_noDevice;
+    status = canOpen(psource, &source);
+    if (status) return status;
+
+    if (!CAN_ID_VALID(first) || !CAN_ID_VALID(last) ||
+	((first ^ last) & CAN_EXTENDED) || first > last) {
+	return S_can_badAddress;
+    }
+
+    proute = calloc(1, sizeof (route_t));
+    if (proute == NULL) return ENOMEM;
+    proute->first  = first;
+    proute->last   = last;
+    proute->offset = offset;
+
+    if (pdataMask != NULL && *pdataMask != '\0') {
+	unsigned int byte;
+
+	memset(proute->mask, 0xff, CAN_DATA_SIZE);
+	for (i = 0; pdataMask[0] != '\0' && i < CAN_DATA_SIZE; i++) {
+	    if (!isxdigit(0xff & pdataMask[0]) ||
+		!isxdigit(0xff & pdataMask[1]) ||
+		sscanf(pdataMask, "%2x", &byte) != 1) break;
+	    proute->mask[i] = byte;
+	    pdataMask += 2;
+	}
+	if (*pdataMask != '\0') {
+	    free(proute);
+	    return S_can_badAddress;
+	}
+	proute->masked = TRUE;
+    }
+
+    /* Count the destinations, then look them up */
+    for (pname = pdestList, n = 0; *pname != '\0'; ) {
+	pname += strspn(pname, " ,");
+	if (*pname == '\0') break;
+	pname += strcspn(pname, " ,");
+	n++;
+    }
+    proute->pdest = calloc(n ? n : 1, sizeof (canBusID_t));
+    if (n == 0 || proute->pdest == NULL) {
+	free(proute->pdest);
+	free(proute);
+	return n ? ENOMEM : S_can_badAddress;
+    }
+
+    for (pname = pdestList, i = 0; i < n; i++) {
+	size_t len;
+
+	pname += strspn(pname, " ,");
+	len = strcspn(pname, " ,");
+	if (len >= sizeof (name)) len = sizeof (name) - 1;
+	memcpy(name, pname, len);
+	name[len] = '\0';
+	pname += strcspn(pname, " ,");
+
+	status = canOpen(name, &proute->pdest[i]);
+	if (!status) {
+	    /* Routes forward from the receive path, maybe an ISR */
+	    status = canWriteAsyncStart(proute->pdest[i]);
+	}
+	if (status) {
+	    free(proute->pdest);
+	    free(proute);
+	    return status;
+	}
+    }
+    proute->ndest = n;
+
+    /* Fully set up before canBusReceive can see it */
+    proute->pnext = source->proutes;
+    source->proutes = proute;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusTap
+
+Purpose:
+    Attach a routine that sees all traffic on a bus
+
+Description:
+    Registers a routine to be called with every message received on the
+    bus, before the message callbacks are run, and with every message
+    canWrite has passed to the controller.  It is meant for diagnostic
+    tools such as the frame capture; only one tap may be attached to a
+    bus at once, and it is detached by passing a NULL routine.  The tap
+    runs in the driver's receive context and in the caller's context of
+    canWrite, so it must be quick and must not block.  After detaching,
+    a tap already in progress on another thread may still complete, so
+    the tap's private data should not be freed.
+
+Returns:
+    0,
+    S_can_badDevice for an invalid bus ID,
+    S_can_busy if another tap is already attached.
+
+*/
+
+int canBusTap (
+    canBusID_t busID,
+    canTap_t *ptap,
+    void *pprivate
+) {
+    struct canBusID_s *pbus = busID;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    if (ptap == NULL) {
+	pbus->ptap = NULL;
+	return 0;
+    }
+    if (pbus->ptap != NULL &&
+	(pbus->ptap != ptap || pbus->ptapPrivate != pprivate)) {
+	return S_can_busy;
+    }
+
+    pbus->ptapPrivate = pprivate;
+    pbus->ptap        = ptap;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canMessage
+
+Purpose:
+    Register CAN message callback
+
+Description:
+    Adds a new callback routine for the given CAN message ID on the
+    given bus.  There can be any number of callbacks for the same ID,
+    and all are called in turn when a message with this ID is
+    received.  As a result, the callback routine must not change the
+    message at all - it is only permitted to examine it.  The callback
+    is called from the controller driver's receive task.  The callback
+    routine should be declared of type canMsgCallback_t
+	void callback(void *pprivate, can_Message_t *pmessage);
+    The pprivate value supplied to canMessage is passed to the callback
+    routine with each message to allow it to identify its context.
+    canMessageClass takes an execution class: CAN_EXEC_INLINE, which
+    canMessage uses, runs the callback in the receive task and should
+    only be used for quick routines that don't block.  The callback of
+    CAN_EXEC_DEFERRED is given a copy of the message in one of a pool
+    of worker tasks, so it may take longer without holding up other
+    messages, but messages are dropped if it falls too far behind.
+
+Returns:
+    0,
+    S_can_badMessage for bad identifier, NULL callback routine or
+	unknown execution class,
+    S_can_badDevice for bad bus pointer,
+    ENOMEM if malloc() fails or the workers can't be started.
+
+*/
+
+int canMessage (
+    canBusID_t busID,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate
+) {
+    return canMessageClass(busID, identifier, pcallback, pprivate,
+			   CAN_EXEC_INLINE);
+}
+
+int canMessageClass (
+    canBusID_t busID,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate,
+    int execClass
+) {
+    struct canBusID_s *pbus = busID;
+    callbackTable_t *phandler, *plist;
+    idHandler_t *pentry;
+    int worker = -1;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    if (!CAN_ID_VALID(identifier) ||
+	pcallback == NULL ||
+	(execClass != CAN_EXEC_INLINE && execClass != CAN_EXEC_DEFERRED)) {
+	return S_can_badMessage;
+    }
+
+    if (execClass == CAN_EXEC_DEFERRED) {
+	epicsThreadOnce(&workerOnce, workerInit, NULL);
+	worker = workerNext++ % CAN_WORKERS;
+	if (workerQ[worker] == NULL) {
+	    return ENOMEM;
+	}
+    }
+
+    pentry = findEntry(pbus, identifier);
+    phandler = calloc(1, sizeof (callbackTable_t));
+    if (pentry == NULL ||
+	phandler == NULL) {
+	free(phandler);
+	return ENOMEM;
+    }
+
+    phandler->pnext     = NULL;
+    phandler->pprivate  = pprivate;
+    phandler->pcallback = (callback_t *) pcallback;
+    phandler->worker    = worker;
+
+    if (pentry->phandler == NULL &&
+	pbus->pdriver->filter != NULL) {
+	pbus->pdriver->filter(pbus->pdev, identifier, TRUE);
+    }
+
+    plist = (callbackTable_t *) (&pentry->phandler);
+    while (plist->pnext != NULL) {
+	plist = plist->pnext;
+    }
+    /* plist now points to the last handler in the list */
+
+    plist->pnext = phandler;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canMsgDelete
+
+Purpose:
+    Delete registered CAN message callback
+
+Description:
+    Deletes an existing callback routine for the given CAN message ID
+    on the given bus.  The first matching callback found in the list
+    is deleted.  To match, the parameters to canMsgDelete must be
+    identical to those given to canMessage.  Frames already queued for
+    a deferred callback are discarded, and its entry is freed by the
+    worker when the last of them has been taken off the queue.
+
+Returns:
+    0,
+    S_can_badMessage for bad identifier or NULL callback routine,
+    S_can_noMessage for no matching message callback,
+    S_can_badDevice for bad bus pointer.
+
+*/
+
+int canMsgDelete (
+    canBusID_t busID,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate
+) {
+    struct canBusID_s *pbus = busID;
+    callbackTable_t *phandler, *plist;
+    idHandler_t *pentry;
+    int release;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    if (!CAN_ID_VALID(identifier) ||
+	pcallback == NULL) {
+	return S_can_badMessage;
+    }
+
+    pentry = lookupEntry(pbus, identifier);
+    if (pentry == NULL) {
+	return S_can_noMessage;
+    }
+
+    plist = (callbackTable_t *) (&pentry->phandler);
+    while (plist->pnext != NULL) {
+	phandler = plist->pnext;
+	if (((canMsgCallback_t *)phandler->pcallback == pcallback) &&
+	    (phandler->pprivate  == pprivate)) {
+	    plist->pnext = phandler->pnext;
+	    if (phandler->worker < 0) {
+		phandler->pnext = NULL;		/* Just in case... */
+		free(phandler);
+	    } else {
+		/* The worker frees it if it still has frames for it */
+		epicsMutexMustLock(workerLock);
+		phandler->deleted = TRUE;
+		release = (phandler->pending == 0);
+		epicsMutexUnlock(workerLock);
+		if (release) {
+		    free(phandler);
+		}
+	    }
+	    if (pentry->phandler == NULL &&
+		pbus->pdriver->filter != NULL) {
+		pbus->pdriver->filter(pbus->pdev, identifier, FALSE);
+	    }
+	    return 0;
+	}
+	plist = phandler;
+    }
+
+    return S_can_noMessage;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canSignal
+
+Purpose:
+    Register CAN error signal callback
+
+Description:
+    Adds a new callback routine for the CAN error reports.  There can be
+    any number of error callbacks, and all are called in turn when the
+    controller reports an error or bus Off.  Some drivers call these
+    from interrupt context, thus there are restrictions in what the
+    routine can perform.  The callback routine should be declared a
+    canSigCallback_t
+	void callback(void *pprivate, int status);
+    The pprivate value supplied to canSignal is passed to the callback
+    routine with the error status to allow it to identify its context.
+    Status values will be one of
+	CAN_BUS_OK,
+	CAN_BUS_ERROR or
+	CAN_BUS_OFF.
+
+Returns:
+    0,
+    S_can_badDevice for bad bus pointer,
+    ENOMEM if malloc() fails.
+
+*/
+
+int canSignal (
+    canBusID_t busID,
+    canSigCallback_t *pcallback,
+    void *pprivate
+) {
+    struct canBusID_s *pbus = busID;
+    callbackTable_t *phandler, *plist;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    phandler = malloc(sizeof (callbackTable_t));
+    if (phandler == NULL) {
+	return ENOMEM;
+    }
+
+    phandler->pnext     = NULL;
+    phandler->pprivate  = pprivate;
+    phandler->pcallback = (callback_t *) pcallback;
+
+    plist = (callbackTable_t *) (&pbus->psigHandler);
+    while (plist->pnext != NULL) {
+	plist = plist->pnext;
+    }
+    /* plist now points to the last handler in the list */
+
+    plist->pnext = phandler;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canRead
+
+Purpose:
+    read incoming CAN message, any ID number
+
+Description:
+    The simplest way to implement this is have canRead take a message
+    ID in the buffer, send an RTR and look for the returned value of
+    this message.  This is in keeping with the CAN philosophy and makes
+    it useful for simple software interfaces.  More complex ones ought
+    to use the canMessage callback functions.  If the driver filters
+    incoming messages and nothing else wants this ID, it is enabled for
+    the duration of the call.
+
+Returns:
+    0, or
+    S_can_badDevice for bad bus ID,
+    S_can_badMessage for bad message Identifier or length,
+    or an error from the controller driver, usually a timeout.
+
+Example:
+    canMessage_t myBuffer = {
+	139,	// Can ID
+	0,	// RTR
+	4	// Length
+    };
+    int status = canRead(canID, &myBuffer, WAIT_FOREVER);
+
+*/
+
+int canRead (
+    canBusID_t busID,
+    canMessage_t *pmessage,
+    double timeout
+) {
+    struct canBusID_s *pbus = busID;
+    int status, filtered;
+
+    if (pbus->magicNumber != CAN_MAGIC_NUMBER) {
+	return S_can_badDevice;
+    }
+
+    if (!CAN_ID_VALID(pmessage->identifier) ||
+	pmessage->length > CAN_DATA_SIZE) {
+	return S_can_badMessage;
+    }
+
+    /* Ensure that only one task canRead at once */
+    if (epicsMutexLock(pbus->readSem) != epicsMutexLockOK) {
+	return S_can_badDevice;
+    }
+
+    filtered = (pbus->pdriver->filter != NULL &&
+		findHandlers(pbus, pmessage->identifier) == NULL);
+    if (filtered) {
+	pbus->pdriver->filter(pbus->pdev, pmessage->identifier, TRUE);
+    }
+    pbus->preadBuffer = pmessage;
+
+    /* All set for the reply, now send the request */
+    pmessage->rtr = RTR;
+
+    status = canWrite(busID, pmessage, timeout);
+    if (status == 0) {
+	/* Wait for the message to be recieved */
+	switch (epicsEventWaitWithTimeout(pbus->rxSem, timeout)) {
+	case epicsEventWaitTimeout:
+	    status = S_can_timeout;
+	    break;
+	case epicsEventWaitError:
+	    status = S_can_badDevice;
+	    break;
+	default:
+	    break;
+	}
+    }
+    if (status) {
+	/* Problem (timeout) sending the RTR or receiving the reply */
+	pbus->preadBuffer = NULL;
+	epicsEventTryWait(pbus->rxSem);	/* Try to clean up */
+    }
+    if (filtered &&
+	findHandlers(pbus, pmessage->identifier) == NULL) {
+	pbus->pdriver->filter(pbus->pdev, pmessage->identifier, FALSE);
+    }
+    epicsMutexUnlock(pbus->readSem);
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canTest
+
+Purpose:
+    Test routine, sends a single message to the named bus.
+
+Description:
+    This routine is intended for use from the shell.
+
+Returns:
+    0, or ERROR
+
+*/
+
+int canTest (
+    char *pbusName,
+    canID_t identifier,
+    int rtr,
+    int length,
+    char *data
+) {
+    canBusID_t busID;
+    canMessage_t message;
+    int status;
+
+    if (pbusName == NULL) {
+	printf("Usage: canTest \"busname\", id, rtr, len, \"data\"\n");
+	return -1;
+    }
+
+    status = canOpen(pbusName, &busID);
+    if (status) {
+	printf("Error %d opening CAN bus '%s'\n", status, pbusName);
+	return -1;
+    }
+
+    message.identifier = identifier;
+    message.rtr        = rtr ? RTR : SEND;
+    message.length     = length;
+
+    if (rtr == 0) {
+	memcpy(&message.data[0], data, length);
+    }
+
+    status = canWrite(busID, &message, 0);
+    if (status) {
+	printf("Error %d writing message\n", status);
+	return -1;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* canReport(int interest) */
+static const iocshArg canReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const canReportArgs[1] = {&canReportArg0};
+static const iocshFuncDef canReportFuncDef =
+    {"canReport",1,canReportArgs};
+static void canReportCallFunc(const iocshArgBuf *args)
+{
+    canReport(args[0].ival);
+}
+
+/* canBusReset(char *pbusName) */
+static const iocshArg canBusResetArg0 = {"busName", iocshArgString};
+static const iocshArg * const canBusResetArgs[1] = {&canBusResetArg0};
+static const iocshFuncDef canBusResetFuncDef =
+    {"canBusReset",1,canBusResetArgs};
+static void canBusResetCallFunc(const iocshArgBuf *args)
+{
+    canBusReset(args[0].sval);
+}
+
+/* canBusStop(char *pbusName) */
+static const iocshArg canBusStopArg0 = {"busName", iocshArgString};
+static const iocshArg * const canBusStopArgs[1] = {&canBusStopArg0};
+static const iocshFuncDef canBusStopFuncDef =
+    {"canBusStop",1,canBusStopArgs};
+static void canBusStopCallFunc(const iocshArgBuf *args)
+{
+    canBusStop(args[0].sval);
+}
+
+/* canBusRestart(char *pbusName) */
+static const iocshArg canBusRestartArg0 = {"busName", iocshArgString};
+static const iocshArg * const canBusRestartArgs[1] = {&canBusRestartArg0};
+static const iocshFuncDef canBusRestartFuncDef =
+    {"canBusRestart",1,canBusRestartArgs};
+static void canBusRestartCallFunc(const iocshArgBuf *args)
+{
+    canBusRestart(args[0].sval);
+}
+
+/* canTop(char *pbusName, int count, double seconds) */
+static const iocshArg canTopArg0 = {"busName", iocshArgString};
+static const iocshArg canTopArg1 = {"count", iocshArgInt};
+static const iocshArg canTopArg2 = {"seconds", iocshArgDouble};
+static const iocshArg * const canTopArgs[3] = {
+    &canTopArg0, &canTopArg1, &canTopArg2};
+static const iocshFuncDef canTopFuncDef =
+    {"canTop",3,canTopArgs};
+static void canTopCallFunc(const iocshArgBuf *args)
+{
+    int status = canTop(args[0].sval, args[1].ival, args[2].dval);
+
+    if (status)
+	printf("canTop: Error %#x\n", status);
+}
+
+/* canBusBitRate(char *pbusName, int kbits) */
+static const iocshArg canBusBitRateArg0 = {"busName", iocshArgString};
+static const iocshArg canBusBitRateArg1 = {"busRate", iocshArgInt};
+static const iocshArg * const canBusBitRateArgs[2] = {
+    &canBusBitRateArg0, &canBusBitRateArg1};
+static const iocshFuncDef canBusBitRateFuncDef =
+    {"canBusBitRate",2,canBusBitRateArgs};
+static void canBusBitRateCallFunc(const iocshArgBuf *args)
+{
+    canBusID_t busID;
+
+    if (args[0].sval == NULL ||
+	canOpen(args[0].sval, &busID)) {
+	printf("canBusBitRate: No such bus\n");
+	return;
+    }
+    canBusBitRate(busID, args[1].ival * 1000);
+}
+
+/* canBusScheduler(char *pbusName, int enable) */
+static const iocshArg canBusSchedulerArg0 = {"busName", iocshArgString};
+static const iocshArg canBusSchedulerArg1 = {"enable", iocshArgInt};
+static const iocshArg * const canBusSchedulerArgs[2] = {
+    &canBusSchedulerArg0, &canBusSchedulerArg1};
+static const iocshFuncDef canBusSchedulerFuncDef =
+    {"canBusScheduler",2,canBusSchedulerArgs};
+static void canBusSchedulerCallFunc(const iocshArgBuf *args)
+{
+    if (canBusScheduler(args[0].sval, args[1].ival))
+	printf("canBusScheduler: No such bus\n");
+}
+
+/* canRoute(char *source, int first, int last, char *dest, int offset,
+ *          char *dataMask) */
+static const iocshArg canRouteArg0 = {"source", iocshArgString};
+static const iocshArg canRouteArg1 = {"first", iocshArgInt};
+static const iocshArg canRouteArg2 = {"last", iocshArgInt};
+static const iocshArg canRouteArg3 = {"destinations", iocshArgString};
+static const iocshArg canRouteArg4 = {"offset", iocshArgInt};
+static const iocshArg canRouteArg5 = {"dataMask", iocshArgString};
+static const iocshArg * const canRouteArgs[6] = {
+    &canRouteArg0, &canRouteArg1, &canRouteArg2,
+    &canRouteArg3, &canRouteArg4, &canRouteArg5};
+static const iocshFuncDef canRouteFuncDef =
+    {"canRoute",6,canRouteArgs};
+static void canRouteCallFunc(const iocshArgBuf *args)
+{
+    int status = canRoute(args[0].sval, args[1].ival, args[2].ival,
+			  args[3].sval, args[4].ival, args[5].sval);
+
+    if (status)
+	printf("canRoute: Error %#x\n", status);
+}
+
+/* canMsgTimes(char *pbusName, int count) */
+static const iocshArg canMsgTimesArg0 = {"busName", iocshArgString};
+static const iocshArg canMsgTimesArg1 = {"count", iocshArgInt};
+static const iocshArg * const canMsgTimesArgs[2] = {
+    &canMsgTimesArg0, &canMsgTimesArg1};
+static const iocshFuncDef canMsgTimesFuncDef =
+    {"canMsgTimes",2,canMsgTimesArgs};
+static void canMsgTimesCallFunc(const iocshArgBuf *args)
+{
+    int status = canMsgTimes(args[0].sval, args[1].ival);
+
+    if (status)
+	printf("canMsgTimes: Error %#x\n", status);
+}
+
+/* canMsgTiming(char *pbusName, int enable) */
+static const iocshArg canMsgTimingArg0 = {"busName", iocshArgString};
+static const iocshArg canMsgTimingArg1 = {"enable", iocshArgInt};
+static const iocshArg * const canMsgTimingArgs[2] = {
+    &canMsgTimingArg0, &canMsgTimingArg1};
+static const iocshFuncDef canMsgTimingFuncDef =
+    {"canMsgTiming",2,canMsgTimingArgs};
+static void canMsgTimingCallFunc(const iocshArgBuf *args)
+{
+    if (canMsgTiming(args[0].sval, args[1].ival))
+	printf("canMsgTiming: No such bus\n");
+}
+
+static void canBusRegistrar(void) {
+    iocshRegister(&canTopFuncDef,canTopCallFunc);
+    iocshRegister(&canMsgTimesFuncDef,canMsgTimesCallFunc);
+    iocshRegister(&canMsgTimingFuncDef,canMsgTimingCallFunc);
+    iocshRegister(&canBusBitRateFuncDef,canBusBitRateCallFunc);
+    iocshRegister(&canBusSchedulerFuncDef,canBusSchedulerCallFunc);
+    iocshRegister(&canRouteFuncDef,canRouteCallFunc);
+    iocshRegister(&canReportFuncDef,canReportCallFunc);
+    iocshRegister(&canBusResetFuncDef,canBusResetCallFunc);
+    iocshRegister(&canBusStopFuncDef,canBusStopCallFunc);
+    iocshRegister(&canBusRestartFuncDef,canBusRestartCallFunc);
+}
+epicsExportRegistrar(canBusRegistrar);
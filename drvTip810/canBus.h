@@ -43,9 +43,23 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include "shareLib.h"
 
 
-#define CAN_IDENTIFIERS 2048
+#define CAN_IDENTIFIERS 2048		/* Standard 11-bit identifiers */
+#define CAN_EXT_IDENTIFIERS 0x20000000	/* Extended 29-bit identifiers */
+#define CAN_EXTENDED 0x80000000		/* Flag bit for extended identifiers */
 #define CAN_DATA_SIZE 8
 
+#define CAN_ID_VALID(id) (((id) & CAN_EXTENDED) ? \
+	((id) & ~CAN_EXTENDED) < CAN_EXT_IDENTIFIERS : (id) < CAN_IDENTIFIERS)
+
+/* Transmit priorities, these match the record PRIO field */
+#define CAN_PRIORITY_LOW 0
+#define CAN_PRIORITY_MEDIUM 1
+#define CAN_PRIORITY_HIGH 2
+
+/* canMessage callback execution classes */
+#define CAN_EXEC_INLINE 0	/* called in the receive task */
+#define CAN_EXEC_DEFERRED 1	/* called by a worker with a copy */
+
 #define CAN_BUS_OK 0
 #define CAN_BUS_ERROR 1
 #define CAN_BUS_OFF 2
@@ -59,12 +73,21 @@ Copyright (c) 1995-2000 Andrew Johnson
 #define S_can_badAddress	(M_can| 2) /*CAN address syntax error*/
 #define S_can_noDevice		(M_can| 3) /*CAN bus name does not exist*/
 #define S_can_noMessage 	(M_can| 4) /*no matching CAN message callback*/
-
-typedef epicsUInt16 canID_t;
+#define S_can_badDevice		(M_can| 5) /*bus ID is not a CAN bus*/
+#define S_can_duplicateBus	(M_can| 6) /*CAN bus name already in use*/
+#define S_can_timeout		(M_can| 7) /*timeout waiting for reply*/
+#define S_can_busy		(M_can| 8) /*CAN bus facility already in use*/
+#define S_can_badCapture	(M_can| 9) /*not a CAN capture file*/
+#define S_can_noCapture 	(M_can|10) /*no capture running on this bus*/
+#define S_can_queueFull		(M_can|11) /*CAN transmit queue is full*/
+#define S_can_noTxTask		(M_can|12) /*canWriteAsync at interrupt level before canWriteAsyncStart*/
+#define S_can_txFailed		(M_can|13) /*CAN message not sent, aborted or bus off*/
+
+typedef epicsUInt32 canID_t;
 typedef struct canBusID_s *canBusID_t;
 
 typedef struct {
-    canID_t identifier;		/* 0 .. 2047 with holes! */
+    canID_t identifier;		/* 0 .. 2047, or CAN_EXTENDED | 29 bits */
     enum {
 	SEND = 0, RTR = 1
     } rtr;			/* Remote Transmission Request */
@@ -84,6 +107,46 @@ typedef struct {
 
 typedef void canMsgCallback_t(void *pprivate, const canMessage_t *pmessage);
 typedef void canSigCallback_t(void *pprivate, int status);
+typedef struct {
+    double frameRate;		/* frames/sec, both directions */
+    double bitRateMin;		/* bits/sec without stuff bits */
+    double bitRateMax;		/* bits/sec with worst-case stuffing */
+    double loadMin;		/* percent of bus rate, -1 if unknown */
+    double loadMax;
+} canBusLoad_t;
+
+typedef void canTap_t(void *pprivate, const canMessage_t *pmessage,
+		      int transmit);
+
+typedef void canWriteQueued_t(void *pprivate, const canMessage_t *pmessage,
+			      int status);
+
+
+/* This is a table which each CAN controller driver provides to the
+   generic canBus code.  One table is required for each type of
+   controller, and each bus is registered with canBusAdd().  The pdev
+   pointer given to canBusAdd is passed to all of the driver routines
+   as a means of identification of the controller.  The canBus code
+   checks the message before calling write.  The driver reports each
+   message that write accepted to canBusTxDone once it has been sent,
+   or failed; a NULL message with an error status says that any it
+   still held were lost. */
+
+typedef struct {
+    const char *driverName;
+			/* String naming the controller type */
+    int (*write)(void *pdev, const canMessage_t *pmessage, double timeout);
+			/* Transmit one message */
+    int (*reset)(void *pdev);
+			/* Reset the controller and its counters */
+    int (*stop)(void *pdev);
+			/* Stop I/O on the bus */
+    int (*restart)(void *pdev);
+			/* Restart I/O after a stop */
+    /* The remaining routine is optional and may be NULL. */
+    int (*filter)(void *pdev, canID_t identifier, int enable);
+			/* Start or stop receiving this identifier */
+} canDriver_t;
 
 
 extern int canSilenceErrors;
@@ -96,13 +159,42 @@ epicsShareFunc int canBusRestart(const char *busName);
 epicsShareFunc int canRead(canBusID_t busID, canMessage_t *pmessage, double timeout);
 epicsShareFunc int canWrite(canBusID_t busID, const canMessage_t *pmessage,
 		    double timeout);
+epicsShareFunc int canWritePriority(canBusID_t busID,
+		    const canMessage_t *pmessage, int priority, double timeout);
+epicsShareFunc int canBusScheduler(const char *busName, int enable);
+epicsShareFunc int canWriteAsync(canBusID_t busID, const canMessage_t *pmessage,
+		    int priority, canWriteQueued_t *pqueued, void *pprivate);
+epicsShareFunc int canWriteAsyncStart(canBusID_t busID);
+epicsShareFunc void canWriteQueuedEvent(void *pevent,
+		    const canMessage_t *pmessage, int status);
+epicsShareFunc int canRoute(const char *source, canID_t first, canID_t last,
+		    const char *destinations, int offset, const char *dataMask);
 epicsShareFunc int canMessage(canBusID_t busID, canID_t identifier, 
 		      canMsgCallback_t callback, void *pprivate);
+epicsShareFunc int canMessageClass(canBusID_t busID, canID_t identifier,
+		      canMsgCallback_t callback, void *pprivate, int execClass);
+epicsShareFunc int canMsgTimes(const char *busName, int count);
+epicsShareFunc int canMsgTiming(const char *busName, int enable);
 epicsShareFunc int canMsgDelete(canBusID_t busID, canID_t identifier, 
 			canMsgCallback_t callback, void *pprivate);
 epicsShareFunc int canSignal(canBusID_t busID, canSigCallback_t callback,
 		     void *pprivate);
 epicsShareFunc int canIoParse(char *canString, canIo_t *pcanIo);
+epicsShareFunc int canReport(int interest);
+epicsShareFunc int canBusTap(canBusID_t busID, canTap_t *ptap, void *pprivate);
+epicsShareFunc int canBusLoad(canBusID_t busID, canBusLoad_t *pload);
+epicsShareFunc int canBusBitRate(canBusID_t busID, int bitRate);
+epicsShareFunc int canTop(const char *busName, int count, double seconds);
+
+/* For use by the CAN controller drivers only */
+epicsShareFunc int canBusAdd(const char *busName, const canDriver_t *pdriver,
+		     void *pdev, canBusID_t *pbusID);
+epicsShareFunc void *canBusPrivate(canBusID_t busID, const canDriver_t *pdriver);
+epicsShareFunc void canBusReceive(canBusID_t busID, const canMessage_t *pmessage);
+epicsShareFunc void canBusSignal(canBusID_t busID, int status);
+epicsShareFunc void canBusTxDone(canBusID_t busID, const canMessage_t *pmessage,
+		     int status);
+epicsShareFunc void canBusShow(canBusID_t busID, int interest);
 
 
 #endif /* INCcanBusH */
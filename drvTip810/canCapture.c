@@ -0,0 +1,654 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canCapture.c
+
+Description:
+    CANbus frame capture and replay.  A capture attaches to a bus with
+    canBusTap and records every received message (and optionally every
+    transmitted one) with its time of arrival into a ring of frames that
+    is allocated when the capture is started, so recording never has to
+    allocate memory and the ring always holds the latest traffic.  The
+    ring can be written to a binary file at any time, and canReplay will
+    send the frames in such a file out on a bus again, either with their
+    original spacing, faster or slower, or as fast as canWrite allows.
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <iocsh.h>
+#include <dbDefs.h>
+#include <errlog.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "canCapture.h"
+
+
+typedef struct canCapture_s {
+    struct canCapture_s *pnext;	/* To next capture. Must be first member */
+    char *pbusName;		/* Bus being captured */
+    canBusID_t busID;
+    epicsMutexId lock;		/* Protects the ring */
+    canCaptureFrame_t *pring;	/* Preallocated frame buffer */
+    int size;			/* Frames in ring */
+    int next;			/* Ring index of next frame */
+    epicsUInt32 count;		/* Frames in ring, up to size */
+    epicsUInt32 total;		/* Frames captured since started */
+    int transmit;		/* Capture transmitted frames too */
+    int running;		/* Adding frames to the ring */
+} canCapture_t;
+
+typedef struct {
+    canBusID_t busID;
+    char *pfileName;
+    double speed;
+    epicsUInt32 count;
+    canCaptureFrame_t *pframes;
+} replay_t;
+
+
+static canCapture_t *pcaptureFirst = NULL;
+
+
+/*******************************************************************************
+
+Routine:
+    findCapture
+
+Purpose:
+    Find the capture for a named bus
+
+Returns:
+    Capture pointer, or NULL if the bus has no capture.
+
+*/
+
+static canCapture_t * findCapture (
+    const char *pbusName
+) {
+    canCapture_t *pcap;
+
+    for (pcap = pcaptureFirst; pcap != NULL; pcap = pcap->pnext) {
+	if (strcmp(pcap->pbusName, pbusName) == 0) break;
+    }
+    return pcap;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    captureTap
+
+Purpose:
+    Record a frame in the ring
+
+Description:
+    canBusTap routine, called for every message received on the bus and
+    every message written to it.  When the ring is full the oldest frame
+    is overwritten.
+
+Returns:
+    void
+
+*/
+
+static void captureTap (
+    void *pprivate,
+    const canMessage_t *pmessage,
+    int transmit
+) {
+    canCapture_t *pcap = pprivate;
+    canCaptureFrame_t *pframe;
+    epicsTimeStamp now;
+
+    if (transmit && !pcap->transmit) return;
+
+    epicsTimeGetCurrent(&now);
+
+    epicsMutexMustLock(pcap->lock);
+    if (pcap->running) {
+	pframe = &pcap->pring[pcap->next];
+	pframe->secPastEpoch = now.secPastEpoch;
+	pframe->nsec         = now.nsec;
+	pframe->identifier   = pmessage->identifier;
+	pframe->flags        = (transmit ? CAN_CAPTURE_TX : 0) |
+			       (pmessage->rtr == RTR ? CAN_CAPTURE_RTR : 0);
+	pframe->length       = pmessage->length;
+	memcpy(pframe->data, pmessage->data, CAN_DATA_SIZE);
+
+	if (++pcap->next == pcap->size) pcap->next = 0;
+	if (pcap->count < pcap->size) pcap->count++;
+	pcap->total++;
+    }
+    epicsMutexUnlock(pcap->lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canCaptureStart
+
+Purpose:
+    Start capturing the traffic on a bus
+
+Description:
+    Allocates a ring big enough for the given number of frames, or
+    reuses the one from an earlier capture of the same bus, empties it
+    and attaches it to the bus.  Received messages are recorded, and
+    transmitted ones too if transmit is non-zero.
+
+Returns:
+    0,
+    S_can_noDevice if the bus does not exist,
+    S_can_busy if another tap is attached to the bus,
+    ENOMEM if memory allocation fails.
+
+Example:
+    canCaptureStart "CAN1", 100000, 1
+
+*/
+
+int canCaptureStart (
+    const char *pbusName,
+    int frames,
+    int transmit
+) {
+    canCapture_t *pcap;
+    canCaptureFrame_t *pring;
+    canBusID_t busID;
+    int status;
+
+    if (pbusName == NULL || frames <= 0) {
+	printf("Usage: canCaptureStart \"busName\", frames, transmit\n");
+	return S_can_noDevice;
+    }
+
+    status = canOpen(pbusName, &busID);
+    if (status) return status;
+
+    pcap = findCapture(pbusName);
+    if (pcap == NULL) {
+	pcap = calloc(1, sizeof (canCapture_t));
+	if (pcap == NULL) return ENOMEM;
+
+	pcap->pbusName = malloc(strlen(pbusName) + 1);
+	pcap->lock     = epicsMutexCreate();
+	if (pcap->pbusName == NULL ||
+	    pcap->lock == NULL) {
+	    if (pcap->lock != NULL) {
+		epicsMutexDestroy(pcap->lock);
+	    }
+	    free(pcap->pbusName);
+	    free(pcap);
+	    return ENOMEM;
+	}
+	strcpy(pcap->pbusName, pbusName);
+	pcap->busID = busID;
+
+	pcap->pnext   = pcaptureFirst;
+	pcaptureFirst = pcap;
+    }
+
+    pring = NULL;
+    if (frames != pcap->size) {
+	pring = calloc(frames, sizeof (canCaptureFrame_t));
+	if (pring == NULL) return ENOMEM;
+    }
+
+    epicsMutexMustLock(pcap->lock);
+    if (pring != NULL) {
+	free(pcap->pring);
+	pcap->pring = pring;
+	pcap->size  = frames;
+    }
+    pcap->next     = 0;
+    pcap->count    = 0;
+    pcap->total    = 0;
+    pcap->transmit = transmit;
+    pcap->running  = TRUE;
+    epicsMutexUnlock(pcap->lock);
+
+    status = canBusTap(busID, captureTap, pcap);
+    if (status) {
+	pcap->running = FALSE;
+    }
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canCaptureStop
+
+Purpose:
+    Stop capturing the traffic on a bus
+
+Description:
+    Detaches the capture from the bus.  The frames recorded so far stay
+    in the ring for canCaptureSave until the capture is started again.
+
+Returns:
+    0, or S_can_noCapture if the bus has no capture.
+
+Example:
+    canCaptureStop "CAN1"
+
+*/
+
+int canCaptureStop (
+    const char *pbusName
+) {
+    canCapture_t *pcap;
+
+    if (pbusName == NULL ||
+	(pcap = findCapture(pbusName)) == NULL) {
+	return S_can_noCapture;
+    }
+
+    if (pcap->running) {
+	canBusTap(pcap->busID, NULL, NULL);
+
+	epicsMutexMustLock(pcap->lock);
+	pcap->running = FALSE;
+	epicsMutexUnlock(pcap->lock);
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canCaptureSave
+
+Purpose:
+    Write the captured frames to a file
+
+Description:
+    Copies the ring, oldest frame first, and writes the copy to the named
+    file after a canCaptureHeader_t.  The capture may still be running;
+    frames that arrive while the file is being written are kept in the
+    ring for the next save.
+
+Returns:
+    0,
+    S_can_noCapture if the bus has no capture,
+    ENOMEM if memory allocation fails,
+    errno if the file could not be written.
+
+Example:
+    canCaptureSave "CAN1", "/tmp/can1.cap"
+
+*/
+
+int canCaptureSave (
+    const char *pbusName,
+    const char *pfileName
+) {
+    canCapture_t *pcap;
+    canCaptureHeader_t header;
+    canCaptureFrame_t *pframes;
+    epicsUInt32 first;
+    FILE *fp;
+    int status = 0;
+
+    if (pbusName == NULL ||
+	(pcap = findCapture(pbusName)) == NULL ||
+	pcap->size == 0) {
+	return S_can_noCapture;
+    }
+    if (pfileName == NULL) {
+	printf("Usage: canCaptureSave \"busName\", \"fileName\"\n");
+	return EINVAL;
+    }
+
+    memset(&header, 0, sizeof (header));
+    header.magic = CAN_CAPTURE_MAGIC;
+    strncpy(header.busName, pbusName, sizeof (header.busName) - 1);
+
+    pframes = malloc(pcap->size * sizeof (canCaptureFrame_t));
+    if (pframes == NULL) return ENOMEM;
+
+    /* Copy so the ring is only locked for as long as a memcpy takes */
+    epicsMutexMustLock(pcap->lock);
+    header.count       = pcap->count;
+    header.overwritten = pcap->total - pcap->count;
+    first = (pcap->next + pcap->size - pcap->count) % pcap->size;
+    if (first + pcap->count <= pcap->size) {
+	memcpy(pframes, &pcap->pring[first],
+	       pcap->count * sizeof (canCaptureFrame_t));
+    } else {
+	epicsUInt32 part = pcap->size - first;
+
+	memcpy(pframes, &pcap->pring[first],
+	       part * sizeof (canCaptureFrame_t));
+	memcpy(&pframes[part], pcap->pring,
+	       (pcap->count - part) * sizeof (canCaptureFrame_t));
+    }
+    epicsMutexUnlock(pcap->lock);
+
+    fp = fopen(pfileName, "wb");
+    if (fp == NULL ||
+	fwrite(&header, sizeof (header), 1, fp) != 1 ||
+	fwrite(pframes, sizeof (canCaptureFrame_t), header.count, fp)
+	    != header.count) {
+	status = errno ? errno : EIO;
+    }
+    if (fp != NULL && fclose(fp) && status == 0) {
+	status = errno ? errno : EIO;
+    }
+    free(pframes);
+
+    if (status) {
+	printf("canCaptureSave: Can't write '%s', %s\n", pfileName,
+	       strerror(status));
+    } else {
+	printf("canCaptureSave: %u frames written to '%s'\n", header.count,
+	       pfileName);
+    }
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canCaptureReport
+
+Purpose:
+    Report the state of all captures
+
+Returns:
+    0
+
+*/
+
+int canCaptureReport (
+    int interest
+) {
+    canCapture_t *pcap;
+
+    for (pcap = pcaptureFirst; pcap != NULL; pcap = pcap->pnext) {
+	printf("  '%s' : %s, %u of %d frames held, %u captured%s\n",
+	       pcap->pbusName, pcap->running ? "Capturing" : "Stopped",
+	       pcap->count, pcap->size, pcap->total,
+	       pcap->transmit ? ", including transmit" : "");
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    replayTask
+
+Purpose:
+    Send the frames from a capture file
+
+Description:
+    Started by canReplay.  The time of each frame relative to the first
+    one in the file is divided by the speed factor to find when it is
+    due; the task sleeps until then, unless the frame is due within half
+    a clock tick, so frames closer together than the clock resolution
+    go out in bursts.  A speed of zero sends every frame as soon as
+    canWrite accepts it.
+
+Returns:
+    void
+
+*/
+
+static void replayTask (
+    void *parg
+) {
+    replay_t *preplay = parg;
+    canCaptureFrame_t *pframe = preplay->pframes;
+    epicsTimeStamp start, now, first;
+    double quantum = epicsThreadSleepQuantum() / 2;
+    epicsUInt32 i, sent = 0, failed = 0;
+
+    if (preplay->count) {
+	first.secPastEpoch = pframe->secPastEpoch;
+	first.nsec         = pframe->nsec;
+    }
+    epicsTimeGetCurrent(&start);
+
+    for (i = 0; i < preplay->count; i++, pframe++) {
+	canMessage_t message;
+
+	if (preplay->speed > 0) {
+	    epicsTimeStamp stamp;
+	    double due;
+
+	    stamp.secPastEpoch = pframe->secPastEpoch;
+	    stamp.nsec         = pframe->nsec;
+	    epicsTimeGetCurrent(&now);
+	    due = epicsTimeDiffInSeconds(&stamp, &first) / preplay->speed -
+		  epicsTimeDiffInSeconds(&now, &start);
+	    if (due > quantum) {
+		epicsThreadSleep(due);
+	    }
+	}
+
+	message.identifier = pframe->identifier;
+	message.rtr        = (pframe->flags & CAN_CAPTURE_RTR) ? RTR : SEND;
+	message.length     = pframe->length;
+	memcpy(message.data, pframe->data, CAN_DATA_SIZE);
+
+	if (canWrite(preplay->busID, &message, 1.0)) {
+	    failed++;
+	} else {
+	    sent++;
+	}
+    }
+
+    epicsTimeGetCurrent(&now);
+    errlogPrintf("canReplay: '%s' done, %u frames sent, %u failed, "
+		 "%.3f sec\n", preplay->pfileName, sent, failed,
+		 epicsTimeDiffInSeconds(&now, &start));
+
+    free(preplay->pframes);
+    free(preplay->pfileName);
+    free(preplay);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canReplay
+
+Purpose:
+    Replay a capture file onto a bus
+
+Description:
+    Reads the whole file into memory so file access can't disturb the
+    timing, after checking that the file is long enough to hold the
+    number of frames its header gives, then starts a task to send the frames on the named bus.
+    Frames captured in both directions are sent.  A speed of 1 gives the
+    original timing, 2 twice as fast and so on; 0 sends the frames back
+    to back.  This routine returns once the task has started.
+
+Returns:
+    0,
+    S_can_noDevice if the bus does not exist,
+    S_can_badCapture if the file is not a capture file,
+    ENOMEM if memory allocation fails,
+    errno if the file could not be read,
+    -1 if the task could not be started.
+
+Example:
+    canReplay "CAN2", "/tmp/can1.cap", 1.0
+
+*/
+
+int canReplay (
+    const char *pbusName,
+    const char *pfileName,
+    double speed
+) {
+    canCaptureHeader_t header;
+    replay_t *preplay;
+    canBusID_t busID;
+    FILE *fp;
+    long length;
+    int status;
+
+    if (pbusName == NULL || pfileName == NULL) {
+	printf("Usage: canReplay \"busName\", \"fileName\", speed\n");
+	return S_can_noDevice;
+    }
+
+    status = canOpen(pbusName, &busID);
+    if (status) return status;
+
+    fp = fopen(pfileName, "rb");
+    if (fp == NULL) {
+	printf("canReplay: Can't open '%s', %s\n", pfileName,
+	       strerror(errno));
+	return errno;
+    }
+    if (fread(&header, sizeof (header), 1, fp) != 1 ||
+	header.magic != CAN_CAPTURE_MAGIC) {
+	fclose(fp);
+	return S_can_badCapture;
+    }
+
+    /* Don't trust the count to size the buffer, check the file holds them */
+    if (fseek(fp, 0, SEEK_END) != 0 ||
+	(length = ftell(fp)) < (long) sizeof (header) ||
+	header.count > (length - sizeof (header)) / sizeof (canCaptureFrame_t) ||
+	fseek(fp, sizeof (header), SEEK_SET) != 0) {
+	fclose(fp);
+	return S_can_badCapture;
+    }
+
+    preplay = calloc(1, sizeof (replay_t));
+    if (preplay == NULL) {
+	fclose(fp);
+	return ENOMEM;
+    }
+    preplay->busID     = busID;
+    preplay->speed     = speed;
+    preplay->count     = header.count;
+    preplay->pframes   = malloc(header.count * sizeof (canCaptureFrame_t) + 1);
+    preplay->pfileName = malloc(strlen(pfileName) + 1);
+    if (preplay->pframes == NULL ||
+	preplay->pfileName == NULL) {
+	status = ENOMEM;
+    } else if (fread(preplay->pframes, sizeof (canCaptureFrame_t),
+		     header.count, fp) != header.count) {
+	status = S_can_badCapture;
+    }
+    fclose(fp);
+
+    if (status == 0) {
+	strcpy(preplay->pfileName, pfileName);
+	if (epicsThreadCreate("canReplay", epicsThreadPriorityMedium,
+			      epicsThreadGetStackSize(epicsThreadStackSmall),
+			      replayTask, preplay) == 0) {
+	    status = -1;
+	}
+    }
+    if (status) {
+	free(preplay->pframes);
+	free(preplay->pfileName);
+	free(preplay);
+    }
+    return status;
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* canCaptureStart(char *pbusName, int frames, int transmit) */
+static const iocshArg canCaptureStartArg0 = {"busName", iocshArgString};
+static const iocshArg canCaptureStartArg1 = {"frames", iocshArgInt};
+static const iocshArg canCaptureStartArg2 = {"transmit", iocshArgInt};
+static const iocshArg * const canCaptureStartArgs[3] = {
+    &canCaptureStartArg0, &canCaptureStartArg1, &canCaptureStartArg2};
+static const iocshFuncDef canCaptureStartFuncDef =
+    {"canCaptureStart",3,canCaptureStartArgs};
+static void canCaptureStartCallFunc(const iocshArgBuf *args)
+{
+    int status = canCaptureStart(args[0].sval, args[1].ival, args[2].ival);
+
+    if (status)
+	printf("canCaptureStart: Error %#x\n", status);
+}
+
+/* canCaptureStop(char *pbusName) */
+static const iocshArg canCaptureStopArg0 = {"busName", iocshArgString};
+static const iocshArg * const canCaptureStopArgs[1] = {&canCaptureStopArg0};
+static const iocshFuncDef canCaptureStopFuncDef =
+    {"canCaptureStop",1,canCaptureStopArgs};
+static void canCaptureStopCallFunc(const iocshArgBuf *args)
+{
+    canCaptureStop(args[0].sval);
+}
+
+/* canCaptureSave(char *pbusName, char *pfileName) */
+static const iocshArg canCaptureSaveArg0 = {"busName", iocshArgString};
+static const iocshArg canCaptureSaveArg1 = {"fileName", iocshArgString};
+static const iocshArg * const canCaptureSaveArgs[2] = {
+    &canCaptureSaveArg0, &canCaptureSaveArg1};
+static const iocshFuncDef canCaptureSaveFuncDef =
+    {"canCaptureSave",2,canCaptureSaveArgs};
+static void canCaptureSaveCallFunc(const iocshArgBuf *args)
+{
+    canCaptureSave(args[0].sval, args[1].sval);
+}
+
+/* canCaptureReport(int interest) */
+static const iocshArg canCaptureReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const canCaptureReportArgs[1] = {
+    &canCaptureReportArg0};
+static const iocshFuncDef canCaptureReportFuncDef =
+    {"canCaptureReport",1,canCaptureReportArgs};
+static void canCaptureReportCallFunc(const iocshArgBuf *args)
+{
+    canCaptureReport(args[0].ival);
+}
+
+/* canReplay(char *pbusName, char *pfileName, double speed) */
+static const iocshArg canReplayArg0 = {"busName", iocshArgString};
+static const iocshArg canReplayArg1 = {"fileName", iocshArgString};
+static const iocshArg canReplayArg2 = {"speed", iocshArgDouble};
+static const iocshArg * const canReplayArgs[3] = {
+    &canReplayArg0, &canReplayArg1, &canReplayArg2};
+static const iocshFuncDef canReplayFuncDef =
+    {"canReplay",3,canReplayArgs};
+static void canReplayCallFunc(const iocshArgBuf *args)
+{
+    int status = canReplay(args[0].sval, args[1].sval, args[2].dval);
+
+    if (status)
+	printf("canReplay: Error %#x\n", status);
+}
+
+static void canCaptureRegistrar(void) {
+    iocshRegister(&canCaptureStartFuncDef,canCaptureStartCallFunc);
+    iocshRegister(&canCaptureStopFuncDef,canCaptureStopCallFunc);
+    iocshRegister(&canCaptureSaveFuncDef,canCaptureSaveCallFunc);
+    iocshRegister(&canCaptureReportFuncDef,canCaptureReportCallFunc);
+    iocshRegister(&canReplayFuncDef,canReplayCallFunc);
+}
+epicsExportRegistrar(canCaptureRegistrar);
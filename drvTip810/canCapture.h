@@ -0,0 +1,56 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canCapture.h
+
+Description:
+    Header file for CANbus frame capture and replay.  The capture file
+    layout is given here so that offline tools can read it: a header
+    followed by count frame records, all in the byte order of the IOC
+    that wrote it (the magic number shows which).
+
+*******************************************************************************/
+
+
+#ifndef INCcanCaptureH
+#define INCcanCaptureH
+
+#include "epicsTypes.h"
+#include "shareLib.h"
+#include "canBus.h"
+
+
+#define CAN_CAPTURE_MAGIC 0x43414e31	/* "CAN1" */
+
+#define CAN_CAPTURE_TX	0x01		/* Frame was sent by this IOC */
+#define CAN_CAPTURE_RTR	0x02		/* Remote Transmission Request */
+
+typedef struct {
+    epicsUInt32 magic;			/* CAN_CAPTURE_MAGIC */
+    epicsUInt32 count;			/* Frames in file */
+    epicsUInt32 overwritten;		/* Older frames lost from ring */
+    epicsUInt32 reserved;
+    char busName[32];			/* Bus captured from */
+} canCaptureHeader_t;
+
+typedef struct {
+    epicsUInt32 secPastEpoch;		/* epicsTimeStamp of arrival */
+    epicsUInt32 nsec;
+    canID_t identifier;			/* As in canMessage_t */
+    epicsUInt8 flags;			/* CAN_CAPTURE_ bits */
+    epicsUInt8 length;
+    epicsUInt8 data[CAN_DATA_SIZE];
+    epicsUInt8 reserved[2];
+} canCaptureFrame_t;
+
+
+epicsShareFunc int canCaptureStart(const char *busName, int frames, int transmit);
+epicsShareFunc int canCaptureStop(const char *busName);
+epicsShareFunc int canCaptureSave(const char *busName, const char *fileName);
+epicsShareFunc int canCaptureReport(int interest);
+epicsShareFunc int canReplay(const char *busName, const char *fileName, double speed);
+
+#endif /* INCcanCaptureH */
@@ -330,7 +330,8 @@ static long read_ai (
 		pcanAi->status = TIMEOUT_ALARM;
 
 		epicsTimerStartDelay(pcanAi->timId, pcanAi->inp.timeout);
-		canWrite(pcanAi->inp.canBusID, &message, pcanAi->inp.timeout);
+		canWritePriority(pcanAi->inp.canBusID, &message,
+				 prec->prio, pcanAi->inp.timeout);
 		return CONVERT;
 	    }
 	default:
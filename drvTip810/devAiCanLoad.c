@@ -0,0 +1,189 @@
+/*******************************************************************************
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    devAiCanLoad.c
+
+Description:
+    CANbus traffic and load Analogue Input device support.  The INP field
+    is an INST_IO address of the form
+
+	@busName:statistic
+
+    where statistic is one of
+
+	LOAD		Upper bound of the bus load, percent
+	LOAD_MIN	Lower bound of the bus load, percent
+	BIT_RATE	Upper bound of the bits/sec used
+	FRAME_RATE	Frames/sec received and sent
+
+    The figures are averages over the last 10 seconds; see canBusLoad.
+    The load statistics need the bus rate to be known, and read as -1
+    with an INVALID alarm if it isn't.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <recSup.h>
+#include <recGbl.h>
+#include <alarm.h>
+#include <devSup.h>
+#include <aiRecord.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+
+
+typedef enum {
+    LOAD_MAX, LOAD_MIN, BIT_RATE, FRAME_RATE
+} loadStat_t;
+
+
+/* Create the dset for devAiCanLoad */
+static long init_ai(struct aiRecord *prec);
+static long read_ai(struct aiRecord *prec);
+
+struct {
+	long		number;
+	DEVSUPFUN	report;
+	DEVSUPFUN	init;
+	DEVSUPFUN	init_record;
+	DEVSUPFUN	get_ioint_info;
+	DEVSUPFUN	read_ai;
+	DEVSUPFUN	special_linconv;
+} devAiCanLoad = {
+	6,
+	NULL,
+	NULL,
+	init_ai,
+	NULL,
+	read_ai,
+	NULL
+};
+epicsExportAddress(dset, devAiCanLoad);
+
+typedef struct {
+    canBusID_t busID;
+    loadStat_t stat;
+} canLoadPvt_t;
+
+static long init_ai(
+    struct aiRecord *prec
+) {
+    static struct {
+	char		*string;
+	loadStat_t	stat;
+    } loadStat[] = {
+	{ "LOAD",	LOAD_MAX },
+	{ "LOAD_MIN",	LOAD_MIN },
+	{ "BIT_RATE",	BIT_RATE },
+	{ "FRAME_RATE",	FRAME_RATE },
+	{ NULL,		0 }
+    };
+
+    char *canString;
+    char *name;
+    char separator;
+    canBusID_t busID;
+    canBusLoad_t load;
+    canLoadPvt_t *ppvt;
+    int i;
+    long status;
+
+    /* ai.inp must be an INST_IO */
+    if (prec->inp.type != INST_IO) goto error;
+
+    canString = ((struct instio *)&(prec->inp.value))->string;
+
+    /* Strip leading whitespace & non-alphanumeric chars */
+    while (!isalnum(0xff & *canString)) {
+	if (*canString++ == '\0') goto error;
+    }
+
+    /* First part of string is the bus name */
+    name = canString;
+
+    /* find the end of the busName */
+    canString = strpbrk(canString, "/:");
+    if (canString == NULL || *canString == '\0') goto error;
+
+    /* Temporarily truncate string after name and look up the bus */
+    separator = *canString;
+    *canString = '\0';
+    status = canOpen(name, &busID);
+    *canString++ = separator;
+    if (status) goto error;
+
+    /* After the bus name comes the name of the statistic */
+    for (i=0; loadStat[i].string != NULL; i++)
+	if (strcmp(canString, loadStat[i].string) == 0)
+	    break;
+    if (loadStat[i].string == NULL) goto error;
+
+    /* Start the bus sampling now so the window fills before the first
+     * scan.  Drivers have been initialised, so the timer queue exists. */
+    if (canBusLoad(busID, &load)) goto error;
+
+    ppvt = malloc(sizeof (canLoadPvt_t));
+    if (ppvt == NULL) {
+	recGblRecordError(S_db_noMemory, (void *)prec,
+			  "devAiCanLoad: Out of memory");
+	return S_db_noMemory;
+    }
+    ppvt->busID = busID;
+    ppvt->stat  = loadStat[i].stat;
+    prec->dpvt  = ppvt;
+    return 0;
+
+error:
+    if (canSilenceErrors) {
+	prec->pact = TRUE;
+	return 0;
+    } else {
+	recGblRecordError(S_db_badField,(void *)prec,
+			  "devAiCanLoad: Bad INP field type or value");
+	return S_db_badField;
+    }
+}
+
+static long read_ai(struct aiRecord *prec)
+{
+    canLoadPvt_t *ppvt = prec->dpvt;
+    canBusLoad_t load;
+
+    if (ppvt == NULL) {
+	prec->pact = TRUE;
+	return S_dev_noDevice;
+    }
+
+    if (canBusLoad(ppvt->busID, &load)) {
+	recGblSetSevr(prec, READ_ALARM, INVALID_ALARM);
+	return S_dev_noDevice;
+    }
+
+    switch (ppvt->stat) {
+	case LOAD_MAX:
+	    prec->val = load.loadMax;
+	    break;
+	case LOAD_MIN:
+	    prec->val = load.loadMin;
+	    break;
+	case BIT_RATE:
+	    prec->val = load.bitRateMax;
+	    break;
+	case FRAME_RATE:
+	    prec->val = load.frameRate;
+	    break;
+    }
+    if (prec->val < 0) {
+	recGblSetSevr(prec, UDF_ALARM, INVALID_ALARM);
+    }
+    prec->udf = FALSE;
+    return 2;		/* Don't convert */
+}
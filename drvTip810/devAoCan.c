@@ -332,8 +332,8 @@ static long write_ao (
 			    pcanAo->data);
 		#endif
 
-		status = canWrite(pcanAo->out.canBusID, &message, 
-				  pcanAo->out.timeout);
+		status = canWritePriority(pcanAo->out.canBusID, &message,
+					  prec->prio, pcanAo->out.timeout);
 		if (status) {
 		    #ifdef DEBUG
 			printf("canAo %s: canWrite status=%#x\n", 
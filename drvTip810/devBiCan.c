@@ -271,7 +271,8 @@ static long read_bi (
 		pcanBi->status = TIMEOUT_ALARM;
 
 		epicsTimerStartDelay(pcanBi->timId, pcanBi->inp.timeout);
-		canWrite(pcanBi->inp.canBusID, &message, pcanBi->inp.timeout);
+		canWritePriority(pcanBi->inp.canBusID, &message,
+				 prec->prio, pcanBi->inp.timeout);
 		return DO_NOT_CONVERT;
 	    }
 	default:
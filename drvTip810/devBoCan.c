@@ -247,8 +247,8 @@ static long write_bo (
 			    pcanBo->data);
 		#endif
 
-		status = canWrite(pcanBo->out.canBusID, &message, 
-				  pcanBo->out.timeout);
+		status = canWritePriority(pcanBo->out.canBusID, &message,
+					  prec->prio, pcanBo->out.timeout);
 		if (status) {
 		    #ifdef DEBUG
 			printf("canBo %s: canWrite status=%#x\n",
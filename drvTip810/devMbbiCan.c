@@ -273,7 +273,8 @@ static long read_mbbi (
 		pcanMbbi->status = TIMEOUT_ALARM;
 
 		epicsTimerStartDelay(pcanMbbi->timId, pcanMbbi->inp.timeout);
-		canWrite(pcanMbbi->inp.canBusID, &message, pcanMbbi->inp.timeout);
+		canWritePriority(pcanMbbi->inp.canBusID, &message,
+				 prec->prio, pcanMbbi->inp.timeout);
 		return DO_NOT_CONVERT;
 	    }
 	default:
@@ -274,8 +274,8 @@ static long read_mbbiDirect (
 
 		epicsTimerStartDelay(pcanMbbiDirect->timId,
 			pcanMbbiDirect->inp.timeout);
-		canWrite(pcanMbbiDirect->inp.canBusID, &message,
-			 pcanMbbiDirect->inp.timeout);
+		canWritePriority(pcanMbbiDirect->inp.canBusID, &message,
+				 prec->prio, pcanMbbiDirect->inp.timeout);
 		return DO_NOT_CONVERT;
 	    }
 	default:
@@ -249,8 +249,8 @@ static long write_mbbo (
 			    pcanMbbo->data);
 		#endif
 
-		status = canWrite(pcanMbbo->out.canBusID, &message, 
-				  pcanMbbo->out.timeout);
+		status = canWritePriority(pcanMbbo->out.canBusID, &message,
+					  prec->prio, pcanMbbo->out.timeout);
 		if (status) {
 		    #ifdef DEBUG
 			printf("canMbbo %s: canWrite status=%#x\n",
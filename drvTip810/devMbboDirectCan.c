@@ -249,8 +249,8 @@ static long write_mbboDirect (
 			    pcanMbboDirect->data);
 		#endif
 
-		status = canWrite(pcanMbboDirect->out.canBusID, &message, 
-				  pcanMbboDirect->out.timeout);
+		status = canWritePriority(pcanMbboDirect->out.canBusID, &message,
+					  prec->prio, pcanMbboDirect->out.timeout);
 		if (status) {
 		    #ifdef DEBUG
 			printf("canMbboDirect %s: canWrite status=%#x\n",
@@ -259,7 +259,8 @@ static long read_si (
 		pcanSi->status = TIMEOUT_ALARM;
 
 		epicsTimerStartDelay(pcanSi->timId, pcanSi->inp.timeout);
-		canWrite(pcanSi->inp.canBusID, &message, pcanSi->inp.timeout);
+		canWritePriority(pcanSi->inp.canBusID, &message,
+				 prec->prio, pcanSi->inp.timeout);
 		return 0;
 	    }
 	default:
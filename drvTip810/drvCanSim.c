@@ -0,0 +1,458 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    drvCanSim.c
+
+Description:
+    Software-simulated CAN Bus driver.  Each simulated bus is attached to
+    a named network; a message written on one bus is received by all of
+    the other buses on the same network, and by the sending bus too if
+    it was created with loopback enabled.  Messages are delivered by a
+    single task through a message queue, so callbacks run in task
+    context as they do with the hardware drivers.  This allows databases
+    to be run and CAN applications tested without any hardware, and
+    gives a reference against which to compare the hardware drivers.
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <iocsh.h>
+#include <dbDefs.h>
+#include <drvSup.h>
+#include <epicsThread.h>
+#include <epicsTimer.h>
+#include <epicsString.h>
+#include <epicsExport.h>
+#include <epicsMessageQueue.h>
+
+#include "canBus.h"
+#include "drvCanSim.h"
+
+
+/* Some local magic numbers */
+#define SIM_MAGIC_NUMBER 81003
+#define SIM_Q_SIZE 1000		/* Num messages to buffer */
+
+
+/* EPICS Driver Support Entry Table */
+
+struct drvet drvCanSim = {
+    2,
+    (DRVSUPFUN) canSimReport,
+    (DRVSUPFUN) canSimInitialise
+};
+epicsExportAddress(drvet, drvCanSim);
+
+
+/* CAN Controller Driver Table */
+
+static int simWrite(void *pdev, const canMessage_t *pmessage, double timeout);
+static int simReset(void *pdev);
+static int simStop(void *pdev);
+static int simRestart(void *pdev);
+
+static const canDriver_t simDriver = {
+    "Simulated",
+    simWrite,
+    simReset,
+    simStop,
+    simRestart,
+    NULL
+};
+
+
+typedef struct simDev_s {
+    struct simDev_s *pnext;	/* To next device. Must be first member */
+    int magicNumber;		/* device pointer confirmation */
+    char *pbusName;		/* Bus identification */
+    char *pnetwork;		/* Simulated network name */
+    int loopback;		/* Receive own messages */
+    canBusID_t busID;		/* canBus handle for this device */
+    int stopped;		/* canBusStop called */
+    int txCount;		/* messages transmitted */
+    int rxCount;		/* messages received */
+} simDev_t;
+
+typedef struct {
+   simDev_t *pdevice;
+   canMessage_t message;
+} simMsg_t;
+
+
+static simDev_t *psimFirst = NULL;
+static epicsMessageQueueId simQueue = NULL;
+
+
+/*******************************************************************************
+
+Routine:
+    canSimReport
+
+Purpose:
+    Report status of all simulated buses
+
+Returns:
+    0, or
+    S_can_badDevice if device list corrupted.
+
+*/
+
+int canSimReport (
+    int interest
+) {
+    simDev_t *pdevice = psimFirst;
+
+    while (pdevice != NULL) {
+	if (pdevice->magicNumber != SIM_MAGIC_NUMBER) {
+	    printf("canSim device list is corrupt\n");
+	    return S_can_badDevice;
+	}
+
+	printf("  '%s' : Simulated, network '%s'%s%s\n", pdevice->pbusName,
+		pdevice->pnetwork, pdevice->loopback ? ", loopback" : "",
+		pdevice->stopped ? " (stopped)" : "");
+
+	switch (interest) {
+	    case 1:
+		printf("\tMessages Sent       : %5d\n", pdevice->txCount);
+		printf("\tMessages Received   : %5d\n", pdevice->rxCount);
+		canBusShow(pdevice->busID, interest);
+		break;
+
+	    case 2:
+		canBusShow(pdevice->busID, interest);
+		break;
+	}
+	pdevice = pdevice->pnext;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canSimCreate
+
+Purpose:
+    Register a new simulated bus
+
+Description:
+    Registers the bus name with the canBus code and adds a new device
+    table to the end of the linked list.  Buses given the same network
+    name receive each other's messages.  Both names are copied, so iocsh
+    can reuse its argument buffers.
+
+Returns:
+    0,
+    ENOMEM if memory allocation fails,
+    S_can_duplicateBus if the bus name is already in use.
+
+Example:
+    canSimCreate "CAN1", "net0", 1
+
+*/
+
+int canSimCreate (
+    char *pbusName,	/* Unique Identifier for this bus */
+    char *pnetwork,	/* Network to attach the bus to */
+    int loopback	/* Non-zero to receive own messages */
+) {
+    simDev_t *pdevice, *plist = (simDev_t *) &psimFirst;
+    int status;
+
+    if (pbusName == NULL || pnetwork == NULL) {
+	printf("Usage: canSimCreate \"busName\", \"network\", loopback\n");
+	return S_can_noDevice;
+    }
+
+    if (simQueue == NULL) {
+	simQueue = epicsMessageQueueCreate(SIM_Q_SIZE, sizeof(simMsg_t));
+	if (simQueue == NULL) {
+	    return ENOMEM;
+	}
+    }
+
+    while (plist->pnext != NULL) {
+	plist = plist->pnext;
+    }
+    /* plist now points to the last item in the list */
+
+    pdevice = calloc(1, sizeof (simDev_t));
+    if (pdevice == NULL) {
+	return ENOMEM;
+    }
+
+    pdevice->magicNumber = SIM_MAGIC_NUMBER;
+    pdevice->pbusName    = epicsStrDup(pbusName);
+    pdevice->pnetwork    = epicsStrDup(pnetwork);
+    pdevice->loopback    = loopback;
+
+    status = canBusAdd(pbusName, &simDriver, pdevice, &pdevice->busID);
+    if (status) {
+	free(pdevice->pbusName);
+	free(pdevice->pnetwork);
+	free(pdevice);
+	return status;
+    }
+
+    plist->pnext = pdevice;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canSimSignal
+
+Purpose:
+    Simulate a bus status change
+
+Description:
+    Runs the canSignal callbacks for the named simulated bus with the
+    given status, CAN_BUS_OK, CAN_BUS_ERROR or CAN_BUS_OFF.
+
+Returns:
+    0, or S_can_noDevice if the bus does not exist or is not simulated.
+
+Example:
+    canSimSignal "CAN1", 2
+
+*/
+
+int canSimSignal (
+    const char *pbusName,
+    int status
+) {
+    canBusID_t busID;
+
+    if (canOpen(pbusName, &busID) ||
+	canBusPrivate(busID, &simDriver) == NULL) {
+	return S_can_noDevice;
+    }
+
+    canBusSignal(busID, status);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canSimTask
+
+Purpose:
+    Delivery task
+
+Description:
+    This routine is a background task started by canSimInitialise.  It
+    takes messages out of the queue and passes each one to every running
+    bus on the sender's network, then reports it sent to canBusTxDone.
+
+Returns:
+    void
+
+*/
+
+static void canSimTask (
+    void *dummy
+) {
+    simMsg_t qmsg;
+    simDev_t *pdevice;
+
+    while (TRUE) {
+	epicsMessageQueueReceive(simQueue, &qmsg, sizeof(simMsg_t));
+
+	for (pdevice = psimFirst; pdevice != NULL; pdevice = pdevice->pnext) {
+	    if (pdevice->stopped ||
+		(pdevice == qmsg.pdevice && !pdevice->loopback) ||
+		strcmp(pdevice->pnetwork, qmsg.pdevice->pnetwork) != 0)
+		continue;
+
+	    pdevice->rxCount++;
+	    canBusReceive(pdevice->busID, &qmsg.message);
+	}
+	canBusTxDone(qmsg.pdevice->busID, &qmsg.message, 0);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canSimInitialise
+
+Purpose:
+    Start the delivery task
+
+Description:
+    Under EPICS this routine is called by iocInit, which must occur
+    after all canSimCreate calls in the startup script.
+
+Returns:
+    0, ENOMEM, or -1 if the task could not be started.
+
+*/
+
+int canSimInitialise (
+    void
+) {
+    if (psimFirst == NULL) return 0;
+
+    if (canTimerQ == NULL)
+	canTimerQ = epicsTimerQueueAllocate(1, epicsThreadPriorityLow);
+    if (canTimerQ == NULL) return ENOMEM;
+
+    if (epicsThreadCreate("canSimTask", epicsThreadPriorityHigh,
+			  epicsThreadGetStackSize(epicsThreadStackMedium),
+			  canSimTask, NULL) == 0) return -1;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simReset, simStop, simRestart
+
+Purpose:
+    Control I/O on simulated CANbus
+
+Description:
+    canBus entry points.  A stopped bus neither sends nor receives.
+    simReset also zeros the counters.
+
+Returns:
+    0
+
+*/
+
+static int simReset (
+    void *pdev
+) {
+    simDev_t *pdevice = pdev;
+
+    pdevice->txCount = 0;
+    pdevice->rxCount = 0;
+    pdevice->stopped = FALSE;
+    return 0;
+}
+
+static int simStop (
+    void *pdev
+) {
+    simDev_t *pdevice = pdev;
+
+    pdevice->stopped = TRUE;
+    return 0;
+}
+
+static int simRestart (
+    void *pdev
+) {
+    simDev_t *pdevice = pdev;
+
+    pdevice->stopped = FALSE;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simWrite
+
+Purpose:
+    writes a CAN message to the simulated network
+
+Description:
+    canWrite entry point, queues the message for the delivery task.  If
+    the queue is full this waits for up to timeout seconds.
+
+Returns:
+    0, or
+    S_can_timeout if the queue stayed full or the bus is stopped.
+
+*/
+
+static int simWrite (
+    void *pdev,
+    const canMessage_t *pmessage,
+    double timeout
+) {
+    simDev_t *pdevice = pdev;
+    simMsg_t qmsg;
+
+    if (pdevice->stopped) {
+	return S_can_timeout;
+    }
+
+    qmsg.pdevice = pdevice;
+    qmsg.message = *pmessage;
+    if (epicsMessageQueueSendWithTimeout(simQueue, &qmsg, sizeof(simMsg_t),
+					 timeout > 0 ? timeout : 0)) {
+	return S_can_timeout;
+    }
+
+    pdevice->txCount++;
+    return 0;
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* canSimCreate(char *pbusName, char *pnetwork, int loopback) */
+static const iocshArg canSimCreateArg0 = {"busName",iocshArgPersistentString};
+static const iocshArg canSimCreateArg1 = {"network",iocshArgPersistentString};
+static const iocshArg canSimCreateArg2 = {"loopback", iocshArgInt};
+static const iocshArg * const canSimCreateArgs[3] = {
+    &canSimCreateArg0, &canSimCreateArg1, &canSimCreateArg2};
+static const iocshFuncDef canSimCreateFuncDef =
+    {"canSimCreate",3,canSimCreateArgs};
+static void canSimCreateCallFunc(const iocshArgBuf *arg)
+{
+    int status = canSimCreate(arg[0].sval, arg[1].sval, arg[2].ival);
+
+    if (status)
+	printf("canSimCreate: Error %#x creating bus\n", status);
+}
+
+/* canSimSignal(char *pbusName, int status) */
+static const iocshArg canSimSignalArg0 = {"busName", iocshArgString};
+static const iocshArg canSimSignalArg1 = {"status", iocshArgInt};
+static const iocshArg * const canSimSignalArgs[2] = {
+    &canSimSignalArg0, &canSimSignalArg1};
+static const iocshFuncDef canSimSignalFuncDef =
+    {"canSimSignal",2,canSimSignalArgs};
+static void canSimSignalCallFunc(const iocshArgBuf *args)
+{
+    canSimSignal(args[0].sval, args[1].ival);
+}
+
+/* canSimReport(int interest) */
+static const iocshArg canSimReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const canSimReportArgs[1] = {&canSimReportArg0};
+static const iocshFuncDef canSimReportFuncDef =
+    {"canSimReport",1,canSimReportArgs};
+static void canSimReportCallFunc(const iocshArgBuf *args)
+{
+    canSimReport(args[0].ival);
+}
+
+static void drvCanSimRegistrar(void) {
+    iocshRegister(&canSimCreateFuncDef,canSimCreateCallFunc);
+    iocshRegister(&canSimSignalFuncDef,canSimSignalCallFunc);
+    iocshRegister(&canSimReportFuncDef,canSimReportCallFunc);
+}
+epicsExportRegistrar(drvCanSimRegistrar);
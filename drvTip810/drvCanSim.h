@@ -0,0 +1,26 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    drvCanSim.h
+
+Description:
+    Header file for the software-simulated CAN Bus driver.
+
+*******************************************************************************/
+
+
+#ifndef INCdrvCanSimH
+#define INCdrvCanSimH
+
+#include "shareLib.h"
+
+
+epicsShareFunc int canSimCreate(char *busName, char *network, int loopback);
+epicsShareFunc int canSimSignal(const char *busName, int status);
+epicsShareFunc int canSimReport(int interest);
+epicsShareFunc int canSimInitialise(void);
+
+#endif /* INCdrvCanSimH */
@@ -0,0 +1,925 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    drvSocketCan.c
+
+Description:
+    CAN Bus driver for Linux SocketCAN network interfaces, implementing the
+    same canBus.h interface as drvTip810 so the CAN device support can be
+    used on soft IOCs with any adapter that has a SocketCAN driver, or with
+    the kernel's virtual vcan interface for testing.
+
+    Each bus is a CAN_RAW socket bound to one interface.  A single receive
+    task waits on all of the sockets with epoll and hands each frame
+    straight to canBusReceive, so there is no receive queue between the
+    kernel and the callbacks.  The kernel's CAN_RAW_FILTER list for each
+    socket is kept equal to the set of identifiers that the canBus code
+    has asked for, so frames nobody wants are dropped in the kernel.
+
+    The socket also receives its own frames back once the interface has
+    sent them, flagged with MSG_CONFIRM, which is how the end of each
+    transmission is reported to canBusTxDone.  The identifiers written
+    are added to the kernel filter list for that, and their echoes are
+    not passed to canBusReceive.
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/can/error.h>
+
+#include <iocsh.h>
+#include <dbDefs.h>
+#include <drvSup.h>
+#include <errlog.h>
+#include <epicsExit.h>
+#include <epicsMutex.h>
+#include <epicsTimer.h>
+#include <epicsThread.h>
+#include <epicsString.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "drvSocketCan.h"
+
+
+/* Some local magic numbers */
+#define SCAN_MAGIC_NUMBER 81002
+#define SCAN_MAX_FILTERS 512	/* Beyond this, take all frames */
+#define SCAN_POLL_SLICE 10	/* ms, canWrite retry interval */
+
+/* accept[] flags */
+#define SCAN_RX 1		/* wanted by canBus */
+#define SCAN_TX 2		/* written, for the echo */
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+
+/* EPICS Driver Support Entry Table */
+
+struct drvet drvSocketCan = {
+    2,
+    (DRVSUPFUN) socketCanReport,
+    (DRVSUPFUN) socketCanInitialise
+};
+epicsExportAddress(drvet, drvSocketCan);
+
+
+/* CAN Controller Driver Table */
+
+static int scanWrite(void *pdev, const canMessage_t *pmessage, double timeout);
+static int scanReset(void *pdev);
+static int scanStop(void *pdev);
+static int scanRestart(void *pdev);
+static int scanFilter(void *pdev, canID_t identifier, int enable);
+
+static const canDriver_t scanDriver = {
+    "Linux SocketCAN",
+    scanWrite,
+    scanReset,
+    scanStop,
+    scanRestart,
+    scanFilter
+};
+
+
+typedef struct scanDev_s {
+    struct scanDev_s *pnext;	/* To next device. Must be first member */
+    int magicNumber;		/* device pointer confirmation */
+    char *pbusName;		/* Bus identification */
+    char *pifName;		/* Linux network interface */
+    canBusID_t busID;		/* canBus handle for this device */
+    int sock;			/* CAN_RAW socket */
+    int stopped;		/* canBusStop called */
+    int txCount;		/* messages transmitted */
+    int txWaits;		/* writes that waited for buffer space */
+    int rxCount;		/* messages received */
+    int overCount;		/* controller overruns reported */
+    unsigned int dropCount;	/* frames dropped by the socket queue */
+    int errorCount;		/* Times entered Error state */
+    int busOffCount;		/* Times entered Bus Off state */
+    int nFilters;		/* kernel filters, 0 = all frames */
+    epicsMutexId filterSem;	/* guards the filter members below */
+    epicsUInt8 accept[CAN_IDENTIFIERS];	/* SCAN_RX, SCAN_TX flags */
+    int nExtended;		/* extended IDs wanted */
+    int allExtended;		/* acceptExt[] overflowed, take them all */
+    canID_t acceptExt[SCAN_MAX_FILTERS];	/* extended IDs wanted */
+    int nEchoExt;		/* extended IDs written */
+    int allEchoExt;		/* echoExt[] overflowed, take them all */
+    canID_t echoExt[SCAN_MAX_FILTERS];	/* extended IDs written */
+    struct can_filter filter[3 * SCAN_MAX_FILTERS];	/* kernel list */
+} scanDev_t;
+
+
+static scanDev_t *pscanFirst = NULL;
+static int epollFd = -1;
+
+
+/*******************************************************************************
+
+Routine:
+    socketCanReport
+
+Purpose:
+    Report status of all socketCan devices
+
+Description:
+    Prints a list of all the socketCan devices created, their interface
+    names and the bus name string.  For interest > 0 it gives additional
+    information about each device.
+
+Returns:
+    0, or
+    S_socketCan_badDevice if device list corrupted.
+
+*/
+
+int socketCanReport (
+    int interest
+) {
+    scanDev_t *pdevice = pscanFirst;
+
+    while (pdevice != NULL) {
+	if (pdevice->magicNumber != SCAN_MAGIC_NUMBER) {
+	    printf("socketCan device list is corrupt\n");
+	    return S_socketCan_badDevice;
+	}
+
+	printf("  '%s' : SocketCAN interface %s%s\n", pdevice->pbusName,
+		pdevice->pifName, pdevice->stopped ? " (stopped)" : "");
+
+	switch (interest) {
+	    case 1:
+		printf("\tMessages Sent       : %5d\n", pdevice->txCount);
+		printf("\tWrites Delayed      : %5d\n", pdevice->txWaits);
+		printf("\tMessages Received   : %5d\n", pdevice->rxCount);
+		printf("\tMessage Overruns    : %5d\n", pdevice->overCount);
+		printf("\tSocket Queue Drops  : %5u\n", pdevice->dropCount);
+		canBusShow(pdevice->busID, interest);
+		printf("\tError Events        : %5d\n", pdevice->errorCount);
+		printf("\tBus Off Events      : %5d\n", pdevice->busOffCount);
+		break;
+
+	    case 2:
+		canBusShow(pdevice->busID, interest);
+		if (pdevice->nFilters) {
+		    printf("\tKernel filters : %d\n", pdevice->nFilters);
+		} else {
+		    printf("\tKernel filters : none, all frames received\n");
+		}
+		break;
+	}
+	pdevice = pdevice->pnext;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    updateFilter
+
+Purpose:
+    Set the socket's kernel receive filters
+
+Description:
+    Gives the kernel one filter for each identifier that the canBus code
+    has enabled through scanFilter or that scanWrite has sent.  Remote
+    frames match the same filters as data frames.  If too many identifiers are enabled the socket is
+    opened up to all frames of that format and canBusReceive discards
+    the others.  The caller must hold filterSem.
+
+Returns:
+    void
+
+*/
+
+static void updateFilter (
+    scanDev_t *pdevice
+) {
+    struct can_filter *filter = pdevice->filter;
+    int n = 0, allStd = FALSE;
+    int id, i;
+
+    for (id = 0; id < CAN_IDENTIFIERS; id++) {
+	if (!pdevice->accept[id])
+	    continue;
+	if (n == SCAN_MAX_FILTERS) {
+	    allStd = TRUE;
+	    break;
+	}
+	filter[n].can_id   = id;
+	filter[n].can_mask = CAN_EFF_FLAG | CAN_SFF_MASK;
+	n++;
+    }
+    if (allStd) {		/* Too many, accept all standard frames */
+	filter[0].can_id   = 0;
+	filter[0].can_mask = CAN_EFF_FLAG;
+	n = 1;
+    }
+    if (pdevice->allExtended || pdevice->allEchoExt) {
+	filter[n].can_id   = CAN_EFF_FLAG;	/* All extended frames */
+	filter[n].can_mask = CAN_EFF_FLAG;
+	n++;
+    } else {
+	for (i = 0; i < pdevice->nExtended; i++) {
+	    filter[n].can_id   = CAN_EFF_FLAG | pdevice->acceptExt[i];
+	    filter[n].can_mask = CAN_EFF_FLAG | CAN_EFF_MASK;
+	    n++;
+	}
+	for (i = 0; i < pdevice->nEchoExt; i++) {
+	    filter[n].can_id   = CAN_EFF_FLAG | pdevice->echoExt[i];
+	    filter[n].can_mask = CAN_EFF_FLAG | CAN_EFF_MASK;
+	    n++;
+	}
+    }
+    pdevice->nFilters = (allStd || pdevice->allExtended ||
+			 pdevice->allEchoExt) ? 0 : n;
+    if (setsockopt(pdevice->sock, SOL_CAN_RAW, CAN_RAW_FILTER, filter,
+		   n * sizeof(struct can_filter)) < 0) {
+	errlogPrintf("socketCan: %s filter update failed, %s\n",
+		     pdevice->pbusName, strerror(errno));
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    scanFilter
+
+Purpose:
+    Start or stop receiving an identifier
+
+Description:
+    canBus filter entry point, called when the first callback for an ID
+    is registered or the last one deleted, and around canRead.  Extended
+    identifiers are kept in a short list.  Once more are wanted than it
+    holds the socket takes all extended frames, and keeps doing so until
+    every extended identifier has been released, since the ones that did
+    not fit were never recorded.
+
+Returns:
+    0
+
+*/
+
+static int scanFilter (
+    void *pdev,
+    canID_t identifier,
+    int enable
+) {
+    scanDev_t *pdevice = pdev;
+    int stored, i;
+
+    epicsMutexMustLock(pdevice->filterSem);
+    stored = pdevice->nExtended < SCAN_MAX_FILTERS ?
+	     pdevice->nExtended : SCAN_MAX_FILTERS;
+    if (!(identifier & CAN_EXTENDED)) {
+	if (enable)
+	    pdevice->accept[identifier] |= SCAN_RX;
+	else
+	    pdevice->accept[identifier] &= ~SCAN_RX;
+    } else if (enable) {
+	if (stored < SCAN_MAX_FILTERS)
+	    pdevice->acceptExt[stored] = identifier & ~CAN_EXTENDED;
+	else
+	    pdevice->allExtended = TRUE;
+	pdevice->nExtended++;
+    } else {
+	for (i = 0; i < stored; i++) {
+	    if (pdevice->acceptExt[i] == (identifier & ~CAN_EXTENDED))
+		break;
+	}
+	if (i < stored)
+	    pdevice->acceptExt[i] = pdevice->acceptExt[stored - 1];
+	if (--pdevice->nExtended == 0)
+	    pdevice->allExtended = FALSE;
+    }
+    updateFilter(pdevice);
+    epicsMutexUnlock(pdevice->filterSem);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    scanEcho
+
+Purpose:
+    Make sure the echo of a written identifier gets through the filter
+
+Description:
+    Called by scanWrite.  Written identifiers are never removed, so a
+    standard identifier can be checked without filterSem.  Once more
+    extended identifiers have been written than echoExt holds the
+    socket takes all extended frames.
+
+Returns:
+    void
+
+*/
+
+static void scanEcho (
+    scanDev_t *pdevice,
+    canID_t identifier
+) {
+    canID_t id = identifier & ~CAN_EXTENDED;
+    int i;
+
+    if (!(identifier & CAN_EXTENDED)) {
+	if (pdevice->accept[id] & SCAN_TX)
+	    return;
+	epicsMutexMustLock(pdevice->filterSem);
+	pdevice->accept[id] |= SCAN_TX;
+    } else {
+	epicsMutexMustLock(pdevice->filterSem);
+	for (i = 0; i < pdevice->nEchoExt; i++) {
+	    if (pdevice->echoExt[i] == id)
+		break;
+	}
+	if (i < pdevice->nEchoExt || pdevice->allEchoExt) {
+	    epicsMutexUnlock(pdevice->filterSem);
+	    return;
+	}
+	if (pdevice->nEchoExt < SCAN_MAX_FILTERS)
+	    pdevice->echoExt[pdevice->nEchoExt++] = id;
+	else
+	    pdevice->allEchoExt = TRUE;
+    }
+    updateFilter(pdevice);
+    epicsMutexUnlock(pdevice->filterSem);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    socketCanCreate
+
+Purpose:
+    Register a new SocketCAN bus
+
+Description:
+    Checks that the given interface name is unique, opens a CAN_RAW
+    socket bound to the interface, registers the bus name with the
+    canBus code and adds a new device table to the end of the linked
+    list.  Both names are copied, so iocsh can reuse its argument
+    buffers.  The interface must already be configured
+    and up; its bit rate is set outside the IOC, for example with
+	ip link set can0 type can bitrate 500000 restart-ms 100
+	ip link set up can0
+    or for testing
+	ip link add dev vcan0 type vcan
+	ip link set up vcan0
+
+Returns:
+    0,
+    ENOMEM if malloc() fails,
+    S_socketCan_duplicateDevice if the interface is already used,
+    S_can_duplicateBus if the bus name is already in use,
+    S_socketCan_noInterface if there is no such network interface,
+    an errno value if the socket can't be set up.
+
+Example:
+    socketCanCreate "CAN1", "can0"
+
+*/
+
+int socketCanCreate (
+    char *pbusName,	/* Unique Identifier for this device */
+    char *pifName	/* Linux network interface name */
+) {
+    scanDev_t *pdevice, *plist = (scanDev_t *) &pscanFirst;
+    struct sockaddr_can addr;
+    can_err_mask_t errMask = CAN_ERR_CRTL | CAN_ERR_BUSOFF | CAN_ERR_RESTARTED;
+    int enable = 1;
+    int ifIndex, sock, status;
+
+    if (pbusName == NULL || pifName == NULL) {
+	printf("Usage: socketCanCreate \"busName\", \"ifName\"\n");
+	return S_socketCan_noInterface;
+    }
+
+    while (plist->pnext != NULL) {
+	plist = plist->pnext;
+	if (strcmp(plist->pifName, pifName) == 0) {
+	    return S_socketCan_duplicateDevice;
+	}
+    }
+    /* plist now points to the last item in the list */
+
+    ifIndex = if_nametoindex(pifName);
+    if (ifIndex == 0) {
+	return S_socketCan_noInterface;
+    }
+
+    sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (sock < 0) {
+	return errno;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifIndex;
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	setsockopt(sock, SOL_CAN_RAW, CAN_RAW_ERR_FILTER,
+		   &errMask, sizeof(errMask)) < 0 ||
+	setsockopt(sock, SOL_CAN_RAW, CAN_RAW_RECV_OWN_MSGS,
+		   &enable, sizeof(enable)) < 0 ||
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) < 0) {
+	status = errno;
+	close(sock);
+	return status;
+    }
+    /* Optional: count frames dropped by the socket receive queue */
+    setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+    pdevice = calloc(1, sizeof (scanDev_t));
+    if (pdevice == NULL) {
+	close(sock);
+	return ENOMEM;
+    }
+    /* pdevice is our new device table, all counters zero */
+
+    pdevice->magicNumber = SCAN_MAGIC_NUMBER;
+    pdevice->pbusName    = epicsStrDup(pbusName);
+    pdevice->pifName     = epicsStrDup(pifName);
+    pdevice->sock        = sock;
+
+    pdevice->filterSem = epicsMutexCreate();
+    if (pdevice->filterSem == NULL) {
+	status = ENOMEM;
+	goto fail;
+    }
+
+    status = canBusAdd(pdevice->pbusName, &scanDriver, pdevice,
+		       &pdevice->busID);
+    if (status) {
+	epicsMutexDestroy(pdevice->filterSem);
+	goto fail;
+    }
+
+    /* No callbacks yet, so no frames */
+    epicsMutexMustLock(pdevice->filterSem);
+    updateFilter(pdevice);
+    epicsMutexUnlock(pdevice->filterSem);
+
+    plist->pnext = pdevice;
+    return 0;
+
+fail:
+    close(sock);
+    free(pdevice->pbusName);
+    free(pdevice->pifName);
+    free(pdevice);
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    socketCanShutdown
+
+Purpose:
+    Exit hook routine
+
+Description:
+    Closes all of the bus sockets.
+
+Returns:
+    void
+
+*/
+
+static void socketCanShutdown (
+    void *dummy
+) {
+    scanDev_t *pdevice = pscanFirst;
+
+    while (pdevice != NULL) {
+	if (pdevice->magicNumber != SCAN_MAGIC_NUMBER) {
+	    return;
+	}
+	close(pdevice->sock);
+	pdevice->sock = -1;
+	pdevice = pdevice->pnext;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    busError
+
+Purpose:
+    Convert a SocketCAN error frame into a canSignal status
+
+Description:
+    Controller error-passive and warning reports become CAN_BUS_ERROR, bus
+    off becomes CAN_BUS_OFF, and a restart or return to error-active
+    becomes CAN_BUS_OK.  At bus off the controller drops the frames it
+    was holding, so they are reported to canBusTxDone as lost.  The kernel restarts a bus-off controller itself
+    if the interface was configured with restart-ms.
+
+Returns:
+    void
+
+*/
+
+static void busError (
+    scanDev_t *pdevice,
+    const struct can_frame *pframe
+) {
+    int status;
+
+    if (pframe->can_id & CAN_ERR_CRTL &&
+	pframe->data[1] & (CAN_ERR_CRTL_RX_OVERFLOW |
+			   CAN_ERR_CRTL_TX_OVERFLOW)) {
+	pdevice->overCount++;
+    }
+
+    if (pframe->can_id & CAN_ERR_BUSOFF) {
+	status = CAN_BUS_OFF;
+	pdevice->busOffCount++;
+	canBusTxDone(pdevice->busID, NULL, S_can_txFailed);
+	if (!canSilenceErrors)
+	    errlogPrintf("socketCan: %s CANbus off event\n", pdevice->pbusName);
+    } else if (pframe->can_id & CAN_ERR_RESTARTED) {
+	status = CAN_BUS_OK;
+	if (!canSilenceErrors)
+	    errlogPrintf("socketCan: %s CANbus OK\n", pdevice->pbusName);
+    } else if (pframe->can_id & CAN_ERR_CRTL &&
+	       pframe->data[1] & (CAN_ERR_CRTL_RX_WARNING |
+				  CAN_ERR_CRTL_TX_WARNING |
+				  CAN_ERR_CRTL_RX_PASSIVE |
+				  CAN_ERR_CRTL_TX_PASSIVE)) {
+	status = CAN_BUS_ERROR;
+	pdevice->errorCount++;
+	if (!canSilenceErrors)
+	    errlogPrintf("socketCan: %s CANbus error event\n", pdevice->pbusName);
+#ifdef CAN_ERR_CRTL_ACTIVE
+    } else if (pframe->can_id & CAN_ERR_CRTL &&
+	       pframe->data[1] & CAN_ERR_CRTL_ACTIVE) {
+	status = CAN_BUS_OK;
+#endif
+    } else {
+	return;			/* Nothing the callbacks need to know */
+    }
+
+    canBusSignal(pdevice->busID, status);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    recvFrames
+
+Purpose:
+    Read and dispatch all frames waiting on a bus socket
+
+Description:
+    Reads until the non-blocking socket is empty, converting each frame
+    to a canMessage_t and passing it to canBusReceive, or to canBusTxDone
+    if it is the echo of one this socket sent.  The socket's queue
+    overflow count arrives as ancillary data with each frame.
+
+Returns:
+    void
+
+*/
+
+static void recvFrames (
+    scanDev_t *pdevice
+) {
+    struct can_frame frame;
+    char control[CMSG_SPACE(sizeof(epicsUInt32))];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    canMessage_t message;
+
+    iov.iov_base = &frame;
+    iov.iov_len  = sizeof(frame);
+
+    while (TRUE) {
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (recvmsg(pdevice->sock, &msg, 0) != sizeof(frame)) {
+	    return;			/* EAGAIN: socket is empty */
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+	    if (cmsg->cmsg_level == SOL_SOCKET &&
+		cmsg->cmsg_type == SO_RXQ_OVFL) {
+		memcpy(&pdevice->dropCount, CMSG_DATA(cmsg),
+		       sizeof(pdevice->dropCount));
+	    }
+	}
+
+	if (frame.can_id & CAN_ERR_FLAG) {
+	    busError(pdevice, &frame);
+	    continue;
+	}
+
+	if (frame.can_id & CAN_EFF_FLAG)
+	    message.identifier = CAN_EXTENDED | (frame.can_id & CAN_EFF_MASK);
+	else
+	    message.identifier = frame.can_id & CAN_SFF_MASK;
+	message.rtr        = (frame.can_id & CAN_RTR_FLAG) ? RTR : SEND;
+	message.length     = frame.can_dlc > CAN_DATA_SIZE ?
+			     CAN_DATA_SIZE : frame.can_dlc;
+	memcpy(message.data, frame.data, CAN_DATA_SIZE);
+
+	if (msg.msg_flags & MSG_CONFIRM) {	/* Our own frame, sent */
+	    canBusTxDone(pdevice->busID, &message, 0);
+	    continue;
+	}
+	if (pdevice->stopped) {
+	    continue;
+	}
+	pdevice->rxCount++;
+
+	canBusReceive(pdevice->busID, &message);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    socketCanRecvTask
+
+Purpose:
+    Receive task
+
+Description:
+    This routine is a background task started by socketCanInitialise.
+    It waits for any of the bus sockets to become readable and then
+    reads and dispatches everything that socket holds.
+
+Returns:
+    void
+
+*/
+
+static void socketCanRecvTask (
+    void *dummy
+) {
+    struct epoll_event events[8];
+    int i, n;
+
+    while (TRUE) {
+	n = epoll_wait(epollFd, events, 8, -1);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    errlogPrintf("socketCan: epoll_wait failed, %s; task exiting.\n",
+			 strerror(errno));
+	    return;
+	}
+	for (i = 0; i < n; i++) {
+	    recvFrames((scanDev_t *) events[i].data.ptr);
+	}
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    socketCanInitialise
+
+Purpose:
+    Start the receive task for all registered buses
+
+Description:
+    Under EPICS this routine is called by iocInit, which must occur
+    after all socketCanCreate calls in the startup script.  It adds the
+    bus sockets to an epoll set and starts the task that services them.
+
+Returns:
+    0, ENOMEM, or an errno value.
+
+*/
+
+int socketCanInitialise (
+    void
+) {
+    scanDev_t *pdevice = pscanFirst;
+    struct epoll_event event;
+
+    epicsAtExit(socketCanShutdown, NULL);
+
+    if (canTimerQ == NULL)
+	canTimerQ = epicsTimerQueueAllocate(1, epicsThreadPriorityLow);
+    if (canTimerQ == NULL) return ENOMEM;
+
+    if (pdevice == NULL) return 0;
+
+    epollFd = epoll_create(1);
+    if (epollFd < 0) return errno;
+
+    while (pdevice != NULL) {
+	event.events   = EPOLLIN;
+	event.data.ptr = pdevice;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, pdevice->sock, &event) < 0)
+	    return errno;
+	pdevice = pdevice->pnext;
+    }
+
+    if (epicsThreadCreate("canRecvTask", epicsThreadPriorityHigh,
+			  epicsThreadGetStackSize(epicsThreadStackMedium),
+			  socketCanRecvTask, NULL) == 0) return -1;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    scanReset, scanStop, scanRestart
+
+Purpose:
+    Control I/O on CANbus
+
+Description:
+    canBus entry points.  A socket can't reset its controller; that is
+    done with
+	ip link set can0 type can restart
+    scanStop discards received frames and rejects writes until scanRestart
+    is called.  scanReset also zeros the counters.
+
+Returns:
+    0
+
+*/
+
+static int scanReset (
+    void *pdev
+) {
+    scanDev_t *pdevice = pdev;
+
+    pdevice->txCount     = 0;
+    pdevice->txWaits     = 0;
+    pdevice->rxCount     = 0;
+    pdevice->overCount   = 0;
+    pdevice->errorCount  = 0;
+    pdevice->busOffCount = 0;
+    pdevice->stopped     = FALSE;
+    return 0;
+}
+
+static int scanStop (
+    void *pdev
+) {
+    scanDev_t *pdevice = pdev;
+
+    pdevice->stopped = TRUE;
+    return 0;
+}
+
+static int scanRestart (
+    void *pdev
+) {
+    scanDev_t *pdevice = pdev;
+
+    pdevice->stopped = FALSE;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    scanWrite
+
+Purpose:
+    writes a CAN message to the bus
+
+Description:
+    canWrite entry point, the message has already been checked.  The
+    socket is non-blocking; if the interface's transmit queue is full
+    the write is retried until it succeeds or timeout seconds have
+    passed.  A timeout of zero or less makes one attempt.  The frame's
+    echo reports the end of the transmission.
+
+Returns:
+    0,
+    S_socketCan_timeout if the queue stayed full or the bus is stopped,
+    an errno value for other socket errors.
+
+*/
+
+static int scanWrite (
+    void *pdev,
+    const canMessage_t *pmessage,
+    double timeout
+) {
+    scanDev_t *pdevice = pdev;
+    struct can_frame frame;
+    int remaining = timeout > 0 ? (int) (timeout * 1000.0) : 0;
+    int waited = FALSE;
+
+    if (pdevice->stopped) {
+	return S_socketCan_timeout;
+    }
+    scanEcho(pdevice, pmessage->identifier);
+
+    memset(&frame, 0, sizeof(frame));
+    if (pmessage->identifier & CAN_EXTENDED)
+	frame.can_id = CAN_EFF_FLAG | (pmessage->identifier & CAN_EFF_MASK);
+    else
+	frame.can_id = pmessage->identifier;
+    frame.can_dlc = pmessage->length;
+    if (pmessage->rtr == RTR) {
+	frame.can_id |= CAN_RTR_FLAG;
+    } else {
+	memcpy(frame.data, pmessage->data, pmessage->length);
+    }
+
+    while (write(pdevice->sock, &frame, sizeof(frame)) != sizeof(frame)) {
+	struct pollfd pfd;
+	int slice = remaining < SCAN_POLL_SLICE ? remaining : SCAN_POLL_SLICE;
+
+	/* ENOBUFS: the interface queue is full and poll() may not say
+	 * when it drains, so wait in short slices.
+	 */
+	if ((errno != EAGAIN && errno != ENOBUFS) || remaining <= 0) {
+	    return (errno == EAGAIN || errno == ENOBUFS) ?
+		S_socketCan_timeout : errno;
+	}
+	if (!waited) {
+	    pdevice->txWaits++;
+	    waited = TRUE;
+	}
+	pfd.fd     = pdevice->sock;
+	pfd.events = POLLOUT;
+	poll(&pfd, 1, slice);
+	remaining -= slice;
+    }
+
+    pdevice->txCount++;
+    return 0;
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* socketCanCreate(char *pbusName, char *pifName) */
+static const iocshArg socketCanCreateArg0 = {"busName",iocshArgPersistentString};
+static const iocshArg socketCanCreateArg1 = {"ifName",iocshArgPersistentString};
+static const iocshArg * const socketCanCreateArgs[2] = {
+    &socketCanCreateArg0, &socketCanCreateArg1};
+static const iocshFuncDef socketCanCreateFuncDef =
+    {"socketCanCreate",2,socketCanCreateArgs};
+static void socketCanCreateCallFunc(const iocshArgBuf *arg)
+{
+    int status = socketCanCreate(arg[0].sval, arg[1].sval);
+
+    if (status)
+	printf("socketCanCreate: Error %#x creating bus\n", status);
+}
+
+/* socketCanReport(int interest) */
+static const iocshArg socketCanReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const socketCanReportArgs[1] = {&socketCanReportArg0};
+static const iocshFuncDef socketCanReportFuncDef =
+    {"socketCanReport",1,socketCanReportArgs};
+static void socketCanReportCallFunc(const iocshArgBuf *args)
+{
+    socketCanReport(args[0].ival);
+}
+
+static void drvSocketCanRegistrar(void) {
+    iocshRegister(&socketCanCreateFuncDef,socketCanCreateCallFunc);
+    iocshRegister(&socketCanReportFuncDef,socketCanReportCallFunc);
+}
+epicsExportRegistrar(drvSocketCanRegistrar);
@@ -0,0 +1,37 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    drvSocketCan.h
+
+Description:
+    Header file for the Linux SocketCAN CAN Bus driver.
+
+*******************************************************************************/
+
+
+#ifndef INCdrvSocketCanH
+#define INCdrvSocketCanH
+
+#include "shareLib.h"
+
+
+/* Error Numbers */
+
+#ifndef M_socketCan
+#define M_socketCan		(812<<16)
+#endif
+
+#define S_socketCan_duplicateDevice (M_socketCan| 1) /*duplicate bus or interface name*/
+#define S_socketCan_noInterface	(M_socketCan| 2) /*no such CAN network interface*/
+#define S_socketCan_badDevice	(M_socketCan| 3) /*device pointer is not for socketCan*/
+#define S_socketCan_timeout	(M_socketCan| 4) /*timeout during request*/
+
+
+epicsShareFunc int socketCanCreate(char *busName, char *ifName);
+epicsShareFunc int socketCanReport(int interest);
+epicsShareFunc int socketCanInitialise(void);
+
+#endif /* INCdrvSocketCanH */
@@ -38,7 +38,6 @@ Copyright (c) 1995-2007 Andrew Johnson
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <errno.h>
 
 #include <iocsh.h>
@@ -46,9 +45,9 @@ Copyright (c) 1995-2007 Andrew Johnson
 #include <devLib.h>
 #include <epicsExit.h>
 #include <epicsEvent.h>
-#include <epicsMutex.h>
 #include <epicsTimer.h>
 #include <epicsThread.h>
+#include <epicsString.h>
 #include <epicsExport.h>
 #include <epicsInterrupt.h>
 #include <epicsMessageQueue.h>
@@ -57,11 +56,19 @@ Copyright (c) 1995-2007 Andrew Johnson
 #include "drvTip810.h"
 #include "drvIpac.h"
 #include "pca82c200.h"
+#include "sja1000.h"
 
 
 /* Some local magic numbers */
 #define T810_MAGIC_NUMBER 81001
 #define RECV_Q_SIZE 1000	/* Num messages to buffer */
+#define RX_BUDGET 24		/* Max messages taken per interrupt */
+
+/* Set non-zero to recover from receive overruns by resetting the chip
+ * as older releases did, rather than with the clear overrun command.
+ */
+int t810OverrunReset = FALSE;
+epicsExportAddress(int, t810OverrunReset);
 
 /* These are the IPAC IDs for this module */
 #define IP_MANUFACTURER_TEWS 0xb3 
@@ -77,40 +84,49 @@ struct drvet drvTip810 = {
 };
 epicsExportAddress(drvet, drvTip810);
 
-epicsTimerQueueId canTimerQ = NULL;
 
+/* CAN Controller Driver Table */
 
-typedef void callback_t(void *pprivate, long parameter);
+static int t810Write(void *pdev, const canMessage_t *pmessage, double timeout);
+static int t810Reset(void *pdev);
+static int t810Stop(void *pdev);
+static int t810Restart(void *pdev);
 
-typedef struct callbackTable_s {
-    struct callbackTable_s *pnext;	/* linked list ... */
-    void *pprivate;			/* reference for callback routine */
-    callback_t *pcallback;		/* registered routine */
-} callbackTable_t;
+static const canDriver_t t810Driver = {
+    "TEWS TIP810",
+    t810Write,
+    t810Reset,
+    t810Stop,
+    t810Restart,
+    NULL
+};
 
 
-typedef struct canBusID_s {
-    struct canBusID_s *pnext;	/* To next device. Must be first member */
+typedef struct t810Dev_s {
+    struct t810Dev_s *pnext;	/* To next device. Must be first member */
     int magicNumber;		/* device pointer confirmation */
     char *pbusName;		/* Bus identification */
+    canBusID_t busID;		/* canBus handle for this device */
     int card;			/* Industry Pack address */
     int slot;			/*     "     "      "    */
     int irqNum; 		/* interrupt vector number */
     int busRate;		/* bit rate of bus in Kbits/sec */
     pca82c200_t *pchip;		/* controller registers */
+    sja1000_t *psja;		/* same, PeliCAN mode, or NULL */
+    epicsUInt8 peliMode;	/* PeliCAN mode register when running */
+    epicsUInt8 acceptCode[4];	/* PeliCAN acceptance filters */
+    epicsUInt8 acceptMask[4];
+    int filter1Ext;		/* Dual filter 1 is for extended frames */
     epicsEventId txSem;		/* Transmit complete signal */
+    canMessage_t txMessage;	/* In the transmit buffer */
+    int txPending;		/* txMessage not yet reported */
     int txCount;		/* messages transmitted */
     int rxCount;		/* messages received */
     int overCount;		/* overrun - lost messages */
-    int unusedCount;		/* messages without callback */
-    canID_t unusedId;		/* last ID received without a callback */
+    int overResets;		/* overruns recovered by chip reset */
     int errorCount;		/* Times entered Error state */
     int busOffCount;		/* Times entered Bus Off state */
-    epicsMutexId readSem;	/* canRead task Mutex */
-    canMessage_t *preadBuffer;	/* canRead destination buffer */
-    epicsEventId rxSem;		/* canRead message arrival signal */
-    callbackTable_t *pmsgHandler[CAN_IDENTIFIERS];	/* message callbacks */
-    callbackTable_t *psigHandler;	/* error signal callbacks */
+    int rxPeak;			/* Most messages taken in one interrupt */
 } t810Dev_t;
 
 typedef struct {
@@ -122,7 +138,6 @@ typedef struct {
 static t810Dev_t *pt810First = NULL;
 static epicsMessageQueueId receiptQueue = NULL;
 
-int canSilenceErrors = FALSE;	/* for EPICS device support use */
 int t810maxQueued = 0;		/* not static so may be reset by operator */
 
 /*******************************************************************************
@@ -145,8 +160,9 @@ Returns:
 int t810Status (
     canBusID_t canBusID
 ) {
-    t810Dev_t *pdevice = canBusID;
-    if (canBusID != 0 &&
+    t810Dev_t *pdevice = canBusPrivate(canBusID, &t810Driver);
+
+    if (pdevice != NULL &&
 	pdevice->magicNumber == T810_MAGIC_NUMBER) {
 	return pdevice->pchip->status;
     } else {
@@ -178,8 +194,6 @@ int t810Report (
     int interest
 ) {
     t810Dev_t *pdevice = pt810First;
-    canID_t id;
-    int printed;
     int status;
 
     if (interest > 0) {
@@ -194,40 +208,26 @@ int t810Report (
 	    return S_t810_badDevice;
 	}
 
-	printf("  '%s' : IP Carrier %hd Slot %hd, Bus rate %d Kbits/sec\n", 
+	printf("  '%s' : IP Carrier %hd Slot %hd, Bus rate %d Kbits/sec%s\n", 
 		pdevice->pbusName, pdevice->card, pdevice->slot, 
-		pdevice->busRate);
+		pdevice->busRate, pdevice->psja ? ", PeliCAN" : "");
 
 	switch (interest) {
 	    case 1:
 		printf("\tMessages Sent       : %5d\n", pdevice->txCount);
 		printf("\tMessages Received   : %5d\n", pdevice->rxCount);
 		printf("\tMessage Overruns    : %5d\n", pdevice->overCount);
-		printf("\tDiscarded Messages  : %5d\n", pdevice->unusedCount);
-		if (pdevice->unusedCount > 0) {
-		    printf("\tLast Discarded ID   : %#5x\n", pdevice->unusedId);
-		}
+		printf("\t  Cleared / Resets  : %5d / %d\n",
+			pdevice->overCount - pdevice->overResets,
+			pdevice->overResets);
+		printf("\tPeak Rx / Interrupt : %5d\n", pdevice->rxPeak);
+		canBusShow(pdevice->busID, interest);
 		printf("\tError Interrupts    : %5d\n", pdevice->errorCount);
 		printf("\tBus Off Events      : %5d\n", pdevice->busOffCount);
 		break;
 
 	    case 2:
-		printed = 0;
-		printf("\tCallbacks registered: ");
-		for (id=0; id < CAN_IDENTIFIERS; id++) {
-		    if (pdevice->pmsgHandler[id] != NULL) {
-			if (printed % 10 == 0) {
-			    printf("\n\t    ");
-			}
-			printf("0x%-3hx  ", id);
-			printed++;
-		    }
-		}
-		if (printed == 0) {
-		    printf("None.");
-		}
-		printf("\n\tcanRead Status : %s\n", 
-			pdevice->preadBuffer ? "Active" : "Idle");
+		canBusShow(pdevice->busID, interest);
 		break;
 
 	    case 3:
@@ -250,6 +250,21 @@ int t810Report (
 			status & PCA_SR_TCS ? "Complete" : "Incomplete");
 		printf("\tTransmit Buffer Access : %s\n",
 			status & PCA_SR_TBS ? "Released" : "Locked");
+		if (pdevice->psja) {
+		    sja1000_t *psja = pdevice->psja;
+		    int i;
+
+		    printf("\tRx/Tx Error Counters   : %d / %d\n",
+			    psja->rxErrorCounter, psja->txErrorCounter);
+		    printf("\tMessages in Rx FIFO    : %d\n",
+			    psja->rxMsgCounter);
+		    printf("\tAcceptance Filter      : %s,",
+			    pdevice->peliMode & SJA_MOD_AFM ? "Single" : "Dual");
+		    for (i = 0; i < 4; i++)
+			printf(" %02x/%02x", pdevice->acceptCode[i],
+				pdevice->acceptMask[i]);
+		    printf("\n");
+		}
 		break;
 	}
 	pdevice = pdevice->pnext;
@@ -258,6 +273,42 @@ int t810Report (
 }
 
 
+/*******************************************************************************
+
+Routine:
+    setPeliFilter
+
+Purpose:
+    Load the PeliCAN acceptance filter registers
+
+Description:
+    The acceptance code and mask registers can only be written in Reset
+    mode, so this resets the chip if it is running and then restores
+    the previous mode, with the acceptance filter mode bit from the
+    device table.  The chip mask registers use 1 for don't care.
+
+Returns:
+    void
+
+*/
+
+static void setPeliFilter (
+    t810Dev_t *pdevice
+) {
+    sja1000_t *psja = pdevice->psja;
+    epicsUInt8 mode = psja->mode;
+    int i;
+
+    psja->mode = mode | SJA_MOD_RM;
+    for (i = 0; i < 4; i++) {
+	psja->SJA_ACR(i) = pdevice->acceptCode[i];
+	psja->SJA_AMR(i) = ~pdevice->acceptMask[i];
+    }
+    psja->mode = (mode & ~SJA_MOD_AFM) |
+		 (pdevice->peliMode & SJA_MOD_AFM);
+}
+
+
 /*******************************************************************************
 
 Routine:
@@ -267,19 +318,25 @@ Purpose:
     Register a new TIP810 device
 
 Description:
-    Checks that the given name and card/slot numbers are unique, then
-    creates a new device table, initialises it and adds it to the end
-    of the linked list.
+    Checks that the given card/slot numbers are unique, then creates a
+    new device table, registers the bus name with the canBus code,
+    initialises it and adds it to the end of the linked list.  If mode
+    is T810_MODE_PELICAN the controller must be an SJA1000, which is
+    switched to PeliCAN mode for extended identifiers and its receive
+    FIFO; otherwise the chip is run in PCA82C200 compatible mode.
 
 Returns:
     0,
     ENOMEM if malloc() fails,
     S_t810_badBusRate for an unsupported bus rate,
     S_t810_duplicateDevice if card/slot already used,
+    S_can_duplicateBus if the bus name is already in use,
+    S_t810_badMode if mode is not T810_MODE_BASIC or T810_MODE_PELICAN,
+    S_t810_noPeliCan if PeliCAN mode was asked for but is not available,
     any result from ipmValidate().
 
 Example:
-    t810Create "CAN1", 0, 0, 0x60, 500
+    t810Create "CAN1", 0, 0, 0x60, 500, 1
 
 */
 
@@ -288,7 +345,8 @@ int t810Create (
     int card,		/* Ipac Driver card .. */
     int slot,		/* .. and slot number */
     int irqNum, 	/* interrupt vector number */
-    int busRate 	/* in Kbits/sec */
+    int busRate,	/* in Kbits/sec */
+    int mode		/* T810_MODE_BASIC or T810_MODE_PELICAN */
 ) {
     static const struct {
 	int rate;
@@ -312,7 +370,7 @@ int t810Create (
 	{ 0,	0,		0		}
     };
     t810Dev_t *pdevice, *plist = (t810Dev_t *) &pt810First;
-    int status, rateIndex, id;
+    int status, rateIndex;
 
     status = ipmValidate(card, slot, IP_MANUFACTURER_TEWS, 
 			 IP_MODEL_TEWS_TIP810);
@@ -324,6 +382,10 @@ int t810Create (
     if (busRate == 0) {
 	return S_t810_badBusRate;
     }
+    if (mode != T810_MODE_BASIC &&
+	mode != T810_MODE_PELICAN) {
+	return S_t810_badMode;
+    }
     for (rateIndex = 0; rateTable[rateIndex].rate != busRate; rateIndex++) {
 	if (rateTable[rateIndex].rate == 0) {
 	    return S_t810_badBusRate;
@@ -333,9 +395,8 @@ int t810Create (
 
     while (plist->pnext != NULL) {
 	plist = plist->pnext;
-	if (strcmp(plist->pbusName, pbusName) == 0 || 
-	    (plist->card == card && 
-	     plist->slot == slot)) {
+	if (plist->card == card &&
+	    plist->slot == slot) {
 	    return S_t810_duplicateDevice;
 	}
     }
@@ -349,40 +410,75 @@ int t810Create (
 
     pdevice->pnext       = NULL;
     pdevice->magicNumber = T810_MAGIC_NUMBER;
-    pdevice->pbusName    = pbusName;
+    pdevice->pbusName    = epicsStrDup(pbusName);
     pdevice->card        = card;
     pdevice->slot        = slot;
     pdevice->irqNum      = irqNum;
     pdevice->busRate     = busRate;
     pdevice->pchip       = (pca82c200_t *) ipmBaseAddr(card, slot, ipac_addrIO);
-    pdevice->preadBuffer = NULL;
-    pdevice->psigHandler = NULL;
-
-    for (id=0; id<CAN_IDENTIFIERS; id++) {
-	pdevice->pmsgHandler[id] = NULL;
-    }
+    pdevice->psja        = NULL;
+    pdevice->peliMode    = 0;		/* Dual filters, all accepted */
+    pdevice->rxPeak      = 0;
+    memset(pdevice->acceptCode, 0, sizeof(pdevice->acceptCode));
+    memset(pdevice->acceptMask, 0, sizeof(pdevice->acceptMask));
+    pdevice->filter1Ext  = FALSE;
+    pdevice->txPending   = FALSE;
 
     pdevice->txSem   = epicsEventCreate(epicsEventFull);
-    pdevice->rxSem   = epicsEventCreate(epicsEventEmpty);
-    pdevice->readSem = epicsMutexCreate();
-    if (pdevice->txSem == NULL ||
-	pdevice->rxSem == NULL ||
-	pdevice->readSem == NULL) {
-	free(pdevice);		/* Ought to free those semaphores, but... */
+    if (pdevice->txSem == NULL) {
+	free(pdevice->pbusName);
+	free(pdevice);
 	return ENOMEM;
     }
 
+    if (mode == T810_MODE_PELICAN) {
+	sja1000_t *psja = (sja1000_t *) pdevice->pchip;
+
+	/* A PCA82C200 has no CAN mode bit, so this won't stick */
+	pdevice->pchip->control = PCA_CR_RR;
+	psja->clockDivider |= SJA_CDR_CANMODE;
+	if (!(psja->clockDivider & SJA_CDR_CANMODE)) {
+	    epicsEventDestroy(pdevice->txSem);
+	    free(pdevice->pbusName);
+	    free(pdevice);
+	    return S_t810_noPeliCan;
+	}
+	pdevice->psja = psja;
+    }
+
+    status = canBusAdd(pbusName, &t810Driver, pdevice, &pdevice->busID);
+    if (status) {
+	epicsEventDestroy(pdevice->txSem);
+	free(pdevice->pbusName);
+	free(pdevice);
+	return status;
+    }
+    canBusBitRate(pdevice->busID, 1000 * abs(busRate));
+
     plist->pnext = pdevice;
     /* device table interface stuff filled in and added to list */
 
-    pdevice->pchip->control        = PCA_CR_RR;	/* Reset state */
-    pdevice->pchip->acceptanceCode = 0;
-    pdevice->pchip->acceptanceMask = 0xff;
-    pdevice->pchip->busTiming0     = rateTable[rateIndex].busTiming0;
-    pdevice->pchip->busTiming1     = rateTable[rateIndex].busTiming1;
-    pdevice->pchip->outputControl  = PCA_OCR_OCM_NORMAL |
-				     PCA_OCR_OCT0_PUSHPULL |
-				     PCA_OCR_OCT1_PUSHPULL;
+    if (pdevice->psja) {
+	sja1000_t *psja = pdevice->psja;
+
+	psja->mode          = SJA_MOD_RM;	/* Reset state */
+	psja->intEnable     = 0;
+	psja->busTiming0    = rateTable[rateIndex].busTiming0;
+	psja->busTiming1    = rateTable[rateIndex].busTiming1;
+	psja->outputControl = PCA_OCR_OCM_NORMAL |
+			      PCA_OCR_OCT0_PUSHPULL |
+			      PCA_OCR_OCT1_PUSHPULL;
+	setPeliFilter(pdevice);
+    } else {
+	pdevice->pchip->control        = PCA_CR_RR;	/* Reset state */
+	pdevice->pchip->acceptanceCode = 0;
+	pdevice->pchip->acceptanceMask = 0xff;
+	pdevice->pchip->busTiming0     = rateTable[rateIndex].busTiming0;
+	pdevice->pchip->busTiming1     = rateTable[rateIndex].busTiming1;
+	pdevice->pchip->outputControl  = PCA_OCR_OCM_NORMAL |
+					 PCA_OCR_OCT0_PUSHPULL |
+					 PCA_OCR_OCT1_PUSHPULL;
+    }
     /* chip now initialised, but held in the Reset state */
 
     ipmIrqCmd(card, slot, 0, ipac_statActive);
@@ -515,26 +611,242 @@ static void putTxMessage (
 /*******************************************************************************
 
 Routine:
-    doCallbacks
+    getPeliMessage
+
+Purpose:
+    Copy a received message from the PeliCAN receive FIFO to memory
+
+Description:
+    Reads the message at the head of the chip receive FIFO into the
+    message buffer and releases it, which brings the next message (if
+    any) into the receive buffer window.
+
+Returns:
+    void
+
+*/
+
+static void getPeliMessage (
+    sja1000_t *psja,
+    canMessage_t *pmessage
+) {
+    epicsUInt8 info = psja->frame[0].reg;
+    int i, data;
+
+    if (info & SJA_FI_FF) {
+	pmessage->identifier = CAN_EXTENDED |
+			       (psja->frame[1].reg << 21) |
+			       (psja->frame[2].reg << 13) |
+			       (psja->frame[3].reg << 5) |
+			       (psja->frame[4].reg >> SJA_EFF_ID_LSHIFT);
+	data = SJA_EFF_DATA;
+    } else {
+	pmessage->identifier = (psja->frame[1].reg << 3) |
+			       (psja->frame[2].reg >> SJA_SFF_ID1_LSHIFT);
+	data = SJA_SFF_DATA;
+    }
+    pmessage->length = info & SJA_FI_DLC_MASK;
+    if (pmessage->length > CAN_DATA_SIZE) {
+	pmessage->length = CAN_DATA_SIZE;
+    }
+
+    if (info & SJA_FI_RTR) {
+	pmessage->rtr = RTR;
+    } else {
+	pmessage->rtr = SEND;
+	for (i=0; i<pmessage->length; i++) {
+	    pmessage->data[i] = psja->frame[data + i].reg;
+	}
+    }
+
+    psja->command = SJA_CMR_RRB;	/* Finished with this message */
+}
+
+
+/*******************************************************************************
+
+Routine:
+    putPeliMessage
+
+Purpose:
+    Copy a message from memory to the PeliCAN transmit buffer
+
+Description:
+    Copies a message from the message buffer into the chip transmit
+    buffer, in standard or extended frame format according to the
+    identifier, and flags the chip to transmit the message.
+
+Returns:
+    void
+
+*/
+
+static void putPeliMessage (
+    sja1000_t *psja,
+    const canMessage_t *pmessage
+) {
+    epicsUInt8 info = pmessage->length & SJA_FI_DLC_MASK;
+    canID_t id = pmessage->identifier & ~CAN_EXTENDED;
+    int i, data;
+
+    if (pmessage->identifier & CAN_EXTENDED) {
+	id <<= SJA_EFF_ID_LSHIFT;
+	info |= SJA_FI_FF;
+	psja->frame[1].reg = id >> 24;
+	psja->frame[2].reg = id >> 16;
+	psja->frame[3].reg = id >> 8;
+	psja->frame[4].reg = id;
+	data = SJA_EFF_DATA;
+    } else {
+	psja->frame[1].reg = id >> 3;
+	psja->frame[2].reg = id << SJA_SFF_ID1_LSHIFT;
+	data = SJA_SFF_DATA;
+    }
+
+    if (pmessage->rtr == SEND) {
+	for (i=0; i<pmessage->length; i++) {
+	    psja->frame[data + i].reg = pmessage->data[i];
+	}
+    } else {
+	info |= SJA_FI_RTR;
+    }
+    psja->frame[0].reg = info;
+
+    psja->command = SJA_CMR_TR;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810TxDone
 
 Purpose:
-    calls all routines in the given list
+    Report the end of a transmission to canBus
 
 Description:
+    Passes the message in the transmit buffer to canBusTxDone with the
+    given status, if it hasn't been reported yet.  Called from the ISRs
+    on a transmit interrupt, with S_can_txFailed if the chip says the
+    transmission was not completed, and with S_can_txFailed at bus off
+    or when the chip is halted, which abort the transmission.
 
+Returns:
+    void
+
+*/
+
+static void t810TxDone (
+    t810Dev_t *pdevice,
+    int status
+) {
+    int key = epicsInterruptLock();
+
+    if (pdevice->txPending) {
+	pdevice->txPending = FALSE;
+	canBusTxDone(pdevice->busID, &pdevice->txMessage, status);
+    }
+    epicsInterruptUnlock(key);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810PeliISR
+
+Purpose:
+    Interrupt Service Routine, PeliCAN mode
+
+Description:
+    Reading the interrupt register clears all of the flags except the
+    receive interrupt, which stays set until the receive FIFO is empty.
+    The FIFO is drained in a loop, up to RX_BUDGET messages, so a burst
+    of messages is taken in one interrupt; if the budget runs out the
+    interrupt is still pending and the ISR is re-entered.  Overruns are
+    handled as in t810ISR.
 
 Returns:
     void
 
 */
 
-static void doCallbacks (
-    callbackTable_t *phandler,
-    long parameter
+static void t810PeliISR (
+    t810Dev_t *pdevice
 ) {
-    while (phandler != NULL) {
-	(*phandler->pcallback)(phandler->pprivate, parameter);
-	phandler = phandler->pnext;
+    sja1000_t *psja = pdevice->psja;
+    int intSource = psja->interrupt;
+
+    if (intSource & SJA_IR_DOI) {		/* Data Overrun Interrupt */
+	pdevice->overCount++;
+	if (t810OverrunReset) {
+	    pdevice->overResets++;
+	    t810Stop(pdevice);
+	    t810Restart(pdevice);
+	    intSource |= psja->interrupt;
+	} else {
+	    psja->command = SJA_CMR_CDO;
+	}
+    }
+
+    if (intSource & SJA_IR_RI) {		/* Receive Interrupt */
+	t810Receipt_t qmsg;
+	int taken = 0;
+
+	qmsg.pdevice = pdevice;
+	while ((psja->status & SJA_SR_RBS) &&
+	       taken < RX_BUDGET) {
+	    getPeliMessage(psja, &qmsg.message);
+	    taken++;
+
+	    if (epicsMessageQueueTrySend(receiptQueue, &qmsg,
+				sizeof(t810Receipt_t)) && !canSilenceErrors)
+		epicsInterruptContextMessage("Warning: CANbus receive queue overflow");
+	}
+	if (taken > pdevice->rxPeak) {
+	    pdevice->rxPeak = taken;
+	}
+    }
+
+    if (intSource & (SJA_IR_EI | SJA_IR_EPI)) {	/* Error Interrupts */
+	int status;
+
+	switch (psja->status & (SJA_SR_ES | SJA_SR_BS)) {
+	    case SJA_SR_ES:
+		status = CAN_BUS_ERROR;
+		pdevice->errorCount++;
+		if (!canSilenceErrors)
+		    epicsInterruptContextMessage("t810ISR: CANbus error event");
+		break;
+	    case SJA_SR_BS:
+	    case SJA_SR_BS | SJA_SR_ES:
+		status = CAN_BUS_OFF;
+		pdevice->busOffCount++;
+		t810TxDone(pdevice, S_can_txFailed);
+		epicsEventSignal(pdevice->txSem);	/* Signal transmit */
+		psja->mode &= ~SJA_MOD_RM;	/* Start bus-off recovery */
+		if (!canSilenceErrors)
+		    epicsInterruptContextMessage("t810ISR: CANbus off event");
+		break;
+	    default:
+		status = CAN_BUS_OK;
+		if (!canSilenceErrors)
+		    epicsInterruptContextMessage("t810ISR: CANbus OK");
+		break;
+	}
+
+	canBusSignal(pdevice->busID, status);
+    }
+
+    if (intSource & SJA_IR_TI) {		/* Transmit Interrupt */
+	pdevice->txCount++;
+	t810TxDone(pdevice, (psja->status & SJA_SR_TCS) ? 0 : S_can_txFailed);
+	epicsEventSignal(pdevice->txSem);
+    }
+
+    if (intSource & SJA_IR_WUI) {		/* Wake-up Interrupt */
+	if (!canSilenceErrors)
+	    epicsInterruptContextMessage("Wake-up Interrupt from CANbus");
     }
 }
 
@@ -548,6 +860,18 @@ Purpose:
     Interrupt Service Routine
 
 Description:
+    The PCA82C200 has two receive buffers, and reading the interrupt
+    register clears the receive interrupt even if the second buffer is
+    also full, so messages are taken in a loop for as long as the
+    Receive Buffer Status bit stays set, up to RX_BUDGET messages.
+    An overrun means a message was lost, but the buffered messages are
+    still good; the Clear Overrun command lets the chip carry on without
+    the reset and bus re-synchronisation that a t810Stop/t810Restart
+    costs, which under heavy traffic tends to cause further overruns.
+    The old behaviour can be selected with t810OverrunReset, and the
+    report shows how many overruns were recovered each way.
+    The parameter is the device's position in the list, as a pointer
+    doesn't fit in the int that ipmIntConnect passes on 64-bit hosts.
 
 
 Returns:
@@ -556,34 +880,58 @@ Returns:
 */
 
 static void t810ISR (
-    int pdev
+    int index
 ) {
-    t810Dev_t *pdevice = (t810Dev_t *) pdev;
-    int intSource = pdevice->pchip->interrupt;
+    t810Dev_t *pdevice = pt810First;
+    int intSource;
+
+    while (index-- > 0) {
+	pdevice = pdevice->pnext;
+    }
+
+    if (pdevice->psja) {
+	t810PeliISR(pdevice);
+	return;
+    }
+
+    intSource = pdevice->pchip->interrupt;
 
     if (intSource & PCA_IR_OI) {		/* Overrun Interrupt */
         pdevice->overCount++;
-        canBusStop(pdevice->pbusName);		/* Reset the chip but not */
-        canBusRestart(pdevice->pbusName);	/* all the counters */
+	if (t810OverrunReset) {
+	    pdevice->overResets++;
+	    t810Stop(pdevice);			/* Reset the chip but not */
+	    t810Restart(pdevice);		/* all the counters */
 
-	intSource = pdevice->pchip->interrupt;	/* Rescan interrupts */
+	    intSource = pdevice->pchip->interrupt;	/* Rescan interrupts */
+	} else {
+	    pdevice->pchip->command = PCA_CMR_COS;
+	}
     }
 
-    if (intSource & PCA_IR_RI) {		/* Receive Interrupt */
+    if ((intSource & PCA_IR_RI) ||		/* Receive Interrupt */
+	(pdevice->pchip->status & PCA_SR_RBS)) {
 	t810Receipt_t qmsg;
+	int taken = 0;
 
-	/* Take a local copy of the message */
 	qmsg.pdevice = pdevice;
-	getRxMessage(pdevice->pchip, &qmsg.message);
-
-	/* Send it to the servicing task */
-	if (epicsMessageQueueTrySend(receiptQueue, &qmsg,
+	while ((pdevice->pchip->status & PCA_SR_RBS) &&
+	       taken < RX_BUDGET) {
+	    /* Take a local copy of the message */
+	    getRxMessage(pdevice->pchip, &qmsg.message);
+	    taken++;
+
+	    /* Send it to the servicing task */
+	    if (epicsMessageQueueTrySend(receiptQueue, &qmsg,
 				sizeof(t810Receipt_t)) && !canSilenceErrors)
-	    epicsInterruptContextMessage("Warning: CANbus receive queue overflow");
+		epicsInterruptContextMessage("Warning: CANbus receive queue overflow");
+	}
+	if (taken > pdevice->rxPeak) {
+	    pdevice->rxPeak = taken;
+	}
     }
 
     if (intSource & PCA_IR_EI) {		/* Error Interrupt */
-	callbackTable_t *phandler = pdevice->psigHandler;
 	int status;
 
 	switch (pdevice->pchip->status & (PCA_SR_ES | PCA_SR_BS)) {
@@ -597,6 +945,7 @@ static void t810ISR (
 	    case PCA_SR_BS | PCA_SR_ES:
 		status = CAN_BUS_OFF;
 		pdevice->busOffCount++;
+		t810TxDone(pdevice, S_can_txFailed);
 		epicsEventSignal(pdevice->txSem);	/* Signal transmit */
 		pdevice->pchip->control &= ~PCA_CR_RR;	/* Clear Reset state */
 		if (!canSilenceErrors)
@@ -609,11 +958,13 @@ static void t810ISR (
 		break;
 	}
 
-	doCallbacks(phandler, status);
+	canBusSignal(pdevice->busID, status);
     }
 
     if (intSource & PCA_IR_TI) {		/* Transmit Interrupt */
 	pdevice->txCount++;
+	t810TxDone(pdevice, (pdevice->pchip->status & PCA_SR_TCS) ?
+		   0 : S_can_txFailed);
 	epicsEventSignal(pdevice->txSem);
     }
 
@@ -634,8 +985,9 @@ Purpose:
 
 Description:
     This routine is a background task started by t810Initialise. It
-    takes messages out of the receive queue one by one and runs the
-    callbacks registered against the relevent message ID.
+    takes messages out of the receive queue one by one and passes them
+    to canBusReceive, which runs the callbacks registered against the
+    relevent message ID.
 
 Returns:
     int
@@ -644,7 +996,6 @@ Returns:
 
 static void t810RecvTask(void *dummy) {
     t810Receipt_t rmsg;
-    callbackTable_t *phandler;
     int numQueued;
 
     if (receiptQueue == 0) {
@@ -660,26 +1011,179 @@ static void t810RecvTask(void *dummy) {
 	epicsMessageQueueReceive(receiptQueue, &rmsg, sizeof(t810Receipt_t));
 	rmsg.pdevice->rxCount++;
 
-	/* Look up the message ID and do the message callbacks */
-	phandler = rmsg.pdevice->pmsgHandler[rmsg.message.identifier];
-	if (phandler == NULL) {
-	    rmsg.pdevice->unusedId = rmsg.message.identifier;
-	    rmsg.pdevice->unusedCount++;
+	canBusReceive(rmsg.pdevice->busID, &rmsg.message);
+   }
+}
+
+/*******************************************************************************
+
+Routine:
+    t810Run, t810Halt
+
+Purpose:
+    Start or stop the chip
+
+Description:
+    t810Run takes the chip out of Reset state with all the interrupts
+    the driver handles enabled; t810Halt puts it back into Reset state,
+    which abandons any transmission.  Both handle the BasicCAN and
+    PeliCAN register layouts.
+
+Returns:
+    void
+
+*/
+
+static void t810Run (
+    t810Dev_t *pdevice
+) {
+    if (pdevice->psja) {
+	pdevice->psja->intEnable = SJA_IR_EPI |
+				   SJA_IR_WUI |
+				   SJA_IR_DOI |
+				   SJA_IR_EI |
+				   SJA_IR_TI |
+				   SJA_IR_RI;
+	pdevice->psja->mode = pdevice->peliMode & SJA_MOD_AFM;
+    } else {
+	pdevice->pchip->control = PCA_CR_OIE |
+				  PCA_CR_EIE |
+				  PCA_CR_TIE |
+				  PCA_CR_RIE;
+    }
+}
+
+static void t810Halt (
+    t810Dev_t *pdevice
+) {
+    if (pdevice->psja) {
+	pdevice->psja->mode |= SJA_MOD_RM;
+    } else {
+	pdevice->pchip->control |= PCA_CR_RR;
+    }
+    t810TxDone(pdevice, S_can_txFailed);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810Filter
+
+Purpose:
+    Set a PeliCAN hardware acceptance filter
+
+Description:
+    Programs one of the SJA1000 acceptance filters so the chip only
+    interrupts for the messages the IOC wants.  Filter 0 selects the
+    single filter mode, which compares the whole identifier.  Filters 1
+    and 2 select the dual filter mode, in which a message is accepted if
+    it matches either filter; for standard identifiers both compare all
+    11 bits, but for extended identifiers they only compare the top 16
+    bits (ID.28 to ID.13).  The chip shares the bits for ID.16 to ID.13
+    of filter 2 with the data byte that a standard filter 1 would
+    compare, so when filter 1 is for standard frames filter 2 only
+    compares ID.28 to ID.17.  Setting filter 1 also sets filter 2 to the
+    same value, so filter 2 must be set afterwards if it is to differ.
+    In the mask a 1 bit means the identifier bit must match the code; a
+    mask of 0 accepts everything.  The CAN_EXTENDED bit of the code says
+    which frame format the filter is for.  Handlers registered for
+    identifiers the filter rejects will never be called.
+
+Returns:
+    0,
+    S_can_noDevice if the bus name is unknown or not a TIP810,
+    S_can_badAddress if the filter number is invalid,
+    S_t810_noPeliCan if the bus is not in PeliCAN mode.
+
+Example:
+    t810Filter "CAN1", 0, 0x100, 0x700
+
+*/
+
+int t810Filter (
+    const char *pbusName,
+    int filter,		/* 0 single, 1 or 2 dual */
+    canID_t code,	/* identifier, CAN_EXTENDED for 29-bit */
+    canID_t mask	/* 1 = must match */
+) {
+    canBusID_t busID;
+    t810Dev_t *pdevice;
+    epicsUInt8 *pcode, *pmask;
+    int extended = (code & CAN_EXTENDED) != 0;
+
+    if (canOpen(pbusName, &busID) ||
+	(pdevice = canBusPrivate(busID, &t810Driver)) == NULL) {
+	return S_can_noDevice;
+    }
+    if (pdevice->psja == NULL) {
+	return S_t810_noPeliCan;
+    }
+    if (filter < 0 || filter > 2) {
+	return S_can_badAddress;
+    }
+    code &= ~CAN_EXTENDED;
+    mask &= ~CAN_EXTENDED;
+
+    if (filter == 0) {
+	pdevice->peliMode |= SJA_MOD_AFM;
+	if (extended) {
+	    code <<= SJA_EFF_ID_LSHIFT;
+	    mask <<= SJA_EFF_ID_LSHIFT;	/* RTR and unused bits ignored */
+	    pdevice->acceptCode[0] = code >> 24;
+	    pdevice->acceptCode[1] = code >> 16;
+	    pdevice->acceptCode[2] = code >> 8;
+	    pdevice->acceptCode[3] = code;
+	    pdevice->acceptMask[0] = mask >> 24;
+	    pdevice->acceptMask[1] = mask >> 16;
+	    pdevice->acceptMask[2] = mask >> 8;
+	    pdevice->acceptMask[3] = mask;
 	} else {
-	    doCallbacks(phandler, (long) &rmsg.message);
+	    pdevice->acceptCode[0] = code >> 3;
+	    pdevice->acceptCode[1] = code << SJA_SFF_ID1_LSHIFT;
+	    pdevice->acceptMask[0] = mask >> 3;
+	    pdevice->acceptMask[1] = mask << SJA_SFF_ID1_LSHIFT;
+	    pdevice->acceptCode[2] = pdevice->acceptCode[3] = 0;
+	    pdevice->acceptMask[2] = pdevice->acceptMask[3] = 0;
 	}
-
-	/* If canRead is waiting for this ID, give it the message and kick it */
-	if (rmsg.pdevice->preadBuffer != NULL &&
-	    rmsg.pdevice->preadBuffer->identifier == rmsg.message.identifier) {
-	    memcpy(rmsg.pdevice->preadBuffer, &rmsg.message, 
-		   sizeof(canMessage_t));
-	    rmsg.pdevice->preadBuffer = NULL;
-	    epicsEventSignal(rmsg.pdevice->rxSem);
+    } else {
+	pdevice->peliMode &= ~SJA_MOD_AFM;
+	pcode = &pdevice->acceptCode[filter == 1 ? 0 : 2];
+	pmask = &pdevice->acceptMask[filter == 1 ? 0 : 2];
+	if (extended) {
+	    code >>= 13;		/* Only ID.28 to ID.13 compared */
+	    mask >>= 13;
+	    pcode[0] = code >> 8;
+	    pcode[1] = code;
+	    pmask[0] = mask >> 8;
+	    pmask[1] = mask;
+	} else {
+	    pcode[0] = code >> 3;
+	    pcode[1] = code << SJA_SFF_ID1_LSHIFT;
+	    pmask[0] = mask >> 3;
+	    pmask[1] = mask << SJA_SFF_ID1_LSHIFT;
 	}
-   }
+	if (filter == 1) {
+	    pdevice->filter1Ext = extended;
+	    pdevice->acceptCode[2] = pdevice->acceptCode[0];
+	    pdevice->acceptCode[3] = pdevice->acceptCode[1];
+	    pdevice->acceptMask[2] = pdevice->acceptMask[0];
+	    pdevice->acceptMask[3] = pdevice->acceptMask[1];
+	}
+	/* For standard frames filter 1 also compares data byte 1, using
+	 * the low nibbles of ACR1 and ACR3.  A standard filter leaves
+	 * those bits of its own bytes clear, but ACR3 belongs to filter 2
+	 * which in extended format holds ID.16 to ID.13 there. */
+	if (!pdevice->filter1Ext) {
+	    pdevice->acceptMask[3] &= 0xf0;
+	}
+    }
+
+    setPeliFilter(pdevice);
+    return 0;
 }
 
+
 /*******************************************************************************
 
 Routine:
@@ -706,12 +1210,14 @@ int t810Initialise (
     void
 ) {
     t810Dev_t *pdevice = pt810First;
+    int index = 0;
     int status = 0;
 
     epicsAtExit(t810Shutdown, NULL);
 
     receiptQueue = epicsMessageQueueCreate(RECV_Q_SIZE, sizeof(t810Receipt_t));
-    canTimerQ = epicsTimerQueueAllocate(1, epicsThreadPriorityLow);
+    if (canTimerQ == NULL)
+	canTimerQ = epicsTimerQueueAllocate(1, epicsThreadPriorityLow);
     if (receiptQueue == NULL ||
 	canTimerQ == NULL) return ENOMEM;
 
@@ -723,22 +1229,19 @@ int t810Initialise (
 	pdevice->txCount     = 0;
 	pdevice->rxCount     = 0;
 	pdevice->overCount   = 0;
-	pdevice->unusedCount = 0;
+	pdevice->overResets  = 0;
 	pdevice->errorCount  = 0;
 	pdevice->busOffCount = 0;
 
 	status = ipmIntConnect(pdevice->card, pdevice->slot, pdevice->irqNum,
-			       t810ISR, (int)pdevice);
+			       t810ISR, index++);
 
 	/* The TIP810's intVec register is external to the PCA82C200 chip */
 	*((epicsUInt8 *) pdevice->pchip + 0x41) = pdevice->irqNum;
 
 	ipmIrqCmd(pdevice->card, pdevice->slot, 0, ipac_irqEnable);
 
-	pdevice->pchip->control = PCA_CR_OIE |
-				  PCA_CR_EIE |
-				  PCA_CR_TIE |
-				  PCA_CR_RIE;
+	t810Run(pdevice);
 
 	pdevice = pdevice->pnext;
     }
@@ -749,82 +1252,61 @@ int t810Initialise (
 /*******************************************************************************
 
 Routine:
-    canOpen
+    t810Reset
 
 Purpose:
-    Return device pointer for given CAN bus name
+    Reset CANbus
 
 Description:
-    Searches through the linked list of known t810 devices for one
-    which matches the name given, and returns the device pointer
-    associated with the relevant device table.
+    canBusReset entry point, resets the chip and all counters
 
 Returns:
-    0, or S_can_noDevice if no match found.
-
-Example:
-    void *can1;
-    status = canOpen("CAN1", &can1);
+    0
 
 */
 
-int canOpen (
-    const char *pbusName,
-    canBusID_t *pbusID
+static int t810Reset (
+    void *pdev
 ) {
-    t810Dev_t *pdevice = pt810First;
+    t810Dev_t *pdevice = pdev;
 
-    while (pdevice != NULL) {
-	if (strcmp(pdevice->pbusName, pbusName) == 0) {
-	    *pbusID = pdevice;
-	    return 0;
-	}
-	pdevice = pdevice->pnext;
-    }
-    return S_can_noDevice;
+    t810Halt(pdevice);			/* Reset the chip */
+    pdevice->txCount   = 0;
+    pdevice->rxCount   = 0;
+    pdevice->overCount   = 0;
+    pdevice->overResets  = 0;
+    pdevice->errorCount  = 0;
+    pdevice->busOffCount = 0;
+    pdevice->rxPeak      = 0;
+    epicsEventSignal(pdevice->txSem);
+    t810Run(pdevice);
+
+    return 0;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canBusReset
+    t810Stop
 
 Purpose:
-    Reset named CANbus
+    Stop I/O on CANbus
 
 Description:
-    Resets the chip and connected to the named bus and all counters
+    canBusStop entry point, holds the chip in Reset state
 
 Returns:
-    0, or S_can_noDevice if no match found.
-
-Example:
-    status = canBusReset("CAN1");
+    0
 
 */
 
-int canBusReset (
-    const char *pbusName
+static int t810Stop (
+    void *pdev
 ) {
-    t810Dev_t *pdevice;
-    int status = canOpen(pbusName, &pdevice);
-
-    if (status) return status;
-
-    pdevice->pchip->control |=  PCA_CR_RR;    /* Reset the chip */
-    pdevice->txCount   = 0;
-    pdevice->rxCount   = 0;
-    pdevice->overCount   = 0;
-    pdevice->unusedCount = 0;
-    pdevice->errorCount  = 0;
-    pdevice->busOffCount = 0;
-    epicsEventSignal(pdevice->txSem);
-    pdevice->pchip->control = PCA_CR_OIE |
-			      PCA_CR_EIE |
-			      PCA_CR_TIE |
-			      PCA_CR_RIE;
+    t810Dev_t *pdevice = pdev;
 
+    t810Halt(pdevice);
     return 0;
 }
 
@@ -832,66 +1314,25 @@ int canBusReset (
 /*******************************************************************************
 
 Routine:
-    canBusStop
-
-Purpose:
-    Stop I/O on named CANbus
-
-Description:
-    Holds the chip for the named bus in Reset state
-
-Returns:
-    0, or S_can_noDevice if no match found.
-
-Example:
-    status = canBusStop("CAN1");
-
-*/
-
-int canBusStop (
-    const char *pbusName
-) {
-    t810Dev_t *pdevice;
-    int status = canOpen(pbusName, &pdevice);
-
-    if (status) return status;
-
-    pdevice->pchip->control |=  PCA_CR_RR;    /* Reset the chip */
-    return 0;
-}
-
-
-/*******************************************************************************
-
-Routine:
-    canBusRestart
+    t810Restart
 
 Purpose: 
-    Restart I/O on named CANbus
+    Restart I/O on CANbus
 
 Description:
-    Restarts the chip for the named bus after a canBusStop
+    canBusRestart entry point, restarts the chip after a t810Stop
 
 Returns: 
-    0, or S_can_noDevice if no match found.
-
-Example: 
-    status = canBusRestart("CAN1");
+    0
 
 */
 
-int canBusRestart (
-    const char *pbusName
+static int t810Restart (
+    void *pdev
 ) {
-    t810Dev_t *pdevice;
-    int status = canOpen(pbusName, &pdevice);
+    t810Dev_t *pdevice = pdev;
 
-    if (status) return status;
-
-    pdevice->pchip->control = PCA_CR_OIE |
-			      PCA_CR_EIE |
-			      PCA_CR_TIE |
-			      PCA_CR_RIE;
+    t810Run(pdevice);
     epicsEventSignal(pdevice->txSem);
 
     return 0;
@@ -901,193 +1342,36 @@ int canBusRestart (
 /*******************************************************************************
 
 Routine:
-    strdupn
-
-Purpose:
-    duplicate n characters of a string and return pointer to new substring
-
-Description:
-    Copies n characters from the input string to a newly malloc'ed memory
-    buffer, and adds a trailing '\0', then returns the new string pointer.
-
-Returns:
-    char *newString, or NULL if malloc failed.
-
-*/
-
-static char* strdupn (
-    const char *ct,
-    size_t n
-) {
-    char *duplicate;
-
-    duplicate = malloc(n+1);
-    if (duplicate == NULL) {
-	return NULL;
-    }
-
-    memcpy(duplicate, ct, n);
-    duplicate[n] = '\0';
-
-    return duplicate;
-}
-
-
-/*******************************************************************************
-
-Routine:
-    canIoParse
-
-Purpose:
-    Parse a CAN address string into a canIo_t structure
-
-Description:
-    canString which must match the format below is converted by this routine
-    into the relevent fields of the canIo_t structure pointed to by pcanIo:
-
-    	busname{/timeout}:id{+n}{.offset} parameter
-
-    where
-    	busname is alphanumeric, all other fields are hex, decimal or octal
-    	timeout is in milliseconds
-	id and any number of +n components are summed to give the CAN Id
-	offset is the byte offset into the message
-	parameter is a string or integer for use by device support
-
-Returns:
-    0, or
-    S_can_badAddress for illegal input strings,
-    ENOMEM if malloc() fails,
-    S_can_noDevice for an unregistered bus name.
-
-Example:
-    canIoParse("CAN1/20:0126+4+1.4 0xfff", &myIo);
-
-*/
-
-int canIoParse (
-    char *canString, 
-    canIo_t *pcanIo
-) {
-    char separator;
-    char *name;
-
-    pcanIo->canBusID = NULL;
-
-    if (canString == NULL ||
-	pcanIo == NULL) {
-	return S_can_badAddress;
-    }
-
-    /* Get rid of leading whitespace and non-alphanumeric chars */
-    while (!isalnum(0xff & *canString)) {
-	if (*canString++ == '\0') {
-	    return S_can_badAddress;
-	}
-    }
-
-    /* First part of string is the bus name */
-    name = canString;
-
-    /* find the end of the busName */
-    canString = strpbrk(canString, "/:");
-    if (canString == NULL ||
-	*canString == '\0') {
-	return S_can_badAddress;
-    }
-
-    /* now we're at character after the end of the busName */
-    pcanIo->busName = strdupn(name, canString - name);
-    if (pcanIo->busName == NULL) {
-	return ENOMEM;
-    }
-    separator = *canString++;
-
-    /* Handle /<timeout> if present, convert from ms to seconds */
-    if (separator == '/') {
-	pcanIo->timeout = ((double)strtol(canString, &canString, 0))/1000.0;
-	separator = *canString++;
-    } else {
-	pcanIo->timeout = -1.0;
-    }
-
-    /* String must contain :<canID> */
-    if (separator != ':') {
-	return S_can_badAddress;
-    }
-    pcanIo->identifier = strtoul(canString, &canString, 0);
-    separator = *canString++;
-
-    /* Handle any number of optional +<n> additions to the ID */
-    while (separator == '+') {
-	pcanIo->identifier += strtol(canString, &canString, 0);
-	separator = *canString++;
-    }
-
-    /* Handle .<offset> if present */
-    if (separator == '.') {
-	pcanIo->offset = strtoul(canString, &canString, 0);
-	if (pcanIo->offset >= CAN_DATA_SIZE) {
-	    return S_can_badAddress;
-	}
-	separator = *canString++;
-    } else {
-	pcanIo->offset = 0;
-    }
-
-    /* Final parameter is separated by whitespace */
-    if (separator != ' ' &&
-	separator != '\t') {
-	return S_can_badAddress;
-    }
-    pcanIo->parameter = strtol(canString, &pcanIo->paramStr, 0);
-
-    /* Ok, finally look up the bus name */
-    return canOpen(pcanIo->busName, &pcanIo->canBusID);
-}
-
-
-/*******************************************************************************
-
-Routine:
-    canWrite
+    t810Write
 
 Purpose:
     writes a CAN message to the bus
 
 Description:
-    Sends the message described by pmessage out through the bus identified by
-    canBusID.  After some simple argument checks it obtains exclusive access to
-    the transmit registers, then copies the message to the chip.  The timeout
-    value allows task recovery in the event that exclusive access is not
-    available within a the given number of seconds.
+    canWrite entry point, the message has already been checked.  It
+    obtains exclusive access to the transmit registers, then copies the
+    message to the chip.  The ISR reports the end of the transmission
+    to canBusTxDone.  The timeout value allows task recovery in the
+    event that exclusive access is not available within a the given
+    number of seconds.
 
 Returns:
     0, 
-    S_can_badMessage for bad identifier, message length or rtr value,
-    S_can_badDevice for bad device pointer,
     S_t810_timeout indicates timeout,
-    S_t810_transmitterBusy indicates an internal error.
-
-Example:
-
+    S_t810_transmitterBusy indicates an internal error,
+    S_can_badMessage for an extended identifier in BasicCAN mode.
 
 */
 
-int canWrite (
-    canBusID_t busID,
+static int t810Write (
+    void *pdev,
     const canMessage_t *pmessage,
     double timeout
 ) {
-    t810Dev_t *pdevice = busID;
-
-    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
-	return S_t810_badDevice;
-    }
+    t810Dev_t *pdevice = pdev;
 
-    if (pmessage->identifier >= CAN_IDENTIFIERS ||
-	pmessage->length > CAN_DATA_SIZE ||
-	(pmessage->rtr != SEND && pmessage->rtr != RTR)) {
+    if ((pmessage->identifier & CAN_EXTENDED) &&
+	pdevice->psja == NULL) {
 	return S_can_badMessage;
     }
 
@@ -1095,372 +1379,64 @@ int canWrite (
 	return S_t810_timeout;
     }
 
-    if (pdevice->pchip->status & PCA_SR_TBS) {
+    /* Set before the transmit interrupt can come */
+    pdevice->txMessage = *pmessage;
+    pdevice->txPending = TRUE;
+
+    if (pdevice->psja) {
+	if (pdevice->psja->status & SJA_SR_TBS) {
+	    putPeliMessage(pdevice->psja, pmessage);
+	    return 0;
+	}
+    } else if (pdevice->pchip->status & PCA_SR_TBS) {
 	putTxMessage(pdevice->pchip, pmessage);
 	return 0;
     }
+    pdevice->txPending = FALSE;
     epicsEventSignal(pdevice->txSem);
     return S_t810_transmitterBusy;
 }
 
 
-/*******************************************************************************
-
-Routine:
-    canMessage
-
-Purpose:
-    Register CAN message callback
-
-Description:
-    Adds a new callback routine for the given CAN message ID on the
-    given device.  There can be any number of callbacks for the same ID,
-    and all are called in turn when a message with this ID is
-    received.  As a result, the callback routine must not change the
-    message at all - it is only permitted to examine it.  The callback
-    is called from vxWorks Interrupt Context, thus there are several
-    restrictions in what the routine can perform (see vxWorks User
-    Guide for details of these).  The callback routine should be
-    declared of type canMsgCallback_t
-	void callback(void *pprivate, can_Message_t *pmessage); 
-    The pprivate value supplied to canMessage is passed to the callback
-    routine with each message to allow it to identify its context.
-
-Returns:
-    0, 
-    S_can_badMessage for bad identifier or NULL callback routine,
-    S_t810_badDevice for bad device pointer,
-    ENOMEM if malloc() fails.
-
-Example:
-
-
-*/
-
-int canMessage (
-    canBusID_t busID,
-    canID_t identifier,
-    canMsgCallback_t *pcallback,
-    void *pprivate
-) {
-    t810Dev_t *pdevice = busID;
-    callbackTable_t *phandler, *plist;
-
-    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
-	return S_t810_badDevice;
-    }
-
-    if (identifier >= CAN_IDENTIFIERS ||
-	pcallback == NULL) {
-	return S_can_badMessage;
-    }
-
-    phandler = malloc(sizeof (callbackTable_t));
-    if (phandler == NULL) {
-	return ENOMEM;
-    }
-
-    phandler->pnext     = NULL;
-    phandler->pprivate  = pprivate;
-    phandler->pcallback = (callback_t *) pcallback;
-
-    plist = (callbackTable_t *) (&pdevice->pmsgHandler[identifier]);
-    while (plist->pnext != NULL) {
-	plist = plist->pnext;
-    }
-    /* plist now points to the last handler in the list */
-
-    plist->pnext = phandler;
-    return 0;
-}
-
-
-/*******************************************************************************
-
-Routine:
-    canMsgDelete
-
-Purpose:
-    Delete registered CAN message callback
-
-Description:
-    Deletes an existing callback routine for the given CAN message ID
-    on the given device.  The first matching callback found in the list
-    is deleted.  To match, the parameters to canMsgDelete must be
-    identical to those given to canMessage.
-
-Returns:
-    0, 
-    S_can_badMessage for bad identifier or NULL callback routine,
-    S_can_noMessage for no matching message callback,
-    S_t810_badDevice for bad device pointer.
-
-Example:
-
-
-*/
-
-int canMsgDelete (
-    canBusID_t busID,
-    canID_t identifier,
-    canMsgCallback_t *pcallback,
-    void *pprivate
-) {
-    t810Dev_t *pdevice = busID;
-    callbackTable_t *phandler, *plist;
-
-    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
-	return S_t810_badDevice;
-    }
-
-    if (identifier >= CAN_IDENTIFIERS ||
-	pcallback == NULL) {
-	return S_can_badMessage;
-    }
-
-    plist = (callbackTable_t *) (&pdevice->pmsgHandler[identifier]);
-    while (plist->pnext != NULL) {
-	phandler = plist->pnext;
-	if (((canMsgCallback_t *)phandler->pcallback == pcallback) &&
-	    (phandler->pprivate  == pprivate)) {
-	    plist->pnext = phandler->pnext;
-	    phandler->pnext = NULL;		/* Just in case... */
-	    free(phandler);
-	    return 0;
-	}
-	plist = phandler;
-    }
-
-    return S_can_noMessage;
-}
-
-
-/*******************************************************************************
-
-Routine:
-    canSignal
-
-Purpose:
-    Register CAN error signal callback
-
-Description:
-    Adds a new callback routine for the CAN error reports.  There can be
-    any number of error callbacks, and all are called in turn when the
-    controller chip reports an error or bus Off The callback is called
-    from vxWorks Interrupt Context, thus there are restrictions in what
-    the routine can perform (see vxWorks User Guide for details of
-    these).  The callback routine should be declared a canSigCallback_t
-	void callback(void *pprivate, int status);
-    The pprivate value supplied to canSignal is passed to the callback
-    routine with the error status to allow it to identify its context.
-    Status values will be one of
-	CAN_BUS_OK,
-	CAN_BUS_ERROR or
-	CAN_BUS_OFF.
-    If the chip goes to the Bus Off state, the driver will attempt to
-    restart it.
-
-Returns:
-    0,
-    S_t810_badDevice for bad device pointer,
-    ENOMEM if malloc() fails.
-
-Example:
-
-
-*/
-
-int canSignal (
-    canBusID_t busID,
-    canSigCallback_t *pcallback,
-    void *pprivate
-) {
-    t810Dev_t *pdevice = busID;
-    callbackTable_t *phandler, *plist;
-
-    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
-	return S_t810_badDevice;
-    }
-
-    phandler = malloc(sizeof (callbackTable_t));
-    if (phandler == NULL) {
-	return ENOMEM;
-    }
-
-    phandler->pnext     = NULL;
-    phandler->pprivate  = pprivate;
-    phandler->pcallback = (callback_t *) pcallback;
-
-    plist = (callbackTable_t *) (&pdevice->psigHandler);
-    while (plist->pnext != NULL) {
-	plist = plist->pnext;
-    }
-    /* plist now points to the last handler in the list */
-
-    plist->pnext = phandler;
-    return 0;
-}
-
-
-/*******************************************************************************
-
-Routine:
-    canRead
-
-Purpose:
-    read incoming CAN message, any ID number
-
-Description:
-    The simplest way to implement this is have canRead take a message
-    ID in the buffer, send an RTR and look for the returned value of
-    this message.  This is in keeping with the CAN philosophy and makes
-    it useful for simple software interfaces.  More complex ones ought
-    to use the canMessage callback functions.
-
-Returns:
-    0, or
-    S_t810_badDevice for bad bus ID, 
-    S_can_badMessage for bad message Identifier or length,
-    S_t810_timeout for timeout
-
-Example:
-    canMessage_t myBuffer = {
-	139,	// Can ID
-	0,	// RTR
-	4	// Length
-    };
-    int status = canRead(canID, &myBuffer, WAIT_FOREVER);
-
-*/
-
-int canRead (
-    canBusID_t busID,
-    canMessage_t *pmessage,
-    double timeout
-) {
-    t810Dev_t *pdevice = busID;
-    int status;
-
-    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
-	return S_t810_badDevice;
-    }
-
-    if (pmessage->identifier >= CAN_IDENTIFIERS ||
-	pmessage->length > CAN_DATA_SIZE) {
-	return S_can_badMessage;
-    }
-
-    /* Ensure that only one task canRead at once */
-    if (epicsMutexLock(pdevice->readSem) != epicsMutexLockOK) {
-	return S_t810_badDevice;
-    }
-
-    pdevice->preadBuffer = pmessage;
-
-    /* All set for the reply, now send the request */
-    pmessage->rtr = RTR;
-
-    status = canWrite(busID, pmessage, timeout);
-    if (status == 0) {
-	/* Wait for the message to be recieved */
-	switch (epicsEventWaitWithTimeout(pdevice->rxSem, timeout)) {
-	case epicsEventWaitTimeout:
-	    status = S_t810_timeout;
-	    break;
-	case epicsEventWaitError:
-	    status = S_t810_badDevice;
-	    break;
-	default:
-	    break;
-	}
-    }
-    if (status) {
-	/* Problem (timeout) sending the RTR or receiving the reply */
-	pdevice->preadBuffer = NULL;
-	epicsEventTryWait(pdevice->rxSem);	/* Try to clean up */
-    }
-    epicsMutexUnlock(pdevice->readSem);
-    return status;
-}
-
-
-/*******************************************************************************
-
-Routine:
-    canTest
-
-Purpose:
-    Test routine, sends a single message to the named bus.
-
-Description:
-    This routine is intended for use from the vxWorks shell.
-
-Returns:
-    0, or ERROR
-
-Example:
-
-
-*/
-
-int canTest (
-    char *pbusName,
-    canID_t identifier,
-    int rtr,
-    int length,
-    char *data
-) {
-    canBusID_t busID;
-    canMessage_t message;
-    int status;
-
-    if (pbusName == NULL) {
-	printf("Usage: canTest \"busname\", id, rtr, len, \"data\"\n");
-	return -1;
-    }
-
-    status = canOpen(pbusName, &busID);
-    if (status) {
-	printf("Error %d opening CAN bus '%s'\n", status, pbusName);
-	return -1;
-    }
-
-    message.identifier = identifier;
-    message.rtr        = rtr ? RTR : SEND;
-    message.length     = length;
-
-    if (rtr == 0) {
-	memcpy(&message.data[0], data, length);
-    }
-
-    status = canWrite(busID, &message, 0);
-    if (status) {
-	printf("Error %d writing message\n", status);
-	return -1;
-    }
-    return 0;
-}
-
-
 /*******************************************************************************
  * EPICS iocsh Command registry
  */
 
-/* t810Create(char *pbusName, int card, int slot, int irqNum, int busRate) */
+/* t810Create(char *pbusName, int card, int slot, int irqNum, int busRate,
+	      int mode) */
 static const iocshArg t810CreateArg0 = {"busName",iocshArgPersistentString};
 static const iocshArg t810CreateArg1 = {"carrier", iocshArgInt};
 static const iocshArg t810CreateArg2 = {"slot", iocshArgInt};
 static const iocshArg t810CreateArg3 = {"intVector", iocshArgInt};
 static const iocshArg t810CreateArg4 = {"busRate", iocshArgInt};
-static const iocshArg * const t810CreateArgs[5] = {
+static const iocshArg t810CreateArg5 = {"peliCan", iocshArgInt};
+static const iocshArg * const t810CreateArgs[6] = {
     &t810CreateArg0, &t810CreateArg1, &t810CreateArg2, &t810CreateArg3,
-    &t810CreateArg4};
+    &t810CreateArg4, &t810CreateArg5};
 static const iocshFuncDef t810CreateFuncDef =
-    {"t810Create",5,t810CreateArgs};
+    {"t810Create",6,t810CreateArgs};
 static void t810CreateCallFunc(const iocshArgBuf *arg)
 {
     t810Create(arg[0].sval, arg[1].ival, arg[2].ival, arg[3].ival, 
-	       arg[4].ival);
+	       arg[4].ival, arg[5].ival);
+}
+
+/* t810Filter(char *pbusName, int filter, int code, int mask) */
+static const iocshArg t810FilterArg0 = {"busName", iocshArgString};
+static const iocshArg t810FilterArg1 = {"filter", iocshArgInt};
+static const iocshArg t810FilterArg2 = {"code", iocshArgInt};
+static const iocshArg t810FilterArg3 = {"mask", iocshArgInt};
+static const iocshArg * const t810FilterArgs[4] = {
+    &t810FilterArg0, &t810FilterArg1, &t810FilterArg2, &t810FilterArg3};
+static const iocshFuncDef t810FilterFuncDef =
+    {"t810Filter",4,t810FilterArgs};
+static void t810FilterCallFunc(const iocshArgBuf *arg)
+{
+    int status = t810Filter(arg[0].sval, arg[1].ival, arg[2].ival,
+			    arg[3].ival);
+
+    if (status)
+	printf("t810Filter: Error %#x setting filter\n", status);
 }
 
 /* t810Report(int interest) */
@@ -1473,42 +1449,10 @@ static void t810ReportCallFunc(const iocshArgBuf *args)
     t810Report(args[0].ival);
 }
 
-/* canBusReset(char *pbusName) */
-static const iocshArg canBusResetArg0 = {"busName", iocshArgString};
-static const iocshArg * const canBusResetArgs[1] = {&canBusResetArg0};
-static const iocshFuncDef canBusResetFuncDef =
-    {"canBusReset",1,canBusResetArgs};
-static void canBusResetCallFunc(const iocshArgBuf *args)
-{
-    canBusReset(args[0].sval);
-}
-
-/* canBusStop(char *pbusName) */
-static const iocshArg canBusStopArg0 = {"busName", iocshArgString};
-static const iocshArg * const canBusStopArgs[1] = {&canBusStopArg0};
-static const iocshFuncDef canBusStopFuncDef =
-    {"canBusStop",1,canBusStopArgs};
-static void canBusStopCallFunc(const iocshArgBuf *args)
-{
-    canBusStop(args[0].sval);
-}
-
-/* canBusRestart(char *pbusName) */
-static const iocshArg canBusRestartArg0 = {"busName", iocshArgString};
-static const iocshArg * const canBusRestartArgs[1] = {&canBusRestartArg0};
-static const iocshFuncDef canBusRestartFuncDef =
-    {"canBusRestart",1,canBusRestartArgs};
-static void canBusRestartCallFunc(const iocshArgBuf *args)
-{
-    canBusRestart(args[0].sval);
-}
-
 static void drvTip810Registrar(void) {
     iocshRegister(&t810CreateFuncDef,t810CreateCallFunc);
+    iocshRegister(&t810FilterFuncDef,t810FilterCallFunc);
     iocshRegister(&t810ReportFuncDef,t810ReportCallFunc);
-    iocshRegister(&canBusResetFuncDef,canBusResetCallFunc);
-    iocshRegister(&canBusStopFuncDef,canBusStopCallFunc);
-    iocshRegister(&canBusRestartFuncDef,canBusRestartCallFunc);
 }
 epicsExportRegistrar(drvTip810Registrar);
 
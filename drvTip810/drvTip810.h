@@ -52,11 +52,20 @@ Copyright (c) 1995-2000 Andrew Johnson
 #define S_t810_badDevice	(M_t810| 3) /*device pointer is not for t810*/
 #define S_t810_transmitterBusy	(M_t810| 4) /*transmit buffer unexpectedly busy*/
 #define S_t810_timeout		(M_t810| 5) /*timeout during request*/
+#define S_t810_noPeliCan	(M_t810| 6) /*controller has no PeliCAN mode*/
+#define S_t810_badMode		(M_t810| 7) /*unknown controller mode*/
+
+
+/* t810Create modes */
+
+#define T810_MODE_BASIC		0	/* PCA82C200 compatible, 11-bit IDs */
+#define T810_MODE_PELICAN	1	/* SJA1000 PeliCAN, 29-bit IDs */
 
 
 epicsShareFunc int t810Status(canBusID_t busID);
 epicsShareFunc int t810Report(int page);
-epicsShareFunc int t810Create(char *busName, int card, int slot, int irqNum, int busRate);
+epicsShareFunc int t810Create(char *busName, int card, int slot, int irqNum, int busRate, int mode);
+epicsShareFunc int t810Filter(const char *busName, int filter, canID_t code, canID_t mask);
 epicsShareFunc void t810Shutdown(void *dummy);
 epicsShareFunc int t810Initialise(void);
 
@@ -0,0 +1,161 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    sja1000.h
+
+Description:
+    Philips SJA1000 Stand-alone CAN-controller chip header file, giving the
+    PeliCAN mode register layout and programming model.  The SJA1000 is
+    pin and register compatible with the PCA82C200 after reset (BasicCAN
+    mode, see pca82c200.h); setting the CAN mode bit of the clock divider
+    register switches it to this register map, which adds 29-bit
+    identifiers, a 64-byte receive FIFO and dual acceptance filters.
+
+*******************************************************************************/
+
+
+#ifndef INCsja1000H
+#define INCsja1000H
+
+#include <epicsTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/***** Control Segment Bit Patterns *****/
+
+/* Mode Register */
+
+#define SJA_MOD_SM	0x10	/* Sleep Mode */
+#define SJA_MOD_AFM	0x08	/* Acceptance Filter Mode, 1 = single */
+#define SJA_MOD_STM	0x04	/* Self Test Mode */
+#define SJA_MOD_LOM	0x02	/* Listen Only Mode */
+#define SJA_MOD_RM	0x01	/* Reset Mode */
+
+
+/* Command Register */
+
+#define SJA_CMR_SRR	0x10	/* Self Reception Request */
+#define SJA_CMR_CDO	0x08	/* Clear Data Overrun */
+#define SJA_CMR_RRB	0x04	/* Release Receive Buffer */
+#define SJA_CMR_AT	0x02	/* Abort Transmission */
+#define SJA_CMR_TR	0x01	/* Transmission Request */
+
+
+/* Status Register */
+
+#define SJA_SR_BS	0x80	/* Bus Status */
+#define SJA_SR_ES	0x40	/* Error Status */
+#define SJA_SR_TS	0x20	/* Transmit Status */
+#define SJA_SR_RS	0x10	/* Receive Status */
+#define SJA_SR_TCS	0x08	/* Transmission Complete Status */
+#define SJA_SR_TBS	0x04	/* Transmit Buffer Status */
+#define SJA_SR_DOS	0x02	/* Data Overrun Status */
+#define SJA_SR_RBS	0x01	/* Receive Buffer Status */
+
+
+/* Interrupt and Interrupt Enable Registers */
+
+#define SJA_IR_BEI	0x80	/* Bus Error Interrupt */
+#define SJA_IR_ALI	0x40	/* Arbitration Lost Interrupt */
+#define SJA_IR_EPI	0x20	/* Error Passive Interrupt */
+#define SJA_IR_WUI	0x10	/* Wake-Up Interrupt */
+#define SJA_IR_DOI	0x08	/* Data Overrun Interrupt */
+#define SJA_IR_EI	0x04	/* Error Warning Interrupt */
+#define SJA_IR_TI	0x02	/* Transmit Interrupt */
+#define SJA_IR_RI	0x01	/* Receive Interrupt */
+
+
+/* Clock Divider Register */
+
+#define SJA_CDR_CANMODE	0x80	/* PeliCAN mode */
+#define SJA_CDR_CBP	0x40	/* Comparator Bypass */
+#define SJA_CDR_RXINTEN	0x20	/* TX1 as receive interrupt output */
+#define SJA_CDR_CLKOFF	0x08	/* Clock Off */
+
+
+/* Frame Information, first byte of the Tx and Rx buffers */
+
+#define SJA_FI_FF	0x80	/* Extended Frame Format */
+#define SJA_FI_RTR	0x40	/* Remote Transmission Request */
+#define SJA_FI_DLC_MASK	0x0f
+
+
+/* Frame buffer layout, indexes into frame[] */
+
+#define SJA_SFF_DATA	3	/* 11-bit ID in bytes 1 and 2 */
+#define SJA_EFF_DATA	5	/* 29-bit ID in bytes 1 to 4 */
+
+#define SJA_SFF_ID1_LSHIFT	5
+#define SJA_EFF_ID_LSHIFT	3
+
+#define SJA_FIFO_SIZE	64	/* Receive FIFO size in bytes */
+
+
+/***** Chip Structure *****/
+
+typedef struct {
+    epicsUInt8 pad;
+    epicsUInt8 reg;
+} sjaReg_t;
+
+
+/* Chip Registers */
+
+typedef volatile struct {
+    epicsUInt8 pad00;
+    epicsUInt8 mode;
+    epicsUInt8 pad01;
+    epicsUInt8 command;
+    epicsUInt8 pad02;
+    epicsUInt8 status;
+    epicsUInt8 pad03;
+    epicsUInt8 interrupt;
+    epicsUInt8 pad04;
+    epicsUInt8 intEnable;
+    epicsUInt8 pad05;
+    epicsUInt8 reserved05;
+    epicsUInt8 pad06;
+    epicsUInt8 busTiming0;
+    epicsUInt8 pad07;
+    epicsUInt8 busTiming1;
+    epicsUInt8 pad08;
+    epicsUInt8 outputControl;
+    epicsUInt8 pad09;
+    epicsUInt8 test;
+    epicsUInt8 pad10;
+    epicsUInt8 reserved10;
+    epicsUInt8 pad11;
+    epicsUInt8 arbLostCapture;
+    epicsUInt8 pad12;
+    epicsUInt8 errCodeCapture;
+    epicsUInt8 pad13;
+    epicsUInt8 errWarningLimit;
+    epicsUInt8 pad14;
+    epicsUInt8 rxErrorCounter;
+    epicsUInt8 pad15;
+    epicsUInt8 txErrorCounter;
+    sjaReg_t frame[13];		/* Tx/Rx buffer; ACR and AMR in Reset mode */
+    epicsUInt8 pad29;
+    epicsUInt8 rxMsgCounter;
+    epicsUInt8 pad30;
+    epicsUInt8 rxBufStart;
+    epicsUInt8 pad31;
+    epicsUInt8 clockDivider;
+} sja1000_t;
+
+/* Acceptance Code and Mask registers, only accessible in Reset mode */
+#define SJA_ACR(n)	frame[(n)].reg
+#define SJA_AMR(n)	frame[4+(n)].reg
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCsja1000H */
@@ -18,6 +18,40 @@ HeadURL:        $URL$
 #ifndef INC_IP520Ext_H
 #define INC_IP520Ext_H
 
+#include <epicsTypes.h>
+
+/* Rx timestamp ioctl() codes. */
+#define IP520_RXSTAMP_ENABLE  0x52000001   /* arg: 1 = on, 0 = off */
+#define IP520_RXSTAMP_GET     0x52000002   /* arg: IP520_RXSTAMP * */
+
+typedef struct {
+    epicsUInt32 stamp;  /* Arrival of the first char returned by the last read(). */
+    epicsUInt32 freq;   /* Timestamp counts per second. */
+} IP520_RXSTAMP;
+
+/* Rx error counter indices for IP520ErrCounts(). */
+typedef enum {
+    IP520_ERR_OVERRUN,
+    IP520_ERR_PARITY,
+    IP520_ERR_FRAMING,
+    IP520_ERR_BREAK,
+    IP520_NERRS
+} IP520_ERR;
+
+/* Port counters returned by IP520Stats(). */
+typedef struct {
+    unsigned long readCount;    /* Chars received. */
+    unsigned long writeCount;   /* Chars sent. */
+    unsigned long irqCount;     /* Module interrupts. */
+    unsigned long errors;       /* All Rx errors. */
+    unsigned long overruns;     /* Rx overrun errors. */
+    unsigned int  fifoPeak;     /* Most Rx chars read in one ISR pass. */
+} IP520_STATS;
+
 const char* IP520DevCreate(char *, const char *, int, int, int);
+int IP520Stats(const char *, int, IP520_STATS *, int);
+int IP520ErrCounts(const char *, int, unsigned long *);
+void IP520ErrorPeriod(double);
+int IP520RxStamp(char *, int);
 
 #endif
@@ -20,9 +20,19 @@ HeadURL:        $URL$
 
 #include <tyLib.h>  /* For TY_DEV. */
 #include <epicsTypes.h>
+#include "drvIpac.h"
 
 typedef enum {RS485, RS232} RSmode;
 
+#define IP520_FIFO_SIZE 64  /* ST16C654 Rx and Tx FIFO depth. */
+#define IP520_NSTAMPS   16  /* Rx burst timestamps kept per port, power of 2. */
+#define IP520_NHIST     32  /* log2 histogram bins. */
+
+typedef struct {
+    epicsUInt32     stamp;        /* Arrival of the burst's first char. */
+    unsigned long   seq;          /* Its position in the rxDelivered stream. */
+} IP520_STAMP;
+
 struct regmap {
     union {
         struct {
@@ -58,11 +68,40 @@ typedef struct ty_ip520_dev {
     RSmode          mode;
     int             baud;
     int             opts;
-    int             overCount;    /* Rx overrun error counter. */
-    int             parityCount;  /* Rx parity error counter. */
-    int             frameCount;   /* Rx framing error counter. */
+    int             rxTrigger;    /* Rx FIFO trigger from IP520Config(), 0 = by baud rate. */
+    int             rxLevel;      /* Rx FIFO trigger level currently programmed. */
+    int             autoFlow;     /* EFR auto RTS/CTS bits from IP520Config(). */
+    int             rs485Auto;    /* RS485 driver released by the ISR. */
+    int             txDriving;    /* RS485 driver enabled for a transmission. */
+    WDOG_ID         txWd;         /* Releases the driver if TEMT comes late. */
+    unsigned long   turnCount;    /* RS485 releases. */
+    unsigned long   turnLate;     /* Watchdog retries waiting for TEMT. */
+    unsigned long   temtSpins;    /* LSR reads in a char time; 0 = watchdog only. */
+    unsigned long   errCount[IP520_NERRS]; /* Rx error counters, written by the ISR. */
+    unsigned long   errSeen[IP520_NERRS];  /* Counts at the last error summary. */
     unsigned long   readCount;
     unsigned long   writeCount;
+    unsigned int    rxPeak;       /* Most Rx chars read in one pass, see IP520Stats(). */
+    char            rxStage[IP520_FIFO_SIZE]; /* ISR Rx staging buffer. */
+    char           *msgBuf;       /* Rx message being framed, NULL = no framing. */
+    int             msgMax;       /* Maximum message size. */
+    int             msgLen;       /* Characters in msgBuf. */
+    int             msgNeed;      /* Length from prefix, once known. */
+    int             msgPrefix;    /* Length prefix bytes; 0 = use terminators. */
+    int             msgNterm;
+    char            msgTerm[8];   /* Message terminator characters. */
+    unsigned long   msgCount;     /* Messages delivered. */
+    unsigned long   msgOverflow;  /* Messages cut at msgMax. */
+    unsigned long   rxDelivered;  /* Chars accepted by tyLib. */
+    unsigned long   rxConsumed;   /* Chars returned by IP520Read(). */
+    int             stampOn;      /* Rx burst timestamping enabled. */
+    int             stampHead;
+    int             stampCount;
+    epicsUInt32     stampLast;    /* Previous burst, for gapHist. */
+    epicsUInt32     readStamp;    /* Arrival of the first char of the last read. */
+    IP520_STAMP     stampRing[IP520_NSTAMPS];
+    unsigned long   latHist[IP520_NHIST];  /* Arrival to read(), log2 timestamp counts. */
+    unsigned long   gapHist[IP520_NHIST];  /* Between Rx bursts, log2 timestamp counts. */
 } TY_IP520_DEV;
 
 typedef struct modTable {
@@ -71,7 +110,12 @@ typedef struct modTable {
     epicsUInt16    modelID;
     epicsUInt16    carrier;
     epicsUInt16    slot;
-    epicsInt16     irqCount;
+    ipac_counter_t *pio;          /* I/O space access counter. */
+    unsigned long  irqCount;
+    unsigned long  charCount;     /* Chars moved by the ISR. */
+    unsigned long  idleCount;     /* Interrupts with no port pending. */
+    unsigned int   maxChars;      /* Most chars moved in one interrupt. */
+    unsigned long  readRate;      /* Register reads per second, 0 = not measured. */
 } MOD_TABLE;
 
 int IP520Drv(int);
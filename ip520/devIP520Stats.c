@@ -0,0 +1,230 @@
+/*
+FILENAME...     devIP520Stats.c
+USAGE...        ai and longin device support for IP520 port statistics.
+
+*/
+
+/**************************************************************************
+ Description:
+ Reads the counters kept by the IP520 driver for one serial port and turns
+ them into values that can be archived and alarmed on.  The INP link is an
+ INST_IO address of the form
+
+     @<moduleID> <port> <statistic>
+
+ where <statistic> is one of:
+
+     RX_RATE    Characters received per second
+     TX_RATE    Characters sent per second
+     IRQ_RATE   Module interrupts per second, shared by all 8 ports of
+                the module (not per port)
+     ERRORS     Total Rx errors (overrun, parity, framing, break)
+     OVERRUNS   Rx overrun errors
+     FIFO_PEAK  Most characters read in one ISR pass since the last scan
+
+ Rates are averaged over the time since the record last processed, so the
+ record's SCAN period sets the averaging interval; the first reading after
+ iocInit is 0.  Records should use a periodic scan.
+**************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <recSup.h>
+#include <recGbl.h>
+#include <alarm.h>
+#include <devSup.h>
+#include <epicsTime.h>
+#include <aiRecord.h>
+#include <longinRecord.h>
+#include <epicsExport.h>
+
+#include "IP520Ext.h"
+
+typedef enum {
+    STAT_RX_RATE,
+    STAT_TX_RATE,
+    STAT_IRQ_RATE,
+    STAT_ERRORS,
+    STAT_OVERRUNS,
+    STAT_FIFO_PEAK
+} statType;
+
+static const char * const statNames[] = {
+    "RX_RATE", "TX_RATE", "IRQ_RATE", "ERRORS", "OVERRUNS", "FIFO_PEAK"
+};
+
+typedef struct {
+    char            moduleID[40];
+    int             port;
+    statType        stat;
+    int             primed;     /* last and lastTime are valid */
+    IP520_STATS     last;
+    epicsTimeStamp  lastTime;
+} statsPvt;
+
+static long statsInit(dbCommon *prec, DBLINK *plink)
+{
+    statsPvt *ppvt;
+    char stat[20];
+    unsigned i;
+
+    if (plink->type != INST_IO)
+        goto error;
+
+    ppvt = calloc(1, sizeof(statsPvt));
+    if (!ppvt) {
+        recGblRecordError(S_db_noMemory, (void *)prec,
+                          "devIP520Stats: Out of memory");
+        return S_db_noMemory;
+    }
+
+    if (sscanf(plink->value.instio.string, "%39s %d %19s",
+               ppvt->moduleID, &ppvt->port, stat) != 3)
+        goto badlink;
+
+    for (i = 0; i < NELEMENTS(statNames); i++)
+        if (strcmp(stat, statNames[i]) == 0)
+            break;
+    if (i == NELEMENTS(statNames))
+        goto badlink;
+    ppvt->stat = i;
+
+    /* Check the port now rather than at every scan */
+    if (IP520Stats(ppvt->moduleID, ppvt->port, &ppvt->last, 0))
+        goto badlink;
+
+    prec->dpvt = ppvt;
+    return 0;
+
+badlink:
+    free(ppvt);
+error:
+    recGblRecordError(S_db_badField, (void *)prec,
+                      "devIP520Stats: Bad INP field type or value");
+    return S_db_badField;
+}
+
+/* Compute the current value of the record's statistic */
+static long statsRead(dbCommon *prec, double *pval)
+{
+    statsPvt *ppvt = prec->dpvt;
+    IP520_STATS now;
+    epicsTimeStamp time;
+    double dt = 0.0;
+
+    if (!ppvt)
+        return S_dev_noDevice;
+
+    if (IP520Stats(ppvt->moduleID, ppvt->port, &now,
+                   ppvt->stat == STAT_FIFO_PEAK)) {
+        recGblSetSevr(prec, READ_ALARM, INVALID_ALARM);
+        return S_dev_noDevice;
+    }
+    epicsTimeGetCurrent(&time);
+    if (ppvt->primed)
+        dt = epicsTimeDiffInSeconds(&time, &ppvt->lastTime);
+
+    switch (ppvt->stat) {
+    case STAT_RX_RATE:
+        *pval = dt > 0 ? (now.readCount - ppvt->last.readCount) / dt : 0;
+        break;
+    case STAT_TX_RATE:
+        *pval = dt > 0 ? (now.writeCount - ppvt->last.writeCount) / dt : 0;
+        break;
+    case STAT_IRQ_RATE:
+        *pval = dt > 0 ? (now.irqCount - ppvt->last.irqCount) / dt : 0;
+        break;
+    case STAT_ERRORS:
+        *pval = now.errors;
+        break;
+    case STAT_OVERRUNS:
+        *pval = now.overruns;
+        break;
+    case STAT_FIFO_PEAK:
+        *pval = now.fifoPeak;
+        break;
+    }
+
+    ppvt->last = now;
+    ppvt->lastTime = time;
+    ppvt->primed = 1;
+    return 0;
+}
+
+
+/* ai */
+static long init_ai(struct aiRecord *prec)
+{
+    return statsInit((dbCommon *)prec, &prec->inp);
+}
+
+static long read_ai(struct aiRecord *prec)
+{
+    double val;
+    long status = statsRead((dbCommon *)prec, &val);
+
+    if (status)
+        return status;
+    prec->val = val;
+    prec->udf = FALSE;
+    return 2;   /* Don't convert */
+}
+
+struct {
+    long        number;
+    DEVSUPFUN   report;
+    DEVSUPFUN   init;
+    DEVSUPFUN   init_record;
+    DEVSUPFUN   get_ioint_info;
+    DEVSUPFUN   read_ai;
+    DEVSUPFUN   special_linconv;
+} devAiIP520Stats = {
+    6,
+    NULL,
+    NULL,
+    init_ai,
+    NULL,
+    read_ai,
+    NULL
+};
+epicsExportAddress(dset, devAiIP520Stats);
+
+
+/* longin */
+static long init_li(struct longinRecord *prec)
+{
+    return statsInit((dbCommon *)prec, &prec->inp);
+}
+
+static long read_li(struct longinRecord *prec)
+{
+    double val;
+    long status = statsRead((dbCommon *)prec, &val);
+
+    if (status)
+        return status;
+    prec->val = (epicsInt32) (val + 0.5);
+    prec->udf = FALSE;
+    return 0;
+}
+
+struct {
+    long        number;
+    DEVSUPFUN   report;
+    DEVSUPFUN   init;
+    DEVSUPFUN   init_record;
+    DEVSUPFUN   get_ioint_info;
+    DEVSUPFUN   read_longin;
+} devLiIP520Stats = {
+    5,
+    NULL,
+    NULL,
+    init_li,
+    NULL,
+    read_li
+};
+epicsExportAddress(dset, devLiIP520Stats);
@@ -42,9 +42,16 @@ Implentation Notes:
 #include <taskLib.h>
 #include <vxLib.h>
 #include <sioLib.h>
+#include <rngLib.h>
+#include <tickLib.h>
+#include <sysLib.h>
+#include <wdLib.h>
 
 #include "epicsString.h"
+#include "epicsStdio.h"
 #include "epicsInterrupt.h"
+#include "epicsThread.h"
+#include "errlog.h"
 #include "drvIpac.h"
 #include "iocsh.h"
 #include "epicsExport.h"
@@ -65,7 +72,24 @@ Implentation Notes:
 #define TY_DEVSTART_PTR FUNCPTR
 #endif
 
-#define isPower2(x) ((x) && !((x) & ((x) - 1)))
+/* Rx timestamp source.  Define IP520_SYS_TIMESTAMP when building to use the
+ * BSP's high resolution timestamp driver instead of the system clock tick.
+ */
+#ifdef IP520_SYS_TIMESTAMP
+#include <drv/timer/timestampDev.h>
+#define IP520Stamp()        ((epicsUInt32) sysTimestampLock())
+#define IP520StampFreq()    ((epicsUInt32) sysTimestampFreq())
+#else
+#define IP520Stamp()        ((epicsUInt32) tickGet())
+#define IP520StampFreq()    ((epicsUInt32) sysClkRateGet())
+#endif
+
+/* Register access through drvIpac, which can count the accesses or pass
+ * them to a register emulator (see IPAC_READ in drvIpac.h).
+ */
+#define REG_READ(dev, reg)          IPAC_READ((dev)->pmod->pio, (dev)->regs->u.read.reg)
+#define REG_WRITE(dev, reg, value)  IPAC_WRITE((dev)->pmod->pio, (dev)->regs->u.write.reg, (value))
+
 
 /*
  * Module variables
@@ -76,6 +100,7 @@ LOCAL int IP520MaxModules;
 int IP520LastModule;
 
 LOCAL int IP520DrvNum;      /* driver number assigned to this driver */
+LOCAL double IP520ErrPeriod = 10.0;  /* Seconds between Rx error summaries, 0 = off. */
 LOCAL epicsUInt8 savedlcr;   /* Saved LCR value for EFROn & EFROff functions. */
 
 /*
@@ -86,14 +111,23 @@ LOCAL void   IP520InitChannel(MOD_TABLE *, int);
 LOCAL int    IP520RebootHook(int);
 LOCAL MOD_TABLE * IP520OctalFindQT(const char *);
 LOCAL int    IP520Open(TY_IP520_DEV *, const char *, int);
+LOCAL int    IP520Read(TY_IP520_DEV *, char *, long);
 LOCAL int    IP520Write(TY_IP520_DEV *, char *, long);
 LOCAL STATUS IP520Ioctl(TY_IP520_DEV *, int, int);
 LOCAL void   IP520TxStartup(TY_IP520_DEV *);
 LOCAL STATUS IP520BaudSet(TY_IP520_DEV *, int);
 LOCAL void   IP520OptsSet(TY_IP520_DEV *, int);
-LOCAL void   EFROn(REGMAP *);
-LOCAL void   EFROff(REGMAP *);
-LOCAL void   IsrErrMsg(epicsUInt8, TY_IP520_DEV *);
+LOCAL int    IP520RxTriggerCode(int);
+LOCAL void   EFROn(TY_IP520_DEV *);
+LOCAL void   EFROff(TY_IP520_DEV *);
+LOCAL void   IsrErrCount(epicsUInt8, TY_IP520_DEV *);
+LOCAL void   IP520ErrTask(void *);
+LOCAL void   IP520StampBurst(TY_IP520_DEV *);
+LOCAL void   IP520TxRelease(TY_IP520_DEV *);
+LOCAL unsigned long IP520ReadRate(TY_IP520_DEV *);
+LOCAL int    IP520HistBin(epicsUInt32);
+LOCAL void   IP520HistPrint(int, const char *, const unsigned long *);
+LOCAL void   IP520MsgPut(TY_IP520_DEV *, const char *, int);
 
 
 /******************************************************************************
@@ -138,7 +172,12 @@ STATUS IP520Drv(int maxModules)
     }
 
     rebootHookAdd(IP520RebootHook);
-    IP520DrvNum = iosDrvInstall(IP520Open, NULL, IP520Open, NULL, tyRead, IP520Write, IP520Ioctl);
+    IP520DrvNum = iosDrvInstall(IP520Open, NULL, IP520Open, NULL, IP520Read, IP520Write, IP520Ioctl);
+
+    if (IP520DrvNum != ERROR &&
+        !epicsThreadCreate("IP520Err", epicsThreadPriorityLow,
+                           epicsThreadGetStackSize(epicsThreadStackSmall), IP520ErrTask, NULL))
+        printf("%s: Can't start error summary task\n", fn_nm);
 
     return(IP520DrvNum == ERROR ? ERROR : OK);
 }
@@ -152,24 +191,56 @@ void IP520Report(void)
         MOD_TABLE *pmod = &IP520Modules[mod];
         int port;
 
-        printf("Module %d: carrier=%d slot=%d irqCnt=%u\n", mod, pmod->carrier, pmod->slot, pmod->irqCount);
+        printf("Module %d: carrier=%d slot=%d irqCnt=%lu\n", mod, pmod->carrier, pmod->slot, pmod->irqCount);
+        if (pmod->irqCount)
+            printf("  %.2f chars/interrupt, max %u, %lu interrupts with no port pending\n",
+                   (double) pmod->charCount / pmod->irqCount, pmod->maxChars, pmod->idleCount);
 
         for (port = 0; port < 8; port++)
         {
             TY_IP520_DEV *dev = &pmod->dev[port];
-            REGMAP *regs      = dev->regs;
 
             if (dev->created)
             {
-                printf("  Port %d: %lu chars in, %lu chars out, %u overrun, %u parity, %u framing\n", port,
-                       dev->readCount, dev->writeCount, dev->overCount, dev->parityCount, dev->frameCount);
+                epicsUInt8 ier = REG_READ(dev, ier), lsr = REG_READ(dev, lsr);
+                epicsUInt8 mcr = REG_READ(dev, mcr), lcr = REG_READ(dev, lcr);
+
+                printf("  Port %d: %lu chars in, %lu chars out, %lu overrun, %lu parity, %lu framing, %lu break\n", port,
+                       dev->readCount, dev->writeCount, dev->errCount[IP520_ERR_OVERRUN],
+                       dev->errCount[IP520_ERR_PARITY], dev->errCount[IP520_ERR_FRAMING],
+                       dev->errCount[IP520_ERR_BREAK]);
+                printf("  Port %d: Rx FIFO trigger = %d%s\n", port, dev->rxLevel,
+                       dev->rxTrigger ? "" : " (by baud rate)");
+                if (dev->rs485Auto)
+                    printf("  Port %d: %lu RS485 turnarounds, %lu watchdog retries\n", port,
+                           dev->turnCount, dev->turnLate);
+                if (dev->msgBuf)
+                    printf("  Port %d: %lu messages, %lu overflowed, %d chars pending\n", port,
+                           dev->msgCount, dev->msgOverflow, dev->msgLen);
+                if (dev->stampOn)
+                {
+                    IP520HistPrint(port, "Rx burst gap", dev->gapHist);
+                    IP520HistPrint(port, "Rx read latency", dev->latHist);
+                }
                 printf("  Port %d: IER = 0x%2.2hhX, LSR = 0x%2.2hhX, MCR = 0x%2.2hhX, LCR = 0x%2.2hhX\n", port,
-                       regs->u.read.ier, regs->u.read.lsr, regs->u.read.mcr, regs->u.read.lcr);
+                       ier, lsr, mcr, lcr);
             }
         }
     }
 }
 
+LOCAL void IP520HistPrint(int port, const char *title, const unsigned long *hist)
+{
+    double usec = 1e6 / IP520StampFreq();   /* Per timestamp count. */
+    int bin;
+
+    printf("  Port %d: %s (us):", port, title);
+    for (bin = 0; bin < IP520_NHIST; bin++)
+        if (hist[bin])
+            printf(" <%.0f:%lu", usec * (1UL << bin), hist[bin]);
+    printf("\n");
+}
+
 LOCAL int IP520RebootHook(int type)
 {
     int mod;
@@ -186,8 +257,8 @@ LOCAL int IP520RebootHook(int type)
 
             if (dev->created)
             {
-                dev->regs->u.write.ier = 0;
-                dev->regs->u.write.mcr &= ~(0x08); /* Port interrupt disable. */
+                REG_WRITE(dev, ier, 0);
+                REG_WRITE(dev, mcr, REG_READ(dev, mcr) & ~(0x08)); /* Port interrupt disable. */
             }
             ipmIrqCmd(pmod->carrier, pmod->slot, 0, ipac_irqDisable);
             ipmIrqCmd(pmod->carrier, pmod->slot, 1, ipac_irqDisable);
@@ -331,17 +402,20 @@ int IP520ModuleInit
         pmod->carrier = carrier;
         pmod->slot = slot;
         pmod->moduleID = ID;
+        pmod->pio = ipmAccessCounter(carrier, slot, ipac_addrIO);
 
         addrIO = ipmBaseAddr(carrier, slot, ipac_addrIO);
         preg = (REGMAP *) addrIO;
 
         for (port = 0; port < 8; port++)
         {
-            pmod->dev[port].created = 0;
-            pmod->dev[port].regs = &preg[port];
-            pmod->dev[port].pmod= pmod;
-            pmod->dev[port].regs->u.write.ier = 0;
-            pmod->dev[port].regs->u.write.scr = int_num;
+            TY_IP520_DEV *dev = &pmod->dev[port];
+
+            dev->created = 0;
+            dev->regs = &preg[port];
+            dev->pmod= pmod;
+            REG_WRITE(dev, ier, 0);
+            REG_WRITE(dev, scr, int_num);
         }
 
         if (ipmIntConnect(carrier, slot, int_num, IP520Int, IP520LastModule))
@@ -516,14 +590,13 @@ LOCAL MOD_TABLE * IP520OctalFindQT(const char *moduleID)
 LOCAL void IP520InitChannel(MOD_TABLE *pmod, int port)
 {
     TY_IP520_DEV *dev = &pmod->dev[port];
-    REGMAP *regs      = dev->regs;
     int key;
     epicsUInt8 status;
 
     key = intLock();    /* disable interrupts during init */
 
-    regs->u.write.ier = 0x0;   /* disable interrupts */
-    status = regs->u.read.isr; /* clear interrupt status bits */
+    REG_WRITE(dev, ier, 0x0);   /* disable interrupts */
+    status = REG_READ(dev, isr); /* clear interrupt status bits */
 
 /*
  * Set up the default port configuration:
@@ -532,8 +605,8 @@ LOCAL void IP520InitChannel(MOD_TABLE *pmod, int port)
     IP520BaudSet(dev, 9600);
     IP520OptsSet(dev, CS8 | CLOCAL);
 
-    regs->u.write.ier |= 0x05;      /* enable FIFO and Rx interrupts */
-    regs->u.write.mcr |= 0x08;      /* enable port interrupts */
+    REG_WRITE(dev, ier, REG_READ(dev, ier) | 0x05);   /* enable FIFO and Rx interrupts */
+    REG_WRITE(dev, mcr, REG_READ(dev, mcr) | 0x08);   /* enable port interrupts */
 
     intUnlock(key);
 }
@@ -550,6 +623,55 @@ LOCAL int IP520Open(TY_IP520_DEV *dev, const char * name, int mode)
 }
 
 
+/******************************************************************************
+ * IP520Read - read characters, timestamping them if enabled
+ *
+ * Each Rx burst timestamp records the offset of its first character in the
+ * stream accepted by tyLib (rxDelivered), and rxConsumed counts the chars
+ * returned here, so the first character of each read has a known offset.
+ * When Rx timestamping is on, find the burst holding that character and
+ * record its arrival time for IP520_RXSTAMP_GET, and the delay from arrival
+ * to now in the read latency histogram.
+ *
+ * NOMANUAL
+ */
+LOCAL int IP520Read
+    (
+    TY_IP520_DEV *dev,  /* device descriptor block */
+    char *read_bfr,     /* ptr to an input buffer */
+    long read_size      /* max # bytes to read */
+    )
+{
+    int nbytes = tyRead(&dev->tyDev, read_bfr, read_size);
+    unsigned long pos = dev->rxConsumed;    /* Offset of read_bfr[0]. */
+
+    if (nbytes <= 0)
+        return nbytes;
+    dev->rxConsumed += nbytes;
+
+    if (dev->stampOn)
+    {
+        epicsUInt32 now = IP520Stamp();
+        int stamped = 0, k, key;
+
+        key = intLock();
+        for (k = 1; k <= dev->stampCount; k++)
+        {
+            IP520_STAMP *ps = &dev->stampRing[(dev->stampHead - k) & (IP520_NSTAMPS - 1)];
+
+            dev->readStamp = ps->stamp;     /* Oldest one if none match. */
+            stamped = 1;
+            if ((long) (pos - ps->seq) >= 0)
+                break;
+        }
+        intUnlock(key);
+
+        if (stamped)
+            dev->latHist[IP520HistBin(now - dev->readStamp)]++;
+    }
+    return nbytes;
+}
+
 /******************************************************************************
  * IP520Write - Outputs a specified number of characters on a serial port
  *
@@ -574,11 +696,29 @@ LOCAL int IP520Write
         return -1;
     }
 
+    if (dev->mode == RS485 && dev->rs485Auto)
+    {
+        /* The ISR releases RTS when the transmitter empties. */
+        if (write_size > 0)
+        {
+            int key = intLock();
+
+            if (!dev->txDriving)
+            {
+                dev->txDriving = 1;
+                REG_WRITE(dev, ier, REG_READ(dev, ier) & ~(0x04));
+                REG_WRITE(dev, mcr, REG_READ(dev, mcr) | 0x02);
+            }
+            intUnlock(key);
+        }
+        return tyWrite(&dev->tyDev, write_bfr, write_size);
+    }
+
     if (dev->mode == RS485)
     {
         /* disable recv, assert RTS */
-        dev->regs->u.write.ier &= ~(0x04);
-        dev->regs->u.write.mcr |= 0x02;
+        REG_WRITE(dev, ier, REG_READ(dev, ier) & ~(0x04));
+        REG_WRITE(dev, mcr, REG_READ(dev, mcr) | 0x02);
     }
 
     nbytes = tyWrite(&dev->tyDev, write_bfr, write_size);
@@ -586,11 +726,11 @@ LOCAL int IP520Write
     if (dev->mode == RS485)
     {
         /* make sure all data sent */
-        while(!(dev->regs->u.read.isr & 0x08))   /* Wait for TxEMT */
+        while(!(REG_READ(dev, isr) & 0x08))   /* Wait for TxEMT */
             ;
         /* enable recv, de-assert RTS */
-        dev->regs->u.write.ier |= 0x04;
-        dev->regs->u.write.mcr &= ~(0x02);
+        REG_WRITE(dev, ier, REG_READ(dev, ier) | 0x04);
+        REG_WRITE(dev, mcr, REG_READ(dev, mcr) & ~(0x02));
     }
 
     return nbytes;
@@ -606,10 +746,9 @@ LOCAL int IP520Write
 LOCAL void IP520OptsSet(TY_IP520_DEV * dev, int opts)
 {
     MOD_TABLE *pmod = dev->pmod;
-    REGMAP *regs    = dev->regs;
     epicsUInt8 llcr, lefr, lmcr, lisr, lfcr;
     int mask = (CSIZE | STOPB | PARENB | PARODD | CLOCAL);
-    int baud, hardwareflowcontrol = 0;
+    int baud, bits, hardwareflowcontrol = 0;
 
     switch (opts & CSIZE)
     {
@@ -638,8 +777,8 @@ LOCAL void IP520OptsSet(TY_IP520_DEV * dev, int opts)
             llcr |= 0x10;  /* Even Parity. */
     }
 
-    regs->u.write.lcr = llcr;
-    llcr = regs->u.read.lcr;    /* Read to flush posted writes. */
+    REG_WRITE(dev, lcr, llcr);
+    llcr = REG_READ(dev, lcr);  /* Read to flush posted writes. */
 
     if (pmod->modelID != IP520_OCTAL232)
     {
@@ -651,12 +790,25 @@ LOCAL void IP520OptsSet(TY_IP520_DEV * dev, int opts)
     {
         dev->mode = RS232;
         if (!(opts & CLOCAL))   /* Hardware flow control */
-            hardwareflowcontrol = 1;
+            hardwareflowcontrol = 0xC0;
+        hardwareflowcontrol |= dev->autoFlow;   /* AUTORTS/AUTOCTS options. */
     }
     dev->opts = opts & mask;
 
     baud = dev->baud;
-    if (baud <= 9600)
+
+    /* LSR reads in one character time, for IP520TxRelease.  Don't spin when
+     * a character takes longer than a clock tick; the watchdog is no slower.
+     */
+    bits = 1 + 5 + (llcr & 0x03) + ((llcr & 0x08) ? 1 : 0) + ((llcr & 0x04) ? 2 : 1);
+    if (pmod->readRate && (double) bits / baud < 1.0 / sysClkRateGet())
+        dev->temtSpins = (unsigned long) ((double) pmod->readRate * bits / baud) + 1;
+    else
+        dev->temtSpins = 0;
+
+    if (dev->rxTrigger)         /* Explicit trigger level from IP520Config(). */
+        lfcr = IP520RxTriggerCode(dev->rxTrigger) | 0x01;
+    else if (baud <= 9600)
         lfcr = 0xA1;            /* Set Rx FIFO trigger level = 60. */
     else if (baud >= 115200)
     {
@@ -675,26 +827,53 @@ LOCAL void IP520OptsSet(TY_IP520_DEV * dev, int opts)
             lfcr = 0x81;        /* Set Rx FIFO trigger level = 56. */
     }
 
-    regs->u.write.fcr  = 0x00;      /* Clear FIFO's. */
-    regs->u.write.fcr  = lfcr;      /* Set Rx FIFO trigger level based on baudrate,
-                                     * Set Tx FIFO trigger level to 8 charaters. */
-    EFROn(regs);
-    lefr = regs->u.read.isr;        /* Read EFR.*/
-    if (hardwareflowcontrol == 0)
-        lefr &= ~(0xC0);            /* Disable RTS/CTS flow control. */
-    else
-        lefr |=   0xC0;             /* Enable  RTS/CTS flow control. */
-    regs->u.write.fcr = lefr;       /* Write to EFR. */
-    lisr = regs->u.read.isr;        /* Read ISR to flush FCR posted writes. */
-    EFROff(regs);
+    switch (lfcr & 0xC0)        /* Characters guaranteed present on an Rx data interrupt. */
+    {
+        case 0x00: dev->rxLevel = 8;  break;
+        case 0x40: dev->rxLevel = 16; break;
+        case 0x80: dev->rxLevel = 56; break;
+        default:   dev->rxLevel = 60; break;
+    }
 
-    lmcr = regs->u.read.mcr;
+    REG_WRITE(dev, fcr, 0x00);      /* Clear FIFO's. */
+    REG_WRITE(dev, fcr, lfcr);      /* Set Rx FIFO trigger level based on baudrate,
+                                     * Set Tx FIFO trigger level to 8 charaters. */
+    EFROn(dev);
+    lefr = REG_READ(dev, isr);      /* Read EFR.*/
+    lefr &= ~(0xC0);                /* Auto CTS = bit 7, auto RTS = bit 6. */
+    lefr |= hardwareflowcontrol;    /* Enable the selected RTS/CTS flow control. */
+    REG_WRITE(dev, fcr, lefr);      /* Write to EFR. */
+    lisr = REG_READ(dev, isr);      /* Read ISR to flush FCR posted writes. */
+    EFROff(dev);
+
+    lmcr = REG_READ(dev, mcr);
     if (hardwareflowcontrol == 0)
         lmcr &= ~(0x02);            /* Set RTS off. */
     else
         lmcr |=   0x02;             /* Set RTS on.  */
-    regs->u.write.mcr = lmcr;
-    lmcr = regs->u.read.mcr;        /* Read to flush posted writes. */
+    REG_WRITE(dev, mcr, lmcr);
+    lmcr = REG_READ(dev, mcr);      /* Read to flush posted writes. */
+}
+
+/******************************************************************************
+ *
+ * IP520RxTriggerCode - FCR bits 7:6 for an Rx FIFO trigger level
+ *
+ * RETURNS: FCR trigger bits, or -1 if the ST16C654 doesn't support the level.
+ *
+ * NOMANUAL
+ */
+
+LOCAL int IP520RxTriggerCode(int level)
+{
+    switch (level)
+    {
+        case 8:  return 0x00;
+        case 16: return 0x40;
+        case 56: return 0x80;
+        case 60: return 0xC0;
+        default: return -1;
+    }
 }
 
 /******************************************************************************
@@ -707,24 +886,25 @@ LOCAL void IP520OptsSet(TY_IP520_DEV * dev, int opts)
 LOCAL STATUS IP520BaudSet(TY_IP520_DEV *dev, int baud)
 {
     int rtnstat = 0;
-    REGMAP *regs = dev->regs;
     epicsUInt8 llcr, lmcr, dlm, dll;
 
     if (dev->baud == baud)              /* Any changes? */
         return(rtnstat);                /* No. Exit.    */
 
-    EFROn(regs);
-    regs->u.write.lcr = savedlcr;       /* Restore LCR to saved value for following MCR write, but
+    EFROn(dev);
+    REG_WRITE(dev, lcr, savedlcr);      /* Restore LCR to saved value for following MCR write, but
                                            don't disable writes to enhanced functions (EF's). */
+    lmcr = REG_READ(dev, mcr);
     if (baud == 57600)
-        regs->u.write.mcr |=   0x80;    /* Only 57600 requires MCR bit#7 = 1; crystal freq. divide by 4.*/
+        lmcr |=   0x80;                 /* Only 57600 requires MCR bit#7 = 1; crystal freq. divide by 4.*/
     else
-        regs->u.write.mcr &= ~(0x80);   /* MCR bit#7 = 0; crystal freq. divide by 1. */
-    lmcr = regs->u.read.mcr;            /* Read MCR to flush posted writes. */
-    EFROff(regs);
+        lmcr &= ~(0x80);                /* MCR bit#7 = 0; crystal freq. divide by 1. */
+    REG_WRITE(dev, mcr, lmcr);
+    lmcr = REG_READ(dev, mcr);          /* Read MCR to flush posted writes. */
+    EFROff(dev);
 
-    regs->u.write.lcr |= 0x80;          /* Expose DLL/DLM; hide RBR/THR/IER. */
-    llcr = regs->u.read.lcr;            /* Read LCR to flush posted writes. */
+    REG_WRITE(dev, lcr, REG_READ(dev, lcr) | 0x80);  /* Expose DLL/DLM; hide RBR/THR/IER. */
+    llcr = REG_READ(dev, lcr);          /* Read LCR to flush posted writes. */
 
     switch (baud)
     {
@@ -771,13 +951,13 @@ LOCAL STATUS IP520BaudSet(TY_IP520_DEV *dev, int baud)
 
     if (rtnstat != -1)
     {
-        regs->u.write.ier = dlm; /* DLM */
-        regs->u.write.thr = dll; /* DLL */
+        REG_WRITE(dev, ier, dlm); /* DLM */
+        REG_WRITE(dev, thr, dll); /* DLL */
         dev->baud = baud;
     }
 
-    regs->u.write.lcr &= ~(0x80); /* Hide DLL/DLM; expose RBR/THR. */
-    llcr = regs->u.read.lcr;      /* Read to flush posted writes. */
+    REG_WRITE(dev, lcr, REG_READ(dev, lcr) & ~(0x80));  /* Hide DLL/DLM; expose RBR/THR. */
+    llcr = REG_READ(dev, lcr);    /* Read to flush posted writes. */
 
     return rtnstat;
 }
@@ -824,6 +1004,24 @@ LOCAL STATUS IP520Ioctl
         case SIO_HW_OPTS_GET:
             *(int *)arg = dev->opts;
             break;
+        case IP520_RXSTAMP_ENABLE:
+            key = intLock();
+            dev->stampOn = arg;
+            dev->stampCount = 0;
+            intUnlock(key);
+            break;
+        case IP520_RXSTAMP_GET:
+            ((IP520_RXSTAMP *) arg)->stamp = dev->readStamp;
+            ((IP520_RXSTAMP *) arg)->freq  = IP520StampFreq();
+            break;
+        case FIOFLUSH:
+        case FIORFLUSH:
+            /* The discarded chars will never be read. */
+            status = tyIoctl(&dev->tyDev, request, arg);
+            key = intLock();
+            dev->rxConsumed = dev->rxDelivered;
+            intUnlock(key);
+            break;
         default:
             status = tyIoctl(&dev->tyDev, request, arg);
             break;
@@ -839,13 +1037,35 @@ LOCAL STATUS IP520Ioctl
  * This routine sets the baud rate, parity, stop bits, word size, and
  * flow control for the specified port.
  *
+ * The optional options string may contain:
+ *   RXTRIG=<n> - Rx FIFO trigger level; 8, 16, 56 or 60 characters.  By
+ *                default the level is chosen from the baud rate.
+ *   AUTORTS    - RS232: the UART drops RTS when the Rx FIFO reaches the
+ *                trigger level and raises it again when it drains.
+ *   AUTOCTS    - RS232: the UART stops transmitting while CTS is low.
+ *   RS485AUTO  - RS485: the ISR releases the line driver and re-enables
+ *                the receiver as soon as the transmitter is empty,
+ *                instead of the writing task polling for it.  The first
+ *                such port on a module takes a clock tick or two to time
+ *                the module's register reads.
+ *
+ * Flow control 'H' turns on both AUTORTS and AUTOCTS.
+ *
+ * The UART raises a receive timeout interrupt when characters below the
+ * trigger level have been idle in the FIFO for 4 character times, so a
+ * high trigger level does not delay the tail of a message indefinitely.
  */
-STATUS IP520Config(char *name, int baud, char parity, int stop, int bits, char flow)
+STATUS IP520Config(char *name, int baud, char parity, int stop, int bits, char flow,
+                   const char *options)
 {
     static char *fn_nm = "IP520Config";
     TY_IP520_DEV *dev = (TY_IP520_DEV *) iosDevFind(name, NULL);
     int opts = 0;
+    int rxTrigger = 0;
+    int autoFlow = 0;
+    int rs485Auto = 0;
     int key;
+    const char *opt;
 
     if (!dev || strcmp(dev->tyDev.devHdr.name, name) != 0)
     {
@@ -853,6 +1073,37 @@ STATUS IP520Config(char *name, int baud, char parity, int stop, int bits, char f
         return(ERROR);
     }
 
+    if (options && (opt = strstr(options, "RXTRIG=")) != NULL)
+    {
+        rxTrigger = atoi(opt + 7);
+        if (IP520RxTriggerCode(rxTrigger) < 0)
+        {
+            printf("%s: Rx FIFO trigger level %d invalid; use 8, 16, 56 or 60\n",
+                   fn_nm, rxTrigger);
+            return(ERROR);
+        }
+    }
+    if (options && strstr(options, "AUTORTS"))
+        autoFlow |= 0x40;
+    if (options && strstr(options, "AUTOCTS"))
+        autoFlow |= 0x80;
+    if (options && strstr(options, "RS485AUTO"))
+    {
+        if (dev->pmod->modelID == IP520_OCTAL232)
+        {
+            printf("%s: RS485AUTO needs an RS422/485 module\n", fn_nm);
+            return(ERROR);
+        }
+        if (!dev->txWd && (dev->txWd = wdCreate()) == NULL)
+        {
+            printf("%s: Watchdog creation failed!\n", fn_nm);
+            return(ERROR);
+        }
+        if (!dev->pmod->readRate)
+            dev->pmod->readRate = IP520ReadRate(dev);
+        rs485Auto = 1;
+    }
+
     switch (bits)
     {
         case 5:
@@ -881,132 +1132,486 @@ STATUS IP520Config(char *name, int baud, char parity, int stop, int bits, char f
         opts |= PARENB | PARODD;
 
     key = intLock();
+    dev->rxTrigger = rxTrigger;
+    dev->autoFlow = autoFlow;
+    dev->rs485Auto = rs485Auto;
     IP520BaudSet(dev, baud);
     IP520OptsSet(dev, opts);    /* Always call after IP520BaudSet. */
     intUnlock(key);
     return(OK);
 }
 
+/******************************************************************************
+ *
+ * IP520Framing - deliver received data to readers a message at a time
+ *
+ * When maxFrame is non-zero the ISR collects received characters until a
+ * message is complete and only then passes it to tyLib.  A message ends
+ * at any character in terms (C escapes such as \r\n are allowed), or,
+ * if lenPrefix is 1 or 2, after the big-endian length held in its first
+ * lenPrefix bytes plus the prefix itself.  A message that reaches maxFrame
+ * characters is passed up as it stands.  maxFrame = 0 turns framing off,
+ * passing up any partial message.
+ *
+ * RETURNS: OK, or ERROR for a bad device or arguments.
+ */
+STATUS IP520Framing(char *name, int maxFrame, const char *terms, int lenPrefix)
+{
+    static char *fn_nm = "IP520Framing";
+    TY_IP520_DEV *dev = (TY_IP520_DEV *) iosDevFind(name, NULL);
+    char term[sizeof(dev->msgTerm)];
+    char *newBuf = NULL, *oldBuf;
+    int nterm = 0;
+    int key;
+
+    if (!dev || strcmp(dev->tyDev.devHdr.name, name) != 0)
+    {
+        printf("%s: Device %s not found\n", fn_nm, name);
+        return(ERROR);
+    }
+
+    if (maxFrame < 0 || lenPrefix < 0 || lenPrefix > 2 || (maxFrame && maxFrame <= lenPrefix))
+    {
+        printf("%s: Bad maxFrame or lenPrefix\n", fn_nm);
+        return(ERROR);
+    }
+
+    if (maxFrame)
+    {
+        if (terms)
+            nterm = epicsStrnRawFromEscaped(term, sizeof(term), terms, strlen(terms));
+        if (!lenPrefix && nterm == 0)
+        {
+            printf("%s: Need terminators or a length prefix\n", fn_nm);
+            return(ERROR);
+        }
+        newBuf = malloc(maxFrame);
+        if (!newBuf)
+        {
+            printf("%s: Memory allocation failed!\n", fn_nm);
+            return(ERROR);
+        }
+    }
+
+    key = intLock();
+    oldBuf = dev->msgBuf;
+    if (oldBuf)             /* Pass up any partial message. */
+    {
+        int i;
+
+        for (i = 0; i < dev->msgLen; i++)
+            if (tyIRd(&dev->tyDev, oldBuf[i]) == OK)
+                dev->rxDelivered++;
+    }
+    memcpy(dev->msgTerm, term, nterm);
+    dev->msgNterm  = nterm;
+    dev->msgPrefix = lenPrefix;
+    dev->msgMax    = maxFrame;
+    dev->msgLen    = 0;
+    dev->msgNeed   = 0;
+    dev->msgBuf    = newBuf;
+    intUnlock(key);
+
+    free(oldBuf);
+    return(OK);
+}
+
 /*****************************************************************************
  * IP520Int - interrupt level processing
  *
  * LOGIC
- * Loop through each of the 8 serial ports, until no Rx or Tx processing required.
- *
+ * Make a single pass over the 8 serial ports; a port that becomes ready
+ * after it has been serviced holds the IRQ line asserted and re-enters.
+ * FOR each created port with an interrupt pending in its ISR.
+ *  Read LSR and process Rx errors.
+ *  IF the Rx trigger level was reached AND the FIFO holds no errored characters.
+ *      Read trigger level characters into the staging buffer without polling LSR.
+ *  ENDIF
+ *  WHILE LSR shows Rx data (includes the Rx timeout case).
+ *      Read characters into the staging buffer, checking LSR for each.
+ *      Pass the staging buffer to tyLib.
+ *  ENDWHILE
+ *  IF Tx interrupts are enabled, AND, Tx FIFO is empty.
+ *      Refill the Tx FIFO.
+ *  ENDIF
+ * ENDFOR
  */
 void IP520Int(int mod)
 {
     MOD_TABLE *pmod = &IP520Modules[mod];
-    REGMAP *regs;
     volatile epicsUInt8 dummy, *flush = NULL;
-    int scan = 0;
+    unsigned int work = 0;
+    int pending = 0;
+    int port;
 
     pmod->irqCount++;
 
-    while (scan <= 7)
+    for (port = 0; port < 8; port++)
     {
         epicsUInt8 isr, lsr, ier;
-        TY_IP520_DEV *dev = &pmod->dev[scan];
-        int key, work = 0;
+        TY_IP520_DEV *dev = &pmod->dev[port];
+        int key, burst, nchars;
 
         if (!dev->created)
+            continue;
+
+        key = intLock(); /* Is this required? */
+        isr = REG_READ(dev, isr);
+        if (isr & 0x01)         /* No interrupt pending on this port. */
         {
-            scan++;
+            intUnlock(key);
             continue;
         }
+        pending++;
 
-        regs = dev->regs;
-        key = intLock(); /* Is this required? */
-        isr = regs->u.read.isr;
-        ier = regs->u.read.ier;
-        lsr = regs->u.read.lsr;
+        lsr = REG_READ(dev, lsr);
+        if (lsr & 0x1E)         /* Check for overrun, parity, framing error or break. */
+            IsrErrCount(lsr, dev);
 
-        if (lsr & 0x0E)         /* Check for overrun, parity or framing error. */
-            IsrErrMsg(lsr, dev);
+        /* Rx data interrupt (not timeout) guarantees rxLevel characters. */
+        if ((isr & 0x3E) == 0x04 && !(lsr & 0x80))
+            burst = dev->rxLevel;
+        else
+            burst = 0;
 
-        while (lsr & 0x01)     /* RBR has a character to read. */
-        {
-            char inChar = regs->u.read.rbr;
-
-            tyIRd(&dev->tyDev, inChar);
-            dev->readCount++;
-            work = 1;
-            lsr = regs->u.read.lsr;
-            if (lsr & 0x0E)         /* Check for overrun, parity or framing error. */
-                IsrErrMsg(lsr, dev);
-        }
+        if (dev->stampOn && (burst || (lsr & 0x01)))
+            IP520StampBurst(dev);
 
-        if ((ier & 0x02) && (lsr & 0x20)) /* If Tx interrupts are enabled, AND, Tx FIFO is empty. */
+        while (burst || (lsr & 0x01))
         {
-            STATUS status = OK;
-            char outChar;
-            int TxCtr = 64;
+            char *pch = dev->rxStage;
 
-            while((TxCtr > 0) && ((status = tyITx(&dev->tyDev, &outChar)) == OK))
+            for (nchars = 0; nchars < burst; nchars++)
+                *pch++ = REG_READ(dev, rbr);
+            if (burst)
             {
-                regs->u.write.thr = outChar;
-                dev->writeCount++;
-                TxCtr--;
+                burst = 0;
+                lsr = REG_READ(dev, lsr);
+                if (lsr & 0x1E)
+                    IsrErrCount(lsr, dev);
             }
 
-            if (status == ERROR)
+            while ((lsr & 0x01) && nchars < IP520_FIFO_SIZE)
             {
-                /* deactivate Tx INT and disable Tx INT */
-                regs->u.write.ier &= ~(0x02);
-                ier = regs->u.read.ier;
-                flush = &regs->u.write.ier;
+                *pch++ = REG_READ(dev, rbr);
+                nchars++;
+                lsr = REG_READ(dev, lsr);
+                if (lsr & 0x1E)         /* Check for overrun, parity, framing error or break. */
+                    IsrErrCount(lsr, dev);
             }
-            work = 1;
+
+            /* tyLib has no block input routine, but the UART is now idle */
+            dev->readCount += nchars;
+            work += nchars;
+            if (nchars > dev->rxPeak)
+                dev->rxPeak = nchars;
+            if (dev->msgBuf)
+                IP520MsgPut(dev, dev->rxStage, nchars);
+            else
+                for (pch = dev->rxStage; nchars > 0; nchars--)
+                    if (tyIRd(&dev->tyDev, *pch++) == OK)
+                        dev->rxDelivered++;
         }
 
-        if (work == 0)
-            scan++;
+        if (lsr & 0x20)         /* Tx FIFO is empty. */
+        {
+            ier = REG_READ(dev, ier);
+            if (ier & 0x02)     /* Tx interrupts are enabled. */
+            {
+                STATUS status = OK;
+                char outChar;
+                int TxCtr = IP520_FIFO_SIZE;
+
+                while((TxCtr > 0) && ((status = tyITx(&dev->tyDev, &outChar)) == OK))
+                {
+                    REG_WRITE(dev, thr, outChar);
+                    dev->writeCount++;
+                    TxCtr--;
+                }
+                work += IP520_FIFO_SIZE - TxCtr;
+
+                /* An RS485 driver is released on the THRE interrupt after
+                 * the last characters, when only the shift register is left.
+                 */
+                if (status == ERROR &&
+                    !(dev->txDriving && TxCtr < IP520_FIFO_SIZE))
+                {
+                    /* deactivate Tx INT and disable Tx INT */
+                    REG_WRITE(dev, ier, ier & ~(0x02));
+                    flush = &dev->regs->u.write.ier;
+                    if (dev->txDriving)
+                        IP520TxRelease(dev);
+                }
+            }
+        }
 
         intUnlock(key); /* Is this required? */
     }
 
+    pmod->charCount += work;
+    if (work > pmod->maxChars)
+        pmod->maxChars = work;
+    if (!pending)
+        pmod->idleCount++;
+
     if (flush)
-        dummy = *flush;    /* Flush last write cycle */
+        dummy = IPAC_READ(pmod->pio, *flush);    /* Flush last write cycle */
 }
 
 
-LOCAL void IsrErrMsg(epicsUInt8 lsr, TY_IP520_DEV *dev)
+/*****************************************************************************
+ * IP520MsgPut - add received characters to the message being framed
+ *
+ * Characters are held back from tyLib until the message is complete; then
+ * the whole message is passed up at once, so a reader blocked in tyRead()
+ * wakes once per message instead of once per character.  A message ends
+ * with a terminator character, when the length given by its prefix has
+ * arrived, or when it fills the buffer.
+ *
+ * NOMANUAL
+ */
+LOCAL void IP520MsgPut(TY_IP520_DEV *dev, const char *pch, int nchars)
 {
-    int cnt;
-    char *errmsg;
-    static char overrunErrMsg[] = "      : Rx overrun ctr = xxx\n";
-    static char parityErrMsg[]  = "      : Rx parity  ctr = xxx\n";
-    static char framingErrMsg[] = "      : Rx framing ctr = xxx\n";
-
-    if (lsr & 0x02)         /* Check for Rx overrun. */
+    while (nchars-- > 0)
     {
-        cnt = ++dev->overCount;
-        errmsg = overrunErrMsg;
+        char c = *pch++;
+        int done;
+
+        dev->msgBuf[dev->msgLen++] = c;
+
+        if (dev->msgPrefix)
+        {
+            if (dev->msgLen == dev->msgPrefix)
+            {
+                int i, len = 0;
+
+                for (i = 0; i < dev->msgPrefix; i++)   /* Big-endian. */
+                    len = (len << 8) | (epicsUInt8) dev->msgBuf[i];
+                dev->msgNeed = dev->msgPrefix + len;
+            }
+            done = (dev->msgLen >= dev->msgPrefix && dev->msgLen >= dev->msgNeed);
+        }
+        else
+            done = (memchr(dev->msgTerm, c, dev->msgNterm) != NULL);
+
+        if (!done && dev->msgLen >= dev->msgMax)
+        {
+            done = 1;
+            dev->msgOverflow++;
+        }
+
+        if (done)
+        {
+            int i;
+
+            for (i = 0; i < dev->msgLen; i++)
+                if (tyIRd(&dev->tyDev, dev->msgBuf[i]) == OK)
+                    dev->rxDelivered++;
+            dev->msgLen = 0;
+            dev->msgNeed = 0;
+            dev->msgCount++;
+        }
     }
-    else if (lsr & 0x04)    /* Check for parity error. */
+}
+
+
+/*****************************************************************************
+ * IP520StampBurst - timestamp the first character of an Rx burst
+ *
+ * Called from the ISR before the burst is read.  The character's position
+ * in the stream passed to tyLib lets IP520Read() find the burst again.
+ *
+ * NOMANUAL
+ */
+LOCAL void IP520StampBurst(TY_IP520_DEV *dev)
+{
+    epicsUInt32 now = IP520Stamp();
+    IP520_STAMP *ps = &dev->stampRing[dev->stampHead];
+
+    if (dev->stampCount)
+        dev->gapHist[IP520HistBin(now - dev->stampLast)]++;
+    dev->stampLast = now;
+
+    ps->stamp = now;
+    ps->seq   = dev->rxDelivered + (dev->msgBuf ? dev->msgLen : 0);
+    dev->stampHead = (dev->stampHead + 1) & (IP520_NSTAMPS - 1);
+    if (dev->stampCount < IP520_NSTAMPS)
+        dev->stampCount++;
+}
+
+/* IP520HistBin - log2 histogram bin; bin n holds values below 2^n. */
+LOCAL int IP520HistBin(epicsUInt32 value)
+{
+    int bin = 0;
+
+    while (value && bin < IP520_NHIST - 1)
     {
-        cnt = ++dev->parityCount;
-        errmsg = parityErrMsg;
+        value >>= 1;
+        bin++;
     }
-    else if (lsr & 0x08)    /* Check for framing error. */
+    return bin;
+}
+
+/*****************************************************************************
+ * IsrErrCount - count Rx errors flagged in the LSR
+ *
+ * Only the port's own counters are touched, so this is safe from the ISR
+ * of any module; IP520ErrTask() reports the counts later at task level.
+ *
+ * NOMANUAL
+ */
+LOCAL void IsrErrCount(epicsUInt8 lsr, TY_IP520_DEV *dev)
+{
+    if (lsr & 0x02)         /* Rx overrun. */
+        dev->errCount[IP520_ERR_OVERRUN]++;
+    if (lsr & 0x04)         /* Parity error. */
+        dev->errCount[IP520_ERR_PARITY]++;
+    if (lsr & 0x08)         /* Framing error. */
+        dev->errCount[IP520_ERR_FRAMING]++;
+    if (lsr & 0x10)         /* Break received. */
+        dev->errCount[IP520_ERR_BREAK]++;
+}
+
+/*****************************************************************************
+ * IP520ErrTask - low priority Rx error summary task
+ *
+ * Every IP520ErrPeriod seconds, print one line for each port whose Rx
+ * error counters have changed since the last summary.  A period of 0
+ * turns the summaries off; the counters still run.
+ *
+ * NOMANUAL
+ */
+LOCAL void IP520ErrTask(void *parm)
+{
+    static const char *errName[IP520_NERRS] = {"overrun", "parity", "framing", "break"};
+
+    for (;;)
     {
-        cnt = ++dev->frameCount;
-        errmsg = framingErrMsg;
+        int mod;
+
+        epicsThreadSleep(IP520ErrPeriod > 0 ? IP520ErrPeriod : 10.0);
+        if (IP520ErrPeriod <= 0)
+            continue;
+
+        for (mod = 0; mod < IP520LastModule; mod++)
+        {
+            MOD_TABLE *pmod = &IP520Modules[mod];
+            int port;
+
+            for (port = 0; port < 8; port++)
+            {
+                TY_IP520_DEV *dev = &pmod->dev[port];
+                char line[160];
+                int err, len = 0;
+
+                if (!dev->created)
+                    continue;
+
+                for (err = 0; err < IP520_NERRS; err++)
+                {
+                    unsigned long count = dev->errCount[err];
+                    unsigned long delta = count - dev->errSeen[err];
+
+                    if (delta && len < (int) sizeof(line))
+                        len += epicsSnprintf(line + len, sizeof(line) - len, " %lu %s (%lu total)",
+                                             delta, errName[err], count);
+                    dev->errSeen[err] = count;
+                }
+                if (len)
+                    errlogPrintf("IP520 %s port %d Rx errors:%s\n", pmod->moduleID, port, line);
+            }
+        }
     }
-    else
-        return;
+}
 
-    if (cnt <= 10 || isPower2(cnt))
+/******************************************************************************
+ *
+ * IP520ErrorPeriod - set the interval between Rx error summaries
+ *
+ * Rx errors are only counted by the ISR; a low priority task prints a
+ * summary line for each port with new errors every period seconds.
+ * A period of 0 turns the summaries off.
+ */
+void IP520ErrorPeriod(double period)
+{
+    IP520ErrPeriod = period;
+}
+
+/******************************************************************************
+ *
+ * IP520RxStamp - turn Rx timestamping on or off for a port
+ *
+ * Same as the IP520_RXSTAMP_ENABLE ioctl, for use from the shell.
+ *
+ * RETURNS: OK, or ERROR if the device is not found.
+ */
+int IP520RxStamp(char *name, int on)
+{
+    TY_IP520_DEV *dev = (TY_IP520_DEV *) iosDevFind(name, NULL);
+
+    if (!dev || strcmp(dev->tyDev.devHdr.name, name) != 0)
     {
-        int size;
-        size = strlen(dev->pmod->moduleID);
-        size = (size >= 6) ? 6 : (size - 1);
-        strncpy(errmsg, dev->pmod->moduleID, size);
-        errmsg[25] = '0' + (cnt / 100) % 10;
-        errmsg[26] = '0' + (cnt / 10) % 10;
-        errmsg[27] = '0' + cnt % 10;
-        epicsInterruptContextMessage(errmsg);
+        printf("IP520RxStamp: Device %s not found\n", name);
+        return(ERROR);
     }
+    return IP520Ioctl(dev, IP520_RXSTAMP_ENABLE, on);
+}
+
+/******************************************************************************
+ *
+ * IP520Stats - read a port's throughput and error counters
+ *
+ * Fills in *stats from the counters the ISR maintains.  The FIFO peak is
+ * the largest number of characters read in one pass since it was last
+ * reset; a non-zero resetPeak clears it after copying.
+ *
+ * RETURNS: OK, or ERROR if the module or port is unknown.
+ */
+int IP520Stats(const char *moduleID, int port, IP520_STATS *stats, int resetPeak)
+{
+    MOD_TABLE *pmod = IP520OctalFindQT(moduleID);
+    TY_IP520_DEV *dev;
+    int err, key;
+
+    if (!pmod || port < 0 || port > 7 || !pmod->dev[port].created || !stats)
+        return(ERROR);
+    dev = &pmod->dev[port];
+
+    key = intLock();
+    stats->readCount  = dev->readCount;
+    stats->writeCount = dev->writeCount;
+    stats->irqCount   = pmod->irqCount;
+    stats->errors     = 0;
+    for (err = 0; err < IP520_NERRS; err++)
+        stats->errors += dev->errCount[err];
+    stats->overruns   = dev->errCount[IP520_ERR_OVERRUN];
+    stats->fifoPeak   = dev->rxPeak;
+    if (resetPeak)
+        dev->rxPeak = 0;
+    intUnlock(key);
+    return(OK);
+}
+
+/******************************************************************************
+ *
+ * IP520ErrCounts - read a port's Rx error counters
+ *
+ * Copies the IP520_NERRS counters of the given port, indexed by IP520_ERR,
+ * into counts.
+ *
+ * RETURNS: OK, or ERROR if the module or port is unknown.
+ */
+int IP520ErrCounts(const char *moduleID, int port, unsigned long *counts)
+{
+    MOD_TABLE *pmod = IP520OctalFindQT(moduleID);
+    int err;
+
+    if (!pmod || port < 0 || port > 7 || !pmod->dev[port].created || !counts)
+        return ERROR;
+
+    for (err = 0; err < IP520_NERRS; err++)
+        counts[err] = pmod->dev[port].errCount[err];
+    return OK;
 }
 
 /******************************************************************************
@@ -1048,15 +1653,14 @@ LOCAL void IsrErrMsg(epicsUInt8 lsr, TY_IP520_DEV *dev)
 LOCAL void IP520TxStartup(TY_IP520_DEV *dev)
 {
     char outChar;
-    REGMAP *regs = dev->regs;
     int key, TxCtr;
     STATUS status = OK;
-    epicsUInt8 lsr;
+    epicsUInt8 lsr, ier;
 
     key = intLock();
-    lsr = regs->u.read.lsr;
-    if (lsr & 0x0E)         /* Check for overrun, parity or framing error. */
-        IsrErrMsg(lsr, dev);
+    lsr = REG_READ(dev, lsr);
+    if (lsr & 0x1E)         /* Check for overrun, parity, framing error or break. */
+        IsrErrCount(lsr, dev);
 
     if (lsr & 0x20)
         TxCtr = 64;
@@ -1065,42 +1669,121 @@ LOCAL void IP520TxStartup(TY_IP520_DEV *dev)
 
     while((TxCtr > 0) && ((status = tyITx(&dev->tyDev, &outChar)) == OK))
     {
-        regs->u.write.thr = outChar;
+        REG_WRITE(dev, thr, outChar);
         dev->writeCount++;
         TxCtr--;
     }
 
-    if (status == ERROR)
-        regs->u.write.ier &= ~(0x02);   /* Disable Tx interrupt */
+    /* An RS485 transmission needs the Tx empty interrupt to end it. */
+    ier = REG_READ(dev, ier);
+    if (status == ERROR && !dev->txDriving)
+        REG_WRITE(dev, ier, ier & ~(0x02));   /* Disable Tx interrupt */
     else
-        regs->u.write.ier |= 0x02;      /*  Enable Tx interrupt */
+        REG_WRITE(dev, ier, ier | 0x02);      /*  Enable Tx interrupt */
+
+    intUnlock(key);
+}
+
+/******************************************************************************
+ * IP520TxRelease - end an RS485 transmission
+ *
+ * Called at interrupt level when the Tx FIFO is empty and tyLib has no more
+ * data, so only the character in the shift register remains and TEMT must
+ * follow within one character time.  Poll for it that long, then de-assert
+ * RTS (the line driver enable) and re-enable the receiver.  If TEMT still
+ * hasn't come, or characters are too slow to wait for (temtSpins is 0), the
+ * watchdog calls this again on the next clock tick.
+ *
+ * NOMANUAL
+ */
+LOCAL void IP520TxRelease(TY_IP520_DEV *dev)
+{
+    epicsUInt8 lsr;
+    unsigned long spins = dev->temtSpins;
+    int key;
+
+    key = intLock();
+    /* Nothing to do if a new write took over the transmitter. */
+    if (dev->txDriving && !(REG_READ(dev, ier) & 0x02))
+    {
+        for (;;)
+        {
+            lsr = REG_READ(dev, lsr);
+            if (lsr & 0x1E)         /* Reading LSR cleared these. */
+                IsrErrCount(lsr, dev);
+            if ((lsr & 0x40) || spins-- == 0)
+                break;
+        }
 
+        if (lsr & 0x40)             /* THR and shift register empty. */
+        {
+            REG_WRITE(dev, mcr, REG_READ(dev, mcr) & ~(0x02));
+            REG_WRITE(dev, ier, REG_READ(dev, ier) | 0x04);
+            dev->txDriving = 0;
+            dev->turnCount++;
+        }
+        else
+        {
+            dev->turnLate++;
+            wdStart(dev->txWd, 1, (FUNCPTR) IP520TxRelease, (int) dev);
+        }
+    }
     intUnlock(key);
 }
 
+/******************************************************************************
+ * IP520ReadRate - measure a module's register reads per second
+ *
+ * Counts scratch register reads from one edge of the timestamp clock for
+ * at least 10ms, so IP520TxRelease can bound its TEMT poll by time.  Task
+ * level only.
+ *
+ * NOMANUAL
+ */
+LOCAL unsigned long IP520ReadRate(TY_IP520_DEV *dev)
+{
+    epicsUInt32 freq = IP520StampFreq();
+    epicsUInt32 first, start, elapsed;
+    unsigned long reads = 0;
+    volatile epicsUInt8 dummy;
+    int i;
+
+    first = IP520Stamp();
+    while ((start = IP520Stamp()) == first)
+        dummy = REG_READ(dev, scr);
+    do
+    {
+        for (i = 0; i < 16; i++)
+            dummy = REG_READ(dev, scr);
+        reads += 16;
+        elapsed = IP520Stamp() - start;
+    } while (elapsed < freq / 100 + 1);
+    return (unsigned long) ((double) reads * freq / elapsed);
+}
+
 /* EFROn - Enable Enhanced Functions */
-LOCAL void EFROn(REGMAP *regs)
+LOCAL void EFROn(TY_IP520_DEV *dev)
 {
     epicsUInt8 llcr, lefr;
 
-    savedlcr = regs->u.read.lcr;        /* Save LCR. */
-    regs->u.write.lcr = 0xBF;           /* Expose EFR/Xon-1/Xon-2/Xoff-1/Xoff-2; hide ISR/FCR/MCR/LSR/MSR/SCR. */
-    llcr = regs->u.read.lcr;            /* Read LCR to flush posted writes. */
-    regs->u.write.fcr |= 0x10;          /* Write to EFR; enable writes to enhanced functions. */
-    lefr = regs->u.read.isr;            /* Read EFR to flush posted writes. */
+    savedlcr = REG_READ(dev, lcr);      /* Save LCR. */
+    REG_WRITE(dev, lcr, 0xBF);          /* Expose EFR/Xon-1/Xon-2/Xoff-1/Xoff-2; hide ISR/FCR/MCR/LSR/MSR/SCR. */
+    llcr = REG_READ(dev, lcr);          /* Read LCR to flush posted writes. */
+    REG_WRITE(dev, fcr, REG_READ(dev, isr) | 0x10);  /* Write to EFR; enable writes to enhanced functions. */
+    lefr = REG_READ(dev, isr);          /* Read EFR to flush posted writes. */
 }
 
 /* EFROff - Disable Enhanced Functions */
-LOCAL void EFROff(REGMAP * regs)
+LOCAL void EFROff(TY_IP520_DEV *dev)
 {
     epicsUInt8 llcr, lefr;
 
-    regs->u.write.fcr &= ~(0x10);       /* Write to EFR:4; disable writes to enhanced functions.
+    REG_WRITE(dev, fcr, REG_READ(dev, isr) & ~(0x10));  /* Write to EFR:4; disable writes to enhanced functions.
                                          * Expose RBR/THR/IER; hide DLL/DLM, AND,
                                          * Expose ISR/FCR/MCR/LSR/MSR/SCR; hide EFR/Xon-1/Xon-2/Xoff-1/Xoff-2. */
-    lefr = regs->u.read.isr;            /* Read EFR to flush posted writes. */
-    regs->u.write.lcr = savedlcr;       /* Restore LCR to save value. */
-    llcr = regs->u.read.lcr;            /* Read LCR to flush posted writes. */
+    lefr = REG_READ(dev, isr);          /* Read EFR to flush posted writes. */
+    REG_WRITE(dev, lcr, savedlcr);      /* Restore LCR to save value. */
+    llcr = REG_READ(dev, lcr);          /* Read LCR to flush posted writes. */
 }
 
 /******************************************************************************
@@ -1161,12 +1844,47 @@ static const iocshArg IP520ConfigArg2 = {"parity",   iocshArgString};
 static const iocshArg IP520ConfigArg3 = {"stopbits", iocshArgInt};
 static const iocshArg IP520ConfigArg4 = {"databits", iocshArgInt};
 static const iocshArg IP520ConfigArg5 = {"flow",     iocshArgString};
-static const iocshArg * const IP520ConfigArgs[6] = {&IP520ConfigArg0, &IP520ConfigArg1, &IP520ConfigArg2,
-                                                    &IP520ConfigArg3, &IP520ConfigArg4, &IP520ConfigArg5};
-static const iocshFuncDef IP520ConfigFuncDef = {"IP520Config",6,IP520ConfigArgs};
+static const iocshArg IP520ConfigArg6 = {"options",  iocshArgString};
+static const iocshArg * const IP520ConfigArgs[7] = {&IP520ConfigArg0, &IP520ConfigArg1, &IP520ConfigArg2,
+                                                    &IP520ConfigArg3, &IP520ConfigArg4, &IP520ConfigArg5,
+                                                    &IP520ConfigArg6};
+static const iocshFuncDef IP520ConfigFuncDef = {"IP520Config",7,IP520ConfigArgs};
 static void IP520ConfigCallFunc(const iocshArgBuf *arg)
 {
-    IP520Config(arg[0].sval, arg[1].ival, arg[2].sval[0], arg[3].ival, arg[4].ival, arg[5].sval[0]);
+    IP520Config(arg[0].sval, arg[1].ival, arg[2].sval[0], arg[3].ival, arg[4].ival, arg[5].sval[0],
+                arg[6].sval);
+}
+
+/* IP520Framing */
+static const iocshArg IP520FramingArg0 = {"devName",   iocshArgString};
+static const iocshArg IP520FramingArg1 = {"maxFrame",  iocshArgInt};
+static const iocshArg IP520FramingArg2 = {"terms",     iocshArgString};
+static const iocshArg IP520FramingArg3 = {"lenPrefix", iocshArgInt};
+static const iocshArg * const IP520FramingArgs[4] = {&IP520FramingArg0, &IP520FramingArg1, &IP520FramingArg2,
+                                                     &IP520FramingArg3};
+static const iocshFuncDef IP520FramingFuncDef = {"IP520Framing",4,IP520FramingArgs};
+static void IP520FramingCallFunc(const iocshArgBuf *arg)
+{
+    IP520Framing(arg[0].sval, arg[1].ival, arg[2].sval, arg[3].ival);
+}
+
+/* IP520ErrorPeriod */
+static const iocshArg IP520ErrorPeriodArg0 = {"seconds", iocshArgDouble};
+static const iocshArg * const IP520ErrorPeriodArgs[1] = {&IP520ErrorPeriodArg0};
+static const iocshFuncDef IP520ErrorPeriodFuncDef = {"IP520ErrorPeriod", 1, IP520ErrorPeriodArgs};
+static void IP520ErrorPeriodCallFunc(const iocshArgBuf *args)
+{
+    IP520ErrorPeriod(args[0].dval);
+}
+
+/* IP520RxStamp */
+static const iocshArg IP520RxStampArg0 = {"devName", iocshArgString};
+static const iocshArg IP520RxStampArg1 = {"on",      iocshArgInt};
+static const iocshArg * const IP520RxStampArgs[2] = {&IP520RxStampArg0, &IP520RxStampArg1};
+static const iocshFuncDef IP520RxStampFuncDef = {"IP520RxStamp", 2, IP520RxStampArgs};
+static void IP520RxStampCallFunc(const iocshArgBuf *args)
+{
+    IP520RxStamp(args[0].sval, args[1].ival);
 }
 
 static void IP520Registrar(void) {
@@ -1175,5 +1893,8 @@ static void IP520Registrar(void) {
     iocshRegister(&IP520ModuleInitFuncDef,IP520ModuleInitCallFunc);
     iocshRegister(&IP520DevCreateFuncDef,IP520DevCreateCallFunc);
     iocshRegister(&IP520ConfigFuncDef,IP520ConfigCallFunc);
+    iocshRegister(&IP520FramingFuncDef,IP520FramingCallFunc);
+    iocshRegister(&IP520ErrorPeriodFuncDef,IP520ErrorPeriodCallFunc);
+    iocshRegister(&IP520RxStampFuncDef,IP520RxStampCallFunc);
 }
 epicsExportRegistrar(IP520Registrar);
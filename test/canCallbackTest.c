@@ -0,0 +1,160 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canCallbackTest.c
+
+Description:
+    Tests the execution classes of canMessage callbacks on a bus with a
+    stand-in driver, feeding frames straight to canBusReceive.  Deferred
+    callbacks must run outside the receive path in arrival order, and once
+    deleted must not be run for frames still on their worker's queue.
+    Callback timing is only done on buses where canMsgTiming turned it on.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "canBus.h"
+
+
+#define NFRAMES 100
+
+static int nopWrite(void *pdev, const canMessage_t *pmessage, double timeout)
+{
+	return 0;
+}
+
+static int nop(void *pdev)
+{
+	return 0;
+}
+
+static canDriver_t testDriver = {"test", nopWrite, nop, nop, nop, NULL};
+
+static volatile int inlineCalls, slowCalls, lastData, outOfOrder;
+static volatile int ranInReceive;
+static epicsThreadId receiver;
+
+
+static void inlineCallback(void *pprivate, const canMessage_t *pmessage)
+{
+	inlineCalls++;
+}
+
+static void slowCallback(void *pprivate, const canMessage_t *pmessage)
+{
+	if (epicsThreadGetIdSelf() == receiver)
+		ranInReceive = 1;
+	if (pmessage->data[0] != (lastData + 1) % 256)
+		outOfOrder++;
+	lastData = pmessage->data[0];
+	epicsThreadSleep(0.002);
+	slowCalls++;
+}
+
+static void send(canBusID_t bus, canID_t identifier, int n)
+{
+	canMessage_t message;
+	int i;
+
+	memset(&message, 0, sizeof(message));
+	message.identifier = identifier;
+	message.length = 1;
+	for (i = 0; i < n; i++) {
+		message.data[0] = i + 1;
+		canBusReceive(bus, &message);
+	}
+}
+
+static int waitFor(volatile int *pcount, int want)
+{
+	int i;
+
+	for (i = 0; i < 200 && *pcount < want; i++)
+		epicsThreadSleep(0.01);
+	return *pcount >= want;
+}
+
+
+static void testClasses(canBusID_t bus)
+{
+	testDiag("Execution classes");
+	testOk1(canMessage(bus, 0x10, inlineCallback, NULL) == 0);
+	testOk1(canMessageClass(bus, 0x20, slowCallback, NULL,
+		CAN_EXEC_DEFERRED) == 0);
+	testOk1(canMessageClass(bus, 0x30, slowCallback, NULL, 7) ==
+		S_can_badMessage);
+
+	send(bus, 0x10, 5);
+	testOk(inlineCalls == 5, "Inline callback ran in the receive path");
+
+	lastData = 0;
+	send(bus, 0x20, 10);
+	testOk(waitFor(&slowCalls, 10), "Deferred callback ran for each frame");
+	testOk(!ranInReceive, "Deferred callback ran outside the receive path");
+	testOk(outOfOrder == 0, "Frames arrived in order");
+}
+
+static void testDelete(canBusID_t bus)
+{
+	int before;
+
+	testDiag("Deleting a deferred callback with frames queued");
+	slowCalls = 0;
+	lastData = 0;
+	send(bus, 0x20, NFRAMES);
+	epicsThreadSleep(0.02);
+	testOk1(canMsgDelete(bus, 0x20, slowCallback, NULL) == 0);
+	before = slowCalls;
+	epicsThreadSleep(0.5);
+	testOk(slowCalls - before <= 1,
+		"Queued frames discarded (%d ran after the delete)",
+		slowCalls - before);
+	testOk(slowCalls < NFRAMES, "%d of %d frames handled", slowCalls,
+		NFRAMES);
+	testOk1(canMsgDelete(bus, 0x20, slowCallback, NULL) == S_can_noMessage);
+
+	/* A new registration doesn't see the old one's frames */
+	testOk1(canMessageClass(bus, 0x20, slowCallback, NULL,
+		CAN_EXEC_DEFERRED) == 0);
+	slowCalls = 0;
+	lastData = 0;
+	send(bus, 0x20, 3);
+	testOk(waitFor(&slowCalls, 3) && slowCalls == 3,
+		"Re-registered callback gets only new frames");
+	testOk1(canMsgDelete(bus, 0x20, slowCallback, NULL) == 0);
+}
+
+static void testTiming(canBusID_t bus)
+{
+	testDiag("Callback timing");
+	testOk1(canMsgTiming("cbTest", 1) == 0);
+	send(bus, 0x10, 5);
+	testOk1(canMsgTimes("cbTest", 5) == 0);
+	testOk1(canMsgTiming("cbTest", 0) == 0);
+	testOk1(canMsgTiming("noSuchBus", 1) == S_can_noDevice);
+}
+
+
+MAIN(canCallbackTest)
+{
+	static int dev;
+	canBusID_t bus;
+
+	testPlan(19);
+	receiver = epicsThreadGetIdSelf();
+
+	testOk1(canBusAdd("cbTest", &testDriver, &dev, &bus) == 0);
+	testClasses(bus);
+	testDelete(bus);
+	testTiming(bus);
+
+	return testDone();
+}
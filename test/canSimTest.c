@@ -0,0 +1,103 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canSimTest.c
+
+Description:
+    Tests the simulated CAN bus driver.  The bus and network names are
+    passed in a buffer that is overwritten afterwards, as iocsh reuses its
+    argument buffers, so canBusAdd and canSimCreate must keep copies.
+    Frames written on one bus must arrive on the other bus on the same
+    network, and not on a bus on a different network.  A canWriteAsync
+    callback runs once the frame has been delivered.
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "canBus.h"
+#include "drvCanSim.h"
+
+
+static volatile int received[3];
+static volatile int sentStatus = -1;
+
+
+static void callback(void *pprivate, const canMessage_t *pmessage)
+{
+	volatile int *count = pprivate;
+
+	(*count)++;
+}
+
+static void queued(void *pprivate, const canMessage_t *pmessage, int status)
+{
+	volatile int *count = pprivate;
+
+	sentStatus = status;
+	(*count)++;
+}
+
+static int waitFor(volatile int *pcount, int want)
+{
+	int i;
+
+	for (i = 0; i < 100 && *pcount < want; i++)
+		epicsThreadSleep(0.01);
+	return *pcount >= want;
+}
+
+
+MAIN(canSimTest)
+{
+	char busName[16], network[16];
+	canBusID_t bus[3];
+	canMessage_t message;
+	int i;
+
+	testPlan(8);
+
+	for (i = 0; i < 3; i++) {
+		sprintf(busName, "sim%d", i);
+		strcpy(network, i < 2 ? "net0" : "net1");
+		testOk(canSimCreate(busName, network, 0) == 0,
+			"canSimCreate %s on %s", busName, network);
+	}
+	strcpy(busName, "overwritten");
+	strcpy(network, "net1");
+	testOk1(canSimInitialise() == 0);
+
+	testOk(canOpen("sim0", &bus[0]) == 0 && canOpen("sim1", &bus[1]) == 0 &&
+		canOpen("sim2", &bus[2]) == 0, "Bus names copied");
+	testOk1(canOpen("overwritten", &bus[0]) != 0);
+
+	for (i = 0; i < 3; i++)
+		canMessage(bus[i], 0x123, callback, (void *) &received[i]);
+	memset(&message, 0, sizeof(message));
+	message.identifier = 0x123;
+	message.length = 1;
+	canWrite(bus[0], &message, 1.0);
+	waitFor(&received[1], 1);
+	epicsThreadSleep(0.05);
+	testOk(received[1] == 1 && received[0] == 0 && received[2] == 0,
+		"Network names copied, frame reached only sim1");
+
+	{
+		volatile int sent = 0;
+
+		canWriteAsync(bus[0], &message, 0, queued, (void *) &sent);
+		waitFor(&sent, 1);
+		testOk(sent == 1 && sentStatus == 0 && received[1] == 2,
+			"canWriteAsync callback after delivery");
+	}
+
+	return testDone();
+}
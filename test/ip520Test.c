@@ -0,0 +1,378 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    ip520Test.c
+
+Description:
+    Runs the IP520 driver against the ST16C654 register emulator, through
+    the vxWorks shim.  Received data must arrive intact, in about one
+    interrupt per Rx FIFO trigger level, with no overruns when the
+    interrupt latency is short; a long latency must overrun the FIFO and
+    the driver must count it.  Transmit must keep the line busy while
+    filling the Tx FIFO once per interrupt.  An RS485AUTO port must drop
+    RTS from the ISR within a character time of the last stop bit, which
+    the test sees by giving each register access a simulated time and
+    running the driver's clock from the emulator.  Framing and break
+    errors injected into the emulator must reach the port's error
+    counters, and IP520_RXSTAMP_GET must return the arrival time of the
+    first character of each read.  The measurements are printed as
+    diagnostics.
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "vxShim.h"
+#include <ioLib.h>
+#include <sioLib.h>
+#include <wdLib.h>
+
+#include "drvIpac.h"
+#include "ipacTestCarrier.h"
+#include "st16c654Emu.h"
+#include "Acromag_ip_modules.h"
+#include "IP520Ext.h"
+#include "IP520Int.h"
+
+
+#define MODULE "ip520"
+#define BAUD 115200
+#define CHAR_TIME (10.0 / BAUD)     /* 8N1 */
+#define NCHARS 2000
+#define NTX 4000
+#define ACCESS_TIME 0.5e-6          /* Per register access, RS485 test */
+
+STATUS IP520Config(char *, int, char, int, int, char, const char *);
+
+static uartEmu *emu;
+static DEV_HDR *dev[8];
+static char sent[NTX], got[NTX];
+
+
+/* The driver's tickGet() clock */
+
+static double emuClock(void *pvt)
+{
+    return uartEmuTime(emu);
+}
+
+static void pattern(char *buffer, int len, int seed)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        buffer[i] = (i * 7 + seed) & 0xff;
+}
+
+static int drain(DEV_HDR *pdev, char *buffer, int maxlen)
+{
+    int n = 0, nread;
+
+    while (n < maxlen &&
+           (nread = vxShimRead(pdev, buffer + n, maxlen - n)) > 0)
+        n += nread;
+    return n;
+}
+
+static void getStats(int port, IP520_STATS *pstats)
+{
+    IP520Stats(MODULE, port, pstats, 1);
+}
+
+
+/* Are the received characters the sent ones, less any that were lost? */
+
+static int inOrder(const char *rx, int nrx, const char *tx, int ntx)
+{
+    int i, j = 0;
+
+    for (i = 0; i < nrx; i++) {
+        while (j < ntx && tx[j] != rx[i])
+            j++;
+        if (j++ == ntx)
+            return 0;
+    }
+    return 1;
+}
+
+/* Receive a block, returning characters per interrupt */
+
+static double receive(int port, int len, int *pintact, unsigned long *plost)
+{
+    IP520_STATS before, after;
+    unsigned long lost = emu->chan[port].rxLost;
+    int n;
+
+    getStats(port, &before);
+    pattern(sent, len, port);
+    uartEmuSend(emu, port, sent, len);
+    uartEmuRun(emu, len * CHAR_TIME + 0.01);
+    n = drain(dev[port], got, sizeof(got));
+    getStats(port, &after);
+
+    *plost = emu->chan[port].rxLost - lost;
+    *pintact = (n + *plost == len) && inOrder(got, n, sent, len);
+    return (double) (after.readCount - before.readCount) /
+        (after.irqCount - before.irqCount);
+}
+
+
+static void testRx(void)
+{
+    IP520_STATS stats;
+    unsigned long lost;
+    double perIrq;
+    int intact;
+
+    testDiag("Receive at %d baud", BAUD);
+    testOk1(vxShimIoctl(dev[0], SIO_BAUD_SET, BAUD) == OK);
+    perIrq = receive(0, NCHARS, &intact, &lost);
+    testOk(intact && !lost, "%d characters received intact", NCHARS);
+    testDiag("%.1f characters per interrupt", perIrq);
+    testOk(perIrq >= 7.0, "About one interrupt per 8 characters");
+    getStats(0, &stats);
+    testOk(stats.overruns == 0, "No overruns at %.0f us latency",
+        emu->latency * 1e6);
+}
+
+static void testTrigger(void)
+{
+    unsigned long lost;
+    double perIrq;
+    int intact;
+
+    testDiag("Rx trigger level from IP520Config");
+    testOk1(IP520Config("/ip520/1", BAUD, 'N', 1, 8, 'N', "RXTRIG=56") == OK);
+    perIrq = receive(1, NCHARS, &intact, &lost);
+    testDiag("%.1f characters per interrupt", perIrq);
+    testOk(intact && perIrq >= 40.0, "Trigger 56 reads long bursts");
+
+    /* The rest of a message comes with the receive timeout */
+    receive(1, 10, &intact, &lost);
+    testOk(intact, "Characters below the trigger level delivered");
+}
+
+static void testOverrun(void)
+{
+    IP520_STATS before, after;
+    unsigned long lost;
+    int intact;
+
+    testDiag("Receive with 10 ms interrupt latency");
+    uartEmuLatency(emu, 0.01);
+    testOk1(vxShimIoctl(dev[2], SIO_BAUD_SET, BAUD) == OK);
+    getStats(2, &before);
+    receive(2, NCHARS, &intact, &lost);
+    getStats(2, &after);
+    testDiag("%lu characters lost, %lu overruns counted", lost,
+        after.overruns - before.overruns);
+    testOk(lost > 0 && after.overruns > before.overruns,
+        "FIFO overruns counted");
+    testOk(intact, "Other characters received in order");
+    uartEmuLatency(emu, 5e-6);
+}
+
+static void testTx(void)
+{
+    IP520_STATS before, after;
+    uartEmuChan *pch = &emu->chan[3];
+    double rate, perIrq;
+    int n;
+
+    testDiag("Transmit at %d baud", BAUD);
+    testOk1(vxShimIoctl(dev[3], SIO_BAUD_SET, BAUD) == OK);
+    getStats(3, &before);
+    pattern(sent, NTX, 3);
+    testOk1(vxShimWrite(dev[3], sent, NTX) == NTX);
+    uartEmuRun(emu, NTX * CHAR_TIME + 0.01);
+    n = uartEmuReceive(emu, 3, got, sizeof(got));
+    getStats(3, &after);
+
+    testOk(n == NTX && memcmp(sent, got, NTX) == 0,
+        "%d characters sent intact", NTX);
+    rate = (pch->txChars - 1) / (pch->txLast - pch->txFirst);
+    perIrq = (double) (after.writeCount - before.writeCount) /
+        (after.irqCount - before.irqCount);
+    testDiag("%.0f characters/second, %.1f characters per interrupt",
+        rate, perIrq);
+    testOk(rate > 0.99 * BAUD / 10, "Line kept busy");
+    testOk(perIrq > 50.0, "Tx FIFO filled once per interrupt");
+}
+
+static void testRs485(void)
+{
+    TY_IP520_DEV *pdev = (TY_IP520_DEV *) dev[4];
+    epicsUInt16 model = pdev->pmod->modelID;
+    double rtsOff, txLast;
+    int n, mcr;
+
+    testDiag("RS485AUTO turnaround at %d baud", BAUD);
+    uartEmuAccessTime(emu, ACCESS_TIME);
+
+    /* The driver only takes RS232 modules so far, so have it set the port
+     * up as it would on an RS422/485 module. */
+    pdev->pmod->modelID = 0;
+    testOk1(IP520Config("/ip520/4", BAUD, 'N', 1, 8, 'N', "RS485AUTO") == OK);
+    pdev->pmod->modelID = model;
+    testDiag("%lu register reads/second, TEMT polled for %lu LSR reads",
+        pdev->pmod->readRate, pdev->temtSpins);
+
+    pattern(sent, NCHARS, 4);
+    testOk1(vxShimWrite(dev[4], sent, NCHARS) == NCHARS);
+    testOk(st16c654EmuMcr(emu, 4, NULL) & 0x02, "RTS raised for the write");
+    uartEmuRun(emu, NCHARS * CHAR_TIME + 0.01);
+    n = uartEmuReceive(emu, 4, got, sizeof(got));
+    testOk(n == NCHARS && memcmp(sent, got, NCHARS) == 0,
+        "%d characters sent intact", NCHARS);
+
+    mcr = st16c654EmuMcr(emu, 4, &rtsOff);
+    txLast = emu->chan[4].txLast;
+    testDiag("RTS dropped %.1f us after the last stop bit",
+        (rtsOff - txLast) * 1e6);
+    testOk(!(mcr & 0x02) && rtsOff >= txLast && rtsOff - txLast < CHAR_TIME,
+        "RTS dropped within a character time");
+    testOk(pdev->turnCount == 1 && pdev->turnLate == 0,
+        "Released by the ISR, not the watchdog");
+
+    testOk1(vxShimIoctl(dev[4], SIO_BAUD_SET, 1200) == OK);
+    testOk(pdev->temtSpins == pdev->pmod->readRate * 10 / 1200 + 1,
+        "TEMT poll follows the baud rate");
+    uartEmuAccessTime(emu, 0);
+}
+
+static void testErrors(void)
+{
+    unsigned long before[IP520_NERRS], after[IP520_NERRS];
+    IP520_STATS stats0, stats1;
+
+    testDiag("Receive errors");
+    testOk1(vxShimIoctl(dev[5], SIO_BAUD_SET, BAUD) == OK);
+    IP520ErrCounts(MODULE, 5, before);
+    getStats(5, &stats0);
+    st16c654EmuRxError(emu, 5, 0x08);           /* Framing */
+    uartEmuSend(emu, 5, "a", 1);
+    uartEmuRun(emu, 0.01);
+    st16c654EmuRxError(emu, 5, 0x10);           /* Break */
+    uartEmuSend(emu, 5, "", 1);
+    uartEmuRun(emu, 0.01);
+    drain(dev[5], got, sizeof(got));
+    IP520ErrCounts(MODULE, 5, after);
+    getStats(5, &stats1);
+
+    testOk(after[IP520_ERR_FRAMING] == before[IP520_ERR_FRAMING] + 1 &&
+        after[IP520_ERR_BREAK] == before[IP520_ERR_BREAK] + 1,
+        "Framing error and break counted once each");
+    testOk(after[IP520_ERR_PARITY] == before[IP520_ERR_PARITY] &&
+        after[IP520_ERR_OVERRUN] == before[IP520_ERR_OVERRUN] &&
+        stats1.errors == stats0.errors + 2, "No other errors counted");
+}
+
+/* The ioctl argument is an int, as on vxWorks, so on a 64-bit host the
+ * IP520_RXSTAMP it points to has to be in the low 2GB.
+ */
+
+static IP520_RXSTAMP *stampBuffer(void)
+{
+    static IP520_RXSTAMP stamp;
+    void *pbuf = &stamp;
+
+    if ((void *) (long) (int) (long) pbuf == pbuf)
+        return pbuf;
+#ifdef MAP_32BIT
+    pbuf = mmap(NULL, sizeof(stamp), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (pbuf != MAP_FAILED && (void *) (long) (int) (long) pbuf == pbuf)
+        return pbuf;
+#endif
+    return NULL;
+}
+
+static void getStamp(int port, IP520_RXSTAMP *pstamp)
+{
+    IP520_RXSTAMP *pbuf = stampBuffer();
+
+    vxShimIoctl(dev[port], IP520_RXSTAMP_GET, (int) (long) pbuf);
+    *pstamp = *pbuf;
+}
+
+static void testStamp(void)
+{
+    IP520_RXSTAMP first, second;
+    double sentFirst, sentSecond;
+    long gap;
+
+    testDiag("Rx timestamps");
+    if (!stampBuffer()) {
+        testSkip(3, "No int-sized address for the ioctl argument");
+        return;
+    }
+    testOk1(vxShimIoctl(dev[6], SIO_BAUD_SET, BAUD) == OK &&
+        vxShimIoctl(dev[6], IP520_RXSTAMP_ENABLE, 1) == OK);
+    pattern(sent, 20, 6);
+    sentFirst = uartEmuTime(emu);
+    uartEmuSend(emu, 6, sent, 10);
+    uartEmuRun(emu, 0.5);
+    sentSecond = uartEmuTime(emu);
+    uartEmuSend(emu, 6, sent + 10, 10);
+    uartEmuRun(emu, 0.01);
+
+    vxShimRead(dev[6], got, 10);
+    getStamp(6, &first);
+    vxShimRead(dev[6], got, 10);
+    getStamp(6, &second);
+    testDiag("Stamps %.3f s and %.3f s, sent at %.3f s and %.3f s",
+        (double) first.stamp / first.freq, (double) second.stamp / second.freq,
+        sentFirst, sentSecond);
+    testOk(first.freq && first.stamp >= (epicsUInt32) (sentFirst * first.freq) &&
+        first.stamp <= (epicsUInt32) (sentFirst * first.freq) + 1,
+        "First read stamped on arrival");
+    gap = second.stamp - first.stamp;
+    testOk(gap >= (long) (0.5 * first.freq) - 1 &&
+        gap <= (long) (0.5 * first.freq) + 1,
+        "Second read stamped %ld ticks later", gap);
+    vxShimIoctl(dev[6], IP520_RXSTAMP_ENABLE, 0);
+}
+
+
+MAIN(ip520Test)
+{
+    int carrier, port;
+
+    testPlan(32);
+
+    carrier = ipacAddTestCarrier("SLOTS=1");
+    ipacTestSetId(carrier, 0, ACROMAG_ID, IP520_OCTAL232);
+    emu = st16c654EmuCreate(carrier, 0);
+    vxShimClock(emuClock, NULL);
+
+    testOk1(IP520Drv(1) == OK);
+    testOk1(IP520ModuleInit(MODULE, "232", 0x80, carrier, 0) == 0);
+    for (port = 0; port < 8; port++) {
+        char name[16];
+
+        sprintf(name, "/ip520/%d", port);
+        IP520DevCreate(name, MODULE, port, 4096, 16384);
+        dev[port] = vxShimDevice(name);
+    }
+    testOk(emu && dev[7], "Module and devices created");
+    if (!emu || !dev[7])
+        testAbort("Can't continue");
+
+    testRx();
+    testTrigger();
+    testOverrun();
+    testTx();
+    testRs485();
+    testErrors();
+    testStamp();
+
+    return testDone();
+}
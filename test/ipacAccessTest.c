@@ -0,0 +1,138 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    ipacAccessTest.c
+
+Description:
+    Tests the bus access accounting against a simulated slot.  This file is
+    built with IPAC_COUNT_ACCESSES defined, as a module driver being measured
+    would be, and makes its register accesses through IPAC_READ() and
+    IPAC_WRITE() on the memory-backed I/O space of the test carrier.
+
+*******************************************************************************/
+
+#ifndef IPAC_COUNT_ACCESSES
+#define IPAC_COUNT_ACCESSES
+#endif
+
+#include <string.h>
+
+#include <epicsTypes.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "drvIpac.h"
+#include "ipacTestCarrier.h"
+
+
+/* Register layout of a simple simulated module */
+
+typedef volatile struct {
+    epicsUInt16 control;
+    epicsUInt16 status;
+    epicsUInt16 data[8];
+} testRegs_t;
+
+
+/* A typical driver operation: start a conversion, wait for it and read
+ * back the results.  Costs 1 write and 2 + nData reads.
+ */
+static int readData(ipac_counter_t *pio, testRegs_t *regs, epicsUInt16 *buf,
+    int nData)
+{
+    int i;
+
+    IPAC_WRITE(pio, regs->control, 1);
+    if ((IPAC_READ(pio, regs->status) & 1) == 0)
+        return -1;
+    for (i = 0; i < nData; i++)
+        buf[i] = IPAC_READ(pio, regs->data[i]);
+    return IPAC_READ(pio, regs->status);
+}
+
+static void testCounters(int carrier)
+{
+    ipac_counter_t *dummy = ipmAccessCounter(-1, 0, ipac_addrIO);
+    ipac_counter_t *pio = ipmAccessCounter(carrier, 0, ipac_addrIO);
+
+    testDiag("Counter lookup");
+    testOk(pio != dummy, "Counters allocated by ipacAddCarrier()");
+    testOk1(ipmAccessCounter(carrier, 0, ipac_addrMem) != pio);
+    testOk1(ipmAccessCounter(carrier, 1, ipac_addrIO) != pio);
+    testOk1(ipmAccessCounter(carrier, 0, ipac_addrIO) == pio);
+    testOk1(ipmAccessCounter(carrier, -1, ipac_addrIO) == dummy);
+    testOk1(ipmAccessCounter(carrier, 0, (ipac_addr_t) IPAC_ADDR_SPACES) == dummy);
+    testOk1(ipmAccessCounter(99, 0, ipac_addrIO) == dummy);
+    testOk1(pio->reads == 0 && pio->writes == 0);
+}
+
+static void testMacros(int carrier)
+{
+    testRegs_t *regs = (testRegs_t *) ipmBaseAddr(carrier, 0, ipac_addrIO);
+    ipac_counter_t *pio = ipmAccessCounter(carrier, 0, ipac_addrIO);
+    ipac_counter_t *other = ipmAccessCounter(carrier, 1, ipac_addrIO);
+    epicsUInt16 buf[8];
+    int i;
+
+    testDiag("IPAC_READ/IPAC_WRITE on a simulated slot");
+    regs->status = 0x8001;
+    for (i = 0; i < 8; i++)
+        regs->data[i] = 100 + i;
+
+    testOk1(readData(pio, regs, buf, 8) == 0x8001);
+    testOk1(regs->control == 1);
+    testOk1(buf[0] == 100 && buf[7] == 107);
+    testOk(pio->reads == 10 && pio->writes == 1,
+        "Operation cost %lu reads, %lu writes", pio->reads, pio->writes);
+    testOk1(other->reads == 0 && other->writes == 0);
+
+    readData(pio, regs, buf, 4);
+    testOk(pio->reads == 16 && pio->writes == 2,
+        "Counts accumulate (%lu reads, %lu writes)", pio->reads, pio->writes);
+
+    ipacAccessReport(carrier);
+    ipacAccessReset(carrier);
+    testOk1(pio->reads == 0 && pio->writes == 0);
+}
+
+static void testBlock(int carrier)
+{
+    ipac_counter_t *pmem = ipmAccessCounter(carrier, 0, ipac_addrMem);
+    ipac_counter_t *pio32 = ipmAccessCounter(carrier, 0, ipac_addrIO32);
+    char buffer[64];
+
+    testDiag("ipmMemRead/ipmMemWrite accounting");
+    testOk1(ipmMemRead(carrier, 0, ipac_addrMem, 0, buffer, 64) == OK);
+    testOk1(ipmMemWrite(carrier, 0, ipac_addrIO32, 0, buffer, 64) == OK);
+
+    /* The Ipac library decides whether block copies are counted */
+    if (pmem->reads == 0 && pio32->writes == 0) {
+        testSkip(2, "drvIpac built without IPAC_COUNT_ACCESSES");
+    }
+    else {
+        testOk(pmem->reads == 32, "64 bytes of Memory space, %lu word reads",
+            pmem->reads);
+        testOk(pio32->writes == 16, "64 bytes of I/O32 space, %lu long writes",
+            pio32->writes);
+    }
+}
+
+
+MAIN(ipacAccessTest)
+{
+    int carrier;
+
+    testPlan(20);
+
+    carrier = ipacAddTestCarrier("SLOTS=2 MEM=0x1000");
+    testOk(carrier >= 0, "Test carrier added");
+
+    testCounters(carrier);
+    testMacros(carrier);
+    testBlock(carrier);
+
+    return testDone();
+}
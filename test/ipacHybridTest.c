@@ -0,0 +1,146 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    ipacHybridTest.c
+
+Description:
+    Tests the hybrid interrupt/polling service against the test carrier.
+    A slot interrupted at a high rate must switch to polled service, be
+    serviced by the polling thread only while it requests service, and go
+    back to interrupts when the requests stop.  A carrier without
+    ipac_irqPoll must never be switched to polling.
+
+*******************************************************************************/
+
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "drvIpac.h"
+#include "ipacTestCarrier.h"
+
+
+#define VECTOR 0x60
+#define HIGH_RATE 1000.0
+#define LOW_RATE 50.0
+
+static volatile unsigned long calls;
+static volatile int firing;
+
+static void routine(int parameter)
+{
+    calls++;
+}
+
+
+/* Interrupt the slot about 10000 times a second while firing is set. */
+
+static void fireThread(void *parm)
+{
+    int carrier = *(int *) parm;
+
+    while (firing) {
+        int i;
+
+        for (i = 0; i < 10; i++)
+            ipacTestInterrupt(carrier, 0);
+        epicsThreadSleep(0.001);
+    }
+    firing = -1;
+}
+
+static void startFiring(int *pcarrier)
+{
+    firing = 1;
+    epicsThreadCreate("fire", epicsThreadPriorityMedium,
+        epicsThreadGetStackSize(epicsThreadStackSmall), fireThread, pcarrier);
+}
+
+static void stopFiring(void)
+{
+    firing = 0;
+    while (firing == 0)
+        epicsThreadSleep(0.01);
+}
+
+/* Wait up to timeout seconds for the slot interrupt enable to reach state. */
+
+static int waitIrq(int carrier, int state, double timeout)
+{
+    for (; timeout > 0; timeout -= 0.05) {
+        if (!ipacTestIrqEnabled(carrier, 0, 0) == !state)
+            return 1;
+        epicsThreadSleep(0.05);
+    }
+    return 0;
+}
+
+static void testNoPoll(void)
+{
+    static int carrier;
+
+    testDiag("Carrier without ipac_irqPoll");
+    carrier = ipacAddTestCarrier("SLOTS=1 NOPOLL");
+    testOk1(ipmHybridConnect(carrier, 0, 0, VECTOR, routine, 0) == OK);
+    testOk1(ipmIrqCmd(carrier, 0, 0, ipac_irqEnable) == OK);
+    testOk1(ipacHybridConfig(carrier, 0, 0, HIGH_RATE, LOW_RATE, 0) ==
+            S_IPAC_notImplemented);
+
+    calls = 0;
+    startFiring(&carrier);
+    epicsThreadSleep(1.5);
+    testOk(ipacTestIrqEnabled(carrier, 0, 0), "Slot stayed interrupt-driven");
+    stopFiring();
+    testOk(calls > 0, "%lu interrupts serviced", calls);
+    ipacHybridConfig(carrier, 0, 0, 0, 0, 0);
+}
+
+static void testSwitching(void)
+{
+    static int carrier;
+    unsigned long before;
+
+    testDiag("Carrier with ipac_irqPoll");
+    carrier = ipacAddTestCarrier("SLOTS=1");
+    testOk1(ipacHybridConfig(carrier, 0, 0, HIGH_RATE, LOW_RATE, 0.001) == OK);
+    testOk1(ipmHybridConnect(carrier, 0, 0, VECTOR, routine, 0) == OK);
+    testOk1(ipmIrqCmd(carrier, 0, 0, ipac_irqEnable) == OK);
+
+    epicsThreadSleep(1.2);
+    testOk(ipacTestIrqEnabled(carrier, 0, 0), "Quiet slot is interrupt-driven");
+
+    startFiring(&carrier);
+    ipacTestRequest(carrier, 0, 0, 1);
+    testOk(waitIrq(carrier, 0, 3.0), "Busy slot switched to polling");
+
+    before = calls;
+    epicsThreadSleep(0.3);
+    testOk(calls > before, "Polling thread calls the routine (%lu times)",
+        calls - before);
+    testOk(ipacTestIrqEnabled(carrier, 0, 0) == 0,
+        "Slot stays polled while busy");
+
+    stopFiring();
+    ipacTestRequest(carrier, 0, 0, 0);
+    epicsThreadSleep(0.1);
+    before = calls;
+    epicsThreadSleep(0.2);
+    testOk(calls == before || ipacTestIrqEnabled(carrier, 0, 0),
+        "Routine not called while no request is raised");
+    testOk(waitIrq(carrier, 1, 3.0), "Quiet slot switched back to interrupts");
+
+    ipacHybridReport(1);
+    testOk1(ipacHybridConfig(carrier, 0, 0, 0, 0, 0) == OK);
+}
+
+
+MAIN(ipacHybridTest)
+{
+    testPlan(15);
+    testNoPoll();
+    testSwitching();
+    return testDone();
+}
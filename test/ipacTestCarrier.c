@@ -0,0 +1,775 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    ipacTestCarrier.c
+
+Description:
+    IPAC Carrier Driver for the host tests.  Each slot's address spaces are
+    ordinary memory, so module drivers and the drvIpac routines can be run
+    without any hardware.  The test program sets the ID Prom contents,
+    raises and clears slot interrupt requests, and calls the interrupt
+    routines that module drivers have connected, as the hardware would.
+
+    The carrier can optionally provide memRead and memWrite routines which
+    handle the Memory space themselves and count their calls, but leave the
+    other spaces to the generic copy in drvIpac.
+
+    Module drivers built with IPAC_ACCESS_HOOKS make their register accesses
+    through ipacHookRead() and ipacHookWrite() below.  A register emulator
+    attached to a slot with ipacTestRegisters() sees the accesses to that
+    slot's I/O space; all others go to the memory as usual.
+
+    This file is only built into the test programs.
+
+*******************************************************************************/
+
+/* Declare the access hooks */
+#ifndef IPAC_ACCESS_HOOKS
+#define IPAC_ACCESS_HOOKS
+#endif
+
+/* ANSI headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* EPICS headers */
+#include <dbDefs.h>
+#include <epicsTypes.h>
+#include <epicsInterrupt.h>
+
+/* Module headers */
+#include "drvIpac.h"
+#include "ipacTestCarrier.h"
+
+
+/* Characteristics of the carrier */
+
+#define SLOTS 8             /* Maximum number of IP slots */
+#define DEFAULT_SLOTS 4     /* Number of slots if not given */
+#define ID_SIZE 0x80        /* Bytes of ID Prom space */
+#define VECTORS 4           /* Interrupt routines per slot */
+
+
+/* Interrupt routine, one per connected vector */
+
+typedef struct {
+    int vector;
+    void (*routine)(int parameter);
+    int parameter;
+} isr_t;
+
+
+/* Register emulator attached to a slot's I/O space */
+
+typedef struct {
+    ipacTestRegRead_t read;
+    ipacTestRegWrite_t write;
+    void *pvt;
+} regs_t;
+
+
+/* Carrier Private structure, one instance per carrier */
+
+typedef struct private_t {
+    struct private_t *next;
+    int carrier;
+    int numSlots;
+    size_t memSize;
+    int hooks;
+    int noPoll;
+    ipacTestHooks_t hookCount;
+    epicsUInt32 irqEnabled;
+    epicsUInt32 irqRequest;
+    isr_t isr[SLOTS][VECTORS];
+    regs_t regs[SLOTS];
+    void *addr[IPAC_ADDR_SPACES][SLOTS];
+} private_t;
+
+static private_t *list_head = NULL;
+
+
+/*******************************************************************************
+
+Routine:
+    findCarrier
+
+Purpose:
+    Returns the private data for a test carrier number
+
+*/
+
+static private_t *findCarrier (
+    int carrier
+) {
+    private_t *private;
+
+    for (private = list_head; private; private = private->next)
+        if (private->carrier == carrier)
+            return private;
+    return NULL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    initialise
+
+Purpose:
+    Allocates the memory for a new test carrier
+
+Description:
+    The parameter string may contain any of the following, in any order:
+
+    SLOTS=<n>
+        The number of IP slots, 1 through 8.  Defaults to 4.
+
+    MEM=<bytes>
+        The size of each slot's Memory space.  Defaults to 0, which gives the
+        slots no Memory space.
+
+    NOIO32
+        The slots have no I/O32 space.
+
+    HOOKS
+        Provide memRead and memWrite routines for the Memory space.
+
+    NOPOLL
+        Don't implement ipac_irqPoll, like many real carriers.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = Parameter string error,
+    S_IPAC_noMemory = malloc() failed
+
+*/
+
+static int initialise (
+    const char *params,
+    void **pprivate,
+    epicsUInt16 carrier
+) {
+    private_t *private;
+    const char *pstart;
+    int slots = DEFAULT_SLOTS;
+    unsigned long memSize = 0;
+    int slot;
+
+    if (params == NULL)
+        params = "";
+
+    if ((pstart = strstr(params, "SLOTS=")) != NULL &&
+        (sscanf(pstart + 6, "%d", &slots) != 1 ||
+         slots < 1 || slots > SLOTS))
+        return S_IPAC_badAddress;
+
+    if ((pstart = strstr(params, "MEM=")) != NULL) {
+        char *end;
+
+        memSize = strtoul(pstart + 4, &end, 0);
+        if (end == pstart + 4)
+            return S_IPAC_badAddress;
+    }
+
+    private = (private_t *) calloc(1, sizeof(private_t));
+    if (private == NULL)
+        return S_IPAC_noMemory;
+
+    private->carrier = carrier;
+    private->numSlots = slots;
+    private->memSize = memSize;
+    private->hooks = strstr(params, "HOOKS") != NULL;
+    private->noPoll = strstr(params, "NOPOLL") != NULL;
+
+    for (slot = 0; slot < slots; slot++) {
+        private->addr[ipac_addrID][slot] = calloc(1, ID_SIZE);
+        private->addr[ipac_addrIO][slot] = calloc(1, TEST_IO_SIZE);
+        if (strstr(params, "NOIO32") == NULL)
+            private->addr[ipac_addrIO32][slot] = calloc(1, TEST_IO_SIZE);
+        if (memSize)
+            private->addr[ipac_addrMem][slot] = calloc(1, memSize);
+        if (private->addr[ipac_addrID][slot] == NULL ||
+            private->addr[ipac_addrIO][slot] == NULL ||
+            (memSize && private->addr[ipac_addrMem][slot] == NULL))
+            return S_IPAC_noMemory;
+    }
+
+    private->next = list_head;
+    list_head = private;
+    *pprivate = private;
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    report
+
+Purpose:
+    Returns a status string for the requested slot
+
+*/
+
+static char *report (
+    void *p,
+    epicsUInt16 slot
+) {
+    private_t *private = (private_t *) p;
+    static char output[IPAC_REPORT_LEN];
+
+    sprintf(output, "Int0: %sabled    Int1: %sabled",
+        (private->irqEnabled & IPAC_IRQ_BIT(slot, 0) ? "en" : "dis"),
+        (private->irqEnabled & IPAC_IRQ_BIT(slot, 1) ? "en" : "dis"));
+    return output;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    baseAddr
+
+Purpose:
+    Returns a pointer to the requested slot & address space
+
+*/
+
+static void *baseAddr (
+    void *p,
+    epicsUInt16 slot,
+    ipac_addr_t space
+) {
+    private_t *private = (private_t *) p;
+
+    if (slot >= private->numSlots)
+        return NULL;
+    return private->addr[space][slot];
+}
+
+
+/*******************************************************************************
+
+Routine:
+    irqCmd
+
+Purpose:
+    Handles interrupter commands and status requests
+
+Returns:
+    ipac_irqGetLevel returns 0,
+    ipac_irqPoll returns 1 if the test has raised the request, else 0,
+        unless the carrier was configured with NOPOLL,
+    other supported commands return 0 = OK,
+    the rest return S_IPAC_notImplemented.
+
+*/
+
+static int irqCmd (
+    void *p,
+    epicsUInt16 slot,
+    epicsUInt16 irqNumber,
+    ipac_irqCmd_t cmd
+) {
+    private_t *private = (private_t *) p;
+    epicsUInt32 irqBit = IPAC_IRQ_BIT(slot, irqNumber);
+
+    switch (cmd) {
+        case ipac_irqGetLevel:
+            return 0;
+
+        case ipac_irqEnable:
+            private->irqEnabled |= irqBit;
+            return OK;
+
+        case ipac_irqDisable:
+            private->irqEnabled &= ~irqBit;
+            return OK;
+
+        case ipac_irqPoll:
+            if (private->noPoll)
+                return S_IPAC_notImplemented;
+            return (private->irqRequest & irqBit) != 0;
+
+        case ipac_statUnused:
+        case ipac_statActive:
+            return OK;
+
+        default:
+            return S_IPAC_notImplemented;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    intConnect
+
+Purpose:
+    Connect module interrupt routine to a slot
+
+*/
+
+static int intConnect (
+    void *p,
+    epicsUInt16 slot,
+    epicsUInt16 vecNum,
+    void (*routine)(int parameter),
+    int parameter
+) {
+    private_t *private = (private_t *) p;
+    int i;
+
+    for (i = 0; i < VECTORS; i++) {
+        isr_t *pisr = &private->isr[slot][i];
+
+        if (pisr->routine == NULL || pisr->vector == vecNum) {
+            pisr->vector = vecNum;
+            pisr->routine = routine;
+            pisr->parameter = parameter;
+            return OK;
+        }
+    }
+    return S_IPAC_noMemory;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    moduleProbe
+
+Purpose:
+    The ID space is memory, so is always safe to read
+
+*/
+
+static int moduleProbe (
+    void *p,
+    epicsUInt16 slot
+) {
+    return 1;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    memRead, memWrite
+
+Purpose:
+    Optional block transfer hooks
+
+Description:
+    When the carrier was configured with HOOKS these copy Memory space
+    transfers with memcpy() and count them; for all other spaces, or without
+    HOOKS, they return S_IPAC_notImplemented so drvIpac falls back to its own
+    copy routine.
+
+*/
+
+static int memRead (
+    void *p,
+    epicsUInt16 slot,
+    ipac_addr_t space,
+    size_t offset,
+    void *buffer,
+    size_t count
+) {
+    private_t *private = (private_t *) p;
+
+    if (!private->hooks || space != ipac_addrMem)
+        return S_IPAC_notImplemented;
+    if (offset + count > private->memSize)
+        return S_IPAC_badAddress;
+
+    memcpy(buffer, (char *) private->addr[space][slot] + offset, count);
+    private->hookCount.memReads++;
+    return OK;
+}
+
+static int memWrite (
+    void *p,
+    epicsUInt16 slot,
+    ipac_addr_t space,
+    size_t offset,
+    const void *buffer,
+    size_t count
+) {
+    private_t *private = (private_t *) p;
+
+    if (!private->hooks || space != ipac_addrMem)
+        return S_IPAC_notImplemented;
+    if (offset + count > private->memSize)
+        return S_IPAC_badAddress;
+
+    memcpy((char *) private->addr[space][slot] + offset, buffer, count);
+    private->hookCount.memWrites++;
+    return OK;
+}
+
+
+/******************************************************************************/
+
+/* IPAC Carrier Table */
+
+static ipac_carrier_t testCarrier = {
+    "Host test carrier",
+    SLOTS,
+    initialise,
+    report,
+    baseAddr,
+    irqCmd,
+    intConnect,
+    moduleProbe,
+    memRead,
+    memWrite,
+    NULL
+};
+
+
+/*******************************************************************************
+
+Routine:
+    ipacAddTestCarrier
+
+Purpose:
+    Registers a test carrier
+
+Returns:
+    The carrier number, or -1 if the carrier could not be added.
+
+*/
+
+int ipacAddTestCarrier (
+    const char *cardParams
+) {
+    if (ipacAddCarrier(&testCarrier, cardParams))
+        return -1;
+    return ipacLatestCarrier();
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacTestSlot
+
+Purpose:
+    Returns the memory behind a slot's address space, or NULL
+
+*/
+
+void *ipacTestSlot (
+    int carrier,
+    int slot,
+    int space
+) {
+    private_t *private = findCarrier(carrier);
+
+    if (private == NULL || slot < 0 || slot >= private->numSlots ||
+        space < ipac_addrID || space > ipac_addrMem)
+        return NULL;
+    return private->addr[space][slot];
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacTestSetId
+
+Purpose:
+    Fills in a slot's ID Prom
+
+Description:
+    Writes a Format-2 ("VITA4 ") ID Prom with no CRC, which ipmValidate()
+    accepts with the given manufacturer and model IDs.
+
+Returns:
+    0 = OK, S_IPAC_badAddress = no such test carrier or slot.
+
+*/
+
+int ipacTestSetId (
+    int carrier,
+    int slot,
+    int manufacturerId,
+    int modelId
+) {
+    ipac_idProm2_t *id = (ipac_idProm2_t *)
+        ipacTestSlot(carrier, slot, ipac_addrID);
+
+    if (id == NULL)
+        return S_IPAC_badAddress;
+
+    memset((void *) id, 0, ID_SIZE);
+    id->asciiVI = 'V' << 8 | 'I';
+    id->asciiTA = 'T' << 8 | 'A';
+    id->ascii4_ = '4' << 8 | ' ';
+    id->manufacturerIdHigh = (manufacturerId >> 16) & 0xff;
+    id->manufacturerIdLow = manufacturerId & 0xffff;
+    id->modelId = modelId;
+    id->bytesUsed = 0x1a;
+    id->CRC = 0;
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacTestRequest
+
+Purpose:
+    Raises or clears a slot interrupt request, as seen by ipac_irqPoll
+
+*/
+
+void ipacTestRequest (
+    int carrier,
+    int slot,
+    int irqNumber,
+    int active
+) {
+    private_t *private = findCarrier(carrier);
+    int key;
+
+    if (private == NULL)
+        return;
+
+    key = epicsInterruptLock();
+    if (active)
+        private->irqRequest |= IPAC_IRQ_BIT(slot, irqNumber);
+    else
+        private->irqRequest &= ~IPAC_IRQ_BIT(slot, irqNumber);
+    epicsInterruptUnlock(key);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacTestInterrupt
+
+Purpose:
+    Calls the interrupt routines connected to a slot
+
+Description:
+    Nothing is called unless one of the slot's interrupts is enabled, as
+    with a real carrier.  The routines are called with interrupts locked,
+    so they see the same exclusion as in a real ISR.
+
+Returns:
+    The number of routines called.
+
+*/
+
+int ipacTestInterrupt (
+    int carrier,
+    int slot
+) {
+    private_t *private = findCarrier(carrier);
+    int i, key, called = 0;
+
+    if (private == NULL || slot < 0 || slot >= private->numSlots ||
+        (private->irqEnabled & (IPAC_IRQ_BIT(slot, 0) |
+                                IPAC_IRQ_BIT(slot, 1))) == 0)
+        return 0;
+
+    key = epicsInterruptLock();
+    for (i = 0; i < VECTORS; i++) {
+        isr_t *pisr = &private->isr[slot][i];
+
+        if (pisr->routine) {
+            pisr->routine(pisr->parameter);
+            called++;
+        }
+    }
+    epicsInterruptUnlock(key);
+    return called;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacTestIrqEnabled
+
+Purpose:
+    Returns non-zero if a slot interrupt is enabled at the carrier
+
+*/
+
+int ipacTestIrqEnabled (
+    int carrier,
+    int slot,
+    int irqNumber
+) {
+    private_t *private = findCarrier(carrier);
+
+    return private && (private->irqEnabled & IPAC_IRQ_BIT(slot, irqNumber));
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacTestHookCounts
+
+Purpose:
+    Returns the memRead/memWrite hook call counts of a test carrier
+
+*/
+
+ipacTestHooks_t *ipacTestHookCounts (
+    int carrier
+) {
+    private_t *private = findCarrier(carrier);
+
+    return private ? &private->hookCount : NULL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacTestRegisters
+
+Purpose:
+    Attaches a register emulator to a slot's I/O space
+
+Description:
+    From now on the accesses that drivers built with IPAC_ACCESS_HOOKS make
+    to the slot's I/O space call readFn and writeFn with the byte offset of
+    the register instead of touching memory.  The routines may be called at
+    interrupt level, from inside ipacTestInterrupt().
+
+Returns:
+    0 = OK, S_IPAC_badAddress = no such test carrier or slot.
+
+*/
+
+int ipacTestRegisters (
+    int carrier,
+    int slot,
+    ipacTestRegRead_t readFn,
+    ipacTestRegWrite_t writeFn,
+    void *pvt
+) {
+    private_t *private = findCarrier(carrier);
+    regs_t *pregs;
+
+    if (private == NULL || slot < 0 || slot >= private->numSlots)
+        return S_IPAC_badAddress;
+
+    pregs = &private->regs[slot];
+    pregs->read = readFn;
+    pregs->write = writeFn;
+    pregs->pvt = pvt;
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    findRegs
+
+Purpose:
+    Finds the register emulator for an I/O space address, if any
+
+*/
+
+static regs_t *findRegs (
+    volatile void *addr,
+    size_t *poffset
+) {
+    private_t *private;
+    int slot;
+
+    for (private = list_head; private; private = private->next) {
+        for (slot = 0; slot < private->numSlots; slot++) {
+            char *base = (char *) private->addr[ipac_addrIO][slot];
+            size_t offset = (char *) addr - base;
+
+            if ((char *) addr >= base && offset < TEST_IO_SIZE) {
+                if (private->regs[slot].read == NULL)
+                    return NULL;
+                *poffset = offset;
+                return &private->regs[slot];
+            }
+        }
+    }
+    return NULL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacHookRead, ipacHookWrite
+
+Purpose:
+    Register access hooks for drivers built with IPAC_ACCESS_HOOKS
+
+Description:
+    Count the access like IPAC_COUNT_ACCESSES does, then hand it to the
+    slot's register emulator or make it to memory.
+
+*/
+
+unsigned long ipacHookRead (
+    ipac_counter_t *pcount,
+    volatile void *addr,
+    int size
+) {
+    size_t offset;
+    regs_t *pregs = findRegs(addr, &offset);
+
+    pcount->reads++;
+    if (pregs)
+        return pregs->read(pregs->pvt, offset, size);
+
+    switch (size) {
+        case 1:
+            return *(volatile epicsUInt8 *) addr;
+        case 2:
+            return *(volatile epicsUInt16 *) addr;
+        default:
+            return *(volatile epicsUInt32 *) addr;
+    }
+}
+
+void ipacHookWrite (
+    ipac_counter_t *pcount,
+    volatile void *addr,
+    int size,
+    unsigned long value
+) {
+    size_t offset;
+    regs_t *pregs = findRegs(addr, &offset);
+
+    pcount->writes++;
+    if (pregs) {
+        pregs->write(pregs->pvt, offset, size, value);
+        return;
+    }
+
+    switch (size) {
+        case 1:
+            *(volatile epicsUInt8 *) addr = value;
+            break;
+        case 2:
+            *(volatile epicsUInt16 *) addr = value;
+            break;
+        default:
+            *(volatile epicsUInt32 *) addr = value;
+            break;
+    }
+}
@@ -0,0 +1,55 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    ipacTestCarrier.h
+
+Description:
+    Interface to the memory-backed IP carrier used by the host tests.
+
+*******************************************************************************/
+
+#ifndef INCipacTestCarrierH
+#define INCipacTestCarrierH
+
+#include <stddef.h>
+#include <epicsTypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Size of each slot's I/O and I/O32 spaces */
+
+#define TEST_IO_SIZE 0x100
+
+/* Counts of calls to the carrier's memRead and memWrite hooks */
+
+typedef struct {
+    unsigned long memReads;
+    unsigned long memWrites;
+} ipacTestHooks_t;
+
+/* Register emulator routines, given the byte offset into the I/O space */
+
+typedef epicsUInt32 (*ipacTestRegRead_t)(void *pvt, size_t offset, int size);
+typedef void (*ipacTestRegWrite_t)(void *pvt, size_t offset, int size,
+    epicsUInt32 value);
+
+int ipacAddTestCarrier(const char *cardParams);
+void *ipacTestSlot(int carrier, int slot, int space);
+int ipacTestSetId(int carrier, int slot, int manufacturerId, int modelId);
+void ipacTestRequest(int carrier, int slot, int irqNumber, int active);
+int ipacTestInterrupt(int carrier, int slot);
+int ipacTestIrqEnabled(int carrier, int slot, int irqNumber);
+ipacTestHooks_t *ipacTestHookCounts(int carrier);
+int ipacTestRegisters(int carrier, int slot, ipacTestRegRead_t readFn,
+    ipacTestRegWrite_t writeFn, void *pvt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCipacTestCarrierH */
@@ -0,0 +1,239 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    ipmMemTest.c
+
+Description:
+    Tests ipmMemRead() and ipmMemWrite() against memory-backed slots of the
+    test carrier: argument checking, every combination of slot offset, buffer
+    alignment and short lengths in each address space, and the use of the
+    carrier's memRead/memWrite hooks.  Finishes with a throughput benchmark
+    comparing the block routines with the 16-bit volatile loops that module
+    drivers used before.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "drvIpac.h"
+#include "ipacTestCarrier.h"
+
+
+#define MEM_SIZE 0x10000
+#define GUARD 0xa5
+#define MAX_ALIGN 8
+#define MAX_SHORT 40
+
+
+static int plain, hooked, noSpaces;
+
+
+/* Check the write then read of count bytes at offset, from a buffer with the
+ * given alignment.  The bytes either side of the block must be untouched.
+ */
+static int roundTrip(int carrier, ipac_addr_t space, size_t offset,
+    int align, size_t count)
+{
+    static char src[MEM_SIZE + 2 * MAX_ALIGN], dst[MEM_SIZE + 2 * MAX_ALIGN];
+    char *slot = (char *) ipacTestSlot(carrier, 0, space);
+    size_t size = space == ipac_addrMem ? MEM_SIZE : TEST_IO_SIZE;
+    size_t i;
+
+    memset(slot, GUARD, size);
+    for (i = 0; i < count; i++)
+        src[align + i] = (char) (i * 7 + offset + 1);
+
+    if (ipmMemWrite(carrier, 0, space, offset, src + align, count))
+        return 0;
+    for (i = 0; i < size; i++) {
+        char want = (i >= offset && i < offset + count) ?
+            src[align + i - offset] : (char) GUARD;
+        if (slot[i] != want)
+            return 0;
+    }
+
+    memset(dst, GUARD, sizeof(dst));
+    if (ipmMemRead(carrier, 0, space, offset, dst + align, count))
+        return 0;
+    if (memcmp(dst + align, src + align, count))
+        return 0;
+    for (i = 0; i < (size_t) align; i++)
+        if (dst[i] != (char) GUARD)
+            return 0;
+    return dst[align + count] == (char) GUARD;
+}
+
+static void testArgs(void)
+{
+    char buffer[4];
+
+    testDiag("Argument checks");
+    testOk1(ipmMemRead(-1, 0, ipac_addrMem, 0, buffer, 4) == S_IPAC_badAddress);
+    testOk1(ipmMemRead(99, 0, ipac_addrMem, 0, buffer, 4) == S_IPAC_badAddress);
+    testOk1(ipmMemRead(plain, -1, ipac_addrMem, 0, buffer, 4) == S_IPAC_badAddress);
+    testOk1(ipmMemRead(plain, 2, ipac_addrMem, 0, buffer, 4) == S_IPAC_badAddress);
+    testOk1(ipmMemRead(plain, 0, (ipac_addr_t) -1, 0, buffer, 4) == S_IPAC_badAddress);
+    testOk1(ipmMemRead(plain, 0, (ipac_addr_t) IPAC_ADDR_SPACES, 0, buffer, 4)
+            == S_IPAC_badAddress);
+    testOk1(ipmMemRead(plain, 0, ipac_addrMem, 0, NULL, 4) == S_IPAC_badAddress);
+    testOk1(ipmMemWrite(plain, 0, (ipac_addr_t) IPAC_ADDR_SPACES, 0, buffer, 4)
+            == S_IPAC_badAddress);
+    testOk1(ipmMemWrite(plain, 0, ipac_addrMem, 0, NULL, 4) == S_IPAC_badAddress);
+    testOk1(ipmBaseAddr(plain, 0, (ipac_addr_t) IPAC_ADDR_SPACES) == NULL);
+
+    testDiag("Slot with no Memory or I/O32 space");
+    testOk1(ipmMemRead(noSpaces, 0, ipac_addrMem, 0, buffer, 4) == S_IPAC_badAddress);
+    testOk1(ipmMemWrite(noSpaces, 0, ipac_addrIO32, 0, buffer, 4) == S_IPAC_badAddress);
+    testOk1(ipmMemRead(noSpaces, 0, ipac_addrIO, 0, buffer, 4) == OK);
+}
+
+static void testCopies(int carrier, ipac_addr_t space, const char *name)
+{
+    size_t offset, count;
+    int align, failed = 0;
+
+    for (offset = 0; offset < MAX_ALIGN; offset++)
+        for (align = 0; align < MAX_ALIGN; align++)
+            for (count = 0; count <= MAX_SHORT; count++)
+                if (!roundTrip(carrier, space, offset, align, count)) {
+                    if (!failed++)
+                        testDiag("%s: offset %u align %d count %u failed",
+                            name, (unsigned) offset, align, (unsigned) count);
+                }
+    testOk(failed == 0, "%s space, short blocks at all alignments", name);
+
+    if (space == ipac_addrMem) {
+        testOk(roundTrip(carrier, space, 1, 3, MEM_SIZE - 9),
+            "%s space, long misaligned block", name);
+        testOk(roundTrip(carrier, space, 0, 0, MEM_SIZE),
+            "%s space, whole space", name);
+    }
+}
+
+static void testHooks(void)
+{
+    ipacTestHooks_t *pcount = ipacTestHookCounts(hooked);
+    unsigned long reads = pcount->memReads, writes = pcount->memWrites;
+
+    testDiag("Carrier memRead/memWrite hooks");
+    testOk(roundTrip(hooked, ipac_addrMem, 3, 1, 1000),
+        "Memory space through hooks");
+    testOk(pcount->memReads == reads + 1 && pcount->memWrites == writes + 1,
+        "Hooks called once each (%lu, %lu)",
+        pcount->memReads - reads, pcount->memWrites - writes);
+
+    reads = pcount->memReads;
+    writes = pcount->memWrites;
+    testOk(roundTrip(hooked, ipac_addrIO32, 2, 0, 100),
+        "I/O32 space falls back to the generic copy");
+    testOk(pcount->memReads == reads && pcount->memWrites == writes,
+        "Hooks returned S_IPAC_notImplemented");
+
+    testOk1(ipmMemRead(hooked, 0, ipac_addrMem, MEM_SIZE - 2,
+                ipacTestSlot(hooked, 0, ipac_addrIO), 4) == S_IPAC_badAddress);
+}
+
+
+/* Benchmark */
+
+static void loopRead(void *buffer, volatile epicsUInt16 *src, size_t count)
+{
+    epicsUInt16 *dst = (epicsUInt16 *) buffer;
+
+    for (count /= 2; count > 0; count--)
+        *dst++ = *src++;
+}
+
+static void loopWrite(volatile epicsUInt16 *dst, const void *buffer, size_t count)
+{
+    const epicsUInt16 *src = (const epicsUInt16 *) buffer;
+
+    for (count /= 2; count > 0; count--)
+        *dst++ = *src++;
+}
+
+static double rate(epicsTimeStamp *start, size_t total)
+{
+    epicsTimeStamp now;
+    double secs;
+
+    epicsTimeGetCurrent(&now);
+    secs = epicsTimeDiffInSeconds(&now, start);
+    return secs > 0 ? total / secs / 1e6 : 0;
+}
+
+static void benchmark(void)
+{
+    static const size_t sizes[] = {64, 1024, MEM_SIZE};
+    static char buffer[MEM_SIZE];
+    volatile epicsUInt16 *mem =
+        (volatile epicsUInt16 *) ipacTestSlot(plain, 0, ipac_addrMem);
+    const size_t total = 16 << 20;
+    unsigned i;
+
+    testDiag("Throughput, MB/s, memory-backed slot:");
+    testDiag("%8s %10s %10s %10s %10s", "bytes",
+        "ipmMemRead", "16-bit", "ipmMemWr", "16-bit");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t size = sizes[i], done;
+        epicsTimeStamp start;
+        double r[4];
+
+        epicsTimeGetCurrent(&start);
+        for (done = 0; done < total; done += size)
+            ipmMemRead(plain, 0, ipac_addrMem, 0, buffer, size);
+        r[0] = rate(&start, total);
+
+        epicsTimeGetCurrent(&start);
+        for (done = 0; done < total; done += size)
+            loopRead(buffer, mem, size);
+        r[1] = rate(&start, total);
+
+        epicsTimeGetCurrent(&start);
+        for (done = 0; done < total; done += size)
+            ipmMemWrite(plain, 0, ipac_addrMem, 0, buffer, size);
+        r[2] = rate(&start, total);
+
+        epicsTimeGetCurrent(&start);
+        for (done = 0; done < total; done += size)
+            loopWrite(mem, buffer, size);
+        r[3] = rate(&start, total);
+
+        testDiag("%8u %10.1f %10.1f %10.1f %10.1f", (unsigned) size,
+            r[0], r[1], r[2], r[3]);
+    }
+}
+
+
+MAIN(ipmMemTest)
+{
+    testPlan(24);
+
+    plain = ipacAddTestCarrier("SLOTS=2 MEM=0x10000");
+    hooked = ipacAddTestCarrier("SLOTS=1 MEM=0x10000 HOOKS");
+    noSpaces = ipacAddTestCarrier("SLOTS=1 NOIO32");
+    testOk(plain >= 0 && hooked >= 0 && noSpaces >= 0, "Test carriers added");
+
+    testArgs();
+
+    testDiag("Generic copy");
+    testCopies(plain, ipac_addrMem, "Memory");
+    testCopies(plain, ipac_addrIO32, "I/O32");
+    testCopies(plain, ipac_addrIO, "I/O");
+
+    testHooks();
+
+    benchmark();
+
+    return testDone();
+}
@@ -0,0 +1,612 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    rtemsShim.c
+
+Description:
+    Host implementation of the RTEMS routines used by the serial module
+    drivers, enough to run them unchanged in the host tests against the
+    register emulators.  See rtemsShim/rtems/system.h.
+
+    The termios layer keeps the driver interface of the real one.  Input
+    arrives through rtems_termios_enqueue_raw_characters() from the
+    interrupt routine.  For interrupt driven output termios hands the
+    driver's write callback the contiguous part of its output buffer, and
+    the interrupt routine reports how much was sent with
+    rtems_termios_dequeue_characters(), which passes on the rest, or a
+    zero length once the buffer is empty.  Polled output is given straight
+    to the write callback.  Task driven output is run as interrupt driven.
+    There is no line discipline, reads return what has arrived without
+    waiting, and setAttributes is only called by the
+    RTEMS_IO_SET_ATTRIBUTES ioctl.
+
+    This file is only built into the test programs.
+
+*******************************************************************************/
+
+/* ANSI headers */
+#include <stdlib.h>
+#include <string.h>
+
+/* EPICS headers */
+#include <epicsEvent.h>
+#include <epicsInterrupt.h>
+#include <epicsTime.h>
+
+/* Shim headers */
+#include "rtems/system.h"
+#include "rtems/error.h"
+#include "rtems/io.h"
+#include "rtems/libio.h"
+#include "rtems/termiostypes.h"
+#include "rtemsShim.h"
+
+
+#define MAX_DRIVERS 8
+#define MAX_NAMES 32
+#define MAX_FILES 16
+#define TTY_BUF 4096
+
+
+/* Registered device name */
+
+typedef struct {
+    char *name;
+    rtems_device_major_number major;
+    rtems_device_minor_number minor;
+} name_t;
+
+/* Open file */
+
+typedef struct {
+    name_t *pname;
+    rtems_libio_t iop;
+} file_t;
+
+/* Termios state of an open port */
+
+typedef struct {
+    const rtems_termios_callbacks *callbacks;
+    int minor;
+    struct termios termios;
+    char in[TTY_BUF];
+    int inHead;
+    int inCount;
+    char out[TTY_BUF];
+    int outHead;
+    int outCount;
+    int outBusy;                    /* The driver has been given output */
+    epicsEventId outSpace;
+} tty_t;
+
+static rtems_driver_address_table drvTable[MAX_DRIVERS];
+static int numDrivers;
+static name_t names[MAX_NAMES];
+static int numNames;
+static file_t files[MAX_FILES];
+
+static double (*clockFn)(void *pvt);
+static void *clockPvt;
+
+
+/*******************************************************************************
+
+Routine:
+    rtems_io_register_driver, rtems_io_register_name
+
+Purpose:
+    I/O manager driver and device name tables
+
+Description:
+    Drivers are given major numbers from 1 up.
+
+*/
+
+rtems_status_code rtems_io_register_driver (
+    rtems_device_major_number major,
+    const rtems_driver_address_table *table,
+    rtems_device_major_number *registered_major
+) {
+    if (numDrivers >= MAX_DRIVERS)
+        return RTEMS_TOO_MANY;
+    drvTable[numDrivers++] = *table;
+    *registered_major = numDrivers;
+    return RTEMS_SUCCESSFUL;
+}
+
+rtems_status_code rtems_io_register_name (
+    const char *name,
+    rtems_device_major_number major,
+    rtems_device_minor_number minor
+) {
+    name_t *pname;
+    int i;
+
+    for (i = 0; i < numNames; i++)
+        if (strcmp(names[i].name, name) == 0)
+            return RTEMS_RESOURCE_IN_USE;
+    if (numNames >= MAX_NAMES)
+        return RTEMS_TOO_MANY;
+
+    pname = &names[numNames];
+    pname->name = malloc(strlen(name) + 1);
+    if (pname->name == NULL)
+        return RTEMS_UNSATISFIED;
+    strcpy(pname->name, name);
+    pname->major = major;
+    pname->minor = minor;
+    numNames++;
+    return RTEMS_SUCCESSFUL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rtemsShimOpen, rtemsShimClose, rtemsShimRead, rtemsShimWrite,
+    rtemsShimIoctl
+
+Purpose:
+    File access for the tests, through the driver's entry points
+
+Returns:
+    As open(), close(), read(), write() and ioctl().
+
+*/
+
+static const rtems_driver_address_table *fileDriver (
+    int fd
+) {
+    if (fd < 0 || fd >= MAX_FILES || files[fd].pname == NULL)
+        return NULL;
+    return &drvTable[files[fd].pname->major - 1];
+}
+
+int rtemsShimOpen (
+    const char *name
+) {
+    rtems_libio_open_close_args_t args;
+    const rtems_driver_address_table *pdrv;
+    name_t *pname = NULL;
+    int fd, i;
+
+    for (i = 0; i < numNames; i++)
+        if (strcmp(names[i].name, name) == 0)
+            pname = &names[i];
+    for (fd = 0; fd < MAX_FILES; fd++)
+        if (files[fd].pname == NULL)
+            break;
+    if (pname == NULL || fd == MAX_FILES)
+        return -1;
+
+    files[fd].pname = pname;
+    files[fd].iop.data1 = NULL;
+    pdrv = fileDriver(fd);
+    args.iop = &files[fd].iop;
+    args.flags = 0;
+    args.mode = 0;
+    if (pdrv->open_entry &&
+        pdrv->open_entry(pname->major, pname->minor, &args)) {
+        files[fd].pname = NULL;
+        return -1;
+    }
+    return fd;
+}
+
+int rtemsShimClose (
+    int fd
+) {
+    const rtems_driver_address_table *pdrv = fileDriver(fd);
+    rtems_libio_open_close_args_t args;
+    rtems_status_code sc = RTEMS_SUCCESSFUL;
+
+    if (pdrv == NULL)
+        return -1;
+    args.iop = &files[fd].iop;
+    args.flags = 0;
+    args.mode = 0;
+    if (pdrv->close_entry)
+        sc = pdrv->close_entry(files[fd].pname->major,
+            files[fd].pname->minor, &args);
+    files[fd].pname = NULL;
+    return sc ? -1 : 0;
+}
+
+static int readWrite (
+    int fd,
+    char *buffer,
+    int nbytes,
+    int write
+) {
+    const rtems_driver_address_table *pdrv = fileDriver(fd);
+    rtems_device_driver_entry entry;
+    rtems_libio_rw_args_t args;
+
+    if (pdrv == NULL)
+        return -1;
+    entry = write ? pdrv->write_entry : pdrv->read_entry;
+    args.iop = &files[fd].iop;
+    args.offset = 0;
+    args.buffer = buffer;
+    args.count = nbytes;
+    args.flags = 0;
+    args.bytes_moved = 0;
+    if (entry(files[fd].pname->major, files[fd].pname->minor, &args))
+        return -1;
+    return args.bytes_moved;
+}
+
+int rtemsShimRead (
+    int fd,
+    char *buffer,
+    int maxbytes
+) {
+    return readWrite(fd, buffer, maxbytes, 0);
+}
+
+int rtemsShimWrite (
+    int fd,
+    const char *buffer,
+    int nbytes
+) {
+    return readWrite(fd, (char *) buffer, nbytes, 1);
+}
+
+int rtemsShimIoctl (
+    int fd,
+    int command,
+    void *arg
+) {
+    const rtems_driver_address_table *pdrv = fileDriver(fd);
+    rtems_libio_ioctl_args_t args;
+
+    if (pdrv == NULL)
+        return -1;
+    args.iop = &files[fd].iop;
+    args.command = command;
+    args.buffer = arg;
+    args.ioctl_return = 0;
+    if (pdrv->control_entry(files[fd].pname->major, files[fd].pname->minor,
+            &args))
+        return -1;
+    return args.ioctl_return;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rtems_termios_open, rtems_termios_close
+
+Purpose:
+    Create and destroy a port's termios state
+
+*/
+
+rtems_status_code rtems_termios_open (
+    rtems_device_major_number major,
+    rtems_device_minor_number minor,
+    void *arg,
+    const rtems_termios_callbacks *callbacks
+) {
+    rtems_libio_open_close_args_t *args = arg;
+    tty_t *tty = calloc(1, sizeof(tty_t));
+
+    if (tty == NULL)
+        return RTEMS_UNSATISFIED;
+    tty->outSpace = epicsEventCreate(epicsEventEmpty);
+    if (tty->outSpace == NULL) {
+        free(tty);
+        return RTEMS_UNSATISFIED;
+    }
+    tty->callbacks = callbacks;
+    tty->minor = minor;
+    tty->termios.c_cflag = CS8 | CREAD | CLOCAL;
+    cfsetispeed(&tty->termios, B9600);
+    cfsetospeed(&tty->termios, B9600);
+
+    if (callbacks->firstOpen &&
+        callbacks->firstOpen(major, minor, arg)) {
+        epicsEventDestroy(tty->outSpace);
+        free(tty);
+        return RTEMS_UNSATISFIED;
+    }
+    args->iop->data1 = tty;
+    return RTEMS_SUCCESSFUL;
+}
+
+rtems_status_code rtems_termios_close (
+    void *arg
+) {
+    rtems_libio_open_close_args_t *args = arg;
+    tty_t *tty = args->iop->data1;
+
+    if (tty->callbacks->lastClose)
+        tty->callbacks->lastClose(0, tty->minor, arg);
+    epicsEventDestroy(tty->outSpace);
+    free(tty);
+    args->iop->data1 = NULL;
+    return RTEMS_SUCCESSFUL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rtems_termios_enqueue_raw_characters
+
+Purpose:
+    Input from the interrupt routine
+
+Returns:
+    The number of characters dropped because the input buffer was full.
+
+*/
+
+int rtems_termios_enqueue_raw_characters (
+    void *ttyp,
+    const char *buf,
+    int len
+) {
+    tty_t *tty = ttyp;
+    int key = epicsInterruptLock();
+    int i;
+
+    for (i = 0; i < len && tty->inCount < TTY_BUF; i++)
+        tty->in[(tty->inHead + tty->inCount++) % TTY_BUF] = buf[i];
+    epicsInterruptUnlock(key);
+    return len - i;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    startOutput, rtems_termios_dequeue_characters
+
+Purpose:
+    Interrupt driven output
+
+Description:
+    startOutput() gives the driver the contiguous part of the output
+    buffer, or a zero length when it is empty.  Both are called with the
+    interrupt lock held.
+
+*/
+
+static void startOutput (
+    tty_t *tty
+) {
+    int len = tty->outCount;
+
+    if (tty->outHead + len > TTY_BUF)
+        len = TTY_BUF - tty->outHead;
+    if (len == 0) {
+        tty->outBusy = 0;
+        tty->callbacks->write(tty->minor, NULL, 0);
+        return;
+    }
+    tty->outBusy = 1;
+    tty->callbacks->write(tty->minor, &tty->out[tty->outHead], len);
+}
+
+int rtems_termios_dequeue_characters (
+    void *ttyp,
+    int len
+) {
+    tty_t *tty = ttyp;
+    int key = epicsInterruptLock();
+
+    if (len > tty->outCount)
+        len = tty->outCount;
+    tty->outHead = (tty->outHead + len) % TTY_BUF;
+    tty->outCount -= len;
+    if (len)
+        epicsEventSignal(tty->outSpace);
+    startOutput(tty);
+    epicsInterruptUnlock(key);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rtems_termios_read, rtems_termios_write, rtems_termios_ioctl
+
+Purpose:
+    The driver's read, write and control entry points pass these the
+    argument block
+
+*/
+
+rtems_status_code rtems_termios_read (
+    void *arg
+) {
+    rtems_libio_rw_args_t *args = arg;
+    tty_t *tty = args->iop->data1;
+    int key = epicsInterruptLock();
+    uint32_t n = 0;
+
+    while (n < args->count && tty->inCount) {
+        args->buffer[n++] = tty->in[tty->inHead];
+        tty->inHead = (tty->inHead + 1) % TTY_BUF;
+        tty->inCount--;
+    }
+    epicsInterruptUnlock(key);
+    args->bytes_moved = n;
+    return RTEMS_SUCCESSFUL;
+}
+
+rtems_status_code rtems_termios_write (
+    void *arg
+) {
+    rtems_libio_rw_args_t *args = arg;
+    tty_t *tty = args->iop->data1;
+    uint32_t n = 0;
+
+    if (tty->callbacks->outputUsesInterrupts == TERMIOS_POLLED) {
+        tty->callbacks->write(tty->minor, args->buffer, args->count);
+        args->bytes_moved = args->count;
+        return RTEMS_SUCCESSFUL;
+    }
+
+    while (n < args->count) {
+        int key = epicsInterruptLock();
+
+        while (n < args->count && tty->outCount < TTY_BUF)
+            tty->out[(tty->outHead + tty->outCount++) % TTY_BUF] =
+                args->buffer[n++];
+        if (!tty->outBusy)
+            startOutput(tty);
+        epicsInterruptUnlock(key);
+        if (n < args->count)
+            epicsEventMustWait(tty->outSpace);
+    }
+    args->bytes_moved = n;
+    return RTEMS_SUCCESSFUL;
+}
+
+rtems_status_code rtems_termios_ioctl (
+    void *arg
+) {
+    rtems_libio_ioctl_args_t *args = arg;
+    tty_t *tty = args->iop->data1;
+
+    switch (args->command) {
+        case RTEMS_IO_GET_ATTRIBUTES:
+            *(struct termios *) args->buffer = tty->termios;
+            break;
+        case RTEMS_IO_SET_ATTRIBUTES:
+            tty->termios = *(struct termios *) args->buffer;
+            if (tty->callbacks->setAttributes)
+                tty->callbacks->setAttributes(tty->minor, &tty->termios);
+            break;
+        default:
+            args->ioctl_return = -1;
+            return RTEMS_INVALID_NUMBER;
+    }
+    args->ioctl_return = 0;
+    return RTEMS_SUCCESSFUL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rtems_termios_baud_to_number
+
+Purpose:
+    Converts a termios speed code to bits per second
+
+Returns:
+    The rate, or -1 for an unknown code.
+
+*/
+
+int rtems_termios_baud_to_number (
+    int termios_baud
+) {
+    static const struct {
+        int code;
+        int baud;
+    } rates[] = {
+        {B0, 0}, {B50, 50}, {B75, 75}, {B110, 110}, {B134, 134},
+        {B150, 150}, {B200, 200}, {B300, 300}, {B600, 600},
+        {B1200, 1200}, {B1800, 1800}, {B2400, 2400}, {B4800, 4800},
+        {B9600, 9600}, {B19200, 19200}, {B38400, 38400},
+        {B57600, 57600}, {B115200, 115200}, {B230400, 230400}
+    };
+    unsigned i;
+
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+        if (rates[i].code == termios_baud)
+            return rates[i].baud;
+    return -1;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rtemsShimClock, rtems_clock_get_uptime
+
+Purpose:
+    The uptime clock, which a test may replace
+
+Description:
+    Without a replacement the uptime runs from the first call.
+
+*/
+
+void rtemsShimClock (
+    double (*uptime)(void *pvt),
+    void *pvt
+) {
+    clockFn = uptime;
+    clockPvt = pvt;
+}
+
+rtems_status_code rtems_clock_get_uptime (
+    struct timespec *uptime
+) {
+    static epicsTimeStamp boot;
+    double now;
+
+    if (clockFn)
+        now = clockFn(clockPvt);
+    else {
+        epicsTimeStamp stamp;
+
+        epicsTimeGetCurrent(&stamp);
+        if (boot.secPastEpoch == 0 && boot.nsec == 0)
+            boot = stamp;
+        now = epicsTimeDiffInSeconds(&stamp, &boot);
+    }
+    uptime->tv_sec = (time_t) now;
+    uptime->tv_nsec = (long) ((now - uptime->tv_sec) * 1e9);
+    return RTEMS_SUCCESSFUL;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rtems_status_text, rtemsShimWriteProbe
+
+Purpose:
+    Status messages, and devWriteProbe() on the test carrier's memory
+
+*/
+
+const char *rtems_status_text (
+    rtems_status_code sc
+) {
+    switch (sc) {
+        case RTEMS_SUCCESSFUL:
+            return "successful completion";
+        case RTEMS_INVALID_NAME:
+            return "invalid object name";
+        case RTEMS_TOO_MANY:
+            return "too many";
+        case RTEMS_INVALID_NUMBER:
+            return "invalid number";
+        case RTEMS_RESOURCE_IN_USE:
+            return "resource in use";
+        case RTEMS_UNSATISFIED:
+            return "request not satisfied";
+    }
+    return "unknown status";
+}
+
+long rtemsShimWriteProbe (
+    unsigned wordSize,
+    volatile void *ptr,
+    const void *pValue
+) {
+    memcpy((void *) ptr, pValue, wordSize);
+    return 0;
+}
@@ -0,0 +1,18 @@
+/* Host test shim, see rtems/system.h */
+
+#ifndef INCrtemsErrorH
+#define INCrtemsErrorH
+
+#include "rtems/system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char *rtems_status_text(rtems_status_code sc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCrtemsErrorH */
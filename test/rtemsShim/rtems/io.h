@@ -0,0 +1,35 @@
+/* Host test shim, see rtems/system.h */
+
+#ifndef INCrtemsIoH
+#define INCrtemsIoH
+
+#include "rtems/system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef rtems_device_driver (*rtems_device_driver_entry)(
+    rtems_device_major_number major, rtems_device_minor_number minor,
+    void *arg);
+
+typedef struct {
+    rtems_device_driver_entry initialization_entry;
+    rtems_device_driver_entry open_entry;
+    rtems_device_driver_entry close_entry;
+    rtems_device_driver_entry read_entry;
+    rtems_device_driver_entry write_entry;
+    rtems_device_driver_entry control_entry;
+} rtems_driver_address_table;
+
+rtems_status_code rtems_io_register_driver(rtems_device_major_number major,
+    const rtems_driver_address_table *table,
+    rtems_device_major_number *registered_major);
+rtems_status_code rtems_io_register_name(const char *name,
+    rtems_device_major_number major, rtems_device_minor_number minor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCrtemsIoH */
@@ -0,0 +1,49 @@
+/* Host test shim, see rtems/system.h */
+
+#ifndef INCrtemsLibioH
+#define INCrtemsLibioH
+
+#include <sys/types.h>
+
+#include "rtems/system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ioctl() commands handled by termios */
+#define RTEMS_IO_GET_ATTRIBUTES 1
+#define RTEMS_IO_SET_ATTRIBUTES 2
+
+typedef struct {
+    void *data1;                    /* The termios tty */
+    uint32_t flags;
+} rtems_libio_t;
+
+typedef struct {
+    rtems_libio_t *iop;
+    uint32_t flags;
+    uint32_t mode;
+} rtems_libio_open_close_args_t;
+
+typedef struct {
+    rtems_libio_t *iop;
+    off_t offset;
+    char *buffer;
+    uint32_t count;
+    uint32_t flags;
+    uint32_t bytes_moved;
+} rtems_libio_rw_args_t;
+
+typedef struct {
+    rtems_libio_t *iop;
+    uint32_t command;
+    void *buffer;
+    int ioctl_return;
+} rtems_libio_ioctl_args_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCrtemsLibioH */
@@ -0,0 +1,56 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    rtems/system.h
+
+Description:
+    Host test shim for the parts of RTEMS the serial module drivers use:
+    the I/O manager, the termios driver interface and the uptime clock.
+    The headers in this directory stand in for the RTEMS ones of the same
+    name; rtemsShim.c implements them on top of libCom.  As in vxShim,
+    interrupt locking is epicsInterruptLock(), which ipacTestInterrupt()
+    also takes.
+
+    The test carrier's slots are plain memory, which devLib can't probe on
+    a host, so devWriteProbe() is redirected to a shim copy.
+
+*******************************************************************************/
+
+#ifndef INCrtemsSystemH
+#define INCrtemsSystemH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    RTEMS_SUCCESSFUL = 0,
+    RTEMS_INVALID_NAME = 3,
+    RTEMS_TOO_MANY = 5,
+    RTEMS_INVALID_NUMBER = 10,
+    RTEMS_RESOURCE_IN_USE = 12,
+    RTEMS_UNSATISFIED = 13
+} rtems_status_code;
+
+typedef uint32_t rtems_device_major_number;
+typedef uint32_t rtems_device_minor_number;
+typedef rtems_status_code rtems_device_driver;
+
+rtems_status_code rtems_clock_get_uptime(struct timespec *uptime);
+
+long rtemsShimWriteProbe(unsigned wordSize, volatile void *ptr,
+    const void *pValue);
+#define devWriteProbe rtemsShimWriteProbe
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCrtemsSystemH */
@@ -0,0 +1,48 @@
+/* Host test shim, see rtems/system.h */
+
+#ifndef INCrtemsTermiostypesH
+#define INCrtemsTermiostypesH
+
+#include <termios.h>
+#include <sys/types.h>
+
+#include "rtems/system.h"
+#include "rtems/libio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Output modes, rtems_termios_callbacks.outputUsesInterrupts */
+#define TERMIOS_POLLED      0
+#define TERMIOS_IRQ_DRIVEN  1
+#define TERMIOS_TASK_DRIVEN 2
+
+typedef struct rtems_termios_callbacks {
+    int (*firstOpen)(int major, int minor, void *arg);
+    int (*lastClose)(int major, int minor, void *arg);
+    int (*pollRead)(int minor);
+    ssize_t (*write)(int minor, const char *buf, size_t len);
+    int (*setAttributes)(int minor, const struct termios *t);
+    int (*stopRemoteTx)(int minor);
+    int (*startRemoteTx)(int minor);
+    int outputUsesInterrupts;
+} rtems_termios_callbacks;
+
+rtems_status_code rtems_termios_open(rtems_device_major_number major,
+    rtems_device_minor_number minor, void *arg,
+    const rtems_termios_callbacks *callbacks);
+rtems_status_code rtems_termios_close(void *arg);
+rtems_status_code rtems_termios_read(void *arg);
+rtems_status_code rtems_termios_write(void *arg);
+rtems_status_code rtems_termios_ioctl(void *arg);
+int rtems_termios_enqueue_raw_characters(void *ttyp, const char *buf,
+    int len);
+int rtems_termios_dequeue_characters(void *ttyp, int len);
+int rtems_termios_baud_to_number(int termios_baud);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCrtemsTermiostypesH */
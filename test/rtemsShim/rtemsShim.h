@@ -0,0 +1,27 @@
+/* Host test shim, see rtems/system.h
+ *
+ * The tests reach devices through these instead of open(), read(), write()
+ * and ioctl().  They call the driver's entry points with the same argument
+ * blocks as the RTEMS I/O manager.  rtemsShimClock() replaces the uptime
+ * clock, so a test can run a register emulator while the driver busy-waits.
+ */
+
+#ifndef INCrtemsShimH
+#define INCrtemsShimH
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int rtemsShimOpen(const char *name);
+int rtemsShimClose(int fd);
+int rtemsShimRead(int fd, char *buffer, int maxbytes);
+int rtemsShimWrite(int fd, const char *buffer, int nbytes);
+int rtemsShimIoctl(int fd, int command, void *arg);
+void rtemsShimClock(double (*uptime)(void *pvt), void *pvt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCrtemsShimH */
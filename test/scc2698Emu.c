@@ -0,0 +1,517 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    scc2698Emu.c
+
+Description:
+    Register emulator for the SCC2698 octal UART, laid out in the I/O space
+    as in scc2698.h: four blocks of 16 registers at odd byte addresses, each
+    block serving channels A and B.  Modelled are the mode register pointer,
+    the commands tyGSOctal uses, the clock selects of baud rate set 2 and the
+    counter/timer as a 16x clock, the status and interrupt status/mask
+    registers, each receiver's 3 character FIFO and the character held in
+    its shift register when that is full, and the transmit holding
+    register.  When a character arrives with both of those full the held
+    one is lost and the overrun bit is set.  Parity, framing and break
+    errors are only set by scc2698EmuRxError.  The modem and input port
+    signals are not modelled.
+
+    This file is only built into the test programs.
+
+*******************************************************************************/
+
+/* ANSI headers */
+#include <stdlib.h>
+
+/* EPICS headers */
+#include <epicsTypes.h>
+
+/* Module headers */
+#include "ipacTestCarrier.h"
+#include "scc2698.h"
+#include "scc2698Emu.h"
+
+
+#define BLOCKS 4
+#define RX_FIFO 3
+
+/* Status register bits */
+#define SR_RXRDY  0x01
+#define SR_FFULL  0x02
+#define SR_TXRDY  0x04
+#define SR_TXEMT  0x08
+#define SR_OE     0x10
+
+
+/* Channel state */
+
+typedef struct {
+    epicsUInt8 mr[2];
+    int mrPtr;
+    epicsUInt8 csr;
+    epicsUInt8 sr;              /* Error bits only */
+    epicsUInt8 rxError;         /* Error bits for the next character */
+    int rxEnabled;
+    int txEnabled;
+    char fifo[RX_FIFO];
+    int head;
+    int count;
+    int held;                   /* Character waiting in the shift register */
+    char hold;
+    char rhr;                   /* Last character read */
+    int thrFull;
+    char thr;
+} chan_t;
+
+/* Block state, shared by channels A and B */
+
+typedef struct {
+    epicsUInt8 acr;
+    epicsUInt8 imr;
+    epicsUInt8 ctu;
+    epicsUInt8 ctl;
+    int preset;                 /* Counter/timer preset when last started */
+} block_t;
+
+typedef struct {
+    uartEmu emu;                /* Must be first */
+    chan_t chan[UART_EMU_CHANNELS];
+    block_t block[BLOCKS];
+} scc2698Emu;
+
+
+/*******************************************************************************
+
+Routine:
+    baudRate
+
+Purpose:
+    Returns a channel's transmitter baud rate
+
+Description:
+    Only the ACR[7]=1 set of clock selects is implemented, which is the one
+    the driver uses.  External clocks aren't fitted on the module.
+
+*/
+
+static double baudRate (
+    scc2698Emu *scc,
+    int chan
+) {
+    static const double set2[16] = {
+        75, 110, 38400, 150, 300, 600, 1200, 2000,
+        2400, 4800, 1800, 9600, 19200, 0, 0, 0
+    };
+    block_t *pblk = &scc->block[chan / 2];
+    int select = scc->chan[chan].csr & 0x0f;
+
+    if (select == (SCC_CSR_TIMER & 0x0f)) {
+        if ((pblk->acr & 0x70) != SCC_ACR_CT_TIMER_X1 ||
+            pblk->preset < SCC_CT_MIN_PRESET)
+            return 0;
+        return (double) SCC_CT_BAUD_CLOCK / pblk->preset;
+    }
+    return set2[select];
+}
+
+
+/*******************************************************************************
+
+Routine:
+    charTime
+
+Purpose:
+    Seconds per character: start bit, data, parity and stop bits
+
+Description:
+    A channel without a clock runs so slowly that no character completes.
+
+*/
+
+static double charTime (
+    uartEmu *emu,
+    int chan
+) {
+    scc2698Emu *scc = (scc2698Emu *) emu;
+    chan_t *pch = &scc->chan[chan];
+    double baud = baudRate(scc, chan);
+    int bits = 1 + 5 + (pch->mr[0] & 0x03);
+
+    if ((pch->mr[0] & 0x18) != 0x10)    /* Parity bit */
+        bits++;
+    bits += (pch->mr[1] & 0x0f) >= 0x08 ? 2 : 1;
+    return baud > 0 ? bits / baud : 1e6;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rxChar
+
+Purpose:
+    A character has arrived at a receiver
+
+*/
+
+static void rxChar (
+    uartEmu *emu,
+    int chan,
+    char c
+) {
+    scc2698Emu *scc = (scc2698Emu *) emu;
+    chan_t *pch = &scc->chan[chan];
+
+    if (!pch->rxEnabled)
+        return;
+
+    pch->sr |= pch->rxError;    /* Block error mode, kept until reset */
+    pch->rxError = 0;
+    if (pch->count < RX_FIFO) {
+        pch->fifo[(pch->head + pch->count++) % RX_FIFO] = c;
+        return;
+    }
+    if (pch->held) {
+        pch->sr |= SR_OE;
+        emu->chan[chan].rxLost++;
+    }
+    pch->held = 1;
+    pch->hold = c;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    txNext
+
+Purpose:
+    Moves the holding register to the transmit shift register
+
+*/
+
+static int txNext (
+    uartEmu *emu,
+    int chan,
+    char *pc
+) {
+    chan_t *pch = &((scc2698Emu *) emu)->chan[chan];
+
+    if (!pch->thrFull)
+        return 0;
+    *pc = pch->thr;
+    pch->thrFull = 0;
+    return 1;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    status, isrBits
+
+Purpose:
+    Compute a channel's status and a block's interrupt status registers
+
+*/
+
+static epicsUInt8 status (
+    scc2698Emu *scc,
+    int chan
+) {
+    chan_t *pch = &scc->chan[chan];
+    epicsUInt8 sr = pch->sr;
+
+    if (pch->count)
+        sr |= SR_RXRDY;
+    if (pch->count == RX_FIFO)
+        sr |= SR_FFULL;
+    if (pch->txEnabled && !pch->thrFull) {
+        sr |= SR_TXRDY;
+        if (!scc->emu.chan[chan].txBusy)
+            sr |= SR_TXEMT;
+    }
+    return sr;
+}
+
+static epicsUInt8 isrBits (
+    scc2698Emu *scc,
+    int block
+) {
+    epicsUInt8 a = status(scc, 2 * block);
+    epicsUInt8 b = status(scc, 2 * block + 1);
+    epicsUInt8 isr = 0;
+
+    if (a & SR_TXRDY)
+        isr |= SCC_ISR_TXRDY_A;
+    if (a & SR_RXRDY)
+        isr |= SCC_ISR_RXRDY_A;
+    if (b & SR_TXRDY)
+        isr |= SCC_ISR_TXRDY_B;
+    if (b & SR_RXRDY)
+        isr |= SCC_ISR_RXRDY_B;
+    return isr;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    irq, timer
+
+Purpose:
+    Interrupt request output, and the next internal event (none)
+
+*/
+
+static int irq (
+    uartEmu *emu
+) {
+    scc2698Emu *scc = (scc2698Emu *) emu;
+    int block;
+
+    for (block = 0; block < BLOCKS; block++)
+        if (isrBits(scc, block) & scc->block[block].imr)
+            return 1;
+    return 0;
+}
+
+static double timer (
+    uartEmu *emu
+) {
+    return 0;
+}
+
+static const uartEmuOps scc2698Ops = {
+    rxChar, txNext, charTime, irq, timer
+};
+
+
+/*******************************************************************************
+
+Routine:
+    command
+
+Purpose:
+    Executes a channel command register write
+
+*/
+
+static void command (
+    scc2698Emu *scc,
+    int chan,
+    epicsUInt8 cr
+) {
+    chan_t *pch = &scc->chan[chan];
+
+    switch (cr & 0x03) {
+        case 1:
+            pch->rxEnabled = 1;
+            break;
+        case 2:
+            pch->rxEnabled = 0;
+            break;
+    }
+    switch ((cr >> 2) & 0x03) {
+        case 1:
+            pch->txEnabled = 1;
+            break;
+        case 2:
+            pch->txEnabled = 0;
+            break;
+    }
+    switch (cr >> 4) {
+        case 0x1:               /* Reset MR pointer */
+            pch->mrPtr = 0;
+            break;
+        case 0x2:               /* Reset receiver */
+            pch->rxEnabled = 0;
+            pch->count = 0;
+            pch->held = 0;
+            break;
+        case 0x3:               /* Reset transmitter */
+            pch->txEnabled = 0;
+            pch->thrFull = 0;
+            break;
+        case 0x4:               /* Reset error status */
+            pch->sr = 0;
+            break;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    regRead, regWrite
+
+Purpose:
+    Register access routines for ipacTestRegisters()
+
+*/
+
+static epicsUInt32 regRead (
+    void *pvt,
+    size_t offset,
+    int size
+) {
+    scc2698Emu *scc = (scc2698Emu *) pvt;
+    int block = offset / 32;
+    int reg = (offset % 32) / 2;
+    int chan = 2 * block + reg / 8;
+    block_t *pblk = &scc->block[block];
+    chan_t *pch = &scc->chan[chan];
+    epicsUInt32 value = 0xff;
+
+    epicsMutexMustLock(scc->emu.lock);
+    uartEmuAccess(&scc->emu);
+    switch (reg) {
+        case 0: case 8:         /* MR1/MR2 */
+            value = pch->mr[pch->mrPtr];
+            pch->mrPtr = 1;
+            break;
+        case 1: case 9:         /* SR */
+            value = status(scc, chan);
+            break;
+        case 3: case 11:        /* RHR */
+            if (pch->count) {
+                pch->rhr = pch->fifo[pch->head];
+                pch->head = (pch->head + 1) % RX_FIFO;
+                pch->count--;
+                if (pch->held) {
+                    pch->fifo[(pch->head + pch->count++) % RX_FIFO] =
+                        pch->hold;
+                    pch->held = 0;
+                }
+            }
+            value = (epicsUInt8) pch->rhr;
+            break;
+        case 4:                 /* IPCR */
+            value = 0;
+            break;
+        case 5:                 /* ISR */
+            value = isrBits(scc, block);
+            break;
+        case 6:                 /* CTU */
+            value = pblk->ctu;
+            break;
+        case 7:                 /* CTL */
+            value = pblk->ctl;
+            break;
+        case 14:                /* Start counter/timer */
+            pblk->preset = pblk->ctu << 8 | pblk->ctl;
+            break;
+    }
+    epicsMutexUnlock(scc->emu.lock);
+    return value;
+}
+
+static void regWrite (
+    void *pvt,
+    size_t offset,
+    int size,
+    epicsUInt32 value
+) {
+    scc2698Emu *scc = (scc2698Emu *) pvt;
+    int block = offset / 32;
+    int reg = (offset % 32) / 2;
+    int chan = 2 * block + reg / 8;
+    block_t *pblk = &scc->block[block];
+    chan_t *pch = &scc->chan[chan];
+
+    epicsMutexMustLock(scc->emu.lock);
+    uartEmuAccess(&scc->emu);
+    switch (reg) {
+        case 0: case 8:         /* MR1/MR2 */
+            pch->mr[pch->mrPtr] = value;
+            pch->mrPtr = 1;
+            break;
+        case 1: case 9:         /* CSR */
+            pch->csr = value;
+            break;
+        case 2: case 10:        /* CR */
+            command(scc, chan, value);
+            break;
+        case 3: case 11:        /* THR */
+            if (pch->txEnabled) {
+                pch->thr = value;
+                pch->thrFull = 1;
+                uartEmuTxKick(&scc->emu, chan);
+            }
+            break;
+        case 4:                 /* ACR */
+            pblk->acr = value;
+            break;
+        case 5:                 /* IMR */
+            pblk->imr = value;
+            break;
+        case 6:                 /* CTU */
+            pblk->ctu = value;
+            break;
+        case 7:                 /* CTL */
+            pblk->ctl = value;
+            break;
+    }
+    epicsMutexUnlock(scc->emu.lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    scc2698EmuCreate
+
+Purpose:
+    Attaches an SCC2698 emulator to a test carrier slot's I/O space
+
+Returns:
+    The emulator, or NULL on failure.
+
+*/
+
+uartEmu *scc2698EmuCreate (
+    int carrier,
+    int slot
+) {
+    scc2698Emu *scc = (scc2698Emu *) calloc(1, sizeof(scc2698Emu));
+
+    if (scc == NULL)
+        return NULL;
+    if (uartEmuInit(&scc->emu, &scc2698Ops, carrier, slot, 8) ||
+        ipacTestRegisters(carrier, slot, regRead, regWrite, scc)) {
+        free(scc);
+        return NULL;
+    }
+    return &scc->emu;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    scc2698EmuRxError
+
+Purpose:
+    Gives the next character to arrive at a channel receive errors
+
+Description:
+    The SR bits given, parity (0x20), framing (0x40) or received break
+    (0x80), are set in the channel's SR when that character arrives and
+    stay set until a reset error status command.
+
+*/
+
+void scc2698EmuRxError (
+    uartEmu *emu,
+    int chan,
+    int sr
+) {
+    scc2698Emu *scc = (scc2698Emu *) emu;
+
+    epicsMutexMustLock(emu->lock);
+    scc->chan[chan].rxError |= sr & 0xe0;
+    epicsMutexUnlock(emu->lock);
+}
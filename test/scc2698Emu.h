@@ -0,0 +1,31 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    scc2698Emu.h
+
+Description:
+    Register emulator for the SCC2698 octal UART of the GreenSpring
+    Ip_Octal modules.
+
+*******************************************************************************/
+
+#ifndef INCscc2698EmuH
+#define INCscc2698EmuH
+
+#include "uartEmu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uartEmu *scc2698EmuCreate(int carrier, int slot);
+void scc2698EmuRxError(uartEmu *emu, int chan, int sr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCscc2698EmuH */
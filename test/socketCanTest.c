@@ -0,0 +1,280 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    socketCanTest.c
+
+Description:
+    Tests the SocketCAN driver on a virtual CAN interface.  A second raw
+    socket on the same interface sends frames to the driver and receives
+    those it writes.  The kernel receive filters must pass every identifier
+    that has a callback, including after the extended identifier list has
+    overflowed, and filter updates on two buses at once must not disturb
+    each other.  The bus and interface names given to socketCanCreate
+    must be copied, as iocsh reuses its argument buffers.  A canWriteAsync
+    callback runs on the echo of the sent frame, which must not reach the
+    bus's own message callbacks.  Needs vcan0,
+    and vcan1 for the two bus test:
+	ip link add dev vcan0 type vcan
+	ip link set up vcan0
+
+*******************************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "canBus.h"
+#include "drvSocketCan.h"
+
+
+#define NEXTENDED 513		/* One more than the driver's filter list */
+#define NTOGGLE 200		/* IDs switched on and off by each thread */
+
+static volatile int received[2][CAN_IDENTIFIERS];
+static volatile int receivedExt;
+static volatile int sent, sentStatus;
+
+
+static void stdCallback(void *pprivate, const canMessage_t *pmessage)
+{
+    volatile int *count = pprivate;
+
+    count[pmessage->identifier]++;
+}
+
+static void extCallback(void *pprivate, const canMessage_t *pmessage)
+{
+    receivedExt++;
+}
+
+static void queued(void *pprivate, const canMessage_t *pmessage, int status)
+{
+    sentStatus = status;
+    sent++;
+}
+
+static int waitFor(volatile int *pcount, int want)
+{
+    int i;
+
+    for (i = 0; i < 100 && *pcount < want; i++)
+	epicsThreadSleep(0.01);
+    return *pcount >= want;
+}
+
+
+/* The peer end of the virtual bus */
+
+static int peerOpen(const char *ifName)
+{
+    struct sockaddr_can addr;
+    int sock = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+
+    if (sock < 0)
+	return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = if_nametoindex(ifName);
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+	close(sock);
+	return -1;
+    }
+    return sock;
+}
+
+static void peerSend(int sock, canID_t identifier)
+{
+    struct can_frame frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = (identifier & CAN_EXTENDED) ?
+	CAN_EFF_FLAG | (identifier & ~CAN_EXTENDED) : identifier;
+    frame.can_dlc = 1;
+    frame.data[0] = 0x5a;
+    if (write(sock, &frame, sizeof(frame)) != sizeof(frame))
+	testDiag("peer write failed");
+}
+
+static int peerReceive(int sock, struct can_frame *pframe)
+{
+    struct pollfd pfd;
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, 1000) == 1 &&
+	read(sock, pframe, sizeof(*pframe)) == sizeof(*pframe);
+}
+
+
+static void testTraffic(canBusID_t bus, int peer)
+{
+    canMessage_t message;
+    struct can_frame frame;
+
+    testDiag("Standard frames");
+    testOk1(canMessage(bus, 0x123, stdCallback, (void *) received[0]) == 0);
+    peerSend(peer, 0x124);
+    peerSend(peer, 0x123);
+    testOk(waitFor(&received[0][0x123], 1), "Frame with a callback received");
+    testOk(received[0][0x124] == 0, "Frame without a callback ignored");
+
+    memset(&message, 0, sizeof(message));
+    message.identifier = 0x321;
+    message.length = 2;
+    message.data[0] = 1;
+    message.data[1] = 2;
+    testOk1(canWrite(bus, &message, 1.0) == 0);
+    testOk(peerReceive(peer, &frame) && frame.can_id == 0x321 &&
+	frame.can_dlc == 2 && frame.data[1] == 2, "canWrite frame sent");
+    canMsgDelete(bus, 0x123, stdCallback, (void *) received[0]);
+
+    testDiag("canWriteAsync completion");
+    canMessage(bus, 0x321, stdCallback, (void *) received[0]);
+    sentStatus = -1;
+    testOk1(canWriteAsync(bus, &message, 0, queued, NULL) == 0);
+    testOk(waitFor(&sent, 1) && sentStatus == 0 && peerReceive(peer, &frame),
+	"Callback on the echo");
+    epicsThreadSleep(0.05);
+    testOk(received[0][0x321] == 0, "Echo not received as a message");
+    canMsgDelete(bus, 0x321, stdCallback, (void *) received[0]);
+}
+
+static void testOverflow(canBusID_t bus, int peer)
+{
+    canID_t last = CAN_EXTENDED | (0x100000 + NEXTENDED - 1);
+    int i, ok = 1;
+
+    testDiag("Extended identifier list overflow");
+    for (i = 0; i < NEXTENDED; i++)
+	if (canMessage(bus, CAN_EXTENDED | (0x100000 + i), extCallback, NULL))
+	    ok = 0;
+    testOk(ok, "%d extended callbacks added", NEXTENDED);
+
+    receivedExt = 0;
+    peerSend(peer, last);
+    testOk(waitFor(&receivedExt, 1), "Identifier past the list received");
+
+    /* Back within the list size, but the last ID was never recorded */
+    canMsgDelete(bus, CAN_EXTENDED | 0x100000, extCallback, NULL);
+    receivedExt = 0;
+    peerSend(peer, last);
+    testOk(waitFor(&receivedExt, 1), "Still received after a delete");
+
+    for (i = 1; i < NEXTENDED; i++)
+	canMsgDelete(bus, CAN_EXTENDED | (0x100000 + i), extCallback, NULL);
+    testOk1(canMessage(bus, CAN_EXTENDED | 0x1234567, extCallback, NULL) == 0);
+    receivedExt = 0;
+    peerSend(peer, CAN_EXTENDED | 0x1234567);
+    testOk(waitFor(&receivedExt, 1), "Filters work after the list empties");
+    canMsgDelete(bus, CAN_EXTENDED | 0x1234567, extCallback, NULL);
+}
+
+
+/* Filter updates on two buses at once */
+
+typedef struct {
+    canBusID_t bus;
+    volatile int *count;
+    epicsEventId done;
+} toggler_t;
+
+static void toggleThread(void *parm)
+{
+    toggler_t *ptog = parm;
+    int round, id;
+
+    for (round = 0; round < 5; round++) {
+	for (id = 0x400; id < 0x400 + NTOGGLE; id++)
+	    canMessage(ptog->bus, id, stdCallback, (void *) ptog->count);
+	for (id = 0x400; id < 0x400 + NTOGGLE; id++)
+	    if (id & 1)
+		canMsgDelete(ptog->bus, id, stdCallback, (void *) ptog->count);
+	if (round < 4)
+	    for (id = 0x400; id < 0x400 + NTOGGLE; id += 2)
+		canMsgDelete(ptog->bus, id, stdCallback, (void *) ptog->count);
+    }
+    epicsEventSignal(ptog->done);
+}
+
+static void testTwoBuses(canBusID_t bus0, canBusID_t bus1, int peer0,
+    int peer1)
+{
+    toggler_t tog[2];
+    int i, id, missed = 0;
+
+    testDiag("Concurrent filter updates on two buses");
+    tog[0].bus = bus0;
+    tog[1].bus = bus1;
+    for (i = 0; i < 2; i++) {
+	tog[i].count = received[i];
+	tog[i].done = epicsEventMustCreate(epicsEventEmpty);
+	epicsThreadCreate("toggle", epicsThreadPriorityMedium,
+	    epicsThreadGetStackSize(epicsThreadStackSmall),
+	    toggleThread, &tog[i]);
+    }
+    for (i = 0; i < 2; i++)
+	epicsEventMustWait(tog[i].done);
+
+    /* Even IDs are left enabled on both buses */
+    for (id = 0x400; id < 0x400 + NTOGGLE; id += 2) {
+	peerSend(peer0, id);
+	peerSend(peer1, id);
+    }
+    epicsThreadSleep(0.5);
+    for (id = 0x400; id < 0x400 + NTOGGLE; id += 2)
+	missed += !received[0][id] + !received[1][id];
+    testOk(missed == 0, "All enabled frames received (%d missed)", missed);
+}
+
+
+MAIN(socketCanTest)
+{
+    canBusID_t bus0, bus1;
+    char busName[16], ifName[IFNAMSIZ];
+    int peer0, peer1, twoBuses, status;
+
+    testPlan(18);
+
+    /* Names in a buffer that is reused, as iocsh does */
+    strcpy(busName, "vcanTest0");
+    strcpy(ifName, "vcan0");
+    status = socketCanCreate(busName, ifName);
+    if (status == S_socketCan_noInterface) {
+	testSkip(18, "No vcan0 interface");
+	return testDone();
+    }
+    testOk(status == 0, "socketCanCreate vcan0 (status %#x)", status);
+    strcpy(busName, "overwritten");
+    strcpy(ifName, "vcan9");
+    twoBuses = socketCanCreate("vcanTest1", "vcan1") == 0;
+    testOk1(socketCanInitialise() == 0);
+    testOk(canOpen("vcanTest0", &bus0) == 0, "Bus name copied");
+    testOk(socketCanCreate("vcanTest2", "vcan0") ==
+	S_socketCan_duplicateDevice, "Interface name copied");
+    peer0 = peerOpen("vcan0");
+
+    testTraffic(bus0, peer0);
+    testOverflow(bus0, peer0);
+
+    if (twoBuses && canOpen("vcanTest1", &bus1) == 0 &&
+	(peer1 = peerOpen("vcan1")) >= 0) {
+	testTwoBuses(bus0, bus1, peer0, peer1);
+    }
+    else {
+	testSkip(1, "No vcan1 interface");
+    }
+
+    return testDone();
+}
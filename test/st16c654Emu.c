@@ -0,0 +1,551 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    st16c654Emu.c
+
+Description:
+    Register emulator for the IP520's UARTs, two ST16C654s giving eight
+    16C554-style register sets at odd byte addresses, 16 bytes apart (see
+    struct regmap in IP520Int.h).  Modelled are the divisor latch and the
+    MCR[7] clock prescaler on the module's 921.6kHz baud clock, the
+    enhanced feature register set selected by LCR=0xBF, the 64 character
+    Rx and Tx FIFOs with the four Rx trigger levels, the receive timeout
+    after 4 idle character times, and interrupt identification with the
+    usual priorities.  A character arriving at a full Rx FIFO is lost and
+    sets the overrun bit.  MCR[3] gates the port's interrupt output.
+    Parity, framing and break errors are only set by st16c654EmuRxError.
+    Modem signals and automatic flow control are not modelled.
+
+    This file is only built into the test programs.
+
+*******************************************************************************/
+
+/* ANSI headers */
+#include <stdlib.h>
+
+/* EPICS headers */
+#include <epicsTypes.h>
+
+/* Module headers */
+#include "ipacTestCarrier.h"
+#include "st16c654Emu.h"
+
+
+#define PORTS 8
+#define FIFO_SIZE 64
+#define BAUD_CLOCK 921600.0     /* 14.7456MHz / 16 */
+
+/* Interrupt identification codes */
+#define IIR_NONE    0x01
+#define IIR_THRE    0x02
+#define IIR_RXDATA  0x04
+#define IIR_LINE    0x06
+#define IIR_TIMEOUT 0x0c
+#define IIR_FIFOS   0xc0
+
+/* Line status bits */
+#define LSR_DR      0x01
+#define LSR_OE      0x02
+#define LSR_ERRORS  0x1c        /* Parity, framing, break */
+#define LSR_THRE    0x20
+#define LSR_TEMT    0x40
+#define LSR_FIFOERR 0x80
+
+
+/* Port state */
+
+typedef struct {
+    char rx[FIFO_SIZE];
+    epicsUInt8 rxErr[FIFO_SIZE];    /* LSR error bits of each character */
+    epicsUInt8 rxErrNext;       /* For the next character to arrive */
+    int rxHead;
+    int rxCount;
+    double rxLast;              /* Last arrival or RBR read */
+    char rbr;                   /* Last character read */
+    char tx[FIFO_SIZE];
+    int txHead;
+    int txCount;
+    int threPending;            /* THR empty interrupt not yet identified */
+    int overrun;
+    int fifos;                  /* FCR[0] */
+    int trigger;                /* Rx trigger level */
+    epicsUInt8 ier, lcr, mcr, scr;
+    epicsUInt8 dll, dlm, efr;
+    epicsUInt8 xonxoff[4];
+    double mcrChanged;          /* When MCR was last changed */
+} port_t;
+
+typedef struct {
+    uartEmu emu;                /* Must be first */
+    port_t port[PORTS];
+} st16c654Emu;
+
+
+/*******************************************************************************
+
+Routine:
+    charTime
+
+Purpose:
+    Seconds per character: start bit, data, parity and stop bits
+
+Description:
+    A port with a zero divisor has no clock, and runs so slowly that no
+    character completes.
+
+*/
+
+static double charTime (
+    uartEmu *emu,
+    int chan
+) {
+    port_t *pp = &((st16c654Emu *) emu)->port[chan];
+    int divisor = pp->dlm << 8 | pp->dll;
+    int bits = 1 + 5 + (pp->lcr & 0x03);
+    double baud;
+
+    if (divisor == 0)
+        return 1e6;
+    baud = BAUD_CLOCK / divisor / ((pp->mcr & 0x80) ? 4 : 1);
+    if (pp->lcr & 0x08)         /* Parity bit */
+        bits++;
+    bits += (pp->lcr & 0x04) ? 2 : 1;
+    return bits / baud;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rxChar, txNext
+
+Purpose:
+    Characters into the Rx FIFO and out of the Tx FIFO
+
+*/
+
+static void rxChar (
+    uartEmu *emu,
+    int chan,
+    char c
+) {
+    port_t *pp = &((st16c654Emu *) emu)->port[chan];
+    int size = pp->fifos ? FIFO_SIZE : 1;
+
+    pp->rxLast = emu->now;
+    if (pp->rxCount >= size) {
+        pp->overrun = 1;
+        emu->chan[chan].rxLost++;
+        return;
+    }
+    pp->rxErr[(pp->rxHead + pp->rxCount) % FIFO_SIZE] = pp->rxErrNext;
+    pp->rx[(pp->rxHead + pp->rxCount++) % FIFO_SIZE] = c;
+    pp->rxErrNext = 0;
+}
+
+static int txNext (
+    uartEmu *emu,
+    int chan,
+    char *pc
+) {
+    port_t *pp = &((st16c654Emu *) emu)->port[chan];
+
+    if (pp->txCount == 0)
+        return 0;
+    *pc = pp->tx[pp->txHead];
+    pp->txHead = (pp->txHead + 1) % FIFO_SIZE;
+    if (--pp->txCount == 0)
+        pp->threPending = 1;
+    return 1;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    timeoutDue, identify
+
+Purpose:
+    When the Rx timeout fires, and the port's highest priority interrupt
+
+*/
+
+static double timeoutDue (
+    st16c654Emu *uart,
+    int port
+) {
+    port_t *pp = &uart->port[port];
+
+    return pp->rxLast + 4 * charTime(&uart->emu, port);
+}
+
+static int identify (
+    st16c654Emu *uart,
+    int port
+) {
+    port_t *pp = &uart->port[port];
+
+    if ((pp->ier & 0x04) && pp->overrun)
+        return IIR_LINE;
+    if ((pp->ier & 0x01) && pp->rxCount >= pp->trigger)
+        return IIR_RXDATA;
+    if ((pp->ier & 0x01) && pp->fifos && pp->rxCount &&
+        uart->emu.now >= timeoutDue(uart, port))
+        return IIR_TIMEOUT;
+    if ((pp->ier & 0x02) && pp->threPending)
+        return IIR_THRE;
+    return IIR_NONE;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    irq, timer
+
+Purpose:
+    Interrupt request output, and the next Rx timeout
+
+*/
+
+static int irq (
+    uartEmu *emu
+) {
+    st16c654Emu *uart = (st16c654Emu *) emu;
+    int port;
+
+    for (port = 0; port < PORTS; port++)
+        if ((uart->port[port].mcr & 0x08) &&
+            identify(uart, port) != IIR_NONE)
+            return 1;
+    return 0;
+}
+
+static double timer (
+    uartEmu *emu
+) {
+    st16c654Emu *uart = (st16c654Emu *) emu;
+    double next = 0;
+    int port;
+
+    for (port = 0; port < PORTS; port++) {
+        port_t *pp = &uart->port[port];
+        double due;
+
+        if (!(pp->ier & 0x01) || !pp->fifos || !pp->rxCount)
+            continue;
+        due = timeoutDue(uart, port);
+        if (due > emu->now && (next == 0 || due < next))
+            next = due;
+    }
+    return next;
+}
+
+static const uartEmuOps st16c654Ops = {
+    rxChar, txNext, charTime, irq, timer
+};
+
+
+/*******************************************************************************
+
+Routine:
+    fifoControl
+
+Purpose:
+    Executes an FCR write
+
+*/
+
+static void fifoControl (
+    port_t *pp,
+    epicsUInt8 fcr
+) {
+    static const int triggers[4] = {8, 16, 56, 60};
+    int fifos = fcr & 0x01;
+
+    if (fifos != pp->fifos)
+        fcr |= 0x06;            /* Changing mode clears both FIFOs */
+    pp->fifos = fifos;
+    if (fcr & 0x02)
+        pp->rxCount = 0;
+    if (fcr & 0x04) {
+        pp->txCount = 0;
+        pp->threPending = 1;
+    }
+    pp->trigger = fifos ? triggers[fcr >> 6] : 1;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    regRead, regWrite
+
+Purpose:
+    Register access routines for ipacTestRegisters()
+
+*/
+
+static epicsUInt32 regRead (
+    void *pvt,
+    size_t offset,
+    int size
+) {
+    st16c654Emu *uart = (st16c654Emu *) pvt;
+    int port = offset / 16;
+    int reg = (offset % 16) / 2;
+    port_t *pp;
+    int enhanced;
+    epicsUInt32 value = 0xff;
+
+    if (port >= PORTS)
+        return value;
+    pp = &uart->port[port];
+
+    epicsMutexMustLock(uart->emu.lock);
+    uartEmuAccess(&uart->emu);
+    enhanced = (pp->lcr == 0xbf);
+    switch (reg) {
+        case 0:
+            if (pp->lcr & 0x80)
+                value = pp->dll;
+            else {
+                if (pp->rxCount) {
+                    pp->rbr = pp->rx[pp->rxHead];
+                    pp->rxHead = (pp->rxHead + 1) % FIFO_SIZE;
+                    pp->rxCount--;
+                }
+                pp->rxLast = uart->emu.now;
+                value = (epicsUInt8) pp->rbr;
+            }
+            break;
+        case 1:
+            value = (pp->lcr & 0x80) ? pp->dlm : pp->ier;
+            break;
+        case 2:
+            if (enhanced)
+                value = pp->efr;
+            else {
+                value = identify(uart, port);
+                if (value == IIR_THRE)
+                    pp->threPending = 0;
+                if (pp->fifos)
+                    value |= IIR_FIFOS;
+            }
+            break;
+        case 3:
+            value = pp->lcr;
+            break;
+        case 4:
+            value = enhanced ? pp->xonxoff[0] : pp->mcr;
+            break;
+        case 5:
+            if (enhanced)
+                value = pp->xonxoff[1];
+            else {
+                int i;
+
+                value = 0;
+                if (pp->rxCount) {
+                    value |= LSR_DR | pp->rxErr[pp->rxHead];
+                    pp->rxErr[pp->rxHead] = 0;  /* Cleared by reading */
+                }
+                for (i = 0; i < pp->rxCount; i++)
+                    if (pp->rxErr[(pp->rxHead + i) % FIFO_SIZE])
+                        value |= LSR_FIFOERR;
+                if (pp->overrun)
+                    value |= LSR_OE;
+                if (pp->txCount == 0) {
+                    value |= LSR_THRE;
+                    if (!uart->emu.chan[port].txBusy)
+                        value |= LSR_TEMT;
+                }
+                pp->overrun = 0;
+            }
+            break;
+        case 6:
+            value = enhanced ? pp->xonxoff[2] : 0x30;   /* DSR, CTS */
+            break;
+        case 7:
+            value = enhanced ? pp->xonxoff[3] : pp->scr;
+            break;
+    }
+    epicsMutexUnlock(uart->emu.lock);
+    return value;
+}
+
+static void regWrite (
+    void *pvt,
+    size_t offset,
+    int size,
+    epicsUInt32 value
+) {
+    st16c654Emu *uart = (st16c654Emu *) pvt;
+    int port = offset / 16;
+    int reg = (offset % 16) / 2;
+    port_t *pp;
+    int enhanced;
+
+    if (port >= PORTS)
+        return;
+    pp = &uart->port[port];
+
+    epicsMutexMustLock(uart->emu.lock);
+    uartEmuAccess(&uart->emu);
+    enhanced = (pp->lcr == 0xbf);
+    switch (reg) {
+        case 0:
+            if (pp->lcr & 0x80)
+                pp->dll = value;
+            else if (pp->txCount < (pp->fifos ? FIFO_SIZE : 1)) {
+                pp->tx[(pp->txHead + pp->txCount++) % FIFO_SIZE] = value;
+                pp->threPending = 0;
+                uartEmuTxKick(&uart->emu, port);
+            }
+            break;
+        case 1:
+            if (pp->lcr & 0x80)
+                pp->dlm = value;
+            else {
+                if ((value & 0x02) && !(pp->ier & 0x02) && !pp->txCount)
+                    pp->threPending = 1;
+                pp->ier = value;
+            }
+            break;
+        case 2:
+            if (enhanced)
+                pp->efr = value;
+            else
+                fifoControl(pp, value);
+            break;
+        case 3:
+            pp->lcr = value;
+            break;
+        case 4:
+            if (enhanced)
+                pp->xonxoff[0] = value;
+            else {
+                epicsUInt8 mcr = pp->mcr;
+
+                if (pp->efr & 0x10)
+                    pp->mcr = value;
+                else            /* MCR[7] needs the enhanced functions */
+                    pp->mcr = (pp->mcr & 0x80) | (value & 0x7f);
+                if (pp->mcr != mcr)
+                    pp->mcrChanged = uart->emu.now;
+            }
+            break;
+        case 5:
+            if (enhanced)
+                pp->xonxoff[1] = value;
+            break;
+        case 6:
+            if (enhanced)
+                pp->xonxoff[2] = value;
+            break;
+        case 7:
+            if (enhanced)
+                pp->xonxoff[3] = value;
+            else
+                pp->scr = value;
+            break;
+    }
+    epicsMutexUnlock(uart->emu.lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    st16c654EmuCreate
+
+Purpose:
+    Attaches an IP520 UART emulator to a test carrier slot's I/O space
+
+Returns:
+    The emulator, or NULL on failure.
+
+*/
+
+uartEmu *st16c654EmuCreate (
+    int carrier,
+    int slot
+) {
+    st16c654Emu *uart = (st16c654Emu *) calloc(1, sizeof(st16c654Emu));
+    int port;
+
+    if (uart == NULL)
+        return NULL;
+    for (port = 0; port < PORTS; port++) {
+        uart->port[port].trigger = 1;
+        uart->port[port].threPending = 1;
+    }
+    if (uartEmuInit(&uart->emu, &st16c654Ops, carrier, slot, PORTS) ||
+        ipacTestRegisters(carrier, slot, regRead, regWrite, uart)) {
+        free(uart);
+        return NULL;
+    }
+    return &uart->emu;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    st16c654EmuMcr
+
+Purpose:
+    Returns a port's modem control register, and when it last changed
+
+Description:
+    MCR[1] drives RTS, which enables the line driver of an RS485 port.
+
+*/
+
+int st16c654EmuMcr (
+    uartEmu *emu,
+    int port,
+    double *pchanged
+) {
+    port_t *pp = &((st16c654Emu *) emu)->port[port];
+    int mcr;
+
+    epicsMutexMustLock(emu->lock);
+    mcr = pp->mcr;
+    if (pchanged)
+        *pchanged = pp->mcrChanged;
+    epicsMutexUnlock(emu->lock);
+    return mcr;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    st16c654EmuRxError
+
+Purpose:
+    Marks the next character to arrive at a port with receive errors
+
+Description:
+    The LSR bits given, parity (0x04), framing (0x08) or break (0x10),
+    show in the LSR while that character is at the top of the Rx FIFO,
+    until the LSR is read.  LSR[7] is set while any character in the
+    FIFO has an error.
+
+*/
+
+void st16c654EmuRxError (
+    uartEmu *emu,
+    int port,
+    int lsr
+) {
+    port_t *pp = &((st16c654Emu *) emu)->port[port];
+
+    epicsMutexMustLock(emu->lock);
+    pp->rxErrNext |= lsr & LSR_ERRORS;
+    epicsMutexUnlock(emu->lock);
+}
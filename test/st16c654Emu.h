@@ -0,0 +1,32 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    st16c654Emu.h
+
+Description:
+    Register emulator for the two ST16C654 quad UARTs of the Acromag IP520,
+    which extend the 16C554 register set with 64 character FIFOs.
+
+*******************************************************************************/
+
+#ifndef INCst16c654EmuH
+#define INCst16c654EmuH
+
+#include "uartEmu.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uartEmu *st16c654EmuCreate(int carrier, int slot);
+int st16c654EmuMcr(uartEmu *emu, int port, double *pchanged);
+void st16c654EmuRxError(uartEmu *emu, int port, int lsr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCst16c654EmuH */
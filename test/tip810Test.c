@@ -0,0 +1,174 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    tip810Test.c
+
+Description:
+    Runs the TIP810 driver in PeliCAN mode on a memory-backed slot, where
+    the SJA1000 registers are plain memory.  Each acceptance filter set
+    with t810Filter must land in the ACR and AMR registers in the layout
+    the chip uses for its frame format, without disturbing the other
+    filter's bits.  The chip mask registers use 1 for don't care.
+    A canWriteAsync callback must not run when the frame is handed to
+    the chip, only on the transmit interrupt, with S_can_txFailed if the
+    chip didn't complete it, or when the bus goes off.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include <epicsThread.h>
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "drvIpac.h"
+#include "ipacTestCarrier.h"
+#include "canBus.h"
+#include "drvTip810.h"
+#include "sja1000.h"
+
+
+#define BUS "tip810"
+#define TEWS 0xb3
+#define TIP810 0x01
+
+static sja1000_t *psja;
+static int carrier;
+static volatile int done, doneStatus;
+
+
+static int acr(int n)
+{
+	return psja->SJA_ACR(n);
+}
+
+static int amr(int n)
+{
+	return psja->SJA_AMR(n);
+}
+
+static void testSingle(void)
+{
+	testDiag("Single filter, extended frames");
+	testOk1(t810Filter(BUS, 0, CAN_EXTENDED | 0x12345678, 0x1fffffff) == 0);
+	testOk1(psja->mode & SJA_MOD_AFM);
+	testOk(acr(0) == 0x91 && acr(1) == 0xa2 && acr(2) == 0xb3 &&
+		acr(3) == 0xc0, "ACR holds ID.28 to ID.0");
+	testOk(amr(0) == 0 && amr(1) == 0 && amr(2) == 0 && amr(3) == 0x07,
+		"AMR compares ID.28 to ID.0 only");
+}
+
+static void testDualExtended(void)
+{
+	testDiag("Dual filters, both extended");
+	testOk1(t810Filter(BUS, 1, CAN_EXTENDED | 0x12345678, 0x1fffe000) == 0);
+	testOk1(!(psja->mode & SJA_MOD_AFM));
+	testOk(acr(0) == 0x91 && acr(1) == 0xa2 && amr(0) == 0 && amr(1) == 0,
+		"Filter 1 compares ID.28 to ID.13");
+	testOk(acr(2) == 0x91 && acr(3) == 0xa2 && amr(2) == 0 && amr(3) == 0,
+		"Filter 2 copied from filter 1");
+
+	testOk1(t810Filter(BUS, 2, CAN_EXTENDED | 0x0abcdef0, 0x1fffe000) == 0);
+	testOk(acr(2) == 0x55 && acr(3) == 0xe6 && amr(2) == 0 && amr(3) == 0,
+		"Filter 2 compares ID.28 to ID.13");
+	testOk(acr(0) == 0x91 && acr(1) == 0xa2 && amr(0) == 0 && amr(1) == 0,
+		"Filter 1 unchanged, still compares ID.16 to ID.13");
+}
+
+static void testDualMixed(void)
+{
+	testDiag("Dual filters, standard then extended");
+	testOk1(t810Filter(BUS, 1, 0x123, 0x7ff) == 0);
+	testOk(acr(0) == 0x24 && acr(1) == 0x60 && amr(0) == 0 && amr(1) == 0x1f,
+		"Filter 1 compares ID.10 to ID.0, not RTR or data");
+	testOk1(t810Filter(BUS, 2, CAN_EXTENDED | 0x0abcdef0, 0x1fffe000) == 0);
+	testOk(acr(2) == 0x55 && acr(3) == 0xe6 && amr(2) == 0 && amr(3) == 0x0f,
+		"Filter 2 compares ID.28 to ID.17, leaving data to filter 1");
+	testOk(acr(0) == 0x24 && acr(1) == 0x60 && amr(0) == 0 && amr(1) == 0x1f,
+		"Filter 1 unchanged");
+}
+
+static void queued(void *pprivate, const canMessage_t *pmessage, int status)
+{
+	doneStatus = status;
+	done++;
+}
+
+static int waitFor(int want)
+{
+	int i;
+
+	for (i = 0; i < 100 && done < want; i++)
+		epicsThreadSleep(0.01);
+	return done >= want;
+}
+
+/* Queue a frame, let canTxTask hand it to the chip, then raise the given
+ * interrupt with the given status.  Returns TRUE if the callback had not
+ * run before the interrupt.
+ */
+
+static int txInterrupt(canBusID_t bus, int intSource, int status)
+{
+	canMessage_t message;
+	int early;
+
+	memset(&message, 0, sizeof(message));
+	message.identifier = 0x321;
+	message.length = 2;
+	message.data[0] = done;
+	psja->status = SJA_SR_TBS;
+	canWriteAsync(bus, &message, 0, queued, NULL);
+	epicsThreadSleep(0.1);
+	early = done;
+
+	psja->status = status;
+	psja->interrupt = intSource;
+	ipacTestInterrupt(carrier, 0);
+	psja->interrupt = 0;
+	return !early;
+}
+
+static void testTxDone(void)
+{
+	canBusID_t bus;
+
+	testDiag("canWriteAsync completion");
+	testOk1(t810Initialise() == 0);
+	testOk1(canOpen(BUS, &bus) == 0 && canWriteAsyncStart(bus) == 0);
+
+	done = 0;
+	testOk(txInterrupt(bus, SJA_IR_TI, SJA_SR_TBS | SJA_SR_TCS),
+		"No callback on hand-over to the chip");
+	testOk(waitFor(1) && doneStatus == 0, "Sent on transmit interrupt");
+
+	txInterrupt(bus, SJA_IR_TI, SJA_SR_TBS);
+	testOk(waitFor(2) && doneStatus == S_can_txFailed,
+		"Failed without transmission complete");
+
+	txInterrupt(bus, SJA_IR_EI, SJA_SR_BS | SJA_SR_ES);
+	testOk(waitFor(3) && doneStatus == S_can_txFailed,
+		"Failed at bus off");
+}
+
+
+MAIN(tip810Test)
+{
+	testPlan(24);
+
+	carrier = ipacAddTestCarrier("SLOTS=1");
+	ipacTestSetId(carrier, 0, TEWS, TIP810);
+	psja = ipacTestSlot(carrier, 0, ipac_addrIO);
+
+	testOk1(t810Create(BUS, carrier, 0, 0x60, 500, T810_MODE_PELICAN) == 0);
+	testOk1(psja->clockDivider & SJA_CDR_CANMODE);
+	testSingle();
+	testDualExtended();
+	testDualMixed();
+	testTxDone();
+
+	return testDone();
+}
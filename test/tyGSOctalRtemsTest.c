@@ -0,0 +1,310 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    tyGSOctalRtemsTest.c
+
+Description:
+    Runs the RTEMS tyGSOctal driver against the SCC2698 register emulator,
+    through the RTEMS shim.  The driver's uptime clock runs the emulator,
+    so time passes while a polled write busy-waits on the UART.  Interrupt
+    driven output must keep the line busy and load an idle transmitter
+    with two characters.  Polled output must do the same without taking
+    interrupts.  Framing and break errors injected into the emulator must
+    reach the port's error counters.  With CRTSCTS set a polled write held off by CTS must wait
+    for as long as it takes and lose nothing; without it a transmitter
+    that is held off is stuck, and the write must give up after
+    TYGS_TXRDY_WAIT, or 4 character times at slow rates, and count it.
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "rtems/libio.h"
+#include "rtemsShim.h"
+
+#include "drvIpac.h"
+#include "ipacTestCarrier.h"
+#include "scc2698Emu.h"
+#include "ip_modules.h"
+
+typedef void *TY_DEV;               /* As in tyGSOctal_RTEMS.c */
+#include "tyGSOctal.h"
+
+
+#define MODULE "gs"
+#define BAUD 38400
+#define CHAR_TIME (10.0 / BAUD)     /* 8N1 */
+#define NRX 100
+#define NTX 1000
+#define STEP 1e-6                   /* Emulator time per clock reading */
+#define TXRDY_WAIT (TYGS_TXRDY_WAIT * 1e-6)
+
+static uartEmu *emu;
+static int fd[8];
+static double releaseAt;            /* uartEmuTxStall() ends, if non-zero */
+static int releasePort;
+static char sent[NTX], got[NTX];
+
+
+/* The driver's uptime clock.  Each reading runs the emulator on a little,
+ * except from inside the emulator's own interrupt calls, and releases a
+ * stalled transmitter once releaseAt has passed.
+ */
+
+static double emuClock(void *pvt)
+{
+    static int running;
+
+    if (!running) {
+        running = 1;
+        uartEmuRun(emu, STEP);
+        running = 0;
+    }
+    if (releaseAt > 0 && uartEmuTime(emu) >= releaseAt) {
+        uartEmuTxStall(emu, releasePort, 0);
+        releaseAt = 0;
+    }
+    return uartEmuTime(emu);
+}
+
+static void pattern(char *buffer, int len, int seed)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        buffer[i] = (i * 7 + seed) & 0xff;
+}
+
+static int setBaud(int port, speed_t speed)
+{
+    struct termios termios;
+
+    if (rtemsShimIoctl(fd[port], RTEMS_IO_GET_ATTRIBUTES, &termios))
+        return -1;
+    cfsetispeed(&termios, speed);
+    cfsetospeed(&termios, speed);
+    return rtemsShimIoctl(fd[port], RTEMS_IO_SET_ATTRIBUTES, &termios);
+}
+
+static int setFlow(int port, int on)
+{
+    struct termios termios;
+
+    if (rtemsShimIoctl(fd[port], RTEMS_IO_GET_ATTRIBUTES, &termios))
+        return -1;
+    if (on)
+        termios.c_cflag |= CRTSCTS;
+    else
+        termios.c_cflag &= ~CRTSCTS;
+    return rtemsShimIoctl(fd[port], RTEMS_IO_SET_ATTRIBUTES, &termios);
+}
+
+static double txRate(int port)
+{
+    uartEmuChan *pch = &emu->chan[port];
+
+    return (pch->txChars - 1) / (pch->txLast - pch->txFirst);
+}
+
+
+static void testRx(void)
+{
+    int n;
+
+    testDiag("Receive at %d baud", BAUD);
+    testOk1(setBaud(0, B38400) == 0);
+    pattern(sent, NRX, 0);
+    uartEmuSend(emu, 0, sent, NRX);
+    uartEmuRun(emu, NRX * CHAR_TIME + 0.01);
+    n = rtemsShimRead(fd[0], got, sizeof(got));
+    testOk(n == NRX && memcmp(sent, got, NRX) == 0,
+        "%d characters received intact", NRX);
+}
+
+static void testErrors(void)
+{
+    unsigned long before[TYGS_NERRS], after[TYGS_NERRS];
+
+    testDiag("Receive errors");
+    testOk1(setBaud(1, B38400) == 0);
+    tyGSOctalErrCounts(MODULE, 1, before);
+    scc2698EmuRxError(emu, 1, 0x40);            /* Framing */
+    uartEmuSend(emu, 1, "a", 1);
+    uartEmuRun(emu, 0.01);
+    scc2698EmuRxError(emu, 1, 0x80);            /* Break */
+    uartEmuSend(emu, 1, "", 1);
+    uartEmuRun(emu, 0.01);
+    rtemsShimRead(fd[1], got, sizeof(got));
+    tyGSOctalErrCounts(MODULE, 1, after);
+
+    testOk(after[TYGS_ERR_FRAMING] == before[TYGS_ERR_FRAMING] + 1 &&
+        after[TYGS_ERR_BREAK] == before[TYGS_ERR_BREAK] + 1,
+        "Framing error and break counted once each");
+    testOk(after[TYGS_ERR_PARITY] == before[TYGS_ERR_PARITY] &&
+        after[TYGS_ERR_OVERRUN] == before[TYGS_ERR_OVERRUN],
+        "No other errors counted");
+}
+
+static void testIrqTx(void)
+{
+    TYGS_STATS before, after;
+    unsigned long irqs;
+    int n;
+
+    testDiag("Interrupt driven transmit at %d baud", BAUD);
+    testOk1(setBaud(3, B38400) == 0);
+    tyGSOctalStats(MODULE, 3, &before, 0);
+    pattern(sent, NTX, 3);
+    testOk1(rtemsShimWrite(fd[3], sent, NTX) == NTX);
+    uartEmuRun(emu, NTX * CHAR_TIME + 0.01);
+    n = uartEmuReceive(emu, 3, got, sizeof(got));
+    tyGSOctalStats(MODULE, 3, &after, 0);
+
+    testOk(n == NTX && memcmp(sent, got, NTX) == 0,
+        "%d characters sent intact", NTX);
+    irqs = after.irqCount - before.irqCount;
+    testDiag("%.0f characters/second, %lu Tx interrupts", txRate(3), irqs);
+    testOk(txRate(3) > 0.99 * BAUD / 10, "Line kept busy");
+    testOk(irqs < NTX, "Idle transmitter loaded with two characters");
+}
+
+static void testPolled(void)
+{
+    TYGS_STATS before, after;
+    int n;
+
+    testDiag("Polled transmit at %d baud", BAUD);
+    testOk1(tyGSOctalTxMode(MODULE, 4, "polled") == 0);
+    fd[4] = rtemsShimOpen("/dev/gs4");
+    testOk(fd[4] >= 0 && setBaud(4, B38400) == 0, "Port reopened polled");
+    tyGSOctalStats(MODULE, 4, &before, 0);
+    pattern(sent, NTX, 4);
+    testOk1(rtemsShimWrite(fd[4], sent, NTX) == NTX);
+    uartEmuRun(emu, 0.01);
+    n = uartEmuReceive(emu, 4, got, sizeof(got));
+    tyGSOctalStats(MODULE, 4, &after, 0);
+
+    testOk(n == NTX && memcmp(sent, got, NTX) == 0,
+        "%d characters sent intact", NTX);
+    testDiag("%.0f characters/second", txRate(4));
+    testOk(txRate(4) > 0.99 * BAUD / 10, "Line kept busy");
+    testOk(after.irqCount == before.irqCount &&
+        after.txTimeouts == before.txTimeouts,
+        "No interrupts or timeouts");
+}
+
+/* Hold the transmitter off and write, returning the seconds the write
+ * took.  *psent gets the characters the driver wrote to the UART.
+ */
+
+static double stalledWrite(int port, int len, unsigned long *psent,
+    unsigned long *ptimeouts)
+{
+    TYGS_STATS before, after;
+    double start;
+
+    uartEmuTxStall(emu, port, 1);
+    tyGSOctalStats(MODULE, port, &before, 0);
+    start = uartEmuTime(emu);
+    rtemsShimWrite(fd[port], sent, len);
+    tyGSOctalStats(MODULE, port, &after, 0);
+    uartEmuTxStall(emu, port, 0);
+    *psent = after.writeCount - before.writeCount;
+    *ptimeouts = after.txTimeouts - before.txTimeouts;
+    return uartEmuTime(emu) - start;
+}
+
+static void testCtsHold(void)
+{
+    unsigned long nsent, timeouts;
+    double wait, hold = 5 * TXRDY_WAIT;
+    int n;
+
+    testDiag("Polled transmit held off by CTS at %d baud", BAUD);
+    testOk1(setFlow(4, 1) == 0);
+    pattern(sent, NRX, 6);
+    releasePort = 4;
+    releaseAt = uartEmuTime(emu) + hold;
+    wait = stalledWrite(4, NRX, &nsent, &timeouts);
+    testDiag("Write returned after %.1f ms, %lu characters written",
+        wait * 1e3, nsent);
+    testOk(timeouts == 0 && nsent == NRX && wait >= hold,
+        "Waited %.0f ms for CTS, nothing discarded", hold * 1e3);
+    uartEmuRun(emu, 0.01);
+    n = uartEmuReceive(emu, 4, got, sizeof(got));
+    testOk(n == NRX && memcmp(sent, got, NRX) == 0,
+        "%d characters sent intact", NRX);
+    testOk1(setFlow(4, 0) == 0);
+}
+
+static void testStall(void)
+{
+    unsigned long nsent, timeouts;
+    double wait, slowWait = 4 * 12 / 300.0;
+    int n;
+
+    testDiag("Polled transmit stuck at %d baud", BAUD);
+    pattern(sent, NRX, 5);
+    wait = stalledWrite(4, NRX, &nsent, &timeouts);
+    testDiag("Write returned after %.1f ms, %lu characters written",
+        wait * 1e3, nsent);
+    testOk(timeouts == 1 && nsent == 1, "Timeout counted, rest discarded");
+    testOk(wait >= TXRDY_WAIT && wait < TXRDY_WAIT + 0.001,
+        "Gave up after %.0f ms", TXRDY_WAIT * 1e3);
+    uartEmuRun(emu, 0.01);
+    n = uartEmuReceive(emu, 4, got, sizeof(got));
+    testOk(n == 1 && got[0] == sent[0], "Held character sent on release");
+
+    testDiag("Polled transmit stuck at 300 baud");
+    testOk1(setBaud(4, B300) == 0);
+    wait = stalledWrite(4, NRX, &nsent, &timeouts);
+    testDiag("Write returned after %.1f ms", wait * 1e3);
+    testOk(timeouts == 1 && wait >= slowWait && wait < slowWait + 0.001,
+        "Gave up after 4 character times");
+    uartEmuRun(emu, 0.1);
+    uartEmuReceive(emu, 4, got, sizeof(got));
+}
+
+
+MAIN(tyGSOctalRtemsTest)
+{
+    int carrier, port;
+
+    testPlan(28);
+
+    carrier = ipacAddTestCarrier("SLOTS=1 MEM=0x100");
+    ipacTestSetId(carrier, 0, GREEN_SPRING_ID, GSIP_OCTAL232);
+    emu = scc2698EmuCreate(carrier, 0);
+    rtemsShimClock(emuClock, NULL);
+
+    testOk1(tyGSOctalDrv(1) == 0);
+    testOk1(tyGSOctalModuleInit(MODULE, "232", 0x80, carrier, 0) == 0);
+    tyGSOctalDevCreate("/dev/gs", MODULE, -1, 0, 0);
+    for (port = 0; port < 8; port++) {
+        char name[16];
+
+        sprintf(name, "/dev/gs%d", port);
+        fd[port] = rtemsShimOpen(name);
+    }
+    testOk(emu && fd[7] >= 0, "Module and devices created");
+    if (!emu || fd[7] < 0)
+        testAbort("Can't continue");
+
+    testRx();
+    testErrors();
+    testIrqTx();
+    rtemsShimClose(fd[4]);
+    testPolled();
+    testCtsHold();
+    testStall();
+
+    return testDone();
+}
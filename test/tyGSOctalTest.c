@@ -0,0 +1,239 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    tyGSOctalTest.c
+
+Description:
+    Runs the tyGSOctal driver against the SCC2698 register emulator, through
+    the vxWorks shim.  Received data must arrive intact with no overruns
+    when the interrupt latency is short, and with all 8 ports busy each
+    interrupt must service several ports within the module's budget.  A
+    budget of 0, one port per interrupt, can't keep up with 8 busy ports,
+    and a long latency must overrun a single port; the driver must count
+    the overruns.  Transmit must keep the line busy, one character per
+    interrupt.  The measurements are printed as diagnostics.
+
+*******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "vxShim.h"
+#include <ioLib.h>
+#include <sioLib.h>
+#include <tyLib.h>
+
+#include "drvIpac.h"
+#include "ipacTestCarrier.h"
+#include "scc2698Emu.h"
+#include "ip_modules.h"
+#include "tyGSOctal.h"
+
+
+#define MODULE "gs"
+#define BAUD 38400
+#define CHAR_TIME (10.0 / BAUD)     /* 8N1 */
+#define NCHARS 400
+#define NTX 1000
+
+static uartEmu *emu;
+static DEV_HDR *dev[8];
+static char sent[8][NTX], got[NTX];
+
+
+static void pattern(char *buffer, int len, int seed)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        buffer[i] = (i * 7 + seed) & 0xff;
+}
+
+static int drain(DEV_HDR *pdev, char *buffer, int maxlen)
+{
+    int n = 0, nread;
+
+    while (n < maxlen &&
+           (nread = vxShimRead(pdev, buffer + n, maxlen - n)) > 0)
+        n += nread;
+    return n;
+}
+
+/* Are the received characters the sent ones, less any that were lost? */
+
+static int inOrder(const char *rx, int nrx, const char *tx, int ntx)
+{
+    int i, j = 0;
+
+    for (i = 0; i < nrx; i++) {
+        while (j < ntx && tx[j] != rx[i])
+            j++;
+        if (j++ == ntx)
+            return 0;
+    }
+    return 1;
+}
+
+
+/* Receive a block on each of nports ports at once.  Returns the
+ * characters per interrupt, and the port results in *pintact (all ports
+ * got the characters that weren't lost, in order), *plost, *poverruns
+ * and *ppeak (most characters read in one visit to a port).
+ */
+
+static double receive(int nports, int len, int *pintact,
+    unsigned long *plost, unsigned long *poverruns, unsigned int *ppeak)
+{
+    TYGS_STATS before[8], after;
+    unsigned long lost[8], reads = 0;
+    unsigned long irqs = 0;
+    int port;
+
+    for (port = 0; port < nports; port++) {
+        tyGSOctalStats(MODULE, port, &before[port], 1);
+        lost[port] = emu->chan[port].rxLost;
+        pattern(sent[port], len, port);
+        uartEmuSend(emu, port, sent[port], len);
+    }
+    uartEmuRun(emu, len * CHAR_TIME + 0.01);
+
+    *pintact = 1;
+    *plost = *poverruns = *ppeak = 0;
+    for (port = 0; port < nports; port++) {
+        int n = drain(dev[port], got, sizeof(got));
+        unsigned long portLost = emu->chan[port].rxLost - lost[port];
+
+        if (n + portLost != len || !inOrder(got, n, sent[port], len))
+            *pintact = 0;
+        *plost += portLost;
+        tyGSOctalStats(MODULE, port, &after, 0);
+        reads += after.readCount - before[port].readCount;
+        *poverruns += after.overruns - before[port].overruns;
+        if (after.fifoPeak > *ppeak)
+            *ppeak = after.fifoPeak;
+        irqs = after.irqCount - before[port].irqCount;
+    }
+    return (double) reads / irqs;
+}
+
+
+static void testRx(void)
+{
+    unsigned long lost, overruns;
+    unsigned int peak;
+    double perIrq;
+    int intact, port;
+
+    testDiag("Receive at %d baud", BAUD);
+    for (port = 0; port < 8; port++)
+        vxShimIoctl(dev[port], SIO_BAUD_SET, BAUD);
+    perIrq = receive(1, NCHARS, &intact, &lost, &overruns, &peak);
+    testOk(intact && !lost && !overruns, "%d characters received intact",
+        NCHARS);
+    testDiag("%.2f characters per interrupt", perIrq);
+    testOk(perIrq <= 1.0, "One interrupt per character on an idle module");
+}
+
+static void testBusy(void)
+{
+    unsigned long lost, overruns;
+    unsigned int peak;
+    double perIrq;
+    int intact;
+
+    testDiag("All 8 ports receiving, 300 us interrupt latency");
+    uartEmuLatency(emu, 300e-6);
+    perIrq = receive(8, NCHARS, &intact, &lost, &overruns, &peak);
+    testDiag("%.2f characters per interrupt, at most %u per port visit",
+        perIrq, peak);
+    testOk(intact && !lost && !overruns, "All characters received intact");
+    testOk(perIrq > 4.0 && perIrq <= TYGS_DEFAULT_BUDGET,
+        "Several ports serviced per interrupt within the budget");
+    testOk(peak <= 4, "No more than the Rx FIFO and shift register per visit");
+
+    testOk1(tyGSOctalBudget(MODULE, 0) == OK);
+    perIrq = receive(8, NCHARS, &intact, &lost, &overruns, &peak);
+    testDiag("Budget 0: %.2f characters per interrupt, %lu lost, "
+        "%lu overruns counted", perIrq, lost, overruns);
+    testOk(lost > 0 && overruns > 0 && intact,
+        "One port per interrupt overruns, and counts it");
+    tyGSOctalBudget(MODULE, TYGS_DEFAULT_BUDGET);
+}
+
+static void testOverrun(void)
+{
+    unsigned long lost, overruns;
+    unsigned int peak;
+    int intact;
+
+    testDiag("One port receiving, 3 ms interrupt latency");
+    uartEmuLatency(emu, 3e-3);
+    receive(1, NCHARS, &intact, &lost, &overruns, &peak);
+    testDiag("%lu characters lost, %lu overruns counted", lost, overruns);
+    testOk(lost > 0 && overruns > 0, "Rx FIFO overruns counted");
+    testOk(intact, "Other characters received in order");
+    uartEmuLatency(emu, 5e-6);
+}
+
+static void testTx(void)
+{
+    TYGS_STATS before, after;
+    uartEmuChan *pch = &emu->chan[3];
+    double rate, perIrq;
+    int n;
+
+    testDiag("Transmit at %d baud", BAUD);
+    tyGSOctalStats(MODULE, 3, &before, 0);
+    pattern(sent[3], NTX, 3);
+    testOk1(vxShimWrite(dev[3], sent[3], NTX) == NTX);
+    uartEmuRun(emu, NTX * CHAR_TIME + 0.01);
+    n = uartEmuReceive(emu, 3, got, sizeof(got));
+    tyGSOctalStats(MODULE, 3, &after, 0);
+
+    testOk(n == NTX && memcmp(sent[3], got, NTX) == 0,
+        "%d characters sent intact", NTX);
+    rate = (pch->txChars - 1) / (pch->txLast - pch->txFirst);
+    perIrq = (double) (after.writeCount - before.writeCount) /
+        (after.irqCount - before.irqCount);
+    testDiag("%.0f characters/second, %.2f characters per interrupt",
+        rate, perIrq);
+    testOk(rate > 0.99 * BAUD / 10, "Line kept busy");
+}
+
+
+MAIN(tyGSOctalTest)
+{
+    int carrier, port;
+
+    testPlan(15);
+
+    carrier = ipacAddTestCarrier("SLOTS=1 MEM=0x100");
+    ipacTestSetId(carrier, 0, GREEN_SPRING_ID, GSIP_OCTAL232);
+    emu = scc2698EmuCreate(carrier, 0);
+
+    testOk1(tyGSOctalDrv(1) == OK);
+    testOk1(tyGSOctalModuleInit(MODULE, "232", 0x80, carrier, 0) == 0);
+    for (port = 0; port < 8; port++) {
+        char name[16];
+
+        sprintf(name, "/gs/%d", port);
+        tyGSOctalDevCreate(name, MODULE, port, 4096, 16384);
+        dev[port] = vxShimDevice(name);
+    }
+    testOk(emu && dev[7], "Module and devices created");
+    if (!emu || !dev[7])
+        testAbort("Can't continue");
+
+    testRx();
+    testBusy();
+    testOverrun();
+    testTx();
+
+    return testDone();
+}
@@ -0,0 +1,496 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    uartEmu.c
+
+Description:
+    Serial line model for the UART register emulators used by the host
+    tests.  Each channel has a receiver that is fed characters from the
+    peer's line buffer and a transmitter that empties the chip's holding
+    register or FIFO onto the output line buffer, each character taking
+    the time the chip's current baud rate and frame format give it.  The
+    chip model decides what its registers do with them.
+
+    Time is simulated: uartEmuRun() steps from one event to the next, so
+    the results don't depend on the speed or load of the host.  When the
+    chip requests an interrupt the module's interrupt routines are called
+    through ipacTestInterrupt() once the interrupt latency has passed;
+    characters keep arriving meanwhile, which is what overruns a FIFO.
+    The ISR and the driver's task level code run in no simulated time,
+    unless the test gives register accesses a time with uartEmuAccessTime()
+    so code that polls a register sees the lines move on.
+
+    The run loop never holds the emulator lock while calling the ISR,
+    because register accesses take it and the driver may hold intLock()
+    (epicsInterruptLock on the host) when it makes them.
+
+    This file is only built into the test programs.
+
+*******************************************************************************/
+
+/* ANSI headers */
+#include <string.h>
+
+/* EPICS headers */
+#include <epicsMutex.h>
+
+/* Module headers */
+#include "ipacTestCarrier.h"
+#include "uartEmu.h"
+
+
+#define DEFAULT_LATENCY 5e-6    /* Interrupt latency, seconds */
+#define MIN_LATENCY 1e-7
+
+
+/*******************************************************************************
+
+Routine:
+    linePut, lineGet
+
+Purpose:
+    Line buffer queue operations
+
+*/
+
+static int linePut (
+    uartEmuLine *pline,
+    char c
+) {
+    if (pline->count >= UART_EMU_LINE)
+        return 0;
+    pline->data[(pline->head + pline->count++) % UART_EMU_LINE] = c;
+    return 1;
+}
+
+static int lineGet (
+    uartEmuLine *pline,
+    char *pc
+) {
+    if (pline->count == 0)
+        return 0;
+    *pc = pline->data[pline->head];
+    pline->head = (pline->head + 1) % UART_EMU_LINE;
+    pline->count--;
+    return 1;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    rxStart, txStart
+
+Purpose:
+    Start the next character into the receiver or out of the transmitter
+
+Description:
+    Characters follow each other without gaps, so the next one starts when
+    the previous one finished rather than when the event was processed.
+
+*/
+
+static void rxStart (
+    uartEmu *emu,
+    int chan,
+    double when
+) {
+    uartEmuChan *pch = &emu->chan[chan];
+
+    if (!pch->rxBusy && lineGet(&pch->in, &pch->rxChar)) {
+        pch->rxBusy = 1;
+        pch->rxDone = when + emu->ops->charTime(emu, chan);
+    }
+}
+
+static void txStart (
+    uartEmu *emu,
+    int chan,
+    double when
+) {
+    uartEmuChan *pch = &emu->chan[chan];
+
+    if (!pch->txBusy && !pch->txStall &&
+        emu->ops->txNext(emu, chan, &pch->txChar)) {
+        pch->txBusy = 1;
+        pch->txDone = when + emu->ops->charTime(emu, chan);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuInit
+
+Purpose:
+    Initializes the line model of a chip emulator
+
+Description:
+    The chip emulator calls this from its create routine, before attaching
+    itself to the slot's registers.
+
+Returns:
+    0 = OK, -1 = bad arguments or no memory.
+
+*/
+
+int uartEmuInit (
+    uartEmu *emu,
+    const uartEmuOps *ops,
+    int carrier,
+    int slot,
+    int nchan
+) {
+    if (nchan < 1 || nchan > UART_EMU_CHANNELS)
+        return -1;
+
+    memset(emu, 0, sizeof(uartEmu));
+    emu->lock = epicsMutexCreate();
+    if (emu->lock == NULL)
+        return -1;
+    emu->ops = ops;
+    emu->carrier = carrier;
+    emu->slot = slot;
+    emu->nchan = nchan;
+    emu->latency = DEFAULT_LATENCY;
+    emu->irqSince = -1;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuLatency
+
+Purpose:
+    Sets the delay from an interrupt request to the ISR being called
+
+*/
+
+void uartEmuLatency (
+    uartEmu *emu,
+    double latency
+) {
+    epicsMutexMustLock(emu->lock);
+    emu->latency = latency < MIN_LATENCY ? MIN_LATENCY : latency;
+    epicsMutexUnlock(emu->lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuAccessTime
+
+Purpose:
+    Sets the simulated time each register access takes, 0 by default
+
+*/
+
+void uartEmuAccessTime (
+    uartEmu *emu,
+    double seconds
+) {
+    epicsMutexMustLock(emu->lock);
+    emu->accessTime = seconds;
+    epicsMutexUnlock(emu->lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuSend, uartEmuReceive
+
+Purpose:
+    The peer's end of a channel's serial line
+
+Description:
+    uartEmuSend() queues characters to arrive at the channel's receiver
+    back to back, starting now.  uartEmuReceive() takes characters the
+    channel's transmitter has finished sending.
+
+Returns:
+    The number of characters queued or taken.
+
+*/
+
+int uartEmuSend (
+    uartEmu *emu,
+    int chan,
+    const char *data,
+    int len
+) {
+    uartEmuChan *pch = &emu->chan[chan];
+    int n;
+
+    epicsMutexMustLock(emu->lock);
+    for (n = 0; n < len; n++)
+        if (!linePut(&pch->in, data[n]))
+            break;
+    rxStart(emu, chan, emu->now);
+    epicsMutexUnlock(emu->lock);
+    return n;
+}
+
+int uartEmuReceive (
+    uartEmu *emu,
+    int chan,
+    char *buffer,
+    int maxlen
+) {
+    uartEmuChan *pch = &emu->chan[chan];
+    int n;
+
+    epicsMutexMustLock(emu->lock);
+    for (n = 0; n < maxlen; n++)
+        if (!lineGet(&pch->out, &buffer[n]))
+            break;
+    epicsMutexUnlock(emu->lock);
+    return n;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuTxStall
+
+Purpose:
+    Holds or releases a channel's transmitter
+
+Description:
+    A stalled transmitter finishes the character it is sending but doesn't
+    take another from the chip, as when the peer drops CTS.
+
+*/
+
+void uartEmuTxStall (
+    uartEmu *emu,
+    int chan,
+    int stall
+) {
+    epicsMutexMustLock(emu->lock);
+    emu->chan[chan].txStall = stall;
+    if (!stall)
+        txStart(emu, chan, emu->now);
+    epicsMutexUnlock(emu->lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuTxKick
+
+Purpose:
+    Starts the transmitter if it is idle
+
+Description:
+    Called by the chip model, with the emulator locked, when it has a new
+    character to send.
+
+*/
+
+void uartEmuTxKick (
+    uartEmu *emu,
+    int chan
+) {
+    txStart(emu, chan, emu->now);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    irqAsserted
+
+Purpose:
+    Is the chip requesting an interrupt that the carrier will deliver?
+
+*/
+
+static int irqAsserted (
+    uartEmu *emu
+) {
+    return emu->ops->irq(emu) &&
+        (ipacTestIrqEnabled(emu->carrier, emu->slot, 0) ||
+         ipacTestIrqEnabled(emu->carrier, emu->slot, 1));
+}
+
+
+/*******************************************************************************
+
+Routine:
+    lineDue, lineRun
+
+Purpose:
+    The time the next character finishes, if before next, and finishing
+    the characters due by now
+
+*/
+
+static double lineDue (
+    uartEmu *emu,
+    double next
+) {
+    int chan;
+
+    for (chan = 0; chan < emu->nchan; chan++) {
+        uartEmuChan *pch = &emu->chan[chan];
+
+        if (pch->rxBusy && pch->rxDone < next)
+            next = pch->rxDone;
+        if (pch->txBusy && pch->txDone < next)
+            next = pch->txDone;
+    }
+    return next;
+}
+
+static void lineRun (
+    uartEmu *emu
+) {
+    int chan;
+
+    for (chan = 0; chan < emu->nchan; chan++) {
+        uartEmuChan *pch = &emu->chan[chan];
+
+        if (pch->rxBusy && pch->rxDone <= emu->now) {
+            pch->rxBusy = 0;
+            pch->rxChars++;
+            emu->ops->rxChar(emu, chan, pch->rxChar);
+            rxStart(emu, chan, pch->rxDone);
+        }
+        if (pch->txBusy && pch->txDone <= emu->now) {
+            pch->txBusy = 0;
+            linePut(&pch->out, pch->txChar);
+            if (pch->txChars++ == 0)
+                pch->txFirst = pch->txDone;
+            pch->txLast = pch->txDone;
+            txStart(emu, chan, pch->txDone);
+        }
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuAccess
+
+Purpose:
+    Lets a register access's time pass
+
+Description:
+    Called by the chip model, with the emulator locked, before each register
+    access.  Characters finish meanwhile, but interrupts wait for the run
+    loop, as the ISR or the code holding intLock() is still running.
+
+*/
+
+void uartEmuAccess (
+    uartEmu *emu
+) {
+    double end = emu->now + emu->accessTime;
+    double next;
+
+    if (emu->accessTime <= 0)
+        return;
+    while ((next = lineDue(emu, end)) < end) {
+        emu->now = next;
+        lineRun(emu);
+    }
+    emu->now = end;
+    lineRun(emu);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuRun
+
+Purpose:
+    Runs the emulated lines and interrupts for a period of simulated time
+
+Returns:
+    The simulated time at the end of the run.
+
+*/
+
+double uartEmuRun (
+    uartEmu *emu,
+    double seconds
+) {
+    double end;
+
+    epicsMutexMustLock(emu->lock);
+    end = emu->now + seconds;
+
+    for (;;) {
+        double next = end + 1.0;
+        double timer;
+
+        if (irqAsserted(emu)) {
+            if (emu->irqSince < 0)
+                emu->irqSince = emu->now;
+            if (emu->irqSince + emu->latency <= emu->now) {
+                emu->irqSince = -1;
+                emu->interrupts++;
+                epicsMutexUnlock(emu->lock);
+                ipacTestInterrupt(emu->carrier, emu->slot);
+                epicsMutexMustLock(emu->lock);
+                continue;
+            }
+            next = emu->irqSince + emu->latency;
+        }
+        else
+            emu->irqSince = -1;
+
+        next = lineDue(emu, next);
+        timer = emu->ops->timer(emu);
+        if (timer > emu->now && timer < next)
+            next = timer;
+
+        /* Register access time in the ISR may have run past either */
+        if (next > end) {
+            if (emu->now < end)
+                emu->now = end;
+            break;
+        }
+        if (next > emu->now)
+            emu->now = next;
+        lineRun(emu);
+    }
+
+    end = emu->now;
+    epicsMutexUnlock(emu->lock);
+    return end;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    uartEmuTime
+
+Purpose:
+    Returns the simulated time
+
+*/
+
+double uartEmuTime (
+    uartEmu *emu
+) {
+    double now;
+
+    epicsMutexMustLock(emu->lock);
+    now = emu->now;
+    epicsMutexUnlock(emu->lock);
+    return now;
+}
@@ -0,0 +1,101 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    uartEmu.h
+
+Description:
+    Baud-timed serial line model shared by the UART register emulators.
+
+*******************************************************************************/
+
+#ifndef INCuartEmuH
+#define INCuartEmuH
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UART_EMU_CHANNELS 8         /* Serial channels per module */
+#define UART_EMU_LINE 16384         /* Line buffer size, each direction */
+
+typedef struct uartEmu uartEmu;
+
+/* Chip model routines, all called with the emulator locked */
+
+typedef struct {
+    /* A character has finished arriving at a channel's receiver */
+    void (*rxChar)(uartEmu *emu, int chan, char c);
+    /* The transmitter wants its next character; return 0 if there is none */
+    int (*txNext)(uartEmu *emu, int chan, char *pc);
+    /* Seconds per character at the channel's current settings */
+    double (*charTime)(uartEmu *emu, int chan);
+    /* Non-zero while the chip asserts its interrupt request */
+    int (*irq)(uartEmu *emu);
+    /* Time of the chip's next internal event, or 0 if none */
+    double (*timer)(uartEmu *emu);
+} uartEmuOps;
+
+/* Line buffer, a character queue */
+
+typedef struct {
+    int head;
+    int count;
+    char data[UART_EMU_LINE];
+} uartEmuLine;
+
+typedef struct {
+    uartEmuLine in;                 /* From the peer, waiting to be sent */
+    uartEmuLine out;                /* Sent by the transmitter */
+    int rxBusy;                     /* A character is arriving */
+    char rxChar;
+    double rxDone;                  /* When it has all arrived */
+    int txBusy;                     /* The shift register is sending */
+    char txChar;
+    double txDone;
+    int txStall;                    /* Transmitter held, e.g. by CTS */
+    double txFirst;                 /* When the first and last characters */
+    double txLast;                  /* finished sending */
+    unsigned long rxChars;          /* Characters given to the receiver */
+    unsigned long rxLost;           /* Of those, lost to overruns */
+    unsigned long txChars;          /* Characters sent */
+} uartEmuChan;
+
+/* Chip emulators start with this structure */
+
+struct uartEmu {
+    const uartEmuOps *ops;
+    epicsMutexId lock;
+    int carrier;
+    int slot;
+    int nchan;
+    double now;                     /* Simulated time, seconds */
+    double latency;                 /* Interrupt request to ISR entry */
+    double accessTime;              /* Time each register access takes */
+    double irqSince;                /* Request asserted since, < 0 = not */
+    unsigned long interrupts;       /* ISR calls */
+    uartEmuChan chan[UART_EMU_CHANNELS];
+};
+
+int uartEmuInit(uartEmu *emu, const uartEmuOps *ops, int carrier, int slot,
+    int nchan);
+void uartEmuLatency(uartEmu *emu, double latency);
+void uartEmuAccessTime(uartEmu *emu, double seconds);
+void uartEmuAccess(uartEmu *emu);
+int uartEmuSend(uartEmu *emu, int chan, const char *data, int len);
+int uartEmuReceive(uartEmu *emu, int chan, char *buffer, int maxlen);
+void uartEmuTxStall(uartEmu *emu, int chan, int stall);
+double uartEmuRun(uartEmu *emu, double seconds);
+double uartEmuTime(uartEmu *emu);
+void uartEmuTxKick(uartEmu *emu, int chan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCuartEmuH */
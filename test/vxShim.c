@@ -0,0 +1,660 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    vxShim.c
+
+Description:
+    Host implementation of the vxWorks routines used by the serial module
+    drivers, enough to run them unchanged in the host tests against the
+    register emulators.  See vxShim/vxWorks.h.
+
+    tyLib keeps the same division of work as the real one: the driver's
+    interrupt routine moves characters with tyIRd() and tyITx(), and tyWrite()
+    calls the driver's txStartup routine when the transmitter is idle.
+    Devices are read and written through the vxShimRead() etc. routines,
+    which call the driver with the device header like the I/O system does.
+
+    This file is only built into the test programs.
+
+*******************************************************************************/
+
+/* ANSI headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/* EPICS headers */
+#include <epicsEvent.h>
+#include <epicsInterrupt.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsTimer.h>
+
+/* Shim headers */
+#include "vxWorks.h"
+#include "intLib.h"
+#include "errnoLib.h"
+#include "iosLib.h"
+#include "ioLib.h"
+#include "rngLib.h"
+#include "tyLib.h"
+#include "logLib.h"
+#include "taskLib.h"
+#include "sysLib.h"
+#include "tickLib.h"
+#include "rebootLib.h"
+#include "vxLib.h"
+#include "wdLib.h"
+#include "vxShim.h"
+
+
+#define MAX_DRIVERS 8
+#define CLOCK_RATE 60       /* vxWorks default system clock rate */
+
+
+/* Driver table entry, the routines given to iosDrvInstall() */
+
+typedef int (*drvRead_t)(DEV_HDR *pDevHdr, char *buffer, long nbytes);
+typedef int (*drvIoctl_t)(DEV_HDR *pDevHdr, int request, int arg);
+
+typedef struct {
+    drvRead_t read;
+    drvRead_t write;
+    drvIoctl_t ioctl;
+} driver_t;
+
+static driver_t drvTable[MAX_DRIVERS];
+static int numDrivers;
+static DEV_HDR *devList;
+
+
+/* Ring buffer, one slot is always empty */
+
+struct ring {
+    int pToBuf;
+    int pFromBuf;
+    int bufSize;
+    char *buf;
+};
+
+
+/* Watchdog timer */
+
+struct wdog {
+    epicsTimerId timer;
+    FUNCPTR routine;
+    int parameter;
+};
+
+static epicsTimerQueueId wdQueue;
+
+static double (*clockFn)(void *pvt);
+static void *clockPvt;
+
+
+/*******************************************************************************
+
+Routine:
+    rngCreate etc.
+
+Purpose:
+    rngLib ring buffers
+
+Description:
+    Only the reader moves pFromBuf and only the writer moves pToBuf, so one
+    task and one interrupt routine may use a ring without locking, as with
+    the real rngLib.
+
+*/
+
+RING_ID rngCreate (
+    int nbytes
+) {
+    RING_ID ringId = (RING_ID) calloc(1, sizeof(struct ring));
+
+    if (ringId == NULL)
+        return NULL;
+    ringId->bufSize = nbytes + 1;
+    ringId->buf = (char *) malloc(ringId->bufSize);
+    if (ringId->buf == NULL) {
+        free(ringId);
+        return NULL;
+    }
+    return ringId;
+}
+
+void rngDelete (
+    RING_ID ringId
+) {
+    free(ringId->buf);
+    free(ringId);
+}
+
+int rngBufGet (
+    RING_ID ringId,
+    char *buffer,
+    int maxbytes
+) {
+    int n = 0;
+    int from = ringId->pFromBuf;
+
+    while (n < maxbytes && from != ringId->pToBuf) {
+        buffer[n++] = ringId->buf[from];
+        if (++from == ringId->bufSize)
+            from = 0;
+    }
+    ringId->pFromBuf = from;
+    return n;
+}
+
+int rngBufPut (
+    RING_ID ringId,
+    const char *buffer,
+    int nbytes
+) {
+    int n = 0;
+    int to = ringId->pToBuf;
+
+    while (n < nbytes) {
+        int next = to + 1 == ringId->bufSize ? 0 : to + 1;
+
+        if (next == ringId->pFromBuf)
+            break;
+        ringId->buf[to] = buffer[n++];
+        to = next;
+    }
+    ringId->pToBuf = to;
+    return n;
+}
+
+int rngNBytes (
+    RING_ID ringId
+) {
+    int n = ringId->pToBuf - ringId->pFromBuf;
+
+    return n < 0 ? n + ringId->bufSize : n;
+}
+
+int rngFreeBytes (
+    RING_ID ringId
+) {
+    return ringId->bufSize - 1 - rngNBytes(ringId);
+}
+
+BOOL rngIsEmpty (
+    RING_ID ringId
+) {
+    return ringId->pToBuf == ringId->pFromBuf;
+}
+
+BOOL rngIsFull (
+    RING_ID ringId
+) {
+    return rngFreeBytes(ringId) == 0;
+}
+
+void rngFlush (
+    RING_ID ringId
+) {
+    ringId->pToBuf = ringId->pFromBuf = 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    tyDevInit
+
+Purpose:
+    Initializes a tyLib device descriptor
+
+*/
+
+STATUS tyDevInit (
+    TY_DEV_ID pTyDev,
+    int rdBufSize,
+    int wrtBufSize,
+    FUNCPTR txStartup
+) {
+    memset(pTyDev, 0, sizeof(TY_DEV));
+    pTyDev->rdBuf = rngCreate(rdBufSize);
+    pTyDev->wrtBuf = rngCreate(wrtBufSize);
+    pTyDev->rdSync = epicsEventCreate(epicsEventEmpty);
+    pTyDev->wrtSync = epicsEventCreate(epicsEventEmpty);
+    if (!pTyDev->rdBuf || !pTyDev->wrtBuf ||
+        !pTyDev->rdSync || !pTyDev->wrtSync)
+        return ERROR;
+    pTyDev->txStartup = txStartup;
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    tyIRd, tyITx
+
+Purpose:
+    Interrupt level input and output
+
+Description:
+    tyIRd() returns ERROR and drops the character if the read buffer is
+    full.  tyITx() returns ERROR when there is nothing left to send, which
+    marks the transmitter idle so the next tyWrite() starts it again.
+
+*/
+
+STATUS tyIRd (
+    TY_DEV_ID pTyDev,
+    char inchar
+) {
+    if (rngBufPut(pTyDev->rdBuf, &inchar, 1) != 1) {
+        pTyDev->rdLost++;
+        return ERROR;
+    }
+    epicsEventSignal(pTyDev->rdSync);
+    return OK;
+}
+
+STATUS tyITx (
+    TY_DEV_ID pTyDev,
+    char *pChar
+) {
+    if (rngBufGet(pTyDev->wrtBuf, pChar, 1) != 1) {
+        pTyDev->wrtBusy = FALSE;
+        return ERROR;
+    }
+    pTyDev->wrtBusy = TRUE;
+    epicsEventSignal(pTyDev->wrtSync);
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    tyRead, tyWrite
+
+Purpose:
+    Task level input and output
+
+Description:
+    tyRead() waits for at least one character.  tyWrite() waits for room
+    in the write buffer and calls the driver's txStartup routine whenever
+    the transmitter is idle.
+
+*/
+
+int tyRead (
+    TY_DEV_ID pTyDev,
+    char *buffer,
+    int maxbytes
+) {
+    int n, key;
+
+    if (maxbytes <= 0)
+        return 0;
+
+    for (;;) {
+        key = intLock();
+        n = rngBufGet(pTyDev->rdBuf, buffer, maxbytes);
+        intUnlock(key);
+        if (n)
+            return n;
+        epicsEventWait(pTyDev->rdSync);
+    }
+}
+
+int tyWrite (
+    TY_DEV_ID pTyDev,
+    char *buffer,
+    int nbytes
+) {
+    int sent = 0;
+
+    while (sent < nbytes) {
+        int key = intLock();
+        int n = rngBufPut(pTyDev->wrtBuf, buffer + sent, nbytes - sent);
+        BOOL busy = pTyDev->wrtBusy;
+
+        intUnlock(key);
+        sent += n;
+        if (!busy)
+            ((void (*)(TY_DEV *)) pTyDev->txStartup)(pTyDev);
+        if (sent < nbytes)
+            epicsEventWait(pTyDev->wrtSync);
+    }
+    return sent;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    tyIoctl
+
+Purpose:
+    Handles the tyLib ioctl requests the tests need
+
+*/
+
+STATUS tyIoctl (
+    TY_DEV_ID pTyDev,
+    int request,
+    int arg
+) {
+    int key = intLock();
+    STATUS status = OK;
+
+    switch (request) {
+        case FIOFLUSH:
+            rngFlush(pTyDev->rdBuf);
+            rngFlush(pTyDev->wrtBuf);
+            break;
+        case FIORFLUSH:
+            rngFlush(pTyDev->rdBuf);
+            break;
+        case FIOWFLUSH:
+            rngFlush(pTyDev->wrtBuf);
+            break;
+        default:
+            errno = S_ioLib_UNKNOWN_REQUEST;
+            status = ERROR;
+            break;
+    }
+    intUnlock(key);
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    iosDrvInstall, iosDevAdd, iosDevFind
+
+Purpose:
+    I/O system driver and device tables
+
+Description:
+    Driver numbers start at 1.  iosDevFind() returns the device with the
+    longest name that prefixes the given one, or NULL.
+
+*/
+
+int iosDrvInstall (
+    FUNCPTR pCreate,
+    FUNCPTR pDelete,
+    FUNCPTR pOpen,
+    FUNCPTR pClose,
+    FUNCPTR pRead,
+    FUNCPTR pWrite,
+    FUNCPTR pIoctl
+) {
+    driver_t *pdrv;
+
+    if (numDrivers >= MAX_DRIVERS)
+        return ERROR;
+    pdrv = &drvTable[numDrivers++];
+    pdrv->read = (drvRead_t) pRead;
+    pdrv->write = (drvRead_t) pWrite;
+    pdrv->ioctl = (drvIoctl_t) pIoctl;
+    return numDrivers;
+}
+
+STATUS iosDevAdd (
+    DEV_HDR *pDevHdr,
+    const char *name,
+    int drvnum
+) {
+    DEV_HDR **pnext;
+
+    if (drvnum < 1 || drvnum > numDrivers || vxShimDevice(name))
+        return ERROR;
+    pDevHdr->drvNum = drvnum;
+    pDevHdr->name = strdup(name);
+    pDevHdr->next = NULL;
+    for (pnext = &devList; *pnext; pnext = &(*pnext)->next)
+        ;
+    *pnext = pDevHdr;
+    return OK;
+}
+
+DEV_HDR *iosDevFind (
+    const char *name,
+    const char **pNameTail
+) {
+    DEV_HDR *pDevHdr, *best = NULL;
+    size_t bestLen = 0;
+
+    for (pDevHdr = devList; pDevHdr; pDevHdr = pDevHdr->next) {
+        size_t len = strlen(pDevHdr->name);
+
+        if (len > bestLen && strncmp(name, pDevHdr->name, len) == 0) {
+            best = pDevHdr;
+            bestLen = len;
+        }
+    }
+    if (best && pNameTail)
+        *pNameTail = name + bestLen;
+    return best;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    vxShimDevice, vxShimRead, vxShimWrite, vxShimIoctl
+
+Purpose:
+    Test access to devices
+
+Description:
+    vxShimDevice() returns the device of exactly that name, or NULL.  The
+    others call the device's driver routines.  vxShimRead() returns 0 if
+    a tyLib device has no input, rather than waiting for some.
+
+*/
+
+DEV_HDR *vxShimDevice (
+    const char *name
+) {
+    DEV_HDR *pDevHdr = iosDevFind(name, NULL);
+
+    if (pDevHdr && strcmp(pDevHdr->name, name) == 0)
+        return pDevHdr;
+    return NULL;
+}
+
+int vxShimRead (
+    DEV_HDR *pDevHdr,
+    char *buffer,
+    int maxbytes
+) {
+    TY_DEV *pTyDev = (TY_DEV *) pDevHdr;
+    int key = intLock();
+    int avail = rngNBytes(pTyDev->rdBuf);
+
+    intUnlock(key);
+    if (avail == 0)
+        return 0;
+    if (maxbytes > avail)
+        maxbytes = avail;
+    return drvTable[pDevHdr->drvNum - 1].read(pDevHdr, buffer, maxbytes);
+}
+
+int vxShimWrite (
+    DEV_HDR *pDevHdr,
+    char *buffer,
+    int nbytes
+) {
+    return drvTable[pDevHdr->drvNum - 1].write(pDevHdr, buffer, nbytes);
+}
+
+int vxShimIoctl (
+    DEV_HDR *pDevHdr,
+    int request,
+    int arg
+) {
+    return drvTable[pDevHdr->drvNum - 1].ioctl(pDevHdr, request, arg);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    wdCreate, wdStart, wdCancel
+
+Purpose:
+    Watchdog timers
+
+Description:
+    The routine is called from an epicsTimer thread with interrupts locked.
+    Its int parameter can't hold a pointer on a 64-bit host.
+
+*/
+
+static void wdExpire (
+    void *arg
+) {
+    WDOG_ID wdId = (WDOG_ID) arg;
+    int key = intLock();
+
+    ((void (*)(int)) wdId->routine)(wdId->parameter);
+    intUnlock(key);
+}
+
+WDOG_ID wdCreate (void)
+{
+    WDOG_ID wdId;
+
+    if (!wdQueue)
+        wdQueue = epicsTimerQueueAllocate(1, epicsThreadPriorityMax);
+    wdId = (WDOG_ID) calloc(1, sizeof(struct wdog));
+    if (wdId == NULL)
+        return NULL;
+    wdId->timer = epicsTimerQueueCreateTimer(wdQueue, wdExpire, wdId);
+    return wdId;
+}
+
+STATUS wdStart (
+    WDOG_ID wdId,
+    int delay,
+    FUNCPTR pRoutine,
+    int parameter
+) {
+    wdId->routine = pRoutine;
+    wdId->parameter = parameter;
+    epicsTimerStartDelay(wdId->timer, (double) delay / CLOCK_RATE);
+    return OK;
+}
+
+STATUS wdCancel (
+    WDOG_ID wdId
+) {
+    epicsTimerCancel(wdId->timer);
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    vxShimClock, sysClkRateGet, tickGet
+
+Purpose:
+    The system clock, which a test may replace
+
+Description:
+    Without a replacement tickGet() follows the host's time.  A replacement
+    returns seconds, e.g. an emulator's simulated time.  Watchdogs always
+    run on the host's time.
+
+*/
+
+void vxShimClock (
+    double (*now)(void *pvt),
+    void *pvt
+) {
+    clockFn = now;
+    clockPvt = pvt;
+}
+
+int sysClkRateGet (void)
+{
+    return CLOCK_RATE;
+}
+
+unsigned long tickGet (void)
+{
+    epicsTimeStamp now;
+
+    if (clockFn)
+        return (unsigned long) (clockFn(clockPvt) * CLOCK_RATE);
+    epicsTimeGetCurrent(&now);
+    return (unsigned long) now.secPastEpoch * CLOCK_RATE +
+        (unsigned long) now.nsec / (1000000000 / CLOCK_RATE);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    Miscellaneous
+
+Purpose:
+    Task, errno, logging, reboot and probe routines
+
+*/
+
+int taskIdSelf (void)
+{
+    return 0;
+}
+
+STATUS errnoSet (
+    int status
+) {
+    errno = status;
+    return OK;
+}
+
+char *taskName (
+    int tid
+) {
+    return (char *) epicsThreadGetNameSelf();
+}
+
+int logMsg (
+    const char *fmt,
+    int arg1,
+    int arg2,
+    int arg3,
+    int arg4,
+    int arg5,
+    int arg6
+) {
+    return printf("# logMsg: %s", fmt);
+}
+
+STATUS rebootHookAdd (
+    FUNCPTR rebootHook
+) {
+    return OK;
+}
+
+STATUS vxMemProbe (
+    char *adrs,
+    int mode,
+    int length,
+    char *pVal
+) {
+    if (mode == VX_WRITE)
+        memcpy(adrs, pVal, length);
+    else
+        memcpy(pVal, adrs, length);
+    return OK;
+}
@@ -0,0 +1,22 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCerrnoLibH
+#define INCerrnoLibH
+
+#include <errno.h>
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS errnoSet(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define errnoGet() (errno)
+
+#endif /* INCerrnoLibH */
@@ -0,0 +1,11 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCintLibH
+#define INCintLibH
+
+#include <epicsInterrupt.h>
+
+#define intLock() epicsInterruptLock()
+#define intUnlock(key) epicsInterruptUnlock(key)
+
+#endif /* INCintLibH */
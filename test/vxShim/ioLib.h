@@ -0,0 +1,19 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCioLibH
+#define INCioLibH
+
+#include "vxWorks.h"
+
+#define M_ioLib (12 << 16)
+#define S_ioLib_NO_DRIVER (M_ioLib | 2)
+#define S_ioLib_UNKNOWN_REQUEST (M_ioLib | 4)
+
+#define FIONREAD 1
+#define FIOFLUSH 2
+#define FIOBAUDRATE 4
+#define FIORFLUSH 8
+#define FIOWFLUSH 9
+#define FIONWRITE 10
+
+#endif /* INCioLibH */
@@ -0,0 +1,27 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCiosLibH
+#define INCiosLibH
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct dev_hdr {
+    struct dev_hdr *next;
+    short drvNum;
+    char *name;
+} DEV_HDR;
+
+int iosDrvInstall(FUNCPTR pCreate, FUNCPTR pDelete, FUNCPTR pOpen,
+    FUNCPTR pClose, FUNCPTR pRead, FUNCPTR pWrite, FUNCPTR pIoctl);
+STATUS iosDevAdd(DEV_HDR *pDevHdr, const char *name, int drvnum);
+DEV_HDR *iosDevFind(const char *name, const char **pNameTail);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCiosLibH */
@@ -0,0 +1,8 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCivH
+#define INCivH
+
+#include "vxWorks.h"
+
+#endif /* INCivH */
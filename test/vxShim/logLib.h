@@ -0,0 +1,19 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INClogLibH
+#define INClogLibH
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int logMsg(const char *fmt, int arg1, int arg2, int arg3, int arg4,
+    int arg5, int arg6);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INClogLibH */
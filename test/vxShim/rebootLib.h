@@ -0,0 +1,18 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCrebootLibH
+#define INCrebootLibH
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS rebootHookAdd(FUNCPTR rebootHook);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCrebootLibH */
@@ -0,0 +1,28 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCrngLibH
+#define INCrngLibH
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ring *RING_ID;
+
+RING_ID rngCreate(int nbytes);
+void rngDelete(RING_ID ringId);
+int rngBufGet(RING_ID rngId, char *buffer, int maxbytes);
+int rngBufPut(RING_ID rngId, const char *buffer, int nbytes);
+int rngFreeBytes(RING_ID ringId);
+int rngNBytes(RING_ID ringId);
+BOOL rngIsEmpty(RING_ID ringId);
+BOOL rngIsFull(RING_ID ringId);
+void rngFlush(RING_ID ringId);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCrngLibH */
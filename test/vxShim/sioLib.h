@@ -0,0 +1,23 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCsioLibH
+#define INCsioLibH
+
+#define SIO_BAUD_SET 0x1003
+#define SIO_BAUD_GET 0x1004
+#define SIO_HW_OPTS_SET 0x1005
+#define SIO_HW_OPTS_GET 0x1006
+
+#define CLOCAL 0x1
+#define CREAD 0x2
+#define CSIZE 0xc
+#define CS5 0x0
+#define CS6 0x4
+#define CS7 0x8
+#define CS8 0xc
+#define HUPCL 0x10
+#define STOPB 0x20
+#define PARENB 0x40
+#define PARODD 0x80
+
+#endif /* INCsioLibH */
@@ -0,0 +1,18 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCsysLibH
+#define INCsysLibH
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sysClkRateGet(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCsysLibH */
@@ -0,0 +1,19 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCtaskLibH
+#define INCtaskLibH
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int taskIdSelf(void);
+char *taskName(int tid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCtaskLibH */
@@ -0,0 +1,18 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCtickLibH
+#define INCtickLibH
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned long tickGet(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCtickLibH */
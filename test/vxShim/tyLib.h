@@ -0,0 +1,41 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCtyLibH
+#define INCtyLibH
+
+#include <epicsEvent.h>
+
+#include "vxWorks.h"
+#include "iosLib.h"
+#include "ioLib.h"
+#include "rngLib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    DEV_HDR devHdr;
+    RING_ID rdBuf;
+    RING_ID wrtBuf;
+    FUNCPTR txStartup;
+    BOOL wrtBusy;                   /* txStartup has been called */
+    epicsEventId rdSync;
+    epicsEventId wrtSync;
+    unsigned long rdLost;           /* tyIRd() found rdBuf full */
+} TY_DEV;
+typedef TY_DEV *TY_DEV_ID;
+
+STATUS tyDevInit(TY_DEV_ID pTyDev, int rdBufSize, int wrtBufSize,
+    FUNCPTR txStartup);
+STATUS tyIRd(TY_DEV_ID pTyDev, char inchar);
+STATUS tyITx(TY_DEV_ID pTyDev, char *pChar);
+int tyRead(TY_DEV_ID pTyDev, char *buffer, int maxbytes);
+int tyWrite(TY_DEV_ID pTyDev, char *buffer, int nbytes);
+STATUS tyIoctl(TY_DEV_ID pTyDev, int request, int arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCtyLibH */
@@ -0,0 +1,21 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCvxLibH
+#define INCvxLibH
+
+#include "vxWorks.h"
+
+#define VX_READ 0
+#define VX_WRITE 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+STATUS vxMemProbe(char *adrs, int mode, int length, char *pVal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCvxLibH */
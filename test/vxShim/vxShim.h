@@ -0,0 +1,29 @@
+/* Host test shim, see vxWorks.h
+ *
+ * The tests reach devices through these instead of open(), read(), write()
+ * and ioctl(), which pass file descriptors the shim doesn't have.  The
+ * driver routines get the device's DEV_HDR pointer as on vxWorks.
+ * vxShimClock() replaces the clock that tickGet() reads.
+ */
+
+#ifndef INCvxShimH
+#define INCvxShimH
+
+#include "vxWorks.h"
+#include "iosLib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+DEV_HDR *vxShimDevice(const char *name);
+int vxShimRead(DEV_HDR *pDevHdr, char *buffer, int maxbytes);
+int vxShimWrite(DEV_HDR *pDevHdr, char *buffer, int nbytes);
+int vxShimIoctl(DEV_HDR *pDevHdr, int request, int arg);
+void vxShimClock(double (*now)(void *pvt), void *pvt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCvxShimH */
@@ -0,0 +1,53 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    vxWorks.h
+
+Description:
+    Host test shim for the parts of vxWorks the serial module drivers use.
+    The headers in this directory stand in for the vxWorks ones of the same
+    name; vxShim.c implements them on top of libCom.  Interrupt locking is
+    epicsInterruptLock(), which ipacTestInterrupt() also takes, so driver
+    tasks are excluded from the "interrupt" routines as on a real IOC.
+
+*******************************************************************************/
+
+#ifndef INCvxWorksH
+#define INCvxWorksH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int STATUS;
+typedef int BOOL;
+typedef int (*FUNCPTR)();
+typedef void (*VOIDFUNCPTR)();
+
+#ifndef OK
+#define OK 0
+#endif
+#define ERROR (-1)
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define LOCAL static
+
+#define WAIT_FOREVER (-1)
+#define NO_WAIT 0
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCvxWorksH */
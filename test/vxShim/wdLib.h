@@ -0,0 +1,22 @@
+/* Host test shim, see vxWorks.h */
+
+#ifndef INCwdLibH
+#define INCwdLibH
+
+#include "vxWorks.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wdog *WDOG_ID;
+
+WDOG_ID wdCreate(void);
+STATUS wdStart(WDOG_ID wdId, int delay, FUNCPTR pRoutine, int parameter);
+STATUS wdCancel(WDOG_ID wdId);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCwdLibH */
@@ -116,6 +116,16 @@ typedef volatile struct scc2698 SCC2698;
 #define SCC_ISR_CBRK_B  0x40
 #define SCC_ISR_MPI     0x80
 
+/*
+ * Counter/timer as baud rate source: ACR[6:4]=110 runs the C/T in timer
+ * mode from X1/CLK (3.6864MHz), CSR code 0xD selects it as a 16x clock,
+ * so baud = SCC_CT_BAUD_CLOCK / preset where the preset must be >= 2.
+ */
+#define SCC_ACR_CT_TIMER_X1 0x60
+#define SCC_CSR_TIMER       0xdd
+#define SCC_CT_BAUD_CLOCK   115200
+#define SCC_CT_MIN_PRESET   2
+
 #endif
 
 /**************************************************************************
@@ -66,8 +66,12 @@
 #include <tyLib.h>
 #include <sioLib.h>
 #include <vxLib.h>
+#include <rngLib.h>
 #include <epicsTypes.h>
 #include <epicsString.h>
+#include <epicsStdio.h>
+#include <epicsThread.h>
+#include <errlog.h>
 
 #include "ip_modules.h"     /* GreenSpring IP modules */
 #include "scc2698.h"        /* SCC 2698 UART register map */
@@ -84,11 +88,32 @@
 #define TY_DEVSTART_PTR FUNCPTR
 #endif
 
+/* Rx timestamp source.  Define TYGS_SYS_TIMESTAMP when building to use the
+ * BSP's high resolution timestamp driver instead of the system clock tick.
+ */
+#ifdef TYGS_SYS_TIMESTAMP
+#include <drv/timer/timestampDev.h>
+#define tyGSOctalStamp()        ((epicsUInt32) sysTimestampLock())
+#define tyGSOctalStampFreq()    ((epicsUInt32) sysTimestampFreq())
+#else
+#define tyGSOctalStamp()        ((epicsUInt32) tickGet())
+#define tyGSOctalStampFreq()    ((epicsUInt32) sysClkRateGet())
+#endif
+
+/* Register access through drvIpac, which can count the accesses or pass
+ * them to a register emulator (see IPAC_READ in drvIpac.h).
+ */
+#define CHAN_READ(dev, reg)         IPAC_READ((dev)->qt->pio, (dev)->chan->u.r.reg)
+#define CHAN_WRITE(dev, reg, value) IPAC_WRITE((dev)->qt->pio, (dev)->chan->u.w.reg, (value))
+#define BLOCK_READ(dev, reg)        IPAC_READ((dev)->qt->pio, (dev)->regs->u.r.reg)
+#define BLOCK_WRITE(dev, reg, value) IPAC_WRITE((dev)->qt->pio, (dev)->regs->u.w.reg, (value))
+
 LOCAL QUAD_TABLE *tyGSOctalModules;
 LOCAL int tyGSOctalMaxModules;
 int tyGSOctalLastModule;
 
 LOCAL int tyGSOctalDrvNum;  /* driver number assigned to this driver */
+LOCAL double tyGSOctalErrPeriod = 10.0;   /* seconds, 0 = no summaries */
 
 /*
  * forward declarations
@@ -98,12 +123,19 @@ LOCAL void   tyGSOctalInitChannel(QUAD_TABLE *, int);
 LOCAL int    tyGSOctalRebootHook(int);
 LOCAL QUAD_TABLE * tyGSOctalFindQT(const char *);
 LOCAL int    tyGSOctalOpen(TY_GSOCTAL_DEV *, const char *, int);
+LOCAL int    tyGSOctalRead(TY_GSOCTAL_DEV *, char *, long);
 LOCAL int    tyGSOctalWrite(TY_GSOCTAL_DEV *, char *, long);
 LOCAL STATUS tyGSOctalIoctl(TY_GSOCTAL_DEV *, int, int);
 LOCAL void   tyGSOctalStartup(TY_GSOCTAL_DEV *);
 LOCAL STATUS tyGSOctalBaudSet(TY_GSOCTAL_DEV *, int);
+LOCAL STATUS tyGSOctalTimerBaud(TY_GSOCTAL_DEV *, int);
 LOCAL void   tyGSOctalOptsSet(TY_GSOCTAL_DEV *, int);
 LOCAL void   tyGSOctalSetmr(TY_GSOCTAL_DEV *, int, int);
+LOCAL void   tyGSOctalMsgPut(TY_GSOCTAL_DEV *, char);
+LOCAL void   tyGSOctalErrTask(void *);
+LOCAL void   tyGSOctalStampBurst(TY_GSOCTAL_DEV *);
+LOCAL int    tyGSOctalHistBin(epicsUInt32);
+LOCAL void   tyGSOctalHistPrint(int, const char *, const unsigned long *);
 
 /******************************************************************************
  *
@@ -149,7 +181,13 @@ STATUS tyGSOctalDrv
     rebootHookAdd(tyGSOctalRebootHook);
 
     tyGSOctalDrvNum = iosDrvInstall(tyGSOctalOpen, NULL, tyGSOctalOpen, NULL,
-        tyRead, tyGSOctalWrite, tyGSOctalIoctl);
+        tyGSOctalRead, tyGSOctalWrite, tyGSOctalIoctl);
+
+    if (tyGSOctalDrvNum != ERROR &&
+        !epicsThreadCreate("tyGSOctalErr", epicsThreadPriorityLow,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            tyGSOctalErrTask, NULL))
+        printf("%s: Can't start error summary task\n", fn_nm);
 
     return tyGSOctalDrvNum == ERROR ? ERROR : OK;
 }
@@ -164,17 +202,56 @@ void tyGSOctalReport(void)
 
         printf("Module %d: carrier=%d slot=%d\n  %lu interrupts\n",
             mod, qt->carrier, qt->slot, qt->interruptCount);
+        if (qt->interruptCount)
+            printf("  %.2f chars/interrupt, max %u, budget %d used up %lu times\n",
+                (double) qt->charCount / qt->interruptCount, qt->maxChars,
+                qt->budget, qt->budgetCount);
 
         for (port=0; port < 8; port++) {
             TY_GSOCTAL_DEV *dev = &qt->dev[port];
 
-            if (dev->created)
-                printf("  Port %d: %lu chars in, %lu chars out, %lu errors\n",
-                    port, dev->readCount, dev->writeCount, dev->errorCount);
+            if (!dev->created)
+                continue;
+            printf("  Port %d: %lu chars in, %lu chars out, %lu errors\n",
+                port, dev->readCount, dev->writeCount, dev->errorCount);
+            if (dev->errorCount)
+                printf("  Port %d: %lu overrun, %lu parity, %lu framing, %lu break\n",
+                    port, dev->errCount[TYGS_ERR_OVERRUN],
+                    dev->errCount[TYGS_ERR_PARITY],
+                    dev->errCount[TYGS_ERR_FRAMING],
+                    dev->errCount[TYGS_ERR_BREAK]);
+            if (dev->msgBuf)
+                printf("  Port %d: %lu messages, %lu overflowed, %d chars pending\n",
+                    port, dev->msgCount, dev->msgOverflow, dev->msgLen);
+            if (dev->stampOn) {
+                tyGSOctalHistPrint(port, "Rx burst gap", dev->gapHist);
+                tyGSOctalHistPrint(port, "Rx read latency", dev->latHist);
+            }
+            if (dev->ctPreset)
+                printf("  Port %d: %d baud from C/T preset %d (%d actual)\n",
+                    port, dev->baud, dev->ctPreset,
+                    SCC_CT_BAUD_CLOCK / dev->ctPreset);
         }
     }
 }
 
+LOCAL void tyGSOctalHistPrint
+    (
+    int                   port,
+    const char *          title,
+    const unsigned long * hist
+    )
+{
+    double usec = 1e6 / tyGSOctalStampFreq();   /* per timestamp count */
+    int bin;
+
+    printf("  Port %d: %s (us):", port, title);
+    for (bin = 0; bin < TYGS_NHIST; bin++)
+        if (hist[bin])
+            printf(" <%.0f:%lu", usec * (1UL << bin), hist[bin]);
+    printf("\n");
+}
+
 LOCAL int tyGSOctalRebootHook(int type)
 {
     int mod;
@@ -189,7 +266,7 @@ LOCAL int tyGSOctalRebootHook(int type)
 
             if (dev->created) {
                 dev->irqEnable = 0; /* prevent re-enabling */
-                dev->regs->u.w.imr = 0;
+                BLOCK_WRITE(dev, imr, 0);
             }
             ipmIrqCmd(qt->carrier, qt->slot, 0, ipac_irqDisable);
             ipmIrqCmd(qt->carrier, qt->slot, 1, ipac_irqDisable);
@@ -327,6 +404,8 @@ int tyGSOctalModuleInit
         qt->carrier = carrier;
         qt->slot = slot;
         qt->moduleID = ID;
+        qt->budget = TYGS_DEFAULT_BUDGET;
+        qt->pio = ipmAccessCounter(carrier, slot, ipac_addrIO);
 
         addrIO = ipmBaseAddr(carrier, slot, ipac_addrIO);
         r = (SCC2698 *) addrIO;
@@ -340,8 +419,10 @@ int tyGSOctalModuleInit
             qt->dev[port].chan = &c[port];
         }
 
-        for (block = 0; block < 4; block++)
+        for (block = 0; block < 4; block++) {
             qt->imr[block] = 0;
+            qt->acr[block] = 0x80;  /* BRG set 2 */
+        }
 
         /* set up the single interrupt vector */
         addrMem = (char *) ipmBaseAddr(carrier, slot, ipac_addrMem);
@@ -523,6 +604,194 @@ LOCAL QUAD_TABLE * tyGSOctalFindQT
     return NULL;
 }
 
+/******************************************************************************
+ *
+ * tyGSOctalBudget - set the per-interrupt work budget for a module
+ *
+ * The interrupt routine moves at most budget characters for the module
+ * before returning; ports it didn't reach are serviced first next time.
+ * A budget of 0 services only one channel per interrupt, as releases
+ * 2.13 and 2.14 did.
+ *
+ * RETURNS: OK, or ERROR if the module is unknown or the budget negative.
+ */
+STATUS tyGSOctalBudget
+    (
+    const char * moduleID,       /* module identifier from the
+                                 * call to tyGSOctalModuleInit(). */
+    int          budget          /* characters per interrupt */
+    )
+{
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+
+    if (!qt || budget < 0) {
+        errnoSet(EINVAL);
+        return ERROR;
+    }
+    qt->budget = budget;
+    return OK;
+}
+
+/******************************************************************************
+ *
+ * tyGSOctalErrTask - low priority Rx error summary task
+ *
+ * Every tyGSOctalErrPeriod seconds, print one line for each port whose
+ * error counters have changed since the last summary.  A period of 0
+ * turns the summaries off; the ISR still counts errors.
+ *
+ * NOMANUAL
+ */
+LOCAL void tyGSOctalErrTask
+    (
+    void *parm
+    )
+{
+    static const char *errName[TYGS_NERRS] =
+        {"overrun", "parity", "framing", "break"};
+
+    for (;;) {
+        int mod;
+
+        epicsThreadSleep(tyGSOctalErrPeriod > 0 ? tyGSOctalErrPeriod : 10.0);
+        if (tyGSOctalErrPeriod <= 0)
+            continue;
+
+        for (mod = 0; mod < tyGSOctalLastModule; mod++) {
+            QUAD_TABLE *qt = &tyGSOctalModules[mod];
+            int port;
+
+            for (port = 0; port < 8; port++) {
+                TY_GSOCTAL_DEV *dev = &qt->dev[port];
+                char line[160];
+                int err, len = 0;
+
+                if (!dev->created)
+                    continue;
+
+                for (err = 0; err < TYGS_NERRS; err++) {
+                    unsigned long count = dev->errCount[err];
+                    unsigned long delta = count - dev->errSeen[err];
+
+                    if (delta && len < (int) sizeof(line))
+                        len += epicsSnprintf(line + len, sizeof(line) - len,
+                            " %lu %s (%lu total)", delta, errName[err], count);
+                    dev->errSeen[err] = count;
+                }
+                if (len)
+                    errlogPrintf("tyGSOctal %s port %d Rx errors:%s\n",
+                        qt->moduleID, port, line);
+            }
+        }
+    }
+}
+
+/******************************************************************************
+ *
+ * tyGSOctalErrorPeriod - set the interval between Rx error summaries
+ *
+ * The ISR only counts Rx errors; a low priority task prints a summary
+ * line for each port with new errors every period seconds.  A period of
+ * 0 turns the summaries off.
+ */
+void tyGSOctalErrorPeriod
+    (
+    double period
+    )
+{
+    tyGSOctalErrPeriod = period;
+}
+
+/******************************************************************************
+ *
+ * tyGSOctalRxStamp - turn Rx timestamping on or off for a port
+ *
+ * Same as the TYGS_RXSTAMP_ENABLE ioctl, for use from the shell.
+ *
+ * RETURNS: OK, or ERROR if the device is not found.
+ */
+STATUS tyGSOctalRxStamp
+    (
+    char *  name,           /* device name */
+    int     on              /* 1 = on, 0 = off */
+    )
+{
+    TY_GSOCTAL_DEV *dev = (TY_GSOCTAL_DEV *) iosDevFind(name, NULL);
+
+    if (!dev || strcmp(dev->tyDev.devHdr.name, name)) {
+        printf("tyGSOctalRxStamp: Device %s not found\n", name);
+        return ERROR;
+    }
+    return tyGSOctalIoctl(dev, TYGS_RXSTAMP_ENABLE, on);
+}
+
+/******************************************************************************
+ *
+ * tyGSOctalStats - read a port's throughput and error counters
+ *
+ * Fills in *stats from the counters the ISR maintains.  The FIFO peak is
+ * the most characters read from the port in one interrupt since it was
+ * last reset; a non-zero resetPeak clears it after copying.
+ *
+ * RETURNS: OK, or ERROR if the module or port is unknown.
+ */
+int tyGSOctalStats
+    (
+    const char *    moduleID,
+    int             port,
+    TYGS_STATS *    stats,
+    int             resetPeak
+    )
+{
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+    TY_GSOCTAL_DEV *dev;
+    int key;
+
+    if (!qt || port < 0 || port > 7 || !qt->dev[port].created || !stats)
+        return ERROR;
+    dev = &qt->dev[port];
+
+    key = intLock();
+    stats->readCount = dev->readCount;
+    stats->writeCount = dev->writeCount;
+    stats->irqCount = qt->interruptCount;
+    stats->errors = dev->errorCount;
+    stats->overruns = dev->errCount[TYGS_ERR_OVERRUN];
+    stats->fifoPeak = dev->rxPeak;
+    stats->txTimeouts = dev->txTimeouts;
+    if (resetPeak)
+        dev->rxPeak = 0;
+    intUnlock(key);
+    return OK;
+}
+
+/******************************************************************************
+ *
+ * tyGSOctalErrCounts - read a port's Rx error counters
+ *
+ * Copies the TYGS_NERRS counters of the port, indexed by TYGS_ERR, into
+ * counts.
+ *
+ * RETURNS: OK, or ERROR if the module or port is unknown.
+ */
+int tyGSOctalErrCounts
+    (
+    const char *    moduleID,
+    int             port,
+    unsigned long * counts
+    )
+{
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+    int err;
+
+    if (!qt || port < 0 || port > 7 || !qt->dev[port].created || !counts)
+        return ERROR;
+
+    for (err = 0; err < TYGS_NERRS; err++)
+        counts[err] = qt->dev[port].errCount[err];
+    return OK;
+}
+
 /******************************************************************************
  *
  * tyGSOctalInitChannel - initialize a single channel
@@ -545,13 +814,13 @@ LOCAL void tyGSOctalInitChannel
 
     dev->irqEnable = ((port%2 == 0) ? SCC_ISR_TXRDY_A : SCC_ISR_TXRDY_B);
 
-    /* choose set 2 BRG */
-    dev->regs->u.w.acr = 0x80;
+    /* choose set 2 BRG, keep C/T mode if the other channel uses it */
+    BLOCK_WRITE(dev, acr, qt->acr[block]);
 
-    dev->chan->u.w.cr = 0x1a; /* disable trans/recv, reset pointer */
-    dev->chan->u.w.cr = 0x20; /* reset recv */
-    dev->chan->u.w.cr = 0x30; /* reset trans */
-    dev->chan->u.w.cr = 0x40; /* reset error status */
+    CHAN_WRITE(dev, cr, 0x1a); /* disable trans/recv, reset pointer */
+    CHAN_WRITE(dev, cr, 0x20); /* reset recv */
+    CHAN_WRITE(dev, cr, 0x30); /* reset trans */
+    CHAN_WRITE(dev, cr, 0x40); /* reset error status */
 
 /*
  * Set up the default port configuration:
@@ -565,8 +834,8 @@ LOCAL void tyGSOctalInitChannel
 */
     qt->imr[block] |= ((port%2) == 0 ? SCC_ISR_RXRDY_A : SCC_ISR_RXRDY_B); 
 
-    dev->regs->u.w.imr = qt->imr[block]; /* enable RxRDY interrupt */
-    dev->chan->u.w.cr = 0x05;            /* enable Tx,Rx */
+    BLOCK_WRITE(dev, imr, qt->imr[block]); /* enable RxRDY interrupt */
+    CHAN_WRITE(dev, cr, 0x05);            /* enable Tx,Rx */
 
     intUnlock (key);
 }
@@ -601,7 +870,6 @@ LOCAL int tyGSOctalWrite
     )
 {
     static char *fn_nm = "tyGSOctalWrite";
-    SCC2698_CHAN *chan = dev->chan;
     int nbytes;
 
     /*
@@ -615,16 +883,16 @@ LOCAL int tyGSOctalWrite
 
     if (dev->mode == RS485)
         /* disable recv, 1000=assert RTSN (low) */
-        chan->u.w.cr = 0x82;
+        CHAN_WRITE(dev, cr, 0x82);
 
     nbytes = tyWrite(&dev->tyDev, write_bfr, write_size);
 
     if (dev->mode == RS485) {
         /* make sure all data sent */
-        while(!(chan->u.r.sr & 0x08))   /* Wait for TxEMT */
+        while(!(CHAN_READ(dev, sr) & 0x08))   /* Wait for TxEMT */
             ;
         /* enable recv, 1001=negate RTSN (high) */
-        chan->u.w.cr = 0x91;
+        CHAN_WRITE(dev, cr, 0x91);
     }
 
     return nbytes;
@@ -638,8 +906,6 @@ LOCAL int tyGSOctalWrite
  */
 
 LOCAL void tyGSOctalSetmr(TY_GSOCTAL_DEV *dev, int mr1, int mr2) {
-    SCC2698_CHAN *chan = dev->chan;
-    SCC2698 *regs = dev->regs;
     QUAD_TABLE *qt = dev->qt;
 
     if (qt->modelID == GSIP_OCTAL485) {
@@ -653,13 +919,13 @@ LOCAL void tyGSOctalSetmr(TY_GSOCTAL_DEV *dev, int mr1, int mr2) {
         dev->mode = RS232;
         /* MPOa/b are RTS outputs, may be controlled by UART */
     }
-    regs->u.w.opcr = 0x80; /* MPPn = output, MPOa/b = RTSN */
-    chan->u.w.cr = 0x10; /* point MR to MR1 */
-    chan->u.w.mr = mr1;
-    chan->u.w.mr = mr2;
+    BLOCK_WRITE(dev, opcr, 0x80); /* MPPn = output, MPOa/b = RTSN */
+    CHAN_WRITE(dev, cr, 0x10); /* point MR to MR1 */
+    CHAN_WRITE(dev, mr, mr1);
+    CHAN_WRITE(dev, mr, mr2);
 
     if (mr1 & 0x80) { /* Hardware flow control */
-        chan->u.w.cr = 0x80;    /* Assert RTSN */
+        CHAN_WRITE(dev, cr, 0x80);    /* Assert RTSN */
     }
 }
 
@@ -718,42 +984,141 @@ LOCAL void tyGSOctalOptsSet(TY_GSOCTAL_DEV *dev, int opts)
 
 LOCAL STATUS tyGSOctalBaudSet(TY_GSOCTAL_DEV *dev, int baud)
 {
-    SCC2698_CHAN *chan = dev->chan;
-
     switch(baud) {  /* NB: ACR[7]=1 */
     case 1200:
-        chan->u.w.csr=0x66;
+        CHAN_WRITE(dev, csr, 0x66);
         break;
     case 2400:
-        chan->u.w.csr=0x88;
+        CHAN_WRITE(dev, csr, 0x88);
         break;
     case 4800:
-        chan->u.w.csr=0x99;
+        CHAN_WRITE(dev, csr, 0x99);
         break;
     case 9600:
-        chan->u.w.csr=0xbb;
+        CHAN_WRITE(dev, csr, 0xbb);
         break;
     case 19200:
-        chan->u.w.csr=0xcc;
+        CHAN_WRITE(dev, csr, 0xcc);
         break;
     case 38400:
-        chan->u.w.csr=0x22;
+        CHAN_WRITE(dev, csr, 0x22);
         break;
     default:
+        if (tyGSOctalTimerBaud(dev, baud) != OK)
+            return ERROR;
+        CHAN_WRITE(dev, csr, SCC_CSR_TIMER);
+        dev->baud = baud;
+        return OK;
+    }
+
+    dev->ctPreset = 0;
+    dev->baud = baud;
+    return OK;
+}
+
+/******************************************************************************
+ *
+ * tyGSOctalTimerBaud - program the block counter/timer for a baud rate
+ *
+ * Rates not in the clock-select table are generated by running the
+ * block's counter/timer as a 16x clock from X1/CLK, giving rates of
+ * SCC_CT_BAUD_CLOCK / preset.  Both channels of a block share the timer,
+ * so they must agree on the preset.  Called with interrupts locked.
+ *
+ * RETURNS: OK, or ERROR if the rate can't be generated closely enough.
+ *
+ * NOMANUAL
+ */
+
+LOCAL STATUS tyGSOctalTimerBaud(TY_GSOCTAL_DEV *dev, int baud)
+{
+    QUAD_TABLE *qt = dev->qt;
+    TY_GSOCTAL_DEV *peer = &qt->dev[(dev - qt->dev) ^ 1];
+    int block = dev->block;
+    int preset, actual, error;
+
+    if (baud <= 0) {
+        errnoSet(EINVAL);
+        return ERROR;
+    }
+    preset = (SCC_CT_BAUD_CLOCK + baud / 2) / baud;
+    if (preset < SCC_CT_MIN_PRESET || preset > 0xffff) {
+        errnoSet(EINVAL);
+        return ERROR;
+    }
+    actual = SCC_CT_BAUD_CLOCK / preset;
+    error = (1000 * abs(actual - baud)) / baud;
+    if (error > TYGS_BAUD_ERROR ||
+        (peer->ctPreset && peer->ctPreset != preset)) {
         errnoSet(EINVAL);
         return ERROR;
     }
 
-    dev->baud = baud;
+    qt->acr[block] |= SCC_ACR_CT_TIMER_X1;
+    BLOCK_WRITE(dev, acr, qt->acr[block]);
+    BLOCK_WRITE(dev, ctu, preset >> 8);
+    BLOCK_WRITE(dev, ctl, preset & 0xff);
+    actual = BLOCK_READ(dev, ctg);         /* Restart the C/T with the new preset */
+
+    dev->ctPreset = preset;
     return OK;
 }
 
+/******************************************************************************
+ *
+ * tyGSOctalRead - read characters, timestamping them if enabled
+ *
+ * Each Rx burst timestamp records the offset of its first character in the
+ * stream accepted by tyLib (rxDelivered), and rxConsumed counts the chars
+ * returned here, so the first character of each read has a known offset.
+ * When Rx timestamping is on, find the burst holding that character and
+ * record its arrival time for TYGS_RXSTAMP_GET, and the delay from arrival
+ * to now in the read latency histogram.
+ *
+ * NOMANUAL
+ */
+LOCAL int tyGSOctalRead
+    (
+    TY_GSOCTAL_DEV *dev,
+    char *buffer,
+    long maxbytes
+    )
+{
+    int nbytes = tyRead(&dev->tyDev, buffer, maxbytes);
+    unsigned long pos = dev->rxConsumed;    /* offset of buffer[0] */
+
+    if (nbytes <= 0)
+        return nbytes;
+    dev->rxConsumed += nbytes;
+
+    if (dev->stampOn) {
+        epicsUInt32 now = tyGSOctalStamp();
+        int stamped = 0, k, key;
+
+        key = intLock();
+        for (k = 1; k <= dev->stampCount; k++) {
+            TYGS_STAMP *ps =
+                &dev->stampRing[(dev->stampHead - k) & (TYGS_NSTAMPS - 1)];
+
+            dev->readStamp = ps->stamp;     /* oldest one if none match */
+            stamped = 1;
+            if ((long) (pos - ps->seq) >= 0)
+                break;
+        }
+        intUnlock(key);
+
+        if (stamped)
+            dev->latHist[tyGSOctalHistBin(now - dev->readStamp)]++;
+    }
+    return nbytes;
+}
+
 /******************************************************************************
  *
  * tyGSOctalIoctl - special device control
  *
- * This routine handles FIOBAUDRATE, SIO_BAUD_SET and SIO_HW_OPTS_SET
- * requests and passes all others to tyIoctl().
+ * This routine handles FIOBAUDRATE, SIO_BAUD_SET, SIO_HW_OPTS_SET and the
+ * TYGS_RXSTAMP requests and passes all others to tyIoctl().
  *
  * RETURNS: OK, or ERROR if invalid input.
  */
@@ -786,6 +1151,24 @@ LOCAL STATUS tyGSOctalIoctl
     case SIO_HW_OPTS_GET:
         *(int *)arg = dev->opts;
         break;
+    case TYGS_RXSTAMP_ENABLE:
+        key = intLock ();
+        dev->stampOn = arg;
+        dev->stampCount = 0;
+        intUnlock (key);
+        break;
+    case TYGS_RXSTAMP_GET:
+        ((TYGS_RXSTAMP *) arg)->stamp = dev->readStamp;
+        ((TYGS_RXSTAMP *) arg)->freq = tyGSOctalStampFreq();
+        break;
+    case FIOFLUSH:
+    case FIORFLUSH:
+        /* The discarded chars will never be read */
+        status = tyIoctl (&dev->tyDev, request, arg);
+        key = intLock ();
+        dev->rxConsumed = dev->rxDelivered;
+        intUnlock (key);
+        break;
     default:
         status = tyIoctl (&dev->tyDev, request, arg);
         break;
@@ -814,6 +1197,7 @@ STATUS tyGSOctalConfig (
     TY_GSOCTAL_DEV *dev = (TY_GSOCTAL_DEV *) iosDevFind(name, NULL);
     int opts = 0;
     int key;
+    STATUS status;
 
     if (!dev || strcmp(dev->tyDev.devHdr.name, name)) {
         printf("%s: Device %s not found\n", fn_nm, name);
@@ -848,14 +1232,201 @@ STATUS tyGSOctalConfig (
 
     key = intLock ();
     tyGSOctalOptsSet(dev, opts);
-    tyGSOctalBaudSet(dev, baud);
+    status = tyGSOctalBaudSet(dev, baud);
     intUnlock (key);
+
+    if (status != OK) {
+        printf("%s: %d baud not possible on %s\n", fn_nm, baud, name);
+        if (baud <= 0 || SCC_CT_BAUD_CLOCK / baud < SCC_CT_MIN_PRESET)
+            printf("    Highest rate is %d baud\n",
+                SCC_CT_BAUD_CLOCK / SCC_CT_MIN_PRESET);
+        else
+            printf("    Rate error over %d.%d%%, or the other port of "
+                "this block uses a different C/T rate\n",
+                TYGS_BAUD_ERROR / 10, TYGS_BAUD_ERROR % 10);
+        return ERROR;
+    }
+    return OK;
+}
+
+/******************************************************************************
+ *
+ * tyGSOctalMsgPut - add a received character to the message being framed
+ *
+ * Characters are held back from tyLib until the message is complete, then
+ * the whole message is passed up at once, so a reader blocked in tyRead()
+ * wakes once per message instead of once per character.  A message ends
+ * with a terminator character, when the length given by its prefix has
+ * arrived, or when it fills the buffer.
+ *
+ * NOMANUAL
+ */
+LOCAL void tyGSOctalMsgPut
+    (
+    TY_GSOCTAL_DEV *dev,
+    char c
+    )
+{
+    int done;
+
+    dev->msgBuf[dev->msgLen++] = c;
+
+    if (dev->msgPrefix) {
+        if (dev->msgLen == dev->msgPrefix) {
+            int i, len = 0;
+
+            for (i = 0; i < dev->msgPrefix; i++)    /* Big-endian */
+                len = (len << 8) | (epicsUInt8) dev->msgBuf[i];
+            dev->msgNeed = dev->msgPrefix + len;
+        }
+        done = (dev->msgLen >= dev->msgPrefix && dev->msgLen >= dev->msgNeed);
+    }
+    else
+        done = (memchr(dev->msgTerm, c, dev->msgNterm) != NULL);
+
+    if (!done && dev->msgLen >= dev->msgMax) {
+        done = 1;
+        dev->msgOverflow++;
+    }
+
+    if (done) {
+        int i;
+
+        for (i = 0; i < dev->msgLen; i++)
+            if (tyIRd(&dev->tyDev, dev->msgBuf[i]) == OK)
+                dev->rxDelivered++;
+        dev->msgLen = 0;
+        dev->msgNeed = 0;
+        dev->msgCount++;
+    }
+}
+
+/******************************************************************************
+ *
+ * tyGSOctalFraming - deliver received data to readers a message at a time
+ *
+ * When maxFrame is non-zero the ISR collects received characters until a
+ * message is complete and only then passes it to tyLib.  A message ends
+ * at any character in terms (C escapes such as \r\n are allowed), or, if
+ * lenPrefix is 1 or 2, after the big-endian length held in its first
+ * lenPrefix bytes plus the prefix itself.  A message that reaches maxFrame
+ * characters is passed up as it stands.  maxFrame = 0 turns framing off,
+ * passing up any partial message.
+ *
+ * RETURNS: OK, or ERROR for a bad device or arguments.
+ */
+STATUS tyGSOctalFraming
+    (
+    char *       name,           /* device name */
+    int          maxFrame,       /* maximum message size, 0 = off */
+    const char * terms,          /* message terminator characters */
+    int          lenPrefix       /* length prefix bytes, 0 = none */
+    )
+{
+    static char *fn_nm = "tyGSOctalFraming";
+    TY_GSOCTAL_DEV *dev = (TY_GSOCTAL_DEV *) iosDevFind(name, NULL);
+    char term[sizeof(dev->msgTerm)];
+    char *newBuf = NULL, *oldBuf;
+    int nterm = 0;
+    int key;
+
+    if (!dev || strcmp(dev->tyDev.devHdr.name, name)) {
+        printf("%s: Device %s not found\n", fn_nm, name);
+        return ERROR;
+    }
+
+    if (maxFrame < 0 || lenPrefix < 0 || lenPrefix > 2 ||
+        (maxFrame && maxFrame <= lenPrefix)) {
+        printf("%s: Bad maxFrame or lenPrefix\n", fn_nm);
+        return ERROR;
+    }
+
+    if (maxFrame) {
+        if (terms)
+            nterm = epicsStrnRawFromEscaped(term, sizeof(term), terms,
+                strlen(terms));
+        if (!lenPrefix && nterm == 0) {
+            printf("%s: Need terminators or a length prefix\n", fn_nm);
+            return ERROR;
+        }
+        newBuf = malloc(maxFrame);
+        if (!newBuf) {
+            printf("%s: Memory allocation failed!\n", fn_nm);
+            return ERROR;
+        }
+    }
+
+    key = intLock();
+    oldBuf = dev->msgBuf;
+    if (oldBuf) {           /* Pass up any partial message */
+        int i;
+
+        for (i = 0; i < dev->msgLen; i++)
+            if (tyIRd(&dev->tyDev, oldBuf[i]) == OK)
+                dev->rxDelivered++;
+    }
+    memcpy(dev->msgTerm, term, nterm);
+    dev->msgNterm = nterm;
+    dev->msgPrefix = lenPrefix;
+    dev->msgMax = maxFrame;
+    dev->msgLen = 0;
+    dev->msgNeed = 0;
+    dev->msgBuf = newBuf;
+    intUnlock(key);
+
+    free(oldBuf);
     return OK;
 }
 
+/*****************************************************************************
+ * tyGSOctalStampBurst - timestamp the first character of an Rx burst
+ *
+ * Called from the ISR before the burst is read.  The character's position
+ * in the stream passed to tyLib lets tyGSOctalRead() find the burst again.
+ *
+ * NOMANUAL
+ */
+LOCAL void tyGSOctalStampBurst
+    (
+    TY_GSOCTAL_DEV *dev
+    )
+{
+    epicsUInt32 now = tyGSOctalStamp();
+    TYGS_STAMP *ps = &dev->stampRing[dev->stampHead];
+
+    if (dev->stampCount)
+        dev->gapHist[tyGSOctalHistBin(now - dev->stampLast)]++;
+    dev->stampLast = now;
+
+    ps->stamp = now;
+    ps->seq = dev->rxDelivered + (dev->msgBuf ? dev->msgLen : 0);
+    dev->stampHead = (dev->stampHead + 1) & (TYGS_NSTAMPS - 1);
+    if (dev->stampCount < TYGS_NSTAMPS)
+        dev->stampCount++;
+}
+
+/* tyGSOctalHistBin - log2 histogram bin; bin n holds values below 2^n */
+LOCAL int tyGSOctalHistBin
+    (
+    epicsUInt32 value
+    )
+{
+    int bin = 0;
+
+    while (value && bin < TYGS_NHIST - 1) {
+        value >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
 /*****************************************************************************
  * tyGSOctalInt - interrupt level processing
  *
+ * Make one round-robin pass over the ports, starting after the last port
+ * serviced by the previous interrupt, until the module's budget of
+ * characters is used up.  A budget of 0 services one channel only.
+ *
  * NOMANUAL
  */
 void tyGSOctalInt
@@ -865,86 +1436,117 @@ void tyGSOctalInt
 {
     epicsUInt8 sr, isr;
     QUAD_TABLE *qt = &tyGSOctalModules[mod];
-    SCC2698 *regs;
     volatile epicsUInt8 *flush = NULL;
+    int budget = qt->budget;
+    int nchars = 0;
     int scan;
 
     qt->interruptCount++;
 
-
-    /*
-     * Check each port for work, stop when we find some.
-     * Next time we're called for this module, continue
-     * scanning with the next port (enforce fairness).
-     */
     for (scan = 1; scan <= 8; scan++) {
         int port = (qt->scan + scan) & 7;
         TY_GSOCTAL_DEV *dev = &qt->dev[port];
-        SCC2698_CHAN *chan;
+        epicsUInt8 errs;
         int block;
         int key;
+        int work = 0;
 
         if (!dev->created)
             continue;
 
         block = dev->block;
-        chan = dev->chan;
-        regs = dev->regs;
 
         key = intLock();
-        sr = chan->u.r.sr;
+        sr = CHAN_READ(dev, sr);
+        errs = sr & 0xf0;
 
         /* Only examine the active interrupts */
-        isr = regs->u.r.isr & qt->imr[block];
+        isr = BLOCK_READ(dev, isr) & qt->imr[block];
 
         /* Channel B interrupt data is on the upper nibble */
         if ((port % 2) == 1)
             isr >>= 4;
 
-        if (isr & 0x02) /* a byte needs to be read */
-        {
-            char inChar = chan->u.r.rhr;
-
-            tyIRd(&dev->tyDev, inChar);
-            dev->readCount++;
+        /*
+         * Read until the Rx FIFO is empty or the budget is used
+         */
+        if (isr & 0x02) {
+            if (dev->stampOn)
+                tyGSOctalStampBurst(dev);
+            do {
+                char inChar = CHAN_READ(dev, rhr);
+
+                if (dev->msgBuf)
+                    tyGSOctalMsgPut(dev, inChar);
+                else if (tyIRd(&dev->tyDev, inChar) == OK)
+                    dev->rxDelivered++;
+                dev->readCount++;
+                work++;
+                sr = CHAN_READ(dev, sr);
+                errs |= sr & 0xf0;
+            } while ((sr & 0x01) && (nchars + work < budget));
+            if (work > dev->rxPeak)
+                dev->rxPeak = work;
         }
 
-        if (isr & 0x01) /* a byte needs to be sent */
-        {
+        /*
+         * Send a byte if the budget allows
+         */
+        if ((isr & 0x01) && (budget == 0 || nchars + work < budget)) {
             char outChar;
 
             if (tyITx(&dev->tyDev, &outChar) == OK) {
-                chan->u.w.thr = outChar;
+                CHAN_WRITE(dev, thr, outChar);
                 dev->writeCount++;
-                chan->u.w.cr = 0;   /* Null command */
-                flush = &chan->u.w.cr;
+                work++;
+                CHAN_WRITE(dev, cr, 0);   /* Null command */
+                flush = &dev->chan->u.w.cr;
             }
             else {
                 /* deactivate Tx INT and disable Tx INT */
                 qt->imr[block] &= ~dev->irqEnable;
-                regs->u.w.imr = qt->imr[block];
-                flush = &regs->u.w.imr;
+                BLOCK_WRITE(dev, imr, qt->imr[block]);
+                flush = &dev->regs->u.w.imr;
             }
         }
 
-        /* Reset errors */
-        if (sr & 0xf0) {
+        /*
+         * Reset errors
+         */
+        if (errs) {
             dev->errorCount++;
-            chan->u.w.cr = 0x40;
-            flush = &chan->u.w.cr;
+            if (errs & 0x10)
+                dev->errCount[TYGS_ERR_OVERRUN]++;
+            if (errs & 0x20)
+                dev->errCount[TYGS_ERR_PARITY]++;
+            if (errs & 0x40)
+                dev->errCount[TYGS_ERR_FRAMING]++;
+            if (errs & 0x80)
+                dev->errCount[TYGS_ERR_BREAK]++;
+            CHAN_WRITE(dev, cr, 0x40);
+            flush = &dev->chan->u.w.cr;
         }
 
         intUnlock(key);
 
-        /* Exit after processing one channel */
-        if ((isr & 0x03) || (sr & 0xf0)) {
+        if ((isr & 0x03) || errs) {
             qt->scan = port;
-            break;
+            nchars += work;
+            if (budget == 0)
+                break;      /* One channel per interrupt */
+            if (nchars >= budget) {
+                qt->budgetCount++;
+                break;
+            }
         }
     }
 
+    qt->charCount += nchars;
+    if (nchars > qt->maxChars)
+        qt->maxChars = nchars;
+
     if (flush)
-        isr = *flush;    /* Flush last write cycle */
+        isr = IPAC_READ(qt->pio, *flush);    /* Flush last write cycle */
 }
 
 /******************************************************************************
@@ -960,23 +1562,21 @@ LOCAL void tyGSOctalStartup
 {
     char outChar;
     QUAD_TABLE *qt = dev->qt;
-    SCC2698 *regs = dev->regs;
-    SCC2698_CHAN *chan = dev->chan;
     int block = dev->block;
     int key;
 
     key = intLock();
     if (tyITx (&dev->tyDev, &outChar) == OK) {
-        if (chan->u.r.sr & 0x04)
-            chan->u.w.thr = outChar;
+        if (CHAN_READ(dev, sr) & 0x04)
+            CHAN_WRITE(dev, thr, outChar);
 
         qt->imr[block] |= dev->irqEnable; /* activate Tx interrupt */
-        regs->u.w.imr = qt->imr[block]; /* enable Tx interrupt */
+        BLOCK_WRITE(dev, imr, qt->imr[block]); /* enable Tx interrupt */
         intUnlock(key);
     }
     else {
         qt->imr[block] &= ~dev->irqEnable;
-        regs->u.w.imr = qt->imr[block];
+        BLOCK_WRITE(dev, imr, qt->imr[block]);
         intUnlock(key);
     }
 }
@@ -1058,11 +1658,65 @@ static void tyGSOctalConfigCallFunc(const iocshArgBuf *arg)
         arg[3].ival, arg[4].ival, arg[5].sval[0]);
 }
 
+/* tyGSOctalBudget */
+static const iocshArg tyGSOctalBudgetArg0 = {"moduleID", iocshArgString};
+static const iocshArg tyGSOctalBudgetArg1 = {"budget", iocshArgInt};
+static const iocshArg * const tyGSOctalBudgetArgs[2] = {
+    &tyGSOctalBudgetArg0, &tyGSOctalBudgetArg1};
+static const iocshFuncDef tyGSOctalBudgetFuncDef =
+    {"tyGSOctalBudget",2,tyGSOctalBudgetArgs};
+static void tyGSOctalBudgetCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalBudget(arg[0].sval, arg[1].ival);
+}
+
+/* tyGSOctalFraming */
+static const iocshArg tyGSOctalFramingArg0 = {"devName",iocshArgString};
+static const iocshArg tyGSOctalFramingArg1 = {"maxFrame", iocshArgInt};
+static const iocshArg tyGSOctalFramingArg2 = {"terms", iocshArgString};
+static const iocshArg tyGSOctalFramingArg3 = {"lenPrefix", iocshArgInt};
+static const iocshArg * const tyGSOctalFramingArgs[4] = {
+    &tyGSOctalFramingArg0, &tyGSOctalFramingArg1,
+    &tyGSOctalFramingArg2, &tyGSOctalFramingArg3};
+static const iocshFuncDef tyGSOctalFramingFuncDef =
+    {"tyGSOctalFraming",4,tyGSOctalFramingArgs};
+static void tyGSOctalFramingCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalFraming(arg[0].sval, arg[1].ival, arg[2].sval, arg[3].ival);
+}
+
+/* tyGSOctalErrorPeriod */
+static const iocshArg tyGSOctalErrorPeriodArg0 = {"seconds", iocshArgDouble};
+static const iocshArg * const tyGSOctalErrorPeriodArgs[1] =
+    {&tyGSOctalErrorPeriodArg0};
+static const iocshFuncDef tyGSOctalErrorPeriodFuncDef =
+    {"tyGSOctalErrorPeriod",1,tyGSOctalErrorPeriodArgs};
+static void tyGSOctalErrorPeriodCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalErrorPeriod(arg[0].dval);
+}
+
+/* tyGSOctalRxStamp */
+static const iocshArg tyGSOctalRxStampArg0 = {"devName", iocshArgString};
+static const iocshArg tyGSOctalRxStampArg1 = {"on", iocshArgInt};
+static const iocshArg * const tyGSOctalRxStampArgs[2] = {
+    &tyGSOctalRxStampArg0, &tyGSOctalRxStampArg1};
+static const iocshFuncDef tyGSOctalRxStampFuncDef =
+    {"tyGSOctalRxStamp",2,tyGSOctalRxStampArgs};
+static void tyGSOctalRxStampCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalRxStamp(arg[0].sval, arg[1].ival);
+}
+
 static void tyGSOctalRegistrar(void) {
     iocshRegister(&tyGSOctalDrvFuncDef,tyGSOctalDrvCallFunc);
     iocshRegister(&tyGSOctalReportFuncDef,tyGSOctalReportCallFunc);
     iocshRegister(&tyGSOctalModuleInitFuncDef,tyGSOctalModuleInitCallFunc);
     iocshRegister(&tyGSOctalDevCreateFuncDef,tyGSOctalDevCreateCallFunc);
+    iocshRegister(&tyGSOctalBudgetFuncDef,tyGSOctalBudgetCallFunc);
+    iocshRegister(&tyGSOctalFramingFuncDef,tyGSOctalFramingCallFunc);
+    iocshRegister(&tyGSOctalErrorPeriodFuncDef,tyGSOctalErrorPeriodCallFunc);
+    iocshRegister(&tyGSOctalRxStampFuncDef,tyGSOctalRxStampCallFunc);
     iocshRegister(&tyGSOctalConfigFuncDef,tyGSOctalConfigCallFunc);
 }
 epicsExportRegistrar(tyGSOctalRegistrar);
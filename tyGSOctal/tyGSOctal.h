@@ -20,9 +20,22 @@
 #define INC_TYGSOCTAL_H
 
 #include "scc2698.h"
+#include "tyGSOctalExt.h"
+#include "drvIpac.h"
 
 typedef enum { RS485,RS232 } RSmode;
 
+#define TYGS_DEFAULT_BUDGET 16  /* characters serviced per interrupt */
+#define TYGS_BAUD_ERROR     20  /* max C/T baud rate error, 0.1% units */
+#define TYGS_NSTAMPS        16  /* Rx burst timestamps per port, power of 2 */
+#define TYGS_NHIST          32  /* log2 histogram bins */
+#define TYGS_TXRDY_WAIT     10000   /* polled TxRDY wait, us, at least */
+
+typedef struct {
+    epicsUInt32     stamp;      /* arrival of the burst's first char */
+    unsigned long   seq;        /* its position in the rxDelivered stream */
+} TYGS_STAMP;
+
 typedef struct ty_gsoctal_dev {
     TY_DEV          tyDev;
     SCC2698*        regs;
@@ -33,11 +46,38 @@ typedef struct ty_gsoctal_dev {
     struct quadTable *qt;
     RSmode          mode;
     int             baud;
+    int             ctPreset;       /* block C/T preset, 0 = fixed rate */
     int             opts;
     epicsUInt8      irqEnable;
+    int             txMode;         /* RTEMS termios output mode */
+    int             txPending;      /* RTEMS chars written, not yet dequeued */
+    unsigned long   txTimeouts;     /* RTEMS polled writes cut short */
+    int             ctsFlow;        /* RTEMS CRTSCTS, CTS may hold Tx off */
     unsigned long   readCount;
     unsigned long   writeCount;
     unsigned long   errorCount;
+    unsigned int    rxPeak;         /* see tyGSOctalStats() */
+    unsigned long   errCount[TYGS_NERRS];   /* written by the ISR */
+    unsigned long   errSeen[TYGS_NERRS];    /* at last error summary */
+    char           *msgBuf;         /* Rx message being framed, or NULL */
+    int             msgMax;         /* maximum message size */
+    int             msgLen;         /* chars in msgBuf */
+    int             msgNeed;        /* length from prefix, once known */
+    int             msgPrefix;      /* length prefix bytes, 0 = terminators */
+    int             msgNterm;
+    char            msgTerm[8];     /* message terminator chars */
+    unsigned long   msgCount;       /* messages delivered */
+    unsigned long   msgOverflow;    /* messages cut at msgMax */
+    unsigned long   rxDelivered;    /* chars accepted by tyLib/termios */
+    unsigned long   rxConsumed;     /* chars returned by read() */
+    int             stampOn;        /* Rx burst timestamping enabled */
+    int             stampHead;
+    int             stampCount;
+    epicsUInt32     stampLast;      /* previous burst, for gapHist */
+    epicsUInt32     readStamp;      /* arrival of first char of last read */
+    TYGS_STAMP      stampRing[TYGS_NSTAMPS];
+    unsigned long   latHist[TYGS_NHIST];    /* arrival to read, log2 counts */
+    unsigned long   gapHist[TYGS_NHIST];    /* between Rx bursts, log2 counts */
 } TY_GSOCTAL_DEV;
 
 typedef struct quadTable {
@@ -47,14 +87,21 @@ typedef struct quadTable {
     epicsUInt16    carrier;
     epicsUInt16    slot;
     epicsUInt16    scan;
+    ipac_counter_t *pio;                /* I/O space access counter */
     epicsUInt8     imr[4];              /* one per block */
-    int 
+    epicsUInt8     acr[4];              /* one per block */
+    int            budget;              /* chars per interrupt, 0 = 1 channel */
     unsigned long  interruptCount;
+    unsigned long  charCount;           /* chars moved by the ISR */
+    unsigned long  budgetCount;         /* interrupts that used up the budget */
+    unsigned int   maxChars;            /* most chars in one interrupt */
 } QUAD_TABLE;
 
 int tyGSOctalDrv(int);
 int tyGSOctalModuleInit(const char *, const char *, int, int, int);
 const char *tyGSOctalDevCreate(char *, const char *, int, int, int);
 void tyGSOctalReport(void);
+int tyGSOctalBudget(const char *, int);
+int tyGSOctalTxMode(const char *, int, const char *);
 
 #endif
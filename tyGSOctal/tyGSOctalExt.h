@@ -0,0 +1,46 @@
+/**************************************************************************
+ Header:        tyGSOctalExt.h
+
+ Description:   Externally accessible tyGSOctal definitions, for use by
+ device support and application code without the driver internals.
+**************************************************************************/
+
+#ifndef INC_TYGSOCTALEXT_H
+#define INC_TYGSOCTALEXT_H
+
+#include <epicsTypes.h>
+
+/* Rx error counter indices for tyGSOctalErrCounts() */
+typedef enum {
+    TYGS_ERR_OVERRUN,
+    TYGS_ERR_PARITY,
+    TYGS_ERR_FRAMING,
+    TYGS_ERR_BREAK,
+    TYGS_NERRS
+} TYGS_ERR;
+
+/* Rx timestamp ioctl() codes */
+#define TYGS_RXSTAMP_ENABLE 0x47530001  /* arg: 1 = on, 0 = off */
+#define TYGS_RXSTAMP_GET    0x47530002  /* arg: TYGS_RXSTAMP * */
+
+typedef struct {
+    epicsUInt32     stamp;      /* arrival of the first char of the last read */
+    epicsUInt32     freq;       /* timestamp counts per second */
+} TYGS_RXSTAMP;
+
+/* Port counters returned by tyGSOctalStats() */
+typedef struct {
+    unsigned long   readCount;  /* chars received */
+    unsigned long   writeCount; /* chars sent */
+    unsigned long   irqCount;   /* module interrupts */
+    unsigned long   errors;     /* Rx errors */
+    unsigned long   overruns;   /* Rx overrun errors */
+    unsigned int    fifoPeak;   /* most Rx chars read in one ISR visit */
+    unsigned long   txTimeouts; /* polled writes that gave up on TxRDY */
+} TYGS_STATS;
+
+int tyGSOctalErrCounts(const char *, int, unsigned long *);
+void tyGSOctalErrorPeriod(double);
+int tyGSOctalStats(const char *, int, TYGS_STATS *, int);
+
+#endif
@@ -14,6 +14,7 @@
 #include <epicsExport.h>
 #include <errlog.h>
 #include <devLib.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <termios.h>
@@ -31,100 +32,256 @@ typedef void *TY_DEV;
 #include "tyGSOctal.h"      /* Device driver includes */
 #include "drvIpac.h"        /* IP management (from drvIpac) */
 
+/*
+ * Register access through drvIpac, which can count the accesses or pass
+ * them to a register emulator (see IPAC_READ in drvIpac.h).
+ */
+#define CHAN_READ(dev, reg)         IPAC_READ((dev)->qt->pio, (dev)->chan->u.r.reg)
+#define CHAN_WRITE(dev, reg, value) IPAC_WRITE((dev)->qt->pio, (dev)->chan->u.w.reg, (value))
+#define BLOCK_READ(dev, reg)        IPAC_READ((dev)->qt->pio, (dev)->regs->u.r.reg)
+#define BLOCK_WRITE(dev, reg, value) IPAC_WRITE((dev)->qt->pio, (dev)->regs->u.w.reg, (value))
+
 /*
  * 'Global' variables
  */
 static QUAD_TABLE *tyGSOctalModules;
 static int tyGSOctalMaxModules;
 static int tyGSOctalLastModule;
+static double tyGSOctalErrPeriod = 10.0;   /* seconds, 0 = no summaries */
+static void tyGSOctalErrTask(void *);
+
+/*
+ * Rx timestamps, in microseconds of uptime
+ */
+#define TYGS_STAMP_FREQ 1000000
+
+static epicsUInt32
+tyGSOctalStamp(void)
+{
+    struct timespec now;
+
+    rtems_clock_get_uptime(&now);
+    return (epicsUInt32) now.tv_sec * TYGS_STAMP_FREQ + now.tv_nsec / 1000;
+}
+
+/*
+ * log2 histogram bin; bin n holds values below 2^n
+ */
+static int
+tyGSOctalHistBin(epicsUInt32 value)
+{
+    int bin = 0;
+
+    while (value && bin < TYGS_NHIST - 1) {
+        value >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+/*
+ * Print the non-empty bins of a histogram in microseconds
+ */
+static void
+tyGSOctalHistPrint(int port, const char *title, const unsigned long *hist)
+{
+    int bin;
+
+    printf("  Port %d: %s (us):", port, title);
+    for (bin = 0; bin < TYGS_NHIST; bin++)
+        if (hist[bin])
+            printf(" <%lu:%lu", 1UL << bin, hist[bin]);
+    printf("\n");
+}
+
+/*
+ * Timestamp the first character of an Rx burst, called from the ISR.
+ * The character's position in the stream passed to termios lets
+ * tyGsOctalRead() find the burst again.
+ */
+static void
+tyGSOctalStampBurst(TY_GSOCTAL_DEV *dev)
+{
+    epicsUInt32 now = tyGSOctalStamp();
+    TYGS_STAMP *ps = &dev->stampRing[dev->stampHead];
+
+    if (dev->stampCount)
+        dev->gapHist[tyGSOctalHistBin(now - dev->stampLast)]++;
+    dev->stampLast = now;
+
+    ps->stamp = now;
+    ps->seq = dev->rxDelivered + (dev->msgBuf ? dev->msgLen : 0);
+    dev->stampHead = (dev->stampHead + 1) & (TYGS_NSTAMPS - 1);
+    if (dev->stampCount < TYGS_NSTAMPS)
+        dev->stampCount++;
+}
 rtems_device_major_number tyGsOctalMajor;
 
+/*
+ * Add a received character to the message being framed
+ *
+ * Characters are held back from termios until the message is complete,
+ * then the whole message is queued at once, so a blocked reader wakes
+ * once per message instead of once per character.  A message ends with a
+ * terminator character, when the length given by its prefix has arrived,
+ * or when it fills the buffer.
+ */
+static void
+tyGSOctalMsgPut(TY_GSOCTAL_DEV *dev, char c)
+{
+    int done;
+
+    dev->msgBuf[dev->msgLen++] = c;
+
+    if (dev->msgPrefix) {
+        if (dev->msgLen == dev->msgPrefix) {
+            int i, len = 0;
+
+            for (i = 0; i < dev->msgPrefix; i++)    /* Big-endian */
+                len = (len << 8) | (epicsUInt8) dev->msgBuf[i];
+            dev->msgNeed = dev->msgPrefix + len;
+        }
+        done = (dev->msgLen >= dev->msgPrefix && dev->msgLen >= dev->msgNeed);
+    }
+    else
+        done = (memchr(dev->msgTerm, c, dev->msgNterm) != NULL);
+
+    if (!done && dev->msgLen >= dev->msgMax) {
+        done = 1;
+        dev->msgOverflow++;
+    }
+
+    if (done) {
+        if (dev->tyDev)
+            dev->rxDelivered += dev->msgLen -
+                rtems_termios_enqueue_raw_characters(dev->tyDev, dev->msgBuf,
+                    dev->msgLen);
+        dev->msgLen = 0;
+        dev->msgNeed = 0;
+        dev->msgCount++;
+    }
+}
+
 /*
  * Interrupt handler
+ *
+ * Make one round-robin pass over the ports, starting after the last port
+ * serviced by the previous interrupt, until the module's budget of
+ * characters is used up.  A budget of 0 services one channel only.
  */
 static void
 tyGSOctalInt(int mod)
 {
     epicsUInt8 sr, isr;
     QUAD_TABLE *qt = &tyGSOctalModules[mod];
-    SCC2698 *regs;
     volatile epicsUInt8 *flush = NULL;
+    int budget = qt->budget;
+    int nchars = 0;
     int scan;
 
     qt->interruptCount++;
 
-    /*
-     * Check each port for work, stop when we find some.
-     * Next time we're called for this module, continue
-     * scanning with the next port (enforce fairness).
-     */
     for (scan = 1; scan <= 8; scan++) {
         int port = (qt->scan + scan) & 7;
         TY_GSOCTAL_DEV *dev = &qt->dev[port];
-        SCC2698_CHAN *chan;
+        epicsUInt8 errs;
         int block;
         int key;
+        int work = 0;
 
         if (!dev->created)
             continue;
 
         block = dev->block;
-        chan = dev->chan;
-        regs = dev->regs;
 
         key = epicsInterruptLock();
-        sr = chan->u.r.sr;
+        sr = CHAN_READ(dev, sr);
+        errs = sr & 0xf0;
 
         /* Only examine the active interrupts */
-        isr = regs->u.r.isr & qt->imr[block];
+        isr = BLOCK_READ(dev, isr) & qt->imr[block];
 
         /* Channel B interrupt status is in the upper nibble */
         if ((port % 2) == 1)
             isr >>= 4;
 
         /*
-         * If receiver is ready, read the character and push it up
+         * If receiver is ready, read characters and push them up
          */
         if (isr & 0x02) {
-            char inChar = chan->u.r.rhr;
-
-            dev->readCount++;
-            flush = NULL;
-            if (dev->tyDev)
-                rtems_termios_enqueue_raw_characters(dev->tyDev, &inChar, 1);
+            if (dev->stampOn)
+                tyGSOctalStampBurst(dev);
+            do {
+                char inChar = CHAN_READ(dev, rhr);
+
+                dev->readCount++;
+                work++;
+                if (dev->msgBuf)
+                    tyGSOctalMsgPut(dev, inChar);
+                else if (dev->tyDev)
+                    dev->rxDelivered += 1 -
+                        rtems_termios_enqueue_raw_characters(dev->tyDev, &inChar, 1);
+                sr = CHAN_READ(dev, sr);
+                errs |= sr & 0xf0;
+            } while ((sr & 0x01) && (nchars + work < budget));
+            if (work > dev->rxPeak)
+                dev->rxPeak = work;
         }
 
         /*
-         * If transmiter is ready tell termios that character has been sent.
+         * If transmitter is ready tell termios how many characters have
+         * been sent; it calls tyGsOctalCallbackWrite() with any more.
          */
-        if (isr & 0x1) {
+        if ((isr & 0x01) && (budget == 0 || nchars + work < budget)) {
+            int sent = dev->txPending;
+
             qt->imr[block] &= ~dev->irqEnable; /* deactivate Tx interrupt */
-            regs->u.w.imr = qt->imr[block];       /* disable Tx interrupt */
-            flush = &regs->u.w.imr;
-            dev->writeCount++;
+            BLOCK_WRITE(dev, imr, qt->imr[block]);  /* disable Tx interrupt */
+            flush = &dev->regs->u.w.imr;
+            dev->txPending = 0;
+            dev->writeCount += sent;
+            work += sent;
             if (dev->tyDev)
-                rtems_termios_dequeue_characters(dev->tyDev, 1);
+                rtems_termios_dequeue_characters(dev->tyDev, sent);
         }
 
         /*
          * Reset errors
          */
-        if (sr & 0xf0) {
+        if (errs) {
             dev->errorCount++;
-            chan->u.w.cr = 0x40;
-            flush = &chan->u.w.cr;
+            if (errs & 0x10)
+                dev->errCount[TYGS_ERR_OVERRUN]++;
+            if (errs & 0x20)
+                dev->errCount[TYGS_ERR_PARITY]++;
+            if (errs & 0x40)
+                dev->errCount[TYGS_ERR_FRAMING]++;
+            if (errs & 0x80)
+                dev->errCount[TYGS_ERR_BREAK]++;
+            CHAN_WRITE(dev, cr, 0x40);
+            flush = &dev->chan->u.w.cr;
         }
 
         epicsInterruptUnlock(key);
 
-        /* Exit after processing one channel */
-        if ((isr & 0x03) || (sr & 0xf0)) {
+        if ((isr & 0x03) || errs) {
             qt->scan = port;
-            break;
+            nchars += work;
+            if (budget == 0)
+                break;      /* One channel per interrupt */
+            if (nchars >= budget) {
+                qt->budgetCount++;
+                break;
+            }
         }
     }
+
+    qt->charCount += nchars;
+    if (nchars > qt->maxChars)
+        qt->maxChars = nchars;
+
     if (flush)
-        isr = *flush;    /* Flush last write cycle */
+        isr = IPAC_READ(qt->pio, *flush);    /* Flush last write cycle */
 }
 
 /*
@@ -148,6 +305,67 @@ csrForTermiosSpeedCode(int speedCode)
     return -1;
 }
 
+/*
+ * Use the block counter/timer to generate a rate not in the clock-select
+ * table.  The timer runs as a 16x clock from X1/CLK, giving rates of
+ * SCC_CT_BAUD_CLOCK / preset; both channels of a block share it, so they
+ * must agree on the preset.  Returns the clock-select code, or -1.
+ */
+static int
+tyGSOctalTimerBaud(TY_GSOCTAL_DEV *dev, int baud)
+{
+    QUAD_TABLE *qt = dev->qt;
+    TY_GSOCTAL_DEV *peer = &qt->dev[(dev - qt->dev) ^ 1];
+    int block = dev->block;
+    int preset, actual, error;
+    int key;
+
+    if (baud <= 0)
+        return -1;
+    preset = (SCC_CT_BAUD_CLOCK + baud / 2) / baud;
+    if (preset < SCC_CT_MIN_PRESET || preset > 0xffff) {
+        errlogPrintf("tyGSOctal: %d baud out of C/T range\n", baud);
+        return -1;
+    }
+    actual = SCC_CT_BAUD_CLOCK / preset;
+    error = (1000 * abs(actual - baud)) / baud;
+    if (error > TYGS_BAUD_ERROR) {
+        errlogPrintf("tyGSOctal: %d baud has %d.%d%% error from C/T\n",
+            baud, error / 10, error % 10);
+        return -1;
+    }
+    if (peer->ctPreset && peer->ctPreset != preset) {
+        errlogPrintf("tyGSOctal: %d baud conflicts with %d baud on the "
+            "other port of block %d\n", baud, peer->baud, block);
+        return -1;
+    }
+
+    key = epicsInterruptLock();
+    qt->acr[block] |= SCC_ACR_CT_TIMER_X1;
+    BLOCK_WRITE(dev, acr, qt->acr[block]);
+    BLOCK_WRITE(dev, ctu, preset >> 8);
+    BLOCK_WRITE(dev, ctl, preset & 0xff);
+    actual = BLOCK_READ(dev, ctg);  /* Restart the C/T with the new preset */
+    epicsInterruptUnlock(key);
+
+    dev->ctPreset = preset;
+    return SCC_CSR_TIMER & 0xf;
+}
+
+/*
+ * How long a polled write waits for TxRDY, in microseconds: 4 character
+ * times of 12 bits at the port's rate, but at least TYGS_TXRDY_WAIT.
+ */
+static epicsUInt32
+tyGSOctalTxWait(TY_GSOCTAL_DEV *dev)
+{
+    epicsUInt32 wait = TYGS_TXRDY_WAIT;
+
+    if (dev->baud > 0 && 48000000 / dev->baud > wait)
+        wait = 48000000 / dev->baud;
+    return wait;
+}
+
 /*
  * TERMIOS callback routines
  */
@@ -156,15 +374,60 @@ tyGsOctalCallbackWrite(int minor, const char *buf, size_t len)
 {
     QUAD_TABLE *qt = &tyGSOctalModules[minor/8];
     TY_GSOCTAL_DEV *dev = &qt->dev[minor%8];
-    SCC2698_CHAN *chan = dev->chan;
-    SCC2698 *regs = dev->regs;
     int block = dev->block;
+    size_t sent = 0;
     int key;
 
+    /*
+     * With CRTSCTS set CTS may hold the transmitter off for as long as
+     * the other end likes, so after each tyGSOctalTxWait() of spinning
+     * the writing thread sleeps and tries again, as output waits in the
+     * other modes.  Without CRTSCTS nothing should stop the transmitter,
+     * so one that isn't ready within tyGSOctalTxWait() is stuck or
+     * disabled; the rest of the buffer is discarded and counted.
+     */
+    if (dev->txMode == TERMIOS_POLLED) {
+        epicsUInt32 wait = tyGSOctalTxWait(dev);
+
+        while (sent < len) {
+            epicsUInt32 start = tyGSOctalStamp();
+            int ready;
+
+            while (!(ready = CHAN_READ(dev, sr) & 0x04) &&  /* Wait for TxRDY */
+                   tyGSOctalStamp() - start <= wait)
+                ;
+            if (!ready && dev->ctsFlow) {
+                epicsThreadSleep(epicsThreadSleepQuantum());
+                continue;
+            }
+            if (!ready) {
+                dev->txTimeouts++;
+                break;
+            }
+            CHAN_WRITE(dev, thr, buf[sent++]);
+        }
+        dev->writeCount += sent;
+        return sent;
+    }
+
+    /*
+     * Termios calls with len == 0 when its output buffer is empty; the
+     * Tx interrupt was already disabled when the last byte was counted.
+     */
+    if (len == 0)
+        return 0;
+
+    /*
+     * Load the transmitter while it has room, usually the holding
+     * register and (when idle) the shift register behind it.  The Tx
+     * interrupt reports the count back to termios.
+     */
     key = epicsInterruptLock();
-    chan->u.w.thr = *buf;
+    while (sent < len && (CHAN_READ(dev, sr) & 0x04))
+        CHAN_WRITE(dev, thr, buf[sent++]);
+    dev->txPending = sent;
     qt->imr[block] |= dev->irqEnable;  /* activate Tx interrupt */
-    regs->u.w.imr = qt->imr[block];             /* enable Tx interrupt */
+    BLOCK_WRITE(dev, imr, qt->imr[block]);      /* enable Tx interrupt */
     epicsInterruptUnlock(key);
     return 0;
 }
@@ -174,15 +437,25 @@ tyGsOctalCallbackSetAttributes(int minor, const struct termios *termios)
 {
     QUAD_TABLE *qt = &tyGSOctalModules[minor/8];
     TY_GSOCTAL_DEV *dev = &qt->dev[minor%8];
-    SCC2698_CHAN *chan = dev->chan;
-    SCC2698 *regs = dev->regs;
     int rxcsr, txcsr;
     int mr1, mr2;
+    int baud;
 
     if (((rxcsr = csrForTermiosSpeedCode(cfgetispeed(termios))) < 0)
-     || ((txcsr = csrForTermiosSpeedCode(cfgetospeed(termios))) < 0))
-        return RTEMS_INVALID_NUMBER;
-    chan->u.w.csr = (rxcsr << 4) | txcsr;
+     || ((txcsr = csrForTermiosSpeedCode(cfgetospeed(termios))) < 0)) {
+        /* Only one C/T rate per channel, so Rx and Tx must match */
+        if (cfgetispeed(termios) != cfgetospeed(termios))
+            return RTEMS_INVALID_NUMBER;
+        baud = rtems_termios_baud_to_number(cfgetospeed(termios));
+        if ((rxcsr = txcsr = tyGSOctalTimerBaud(dev, baud)) < 0)
+            return RTEMS_INVALID_NUMBER;
+    }
+    else {
+        baud = rtems_termios_baud_to_number(cfgetospeed(termios));
+        dev->ctPreset = 0;
+    }
+    CHAN_WRITE(dev, csr, (rxcsr << 4) | txcsr);
+    dev->baud = baud;
     
     switch (termios->c_cflag & CSIZE) {
     case CS5:     mr1 = 0x0; break;
@@ -203,12 +476,13 @@ tyGsOctalCallbackSetAttributes(int minor, const struct termios *termios)
         mr1 |=0x80;      /* Control RTS from RxFIFO */
         mr2 |=0x10;      /* Enable Tx using CTS */
     }
-    regs->u.w.opcr = 0x80; /* MPPn = output, MPOa/b = RTSN */
-    chan->u.w.cr = 0x10; /* point MR to MR1 */
-    chan->u.w.mr = mr1;
-    chan->u.w.mr = mr2;
+    dev->ctsFlow = (mr2 & 0x10) != 0;
+    BLOCK_WRITE(dev, opcr, 0x80); /* MPPn = output, MPOa/b = RTSN */
+    CHAN_WRITE(dev, cr, 0x10); /* point MR to MR1 */
+    CHAN_WRITE(dev, mr, mr1);
+    CHAN_WRITE(dev, mr, mr2);
     if (mr1 & 0x80) /* Hardware flow control */
-        chan->u.w.cr = 0x80;    /* Assert RTSN */
+        CHAN_WRITE(dev, cr, 0x80);    /* Assert RTSN */
     return RTEMS_SUCCESSFUL;
 }
 
@@ -221,8 +495,9 @@ tyGsOctalOpen(rtems_device_major_number major,
               void *arg) 
 {
     rtems_libio_open_close_args_t *args = (rtems_libio_open_close_args_t *)arg;
+    TY_GSOCTAL_DEV *dev = &(tyGSOctalModules+(minor/8))->dev[minor%8];
     rtems_status_code sc;
-    static const rtems_termios_callbacks callbacks = {
+    static const rtems_termios_callbacks irqCallbacks = {
         NULL, /* firstOpen */
         NULL, /* lastClose */
         NULL, /* pollRead */
@@ -232,8 +507,47 @@ tyGsOctalOpen(rtems_device_major_number major,
         NULL, /* startRemoteTx */
         TERMIOS_IRQ_DRIVEN
     };
-    sc = rtems_termios_open(major, minor, arg, &callbacks);
-    (tyGSOctalModules+(minor/8))->dev[minor%8].tyDev = args->iop->data1;
+    /* Input stays interrupt driven, as pollRead is NULL */
+    static const rtems_termios_callbacks polledCallbacks = {
+        NULL, /* firstOpen */
+        NULL, /* lastClose */
+        NULL, /* pollRead */
+        tyGsOctalCallbackWrite,
+        tyGsOctalCallbackSetAttributes,
+        NULL, /* stopRemoteTx */
+        NULL, /* startRemoteTx */
+        TERMIOS_POLLED
+    };
+#ifdef TERMIOS_TASK_DRIVEN
+    static const rtems_termios_callbacks taskCallbacks = {
+        NULL, /* firstOpen */
+        NULL, /* lastClose */
+        NULL, /* pollRead */
+        tyGsOctalCallbackWrite,
+        tyGsOctalCallbackSetAttributes,
+        NULL, /* stopRemoteTx */
+        NULL, /* startRemoteTx */
+        TERMIOS_TASK_DRIVEN
+    };
+#endif
+    const rtems_termios_callbacks *callbacks;
+
+    switch (dev->txMode) {
+    case TERMIOS_POLLED:
+        callbacks = &polledCallbacks;
+        break;
+#ifdef TERMIOS_TASK_DRIVEN
+    case TERMIOS_TASK_DRIVEN:
+        callbacks = &taskCallbacks;
+        break;
+#endif
+    default:
+        callbacks = &irqCallbacks;
+        break;
+    }
+    dev->txPending = 0;
+    sc = rtems_termios_open(major, minor, arg, callbacks);
+    dev->tyDev = args->iop->data1;
     return sc;
 }
 
@@ -245,12 +559,43 @@ tyGsOctalClose(rtems_device_major_number major,
     return rtems_termios_close(arg);
 }
 
+/*
+ * With Rx timestamping on, find the burst holding the first character
+ * read and record its arrival time and the read latency.  Termios editing
+ * in canonical mode makes the match approximate.
+ */
 static rtems_device_driver
 tyGsOctalRead(rtems_device_major_number major,
               rtems_device_minor_number minor,
               void *arg) 
 {
-    return rtems_termios_read(arg);
+    TY_GSOCTAL_DEV *dev = &tyGSOctalModules[minor/8].dev[minor%8];
+    rtems_libio_rw_args_t *args = arg;
+    rtems_device_driver sc = rtems_termios_read(arg);
+
+    if (sc == RTEMS_SUCCESSFUL && args->bytes_moved > 0 && dev->stampOn) {
+        epicsUInt32 now = tyGSOctalStamp();
+        unsigned long pos = dev->rxConsumed;
+        int stamped = 0, k, key;
+
+        key = epicsInterruptLock();
+        for (k = 1; k <= dev->stampCount; k++) {
+            TYGS_STAMP *ps =
+                &dev->stampRing[(dev->stampHead - k) & (TYGS_NSTAMPS - 1)];
+
+            dev->readStamp = ps->stamp;     /* oldest one if none match */
+            stamped = 1;
+            if ((long) (pos - ps->seq) >= 0)
+                break;
+        }
+        epicsInterruptUnlock(key);
+
+        if (stamped)
+            dev->latHist[tyGSOctalHistBin(now - dev->readStamp)]++;
+    }
+    if (sc == RTEMS_SUCCESSFUL)
+        dev->rxConsumed += args->bytes_moved;
+    return sc;
 }
 
 static rtems_device_driver
@@ -266,6 +611,25 @@ tyGsOctalControl(rtems_device_major_number major,
                  rtems_device_minor_number minor,
                  void *arg) 
 {
+    TY_GSOCTAL_DEV *dev = &tyGSOctalModules[minor/8].dev[minor%8];
+    rtems_libio_ioctl_args_t *args = arg;
+    int key;
+
+    switch (args->command) {
+    case TYGS_RXSTAMP_ENABLE:
+        key = epicsInterruptLock();
+        dev->stampOn = (args->buffer != NULL);
+        dev->stampCount = 0;
+        dev->rxConsumed = dev->rxDelivered;     /* assume nothing buffered */
+        epicsInterruptUnlock(key);
+        args->ioctl_return = 0;
+        return RTEMS_SUCCESSFUL;
+    case TYGS_RXSTAMP_GET:
+        ((TYGS_RXSTAMP *) args->buffer)->stamp = dev->readStamp;
+        ((TYGS_RXSTAMP *) args->buffer)->freq = TYGS_STAMP_FREQ;
+        args->ioctl_return = 0;
+        return RTEMS_SUCCESSFUL;
+    }
     return rtems_termios_ioctl(arg);
 }
 
@@ -287,7 +651,7 @@ tyGSOctalRebootHook(void *arg)
 
             if (dev->created) {
                 dev->irqEnable = 0; /* prevent re-enabling */
-                dev->regs->u.w.imr = 0;
+                BLOCK_WRITE(dev, imr, 0);
             }
             ipmIrqCmd(qt->carrier, qt->slot, 0, ipac_irqDisable);
             ipmIrqCmd(qt->carrier, qt->slot, 1, ipac_irqDisable);
@@ -342,6 +706,10 @@ tyGSOctalDrv(int maxModules)
         printf("Can't register driver: %s\n", rtems_status_text(sc));
         return -1;
     }
+    if (!epicsThreadCreate("tyGSOctalErr", epicsThreadPriorityLow,
+            epicsThreadGetStackSize(epicsThreadStackSmall),
+            tyGSOctalErrTask, NULL))
+        printf("Can't start error summary task\n");
     return 0;
 }
 
@@ -355,13 +723,38 @@ void tyGSOctalReport()
 
         printf("Module %d: carrier=%d slot=%d\n  %lu interrupts\n",
             mod, qt->carrier, qt->slot, qt->interruptCount);
+        if (qt->interruptCount)
+            printf("  %.2f chars/interrupt, max %u, budget %d used up %lu times\n",
+                (double) qt->charCount / qt->interruptCount, qt->maxChars,
+                qt->budget, qt->budgetCount);
 
         for (port = 0; port < 8; port++) {
             TY_GSOCTAL_DEV *dev = &qt->dev[port];
 
-            if (dev->created)
-                printf("  Port %d: %lu chars in, %lu chars out, %lu errors\n",
-                    port, dev->readCount, dev->writeCount, dev->errorCount);
+            if (!dev->created)
+                continue;
+            printf("  Port %d: %lu chars in, %lu chars out, %lu errors\n",
+                port, dev->readCount, dev->writeCount, dev->errorCount);
+            if (dev->txTimeouts)
+                printf("  Port %d: %lu polled writes timed out waiting for TxRDY\n",
+                    port, dev->txTimeouts);
+            if (dev->errorCount)
+                printf("  Port %d: %lu overrun, %lu parity, %lu framing, %lu break\n",
+                    port, dev->errCount[TYGS_ERR_OVERRUN],
+                    dev->errCount[TYGS_ERR_PARITY],
+                    dev->errCount[TYGS_ERR_FRAMING],
+                    dev->errCount[TYGS_ERR_BREAK]);
+            if (dev->msgBuf)
+                printf("  Port %d: %lu messages, %lu overflowed, %d chars pending\n",
+                    port, dev->msgCount, dev->msgOverflow, dev->msgLen);
+            if (dev->stampOn) {
+                tyGSOctalHistPrint(port, "Rx burst gap", dev->gapHist);
+                tyGSOctalHistPrint(port, "Rx read latency", dev->latHist);
+            }
+            if (dev->ctPreset)
+                printf("  Port %d: %d baud from C/T preset %d (%d actual)\n",
+                    port, dev->baud, dev->ctPreset,
+                    SCC_CT_BAUD_CLOCK / dev->ctPreset);
         }
     }
 }
@@ -491,6 +884,8 @@ int tyGSOctalModuleInit
         qt->carrier = carrier;
         qt->slot = slot;
         qt->moduleID = ID;
+        qt->budget = TYGS_DEFAULT_BUDGET;
+        qt->pio = ipmAccessCounter(carrier, slot, ipac_addrIO);
 
         addrIO = ipmBaseAddr(carrier, slot, ipac_addrIO);
         r = (SCC2698 *) addrIO;
@@ -502,10 +897,13 @@ int tyGSOctalModuleInit
             qt->dev[port].qt = qt;
             qt->dev[port].regs = &r[block];
             qt->dev[port].chan = &c[port];
+            qt->dev[port].txMode = TERMIOS_IRQ_DRIVEN;
         }
 
-        for (block = 0; block < 4; block++)
+        for (block = 0; block < 4; block++) {
             qt->imr[block] = 0;
+            qt->acr[block] = 0x80;  /* BRG set 2 */
+        }
 
         /* set up the single interrupt vector */
         addrMem = (char *) ipmBaseAddr(carrier, slot, ipac_addrMem);
@@ -551,6 +949,268 @@ tyGSOctalFindQT(const char *moduleID)
     return NULL;
 }
 
+/*
+ * Set the per-interrupt work budget for a module
+ *
+ * The interrupt routine moves at most budget characters for the module
+ * before returning; ports it didn't reach are serviced first next time.
+ * A budget of 0 services only one channel per interrupt.
+ */
+int
+tyGSOctalBudget(const char *moduleID, int budget)
+{
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+
+    if (!qt || budget < 0) {
+        printf("tyGSOctalBudget: Bad module or budget\n");
+        errno = EINVAL;
+        return -1;
+    }
+    qt->budget = budget;
+    return 0;
+}
+
+/*
+ * Select how termios transmits on a port
+ *
+ * The mode is one of "irq" (the default), "polled" where the writing
+ * thread busy-waits on the UART, or "task" where a termios task does the
+ * output.  The mode takes effect the next time the port is opened.
+ * Calling this routine with a negative port number sets all eight ports.
+ */
+int
+tyGSOctalTxMode(const char *moduleID, int port, const char *mode)
+{
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+    int txMode;
+
+    if (!mode || !strcmp(mode, "irq"))
+        txMode = TERMIOS_IRQ_DRIVEN;
+    else if (!strcmp(mode, "polled"))
+        txMode = TERMIOS_POLLED;
+#ifdef TERMIOS_TASK_DRIVEN
+    else if (!strcmp(mode, "task"))
+        txMode = TERMIOS_TASK_DRIVEN;
+#endif
+    else {
+        printf("tyGSOctalTxMode: Unknown mode \"%s\"\n", mode);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!qt || port > 7) {
+        printf("tyGSOctalTxMode: Bad module or port\n");
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (port < 0) {
+        for (port = 0; port < 8; port++)
+            qt->dev[port].txMode = txMode;
+    }
+    else
+        qt->dev[port].txMode = txMode;
+    return 0;
+}
+
+/*
+ * Deliver received data to readers a message at a time
+ *
+ * When maxFrame is non-zero the ISR collects received characters until a
+ * message is complete and only then passes it to termios.  A message ends
+ * at any character in terms (C escapes such as \r\n are allowed), or, if
+ * lenPrefix is 1 or 2, after the big-endian length held in its first
+ * lenPrefix bytes plus the prefix itself.  A message that reaches maxFrame
+ * characters is passed up as it stands.  maxFrame = 0 turns framing off.
+ */
+int
+tyGSOctalFraming(const char *moduleID, int port, int maxFrame,
+    const char *terms, int lenPrefix)
+{
+    TY_GSOCTAL_DEV *dev;
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+    char term[sizeof(dev->msgTerm)];
+    char *newBuf = NULL, *oldBuf;
+    int nterm = 0;
+    int key;
+
+    if (!qt || port < 0 || port > 7) {
+        printf("tyGSOctalFraming: Bad module or port\n");
+        errno = EINVAL;
+        return -1;
+    }
+    dev = &qt->dev[port];
+
+    if (maxFrame < 0 || lenPrefix < 0 || lenPrefix > 2 ||
+        (maxFrame && maxFrame <= lenPrefix)) {
+        printf("tyGSOctalFraming: Bad maxFrame or lenPrefix\n");
+        return -1;
+    }
+
+    if (maxFrame) {
+        if (terms)
+            nterm = epicsStrnRawFromEscaped(term, sizeof(term), terms,
+                strlen(terms));
+        if (!lenPrefix && nterm == 0) {
+            printf("tyGSOctalFraming: Need terminators or a length prefix\n");
+            return -1;
+        }
+        newBuf = malloc(maxFrame);
+        if (!newBuf) {
+            printf("tyGSOctalFraming: Memory allocation failed!\n");
+            return -1;
+        }
+    }
+
+    key = epicsInterruptLock();
+    oldBuf = dev->msgBuf;
+    if (oldBuf && dev->tyDev)   /* Pass up any partial message */
+        dev->rxDelivered += dev->msgLen -
+            rtems_termios_enqueue_raw_characters(dev->tyDev, oldBuf, dev->msgLen);
+    memcpy(dev->msgTerm, term, nterm);
+    dev->msgNterm = nterm;
+    dev->msgPrefix = lenPrefix;
+    dev->msgMax = maxFrame;
+    dev->msgLen = 0;
+    dev->msgNeed = 0;
+    dev->msgBuf = newBuf;
+    epicsInterruptUnlock(key);
+
+    free(oldBuf);
+    return 0;
+}
+
+/*
+ * Low priority Rx error summary task
+ *
+ * Every tyGSOctalErrPeriod seconds, print one line for each port whose
+ * error counters have changed since the last summary.  A period of 0
+ * turns the summaries off; the ISR still counts errors.
+ */
+static void
+tyGSOctalErrTask(void *parm)
+{
+    static const char *errName[TYGS_NERRS] =
+        {"overrun", "parity", "framing", "break"};
+
+    for (;;) {
+        int mod;
+
+        epicsThreadSleep(tyGSOctalErrPeriod > 0 ? tyGSOctalErrPeriod : 10.0);
+        if (tyGSOctalErrPeriod <= 0)
+            continue;
+
+        for (mod = 0; mod < tyGSOctalLastModule; mod++) {
+            QUAD_TABLE *qt = &tyGSOctalModules[mod];
+            int port;
+
+            for (port = 0; port < 8; port++) {
+                TY_GSOCTAL_DEV *dev = &qt->dev[port];
+                char line[160];
+                int err, len = 0;
+
+                if (!dev->created)
+                    continue;
+
+                for (err = 0; err < TYGS_NERRS; err++) {
+                    unsigned long count = dev->errCount[err];
+                    unsigned long delta = count - dev->errSeen[err];
+
+                    if (delta && len < (int) sizeof(line))
+                        len += epicsSnprintf(line + len, sizeof(line) - len,
+                            " %lu %s (%lu total)", delta, errName[err], count);
+                    dev->errSeen[err] = count;
+                }
+                if (len)
+                    errlogPrintf("tyGSOctal %s port %d Rx errors:%s\n",
+                        qt->moduleID, port, line);
+            }
+        }
+    }
+}
+
+/*
+ * Turn Rx timestamping on or off for a port.  Programs use the
+ * TYGS_RXSTAMP_ENABLE ioctl, with a non-NULL argument for on.
+ */
+int
+tyGSOctalRxStamp(const char *moduleID, int port, int on)
+{
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+    TY_GSOCTAL_DEV *dev;
+    int key;
+
+    if (!qt || port < 0 || port > 7 || !qt->dev[port].created) {
+        printf("tyGSOctalRxStamp: Bad module or port\n");
+        errno = EINVAL;
+        return -1;
+    }
+    dev = &qt->dev[port];
+
+    key = epicsInterruptLock();
+    dev->stampOn = on;
+    dev->stampCount = 0;
+    dev->rxConsumed = dev->rxDelivered;
+    epicsInterruptUnlock(key);
+    return 0;
+}
+
+/*
+ * Set the interval between Rx error summaries, 0 = off
+ */
+void
+tyGSOctalErrorPeriod(double period)
+{
+    tyGSOctalErrPeriod = period;
+}
+
+/*
+ * Read a port's throughput and error counters.  The FIFO peak is the most
+ * characters read from the port in one interrupt; resetPeak clears it.
+ */
+int
+tyGSOctalStats(const char *moduleID, int port, TYGS_STATS *stats,
+    int resetPeak)
+{
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+    TY_GSOCTAL_DEV *dev;
+    int key;
+
+    if (!qt || port < 0 || port > 7 || !qt->dev[port].created || !stats)
+        return -1;
+    dev = &qt->dev[port];
+
+    key = epicsInterruptLock();
+    stats->readCount = dev->readCount;
+    stats->writeCount = dev->writeCount;
+    stats->irqCount = qt->interruptCount;
+    stats->errors = dev->errorCount;
+    stats->overruns = dev->errCount[TYGS_ERR_OVERRUN];
+    stats->fifoPeak = dev->rxPeak;
+    stats->txTimeouts = dev->txTimeouts;
+    if (resetPeak)
+        dev->rxPeak = 0;
+    epicsInterruptUnlock(key);
+    return 0;
+}
+
+/*
+ * Read a port's Rx error counters, indexed by TYGS_ERR
+ */
+int
+tyGSOctalErrCounts(const char *moduleID, int port, unsigned long *counts)
+{
+    QUAD_TABLE *qt = tyGSOctalFindQT(moduleID);
+    int err;
+
+    if (!qt || port < 0 || port > 7 || !qt->dev[port].created || !counts)
+        return -1;
+
+    for (err = 0; err < TYGS_NERRS; err++)
+        counts[err] = qt->dev[port].errCount[err];
+    return 0;
+}
+
 /*
  * Create a device for a serial port on an IP module
  *
@@ -609,14 +1269,14 @@ tyGSOctalDevCreate (
     key = epicsInterruptLock(); /* disable interrupts during init */
     dev->block = block;
     dev->irqEnable = ((port%2 == 0) ? SCC_ISR_TXRDY_A : SCC_ISR_TXRDY_B);
-    dev->regs->u.w.acr = 0x80; /* choose set 2 BRG */
-    dev->chan->u.w.cr = 0x1a; /* disable trans/recv, reset pointer */
-    dev->chan->u.w.cr = 0x20; /* reset recv */
-    dev->chan->u.w.cr = 0x30; /* reset trans */
-    dev->chan->u.w.cr = 0x40; /* reset error status */
+    BLOCK_WRITE(dev, acr, qt->acr[block]); /* choose set 2 BRG */
+    CHAN_WRITE(dev, cr, 0x1a); /* disable trans/recv, reset pointer */
+    CHAN_WRITE(dev, cr, 0x20); /* reset recv */
+    CHAN_WRITE(dev, cr, 0x30); /* reset trans */
+    CHAN_WRITE(dev, cr, 0x40); /* reset error status */
     qt->imr[block] |= ((port%2) == 0 ? SCC_ISR_RXRDY_A : SCC_ISR_RXRDY_B); 
-    dev->regs->u.w.imr = qt->imr[block]; /* enable RxRDY interrupt */
-    dev->chan->u.w.cr = 0x05;            /* enable Tx,Rx */
+    BLOCK_WRITE(dev, imr, qt->imr[block]); /* enable RxRDY interrupt */
+    CHAN_WRITE(dev, cr, 0x05);            /* enable Tx,Rx */
     epicsInterruptUnlock(key);
 
     /* mark the device as created, and add it to the I/O system */
@@ -688,10 +1348,81 @@ static void tyGSOctalDevCreateCallFunc(const iocshArgBuf *arg)
                        arg[3].ival, arg[4].ival);
 }
 
+/* tyGSOctalBudget */
+static const iocshArg tyGSOctalBudgetArg0 = {"moduleID", iocshArgString};
+static const iocshArg tyGSOctalBudgetArg1 = {"budget", iocshArgInt};
+static const iocshArg * const tyGSOctalBudgetArgs[2] = {
+    &tyGSOctalBudgetArg0, &tyGSOctalBudgetArg1};
+static const iocshFuncDef tyGSOctalBudgetFuncDef =
+    {"tyGSOctalBudget",2,tyGSOctalBudgetArgs};
+static void tyGSOctalBudgetCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalBudget(arg[0].sval, arg[1].ival);
+}
+
+/* tyGSOctalTxMode */
+static const iocshArg tyGSOctalTxModeArg0 = {"moduleID", iocshArgString};
+static const iocshArg tyGSOctalTxModeArg1 = {"port", iocshArgInt};
+static const iocshArg tyGSOctalTxModeArg2 = {"irq/polled/task", iocshArgString};
+static const iocshArg * const tyGSOctalTxModeArgs[3] = {
+    &tyGSOctalTxModeArg0, &tyGSOctalTxModeArg1, &tyGSOctalTxModeArg2};
+static const iocshFuncDef tyGSOctalTxModeFuncDef =
+    {"tyGSOctalTxMode",3,tyGSOctalTxModeArgs};
+static void tyGSOctalTxModeCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalTxMode(arg[0].sval, arg[1].ival, arg[2].sval);
+}
+
+/* tyGSOctalFraming */
+static const iocshArg tyGSOctalFramingArg0 = {"moduleID", iocshArgString};
+static const iocshArg tyGSOctalFramingArg1 = {"port", iocshArgInt};
+static const iocshArg tyGSOctalFramingArg2 = {"maxFrame", iocshArgInt};
+static const iocshArg tyGSOctalFramingArg3 = {"terms", iocshArgString};
+static const iocshArg tyGSOctalFramingArg4 = {"lenPrefix", iocshArgInt};
+static const iocshArg * const tyGSOctalFramingArgs[5] = {
+    &tyGSOctalFramingArg0, &tyGSOctalFramingArg1, &tyGSOctalFramingArg2,
+    &tyGSOctalFramingArg3, &tyGSOctalFramingArg4};
+static const iocshFuncDef tyGSOctalFramingFuncDef =
+    {"tyGSOctalFraming",5,tyGSOctalFramingArgs};
+static void tyGSOctalFramingCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalFraming(arg[0].sval, arg[1].ival, arg[2].ival, arg[3].sval,
+        arg[4].ival);
+}
+
+/* tyGSOctalErrorPeriod */
+static const iocshArg tyGSOctalErrorPeriodArg0 = {"seconds", iocshArgDouble};
+static const iocshArg * const tyGSOctalErrorPeriodArgs[1] =
+    {&tyGSOctalErrorPeriodArg0};
+static const iocshFuncDef tyGSOctalErrorPeriodFuncDef =
+    {"tyGSOctalErrorPeriod",1,tyGSOctalErrorPeriodArgs};
+static void tyGSOctalErrorPeriodCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalErrorPeriod(arg[0].dval);
+}
+
+/* tyGSOctalRxStamp */
+static const iocshArg tyGSOctalRxStampArg0 = {"moduleID", iocshArgString};
+static const iocshArg tyGSOctalRxStampArg1 = {"port", iocshArgInt};
+static const iocshArg tyGSOctalRxStampArg2 = {"on", iocshArgInt};
+static const iocshArg * const tyGSOctalRxStampArgs[3] = {
+    &tyGSOctalRxStampArg0, &tyGSOctalRxStampArg1, &tyGSOctalRxStampArg2};
+static const iocshFuncDef tyGSOctalRxStampFuncDef =
+    {"tyGSOctalRxStamp",3,tyGSOctalRxStampArgs};
+static void tyGSOctalRxStampCallFunc(const iocshArgBuf *arg)
+{
+    tyGSOctalRxStamp(arg[0].sval, arg[1].ival, arg[2].ival);
+}
+
 static void tyGSOctalRegistrar(void) {
     iocshRegister(&tyGSOctalDrvFuncDef,tyGSOctalDrvCallFunc);
     iocshRegister(&tyGSOctalReportFuncDef,tyGSOctalReportCallFunc);
     iocshRegister(&tyGSOctalModuleInitFuncDef,tyGSOctalModuleInitCallFunc);
     iocshRegister(&tyGSOctalDevCreateFuncDef,tyGSOctalDevCreateCallFunc);
+    iocshRegister(&tyGSOctalBudgetFuncDef,tyGSOctalBudgetCallFunc);
+    iocshRegister(&tyGSOctalFramingFuncDef,tyGSOctalFramingCallFunc);
+    iocshRegister(&tyGSOctalErrorPeriodFuncDef,tyGSOctalErrorPeriodCallFunc);
+    iocshRegister(&tyGSOctalRxStampFuncDef,tyGSOctalRxStampCallFunc);
+    iocshRegister(&tyGSOctalTxModeFuncDef,tyGSOctalTxModeCallFunc);
 }
 epicsExportRegistrar(tyGSOctalRegistrar);